@@ -1,30 +1,51 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "EventLoop.h"
+#include "CompletionIo.h"
 
 #include <sys/types.h>    
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
 
+const int Acceptor::kDefaultAcceptBatch;
 
-static int createNonblocking()
+
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) 
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking()) // socket
+    , acceptSocket_(createNonblocking(listenAddr.family())) // socket
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
+    , paused_(false)
+    , acceptBatch_(kDefaultAcceptBatch)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    if (listenAddr.isUnix())
+    {
+        // 抽象地址不在文件系统里，进程退出时自动释放
+        if (!listenAddr.isAbstract())
+        {
+            Socket::removeStaleUnixPath(listenAddr, SOCK_STREAM);
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(reuseport);
+    }
     acceptSocket_.bindAddress(listenAddr); // bind
     // TcpServer::start() Acceptor.listen  有新用户的连接，要执行一个回调（connfd=》channel=》subloop）
     // baseLoop => acceptChannel_(listenfd) => 
@@ -33,39 +54,159 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
 
 Acceptor::~Acceptor()
 {
+    CompletionIo *io = loop_->completionIo();
+    if (listenning_ && !paused_ && io)
+    {
+        io->cancel(&acceptChannel_);
+    }
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen()
 {
     listenning_ = true;
     acceptSocket_.listen(); // listen
-    acceptChannel_.enableReading(); // acceptChannel_ => Poller
+    if (!paused_)
+    {
+        startAccepting();
+    }
+}
+
+void Acceptor::startAccepting()
+{
+    CompletionIo *io = loop_->completionIo();
+    if (io)
+    {
+        io->startAccept(&acceptChannel_, std::bind(&Acceptor::handleAccepted, this, std::placeholders::_1));
+    }
+    else
+    {
+        acceptChannel_.enableReading(); // acceptChannel_ => Poller
+    }
+}
+
+void Acceptor::pause()
+{
+    if (paused_)
+    {
+        return;
+    }
+    paused_ = true;
+    if (!listenning_)
+    {
+        return;
+    }
+    CompletionIo *io = loop_->completionIo();
+    if (io)
+    {
+        io->cancel(&acceptChannel_);
+    }
+    if (acceptChannel_.isReading())
+    {
+        acceptChannel_.disableReading(); // 完成通知模式下EMFILE以后也会用可读事件
+    }
+}
+
+void Acceptor::resume()
+{
+    if (!paused_)
+    {
+        return;
+    }
+    paused_ = false;
+    if (listenning_)
+    {
+        startAccepting();
+    }
 }
 
-// listenfd有事件发生了，就是有新用户连接了
+// listenfd有事件发生了，就是有新用户连接了  一直accept到EAGAIN或者accept了acceptBatch_个
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
+    for (int i = 0; i < acceptBatch_ && !paused_; ++i)
     {
-        if (newConnectionCallback_)
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
+        {
+            newConnection(connfd, peerAddr);
+            continue;
+        }
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
         {
-            newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
+            break;
         }
-        else
+        else if (savedErrno == EMFILE || savedErrno == ENFILE)
         {
-            ::close(connfd);
+            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
+            dropConnectionWithIdleFd();
+        }
+        else if (savedErrno != ECONNABORTED && savedErrno != EINTR)
+        {
+            // accept之前对端就RST了（ECONNABORTED）可以接着accept，别的错误留到下一次可读事件
+            LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+            break;
         }
     }
+}
+
+void Acceptor::dropConnectionWithIdleFd()
+{
+    if (idleFd_ < 0)
+    {
+        return;
+    }
+    ::close(idleFd_);
+    int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (connfd >= 0)
+    {
+        ::close(connfd);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+// multishot accept的完成事件  内核不返回对端地址，用getpeername取
+void Acceptor::handleAccepted(int connfd)
+{
+    if (connfd >= 0)
+    {
+        sockaddr_storage addr;
+        socklen_t len = sizeof addr;
+        bzero(&addr, sizeof addr);
+        ::getpeername(connfd, (sockaddr*)&addr, &len);
+        InetAddress peerAddr;
+        peerAddr.setSockAddr((sockaddr*)&addr, len);
+        newConnection(connfd, peerAddr);
+    }
     else
     {
-        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
-        if (errno == EMFILE)
+        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, -connfd);
+        // fd用完以后内核的accept不管有没有连接都会失败，Poller不再重新提交
+        // 改成readiness模式，只在真的有连接等待时才由handleRead去accept
+        if (connfd == -EMFILE || connfd == -ENFILE)
         {
-            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
+            dropConnectionWithIdleFd();
+            acceptChannel_.enableReading();
         }
     }
+}
+
+void Acceptor::newConnection(int connfd, const InetAddress &peerAddr)
+{
+    loop_->metrics().add(LoopMetrics::kAccepts);
+    if (newConnectionCallback_)
+    {
+        newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
+    }
+    else
+    {
+        ::close(connfd);
+    }
 }
\ No newline at end of file
@@ -21,14 +21,35 @@ public:
         newConnectionCallback_ = std::move(cb);
     }
 
+    static const int kDefaultAcceptBatch = 64;
+
     bool listenning() const { return listenning_; }
     void listen();
+    // 暂停/继续accept  暂停期间新连接留在内核的backlog里，backlog满了以后客户端的SYN会被丢弃，由客户端重传
+    // 完成通知模式下取消内核里的accept，取消之前刚完成的连接会被关掉  只能在loop线程调用
+    void pause();
+    void resume();
+    bool paused() const { return paused_; }
+    // 一次可读事件最多accept多少个连接，遇到EAGAIN提前结束  连接风暴时少走几次epoll_wait
+    void setAcceptBatch(int batch) { acceptBatch_ = batch > 0 ? batch : 1; }
+    // 见Socket::setReusePortCpuSteering
+    void setCpuSteering(unsigned groupSize) { acceptSocket_.setReusePortCpuSteering(groupSize); }
 private:
     void handleRead();
+    // 注册可读事件或者向内核提交multishot accept
+    void startAccepting();
+    // loop的Poller支持完成通知IO时，由内核accept，结果从这里回调
+    void handleAccepted(int connfd);
+    void newConnection(int connfd, const InetAddress &peerAddr);
+    // fd用完了：关掉预留的idleFd_腾出一个fd，把等待的连接accept出来马上关掉，再把idleFd_占回来
+    void dropConnectionWithIdleFd();
     
     EventLoop                   *loop_; // Acceptor用的就是用户定义的那个baseLoop，也称作mainLoop
     Socket                      acceptSocket_;
     Channel                     acceptChannel_;
     NewConnectionCallback       newConnectionCallback_;
     bool                        listenning_;
+    bool                        paused_;
+    int                         acceptBatch_;
+    int                         idleFd_; // 预留的fd，EMFILE的时候用  否则LT模式下等待的连接一直可读，loop空转
 };
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "AsyncLogging.h"
+#include "LogFile.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <chrono>
+
+AsyncLogging::AsyncLogging(const std::string &basename,
+                        off_t rollSize,
+                        int flushInterval)
+    : flushInterval_(flushInterval)
+    , running_(false)
+    , basename_(basename)
+    , rollSize_(rollSize)
+    , thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging")
+    , currentBuffer_(new FixedBuffer)
+    , nextBuffer_(new FixedBuffer)
+{
+    buffers_.reserve(16);
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    running_ = false;
+    cond_.notify_one();
+    thread_.join();
+}
+
+// 前端在锁内只做一次memcpy，写满了才通知后台线程
+void AsyncLogging::append(const char *logline, int len)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (currentBuffer_->avail() > static_cast<size_t>(len))
+    {
+        currentBuffer_->append(logline, len);
+    }
+    else
+    {
+        buffers_.push_back(std::move(currentBuffer_));
+
+        if (nextBuffer_)
+        {
+            currentBuffer_ = std::move(nextBuffer_);
+        }
+        else
+        {
+            currentBuffer_.reset(new FixedBuffer); // 日志写得太快，备用缓冲区也用完了，很少发生
+        }
+        currentBuffer_->append(logline, len);
+        cond_.notify_one();
+    }
+}
+
+void AsyncLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_, flushInterval_);
+    // 后台线程自己也准备两块缓冲区，和前端交换，避免在临界区内分配内存
+    BufferPtr newBuffer1(new FixedBuffer);
+    BufferPtr newBuffer2(new FixedBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(16);
+
+    while (running_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (buffers_.empty())
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_ = std::move(newBuffer1);
+            buffersToWrite.swap(buffers_);
+            if (!nextBuffer_)
+            {
+                nextBuffer_ = std::move(newBuffer2);
+            }
+        }
+
+        // 前端产生日志的速度远大于写文件的速度，丢掉多余的日志，只保留前两块
+        if (buffersToWrite.size() > 25)
+        {
+            char buf[256];
+            int n = snprintf(buf, sizeof buf, "Dropped log messages at %s, %zd larger buffers\n",
+                    Timestamp::now().toString().c_str(),
+                    buffersToWrite.size() - 2);
+            fputs(buf, stderr);
+            output.append(buf, n);
+            buffersToWrite.erase(buffersToWrite.begin() + 2, buffersToWrite.end());
+        }
+
+        for (const BufferPtr &buffer : buffersToWrite)
+        {
+            output.append(buffer->data(), buffer->length());
+        }
+
+        if (buffersToWrite.size() > 2)
+        {
+            buffersToWrite.resize(2);
+        }
+
+        if (!newBuffer1)
+        {
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->reset();
+        }
+        if (!newBuffer2)
+        {
+            newBuffer2 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer2->reset();
+        }
+
+        buffersToWrite.clear();
+        output.flush();
+    }
+
+    // stop以后，把前端剩下的日志全部写完
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        buffers_.push_back(std::move(currentBuffer_));
+        buffersToWrite.swap(buffers_);
+    }
+    for (const BufferPtr &buffer : buffersToWrite)
+    {
+        if (buffer)
+        {
+            output.append(buffer->data(), buffer->length());
+        }
+    }
+    output.flush();
+}
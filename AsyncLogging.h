@@ -0,0 +1,83 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * 异步日志后端  双缓冲
+ * IO线程(前端)调用append，只把日志拷贝到currentBuffer_，不做任何IO
+ * 后台线程每隔flushInterval秒，或者有缓冲区写满时，交换出所有写满的缓冲区，统一写入滚动文件
+ *
+ * 使用方法：
+ *   AsyncLogging log("/tmp/server", 500*1000*1000);
+ *   log.start();
+ *   Logger::setOutput(...);  // 把Logger的输出重定向到log.append
+ */
+class AsyncLogging : noncopyable
+{
+public:
+    AsyncLogging(const std::string &basename,
+                off_t rollSize,
+                int flushInterval = 3);
+    ~AsyncLogging();
+
+    // 前端 所有IO线程都会调用
+    void append(const char *logline, int len);
+
+    void start();
+    void stop();
+
+private:
+    // 固定大小的日志缓冲区，不会扩容
+    class FixedBuffer : noncopyable
+    {
+    public:
+        static const int kBufferSize = 4000 * 1000;
+
+        FixedBuffer() : cur_(data_) {}
+
+        void append(const char *buf, size_t len)
+        {
+            if (avail() > len)
+            {
+                memcpy(cur_, buf, len);
+                cur_ += len;
+            }
+        }
+
+        const char* data() const { return data_; }
+        int length() const { return static_cast<int>(cur_ - data_); }
+        size_t avail() const { return static_cast<size_t>(end() - cur_); }
+        void reset() { cur_ = data_; }
+    private:
+        const char* end() const { return data_ + sizeof data_; }
+
+        char data_[kBufferSize];
+        char *cur_;
+    };
+
+    using BufferPtr = std::unique_ptr<FixedBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    void threadFunc(); // 后台线程
+
+    const int                   flushInterval_;
+    std::atomic_bool            running_;
+    const std::string           basename_;
+    const off_t                 rollSize_;
+    Thread                      thread_;
+
+    std::mutex                  mutex_;
+    std::condition_variable     cond_;
+    BufferPtr                   currentBuffer_; // 前端正在写的缓冲区
+    BufferPtr                   nextBuffer_;    // 备用缓冲区
+    BufferVector                buffers_;       // 已经写满，等待后台线程写入文件的缓冲区
+};
@@ -1,45 +1,225 @@
 #include "Buffer.h"
+#include "BufferPool.h"
+#include "ByteSearch.h"
 
 #include <errno.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+const size_t Buffer::kMinReadHint;
+const size_t Buffer::kMaxReadHint;
+
+char Buffer::emptyStorage_[Buffer::kCheapPrepend];
+
+Buffer::Buffer(const Buffer &rhs)
+    : buffer_(nullptr)
+    , capacity_(0)
+    , initialSize_(rhs.initialSize_)
+    , readHint_(rhs.readHint_)
+    , readShrinkStreak_(0)
+    , readerIndex_(kCheapPrepend)
+    , writerIndex_(kCheapPrepend)
+{
+    append(rhs.peek(), rhs.readableBytes());
+}
+
+Buffer& Buffer::operator=(const Buffer &rhs)
+{
+    if (this != &rhs)
+    {
+        Buffer(rhs).swap(*this);
+    }
+    return *this;
+}
+
+const char* Buffer::findCRLF(const char *start) const
+{
+    return ByteSearch::findCRLF(start, beginWrite());
+}
+
+const char* Buffer::findEOL(const char *start) const
+{
+    return ByteSearch::findByte(start, beginWrite(), '\n');
+}
+
+const char* Buffer::find(const char *start, const char *delim, size_t len) const
+{
+    return ByteSearch::find(start, beginWrite(), delim, len);
+}
+
+void Buffer::makeSpace(size_t len)
+{
+    size_t readable = readableBytes();
+    if (buffer_ && writableBytes() + prependableBytes() >= len + kCheapPrepend)
+    {
+        // 前面已经读走的空间够用，把可读数据挪到前面
+        ::memmove(buffer_ + kCheapPrepend, buffer_ + readerIndex_, readable);
+    }
+    else
+    {
+        // 至少翻倍，避免连续append时反复分配
+        size_t size = std::max(kCheapPrepend + readable + len,
+                               buffer_ ? capacity_ * 2 : kCheapPrepend + initialSize_);
+        char *data = BufferPool::allocate(&size);
+        if (buffer_)
+        {
+            ::memcpy(data + kCheapPrepend, buffer_ + readerIndex_, readable);
+            BufferPool::deallocate(buffer_, capacity_);
+        }
+        buffer_ = data;
+        capacity_ = size;
+    }
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+}
+
+void Buffer::makePrependSpace(size_t len)
+{
+    if (buffer_ == nullptr)
+    {
+        makeSpace(0); // emptyStorage_不能写
+    }
+    if (len <= prependableBytes())
+    {
+        return;
+    }
+    // 之前prepend过，预留的空间用掉了，把可读数据往后挪
+    size_t shift = len - prependableBytes();
+    ensureWriteableBytes(shift);
+    if (len > prependableBytes()) // makeSpace可能已经把数据挪回了kCheapPrepend
+    {
+        shift = len - prependableBytes();
+        ::memmove(buffer_ + readerIndex_ + shift, buffer_ + readerIndex_, readableBytes());
+        readerIndex_ += shift;
+        writerIndex_ += shift;
+    }
+}
+
+void Buffer::releaseStorage()
+{
+    if (buffer_)
+    {
+        BufferPool::deallocate(buffer_, capacity_);
+        buffer_ = nullptr;
+        capacity_ = 0;
+    }
+    readerIndex_ = writerIndex_ = kCheapPrepend;
+}
+
+namespace
+{
+// 每个线程一块读缓冲区，所有连接共用  one loop per thread，同一时刻只有一个连接在读
+__thread char t_extrabuf[65536];
+}
+
 /**
  * 从fd上读取数据  Poller工作在LT模式
  * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小
+ * 先按照最近几次读到的数据量(readHint_)保证Buffer里有足够的空间，大部分时候直接读进Buffer，
+ * 放不下的部分读进线程局部的t_extrabuf，然后再append到Buffer里
  */ 
-ssize_t Buffer::readFd(int fd, int* saveErrno)
+ssize_t Buffer::readFd(int fd, int* saveErrno, std::vector<int> *fds)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间  64K
-    
+    // Buffer是空的，而且底层内存比最近的流量大很多，换一块小的
+    if (readableBytes() == 0 && capacity_ > kCheapPrepend + kShrinkFactor * readHint_)
+    {
+        releaseStorage();
+    }
+    ensureWriteableBytes(readHint_);
+
     struct iovec vec[2];
     
     const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
     vec[0].iov_base = begin() + writerIndex_;
     vec[0].iov_len = writable;
 
-    vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_base = t_extrabuf;
+    vec[1].iov_len = sizeof t_extrabuf;
     
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
-    const ssize_t n = ::readv(fd, vec, iovcnt);
+    const int iovcnt = (writable < sizeof t_extrabuf) ? 2 : 1;
+    const ssize_t n = fds ? recvWithRights(fd, vec, iovcnt, fds) : ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
         *saveErrno = errno;
     }
-    else if (n <= writable) // Buffer的可写缓冲区已经够存储读出来的数据了
+    else
     {
-        writerIndex_ += n;
+        if (static_cast<size_t>(n) <= writable) // Buffer的可写缓冲区已经够存储读出来的数据了
+        {
+            writerIndex_ += n;
+        }
+        else // extrabuf里面也写入了数据 
+        {
+            writerIndex_ = capacity_;
+            append(t_extrabuf, n - writable);  // writerIndex_开始写 n - writable大小的数据
+        }
+        adjustReadHint(static_cast<size_t>(n));
     }
-    else // extrabuf里面也写入了数据 
+
+    return n;
+}
+
+// 一次recvmsg最多收到SCM_MAX_FD（253）个fd，控制消息的空间按这个准备
+ssize_t Buffer::recvWithRights(int fd, struct iovec *vec, int iovcnt, std::vector<int> *fds)
+{
+    union
+    {
+        struct cmsghdr  align;
+        char            buf[CMSG_SPACE(253 * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0)
     {
-        writerIndex_ = buffer_.size();
-        append(extrabuf, n - writable);  // writerIndex_开始写 n - writable大小的数据
+        return n;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *data = CMSG_DATA(cmsg);
+            for (size_t i = 0; i < count; ++i)
+            {
+                int received;
+                ::memcpy(&received, data + i * sizeof(int), sizeof(int));
+                fds->push_back(received);
+            }
+        }
     }
-
     return n;
 }
 
+/**
+ * 读满了readHint_就翻倍，连续两次不到一半才减半  增长快、缩小慢，避免来回抖动
+ */
+void Buffer::adjustReadHint(size_t n)
+{
+    if (n >= readHint_)
+    {
+        readHint_ = std::min(readHint_ * 2, kMaxReadHint);
+        readShrinkStreak_ = 0;
+    }
+    else if (n < readHint_ / 2)
+    {
+        if (++readShrinkStreak_ >= 2)
+        {
+            readHint_ = std::max(readHint_ / 2, kMinReadHint);
+            readShrinkStreak_ = 0;
+        }
+    }
+    else
+    {
+        readShrinkStreak_ = 0;
+    }
+}
+
 ssize_t Buffer::writeFd(int fd, int* saveErrno)
 {
     ssize_t n = ::write(fd, peek(), readableBytes());
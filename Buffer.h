@@ -1,22 +1,62 @@
 #pragma once
 
-#include <vector>
 #include <string>
+#include <vector>
 #include <algorithm>
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+struct iovec;
 
 // 网络库底层的缓冲器类型定义
+// 底层内存从BufferPool分配，第一次写入时才分配；扩容时只拷贝可读数据，不会清零
+// 整数都按网络字节序（大端）读写；前面预留kCheapPrepend字节，消息写完以后可以把长度头prepend进去，不用挪动数据
 class Buffer
 {
 public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
+    static const size_t kMinReadHint = 256;
+    static const size_t kMaxReadHint = 65536;
+    static const size_t kShrinkFactor = 4;      // 空闲内存超过readHint_的这么多倍，readFd时换成小的
 
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , initialSize_(initialSize)
+        , readHint_(std::max(std::min(initialSize, kMaxReadHint), kMinReadHint))
+        , readShrinkStreak_(0)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
     {}
 
+    ~Buffer() { releaseStorage(); }
+
+    Buffer(const Buffer &rhs);
+    Buffer& operator=(const Buffer &rhs);
+
+    Buffer(Buffer &&rhs) noexcept
+        : buffer_(rhs.buffer_)
+        , capacity_(rhs.capacity_)
+        , initialSize_(rhs.initialSize_)
+        , readHint_(rhs.readHint_)
+        , readShrinkStreak_(rhs.readShrinkStreak_)
+        , readerIndex_(rhs.readerIndex_)
+        , writerIndex_(rhs.writerIndex_)
+    {
+        rhs.buffer_ = nullptr;
+        rhs.capacity_ = 0;
+        rhs.readerIndex_ = rhs.writerIndex_ = kCheapPrepend;
+    }
+
+    Buffer& operator=(Buffer &&rhs) noexcept
+    {
+        Buffer(std::move(rhs)).swap(*this);
+        return *this;
+    }
+
     size_t readableBytes() const 
     {
         return writerIndex_ - readerIndex_;
@@ -24,9 +64,14 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return capacity_ > writerIndex_ ? capacity_ - writerIndex_ : 0;
     }
 
+    // 底层内存的大小，还没有分配时为0
+    size_t capacity() const { return capacity_; }
+    // readFd下一次预留的空间，根据最近读到的数据量调整
+    size_t readHint() const { return readHint_; }
+
     size_t prependableBytes() const
     {
         return readerIndex_;
@@ -38,6 +83,21 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 在可读数据里找，返回第一次出现的位置，找不到返回nullptr  start必须在[peek(), beginWrite()]之间
+    // 实现见ByteSearch，按CPU选择SIMD指令
+    const char* findCRLF() const { return findCRLF(peek()); }
+    const char* findCRLF(const char *start) const;
+    const char* findEOL() const { return findEOL(peek()); }
+    const char* findEOL(const char *start) const;
+    const char* find(const char *delim, size_t len) const { return find(peek(), delim, len); }
+    const char* find(const char *start, const char *delim, size_t len) const;
+
+    // 删除到end为止（不含end）的数据，end一般是find的结果
+    void retrieveUntil(const char *end)
+    {
+        retrieve(end - peek());
+    }
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
@@ -69,7 +129,7 @@ public:
         return result;
     }
 
-    // buffer_.size() - writerIndex_    len
+    // capacity_ - writerIndex_    len
     void ensureWriteableBytes(size_t len)
     {
         if (writableBytes() < len)
@@ -82,10 +142,98 @@ public:
     void append(const char *data, size_t len)
     {
         ensureWriteableBytes(len);
-        std::copy(data, data+len, beginWrite());
+        ::memcpy(beginWrite(), data, len);
         writerIndex_ += len;
     }
 
+    void appendInt64(int64_t x)
+    {
+        uint64_t be = htobe64(static_cast<uint64_t>(x));
+        append(reinterpret_cast<const char*>(&be), sizeof be);
+    }
+    void appendInt32(int32_t x)
+    {
+        uint32_t be = htobe32(static_cast<uint32_t>(x));
+        append(reinterpret_cast<const char*>(&be), sizeof be);
+    }
+    void appendInt16(int16_t x)
+    {
+        uint16_t be = htobe16(static_cast<uint16_t>(x));
+        append(reinterpret_cast<const char*>(&be), sizeof be);
+    }
+    void appendInt8(int8_t x)
+    {
+        append(reinterpret_cast<const char*>(&x), sizeof x);
+    }
+
+    // 调用前要保证readableBytes()足够
+    int64_t peekInt64() const
+    {
+        uint64_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return static_cast<int64_t>(be64toh(be));
+    }
+    int32_t peekInt32() const
+    {
+        uint32_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return static_cast<int32_t>(be32toh(be));
+    }
+    int16_t peekInt16() const
+    {
+        uint16_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return static_cast<int16_t>(be16toh(be));
+    }
+    int8_t peekInt8() const
+    {
+        return static_cast<int8_t>(*peek());
+    }
+
+    int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+    int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+    int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+    int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
+    // 把[data, data+len]放到可读数据前面  不超过prependableBytes()时直接写进预留的空间
+    void prepend(const void *data, size_t len)
+    {
+        if (buffer_ == nullptr || len > prependableBytes())
+        {
+            makePrependSpace(len);
+        }
+        readerIndex_ -= len;
+        ::memcpy(begin() + readerIndex_, data, len);
+    }
+    void prependInt64(int64_t x)
+    {
+        uint64_t be = htobe64(static_cast<uint64_t>(x));
+        prepend(&be, sizeof be);
+    }
+    void prependInt32(int32_t x)
+    {
+        uint32_t be = htobe32(static_cast<uint32_t>(x));
+        prepend(&be, sizeof be);
+    }
+    void prependInt16(int16_t x)
+    {
+        uint16_t be = htobe16(static_cast<uint16_t>(x));
+        prepend(&be, sizeof be);
+    }
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
+    // 没有可读数据时把底层内存还给BufferPool，下次写入时重新分配
+    void shrinkIfEmpty()
+    {
+        if (readableBytes() == 0)
+        {
+            releaseStorage();
+        }
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -96,38 +244,50 @@ public:
         return begin() + writerIndex_;
     }
 
-    // 从fd上读取数据
-    ssize_t readFd(int fd, int* saveErrno);
+    // 直接往beginWrite()写了len字节以后调用，len不能超过writableBytes()
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
+    void swap(Buffer &rhs)
+    {
+        std::swap(buffer_, rhs.buffer_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(initialSize_, rhs.initialSize_);
+        std::swap(readHint_, rhs.readHint_);
+        std::swap(readShrinkStreak_, rhs.readShrinkStreak_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
+    // 从fd上读取数据  fds不为空时用recvmsg读，对端用SCM_RIGHTS传过来的fd追加到fds里（已经设置了CLOEXEC）
+    ssize_t readFd(int fd, int* saveErrno, std::vector<int> *fds = nullptr);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int* saveErrno);
 private:
     char* begin()
     {
-        // it.operator*()
-        return &*buffer_.begin();  // vector底层数组首元素的地址，也就是数组的起始地址
+        return buffer_ ? buffer_ : emptyStorage_;
     }
     const char* begin() const
     {
-        return &*buffer_.begin();
-    }
-    void makeSpace(size_t len)
-    {
-        if (writableBytes() + prependableBytes() < len + kCheapPrepend)
-        {
-            buffer_.resize(writerIndex_ + len);
-        }
-        else
-        {
-            size_t readalbe = readableBytes();
-            std::copy(begin() + readerIndex_, 
-                    begin() + writerIndex_,
-                    begin() + kCheapPrepend);
-            readerIndex_ = kCheapPrepend;
-            writerIndex_ = readerIndex_ + readalbe;
-        }
+        return buffer_ ? buffer_ : emptyStorage_;
     }
+    void makeSpace(size_t len);
+    // 保证前面至少有len字节可以prepend
+    void makePrependSpace(size_t len);
+    void releaseStorage();
+    void adjustReadHint(size_t n);
+    static ssize_t recvWithRights(int fd, struct iovec *vec, int iovcnt, std::vector<int> *fds);
+
+    static char emptyStorage_[kCheapPrepend]; // 还没有分配内存时begin()指向这里，不会被写入
 
-    std::vector<char> buffer_;
+    char *buffer_;          // 从BufferPool分配
+    size_t capacity_;
+    size_t initialSize_;    // 第一次分配的大小（不含kCheapPrepend）
+    size_t readHint_;
+    int readShrinkStreak_;  // 连续几次读到的数据不到readHint_的一半
     size_t readerIndex_;
     size_t writerIndex_;
 };
\ No newline at end of file
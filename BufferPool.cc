@@ -0,0 +1,115 @@
+#include "BufferPool.h"
+#include "Buffer.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace
+{
+const size_t kClassSizes[BufferPool::kNumClasses] = {
+    Buffer::kCheapPrepend + 1024,
+    Buffer::kCheapPrepend + 4 * 1024,
+    Buffer::kCheapPrepend + 16 * 1024,
+    Buffer::kCheapPrepend + 64 * 1024,
+};
+
+// 线程退出时缓存先析构，之后再释放的Buffer直接free
+__thread bool t_poolDestroyed = false;
+}
+
+BufferPool::BufferPool()
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        freeLists_[i] = nullptr;
+        counts_[i] = 0;
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        while (freeLists_[i])
+        {
+            FreeBlock *block = freeLists_[i];
+            freeLists_[i] = block->next;
+            ::free(block);
+        }
+    }
+    t_poolDestroyed = true;
+}
+
+BufferPool* BufferPool::instance()
+{
+    if (t_poolDestroyed)
+    {
+        return nullptr;
+    }
+    static thread_local BufferPool pool;
+    return &pool;
+}
+
+int BufferPool::classIndex(size_t size)
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        if (size <= kClassSizes[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+char* BufferPool::allocate(size_t *size)
+{
+    int index = classIndex(*size);
+    if (index >= 0)
+    {
+        *size = kClassSizes[index];
+        BufferPool *pool = instance();
+        if (pool && pool->freeLists_[index])
+        {
+            FreeBlock *block = pool->freeLists_[index];
+            pool->freeLists_[index] = block->next;
+            --pool->counts_[index];
+            return reinterpret_cast<char*>(block);
+        }
+    }
+
+    // 不用new char[]，不需要初始化
+    void *data = ::malloc(*size);
+    if (data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(data);
+}
+
+void BufferPool::deallocate(char *data, size_t size)
+{
+    int index = classIndex(size);
+    BufferPool *pool = index >= 0 ? instance() : nullptr;
+    if (pool && kClassSizes[index] == size
+        && (pool->counts_[index] + 1) * size <= kMaxCachedBytes)
+    {
+        FreeBlock *block = reinterpret_cast<FreeBlock*>(data);
+        block->next = pool->freeLists_[index];
+        pool->freeLists_[index] = block;
+        ++pool->counts_[index];
+        return;
+    }
+    ::free(data);
+}
+
+size_t BufferPool::cachedBlocks()
+{
+    BufferPool *pool = instance();
+    size_t n = 0;
+    for (int i = 0; pool && i < kNumClasses; ++i)
+    {
+        n += pool->counts_[i];
+    }
+    return n;
+}
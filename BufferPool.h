@@ -0,0 +1,41 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <stddef.h>
+
+/**
+ * Buffer底层内存的线程局部缓存  one loop per thread，所以也就是每个loop一个
+ * 按大小分成几档（kCheapPrepend + 1K/4K/16K/64K），每档保存一些释放掉的内存块，下次直接复用，不经过malloc
+ * 在哪个线程释放就放回哪个线程的缓存，每档缓存的总大小有上限，超出的部分直接free
+ * 比最大一档还大的内存不缓存
+ */
+class BufferPool : noncopyable
+{
+public:
+    static const int kNumClasses = 4;
+    static const size_t kMaxCachedBytes = 1024 * 1024; // 每一档最多缓存的字节数
+
+    // 分配至少*size字节的内存，*size返回实际的大小
+    static char* allocate(size_t *size);
+    // size必须是allocate返回的大小
+    static void deallocate(char *data, size_t size);
+
+    // 当前线程缓存的内存块数量
+    static size_t cachedBlocks();
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    BufferPool();
+    ~BufferPool();
+
+    static BufferPool* instance();
+    static int classIndex(size_t size);
+
+    FreeBlock   *freeLists_[kNumClasses];
+    size_t      counts_[kNumClasses];
+};
@@ -0,0 +1,389 @@
+#include "ByteSearch.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BYTESEARCH_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BYTESEARCH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+// q是'\n'的位置，前一个字节是'\r'就找到了  q-1不能越过begin
+inline bool endsCRLF(const char *begin, const char *q)
+{
+    return q > begin && q[-1] == '\r';
+}
+
+const char* findCRLFTail(const char *begin, const char *p, const char *end)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == '\n' && endsCRLF(begin, p))
+        {
+            return p - 1;
+        }
+    }
+    return nullptr;
+}
+
+const char* findCRLFScalar(const char *begin, const char *end)
+{
+    const char *p = begin;
+    while (end - p >= 2)
+    {
+        p = static_cast<const char*>(::memchr(p, '\r', end - p - 1));
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (p[1] == '\n')
+        {
+            return p;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+const char* findScalar(const char *begin, const char *end, const char *delim, size_t len)
+{
+    if (static_cast<size_t>(end - begin) < len)
+    {
+        return nullptr;
+    }
+    return static_cast<const char*>(::memmem(begin, end - begin, delim, len));
+}
+
+// CRLF：只找'\n'，每个向量一次比较，一轮处理4个向量，找到以后检查前一个字节  和memchr的做法一样
+// 其它分隔符：先比较第一个和最后一个字节，两个都对上的位置再比较中间，参考Wojciech Muła的SIMD strstr，要求len >= 2
+
+#if defined(BYTESEARCH_X86)
+
+// 按位从低到高检查mask里的'\n'
+inline const char* checkLF(const char *begin, const char *p, uint64_t mask)
+{
+    while (mask != 0)
+    {
+        const char *q = p + __builtin_ctzll(mask);
+        if (endsCRLF(begin, q))
+        {
+            return q - 1;
+        }
+        mask &= mask - 1;
+    }
+    return nullptr;
+}
+
+const char* findCRLFSse2(const char *begin, const char *end)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 64)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), lf);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), lf);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), lf);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), lf);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0)
+        {
+            uint64_t mask = static_cast<uint64_t>(_mm_movemask_epi8(a))
+                          | static_cast<uint64_t>(_mm_movemask_epi8(b)) << 16
+                          | static_cast<uint64_t>(_mm_movemask_epi8(c)) << 32
+                          | static_cast<uint64_t>(_mm_movemask_epi8(d)) << 48;
+            const char *found = checkLF(begin, p, mask);
+            if (found)
+            {
+                return found;
+            }
+        }
+        p += 64;
+    }
+    while (end - p >= 16)
+    {
+        uint64_t mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), lf)));
+        const char *found = checkLF(begin, p, mask);
+        if (found)
+        {
+            return found;
+        }
+        p += 16;
+    }
+    return findCRLFTail(begin, p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findCRLFAvx2(const char *begin, const char *end)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 128)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), lf);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), lf);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)), lf);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96)), lf);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any))
+        {
+            uint64_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(a))
+                        | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32;
+            const char *found = checkLF(begin, p, lo);
+            if (found)
+            {
+                return found;
+            }
+            uint64_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(c))
+                        | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(d))) << 32;
+            found = checkLF(begin, p + 64, hi);
+            if (found)
+            {
+                return found;
+            }
+        }
+        p += 128;
+    }
+    while (end - p >= 32)
+    {
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), lf)));
+        const char *found = checkLF(begin, p, mask);
+        if (found)
+        {
+            return found;
+        }
+        p += 32;
+    }
+    return findCRLFTail(begin, p, end);
+}
+
+const char* findSse2(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const __m128i first = _mm_set1_epi8(delim[0]);
+    const __m128i last = _mm_set1_epi8(delim[len - 1]);
+    const char *p = begin;
+    // 每次检查[p, p+16)这16个起始位置，需要读到p+16+len-1
+    while (static_cast<size_t>(end - p) >= 16 + len - 1)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+        while (mask != 0)
+        {
+            int i = __builtin_ctz(mask);
+            if (len == 2 || ::memcmp(p + i + 1, delim + 1, len - 2) == 0)
+            {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return findScalar(p, end, delim, len);
+}
+
+__attribute__((target("avx2")))
+const char* findAvx2(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(delim[0]);
+    const __m256i last = _mm256_set1_epi8(delim[len - 1]);
+    const char *p = begin;
+    while (static_cast<size_t>(end - p) >= 32 + len - 1)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+        while (mask != 0)
+        {
+            int i = __builtin_ctz(mask);
+            if (len == 2 || ::memcmp(p + i + 1, delim + 1, len - 2) == 0)
+            {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    // 剩下不到32字节用SSE2
+    return findSse2(p, end, delim, len);
+}
+
+#elif defined(BYTESEARCH_NEON)
+
+// NEON没有movemask，右移窄化以后每个字节占4位
+inline uint64_t neonMask(uint8x16_t eq)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+const char* findCRLFNeon(const char *begin, const char *end)
+{
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const char *p = begin;
+    while (end - p >= 64)
+    {
+        uint8x16_t a = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p)), lf);
+        uint8x16_t b = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p + 16)), lf);
+        uint8x16_t c = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p + 32)), lf);
+        uint8x16_t d = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p + 48)), lf);
+        if (vmaxvq_u8(vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d))) != 0)
+        {
+            break; // 这64字节里有'\n'，交给下面逐个向量检查
+        }
+        p += 64;
+    }
+    while (end - p >= 16)
+    {
+        uint64_t mask = neonMask(vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p)), lf));
+        while (mask != 0)
+        {
+            const char *q = p + (__builtin_ctzll(mask) >> 2);
+            if (endsCRLF(begin, q))
+            {
+                return q - 1;
+            }
+            mask &= ~(0xfULL << ((q - p) * 4));
+        }
+        p += 16;
+    }
+    return findCRLFTail(begin, p, end);
+}
+
+const char* findNeon(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(delim[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(delim[len - 1]));
+    const char *p = begin;
+    while (static_cast<size_t>(end - p) >= 16 + len - 1)
+    {
+        uint8x16_t blockFirst = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t blockLast = vld1q_u8(reinterpret_cast<const uint8_t*>(p + len - 1));
+        uint64_t mask = neonMask(vandq_u8(vceqq_u8(blockFirst, first), vceqq_u8(blockLast, last)));
+        while (mask != 0)
+        {
+            int i = __builtin_ctzll(mask) >> 2;
+            if (len == 2 || ::memcmp(p + i + 1, delim + 1, len - 2) == 0)
+            {
+                return p + i;
+            }
+            mask &= ~(0xfULL << (i * 4));
+        }
+        p += 16;
+    }
+    return findScalar(p, end, delim, len);
+}
+
+#endif
+
+ByteSearch::Impl detectImpl()
+{
+#if defined(BYTESEARCH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return ByteSearch::kAvx2;
+    }
+    return __builtin_cpu_supports("sse2") ? ByteSearch::kSse2 : ByteSearch::kScalar;
+#elif defined(BYTESEARCH_NEON)
+    return ByteSearch::kNeon;
+#else
+    return ByteSearch::kScalar;
+#endif
+}
+
+} // namespace
+
+ByteSearch::Impl ByteSearch::defaultImpl()
+{
+    static const Impl impl = detectImpl();
+    return impl;
+}
+
+const char* ByteSearch::implName(Impl impl)
+{
+    switch (impl)
+    {
+    case kSse2: return "sse2";
+    case kAvx2: return "avx2";
+    case kNeon: return "neon";
+    default:    return "scalar";
+    }
+}
+
+bool ByteSearch::supported(Impl impl)
+{
+    Impl best = defaultImpl();
+    switch (impl)
+    {
+    case kScalar: return true;
+    case kSse2:   return best == kSse2 || best == kAvx2;
+    default:      return best == impl;
+    }
+}
+
+const char* ByteSearch::findByte(const char *begin, const char *end, char c)
+{
+    return static_cast<const char*>(::memchr(begin, c, end - begin));
+}
+
+const char* ByteSearch::findCRLF(const char *begin, const char *end)
+{
+    return findCRLF(defaultImpl(), begin, end);
+}
+
+const char* ByteSearch::find(const char *begin, const char *end, const char *delim, size_t len)
+{
+    return find(defaultImpl(), begin, end, delim, len);
+}
+
+const char* ByteSearch::findCRLF(Impl impl, const char *begin, const char *end)
+{
+    if (!supported(impl))
+    {
+        impl = kScalar;
+    }
+    switch (impl)
+    {
+#if defined(BYTESEARCH_X86)
+    case kAvx2: return findCRLFAvx2(begin, end);
+    case kSse2: return findCRLFSse2(begin, end);
+#elif defined(BYTESEARCH_NEON)
+    case kNeon: return findCRLFNeon(begin, end);
+#endif
+    default:    return findCRLFScalar(begin, end);
+    }
+}
+
+const char* ByteSearch::find(Impl impl, const char *begin, const char *end, const char *delim, size_t len)
+{
+    if (len == 0)
+    {
+        return begin;
+    }
+    if (len == 1)
+    {
+        return findByte(begin, end, delim[0]);
+    }
+    if (!supported(impl))
+    {
+        impl = kScalar;
+    }
+    switch (impl)
+    {
+#if defined(BYTESEARCH_X86)
+    case kAvx2: return findAvx2(begin, end, delim, len);
+    case kSse2: return findSse2(begin, end, delim, len);
+#elif defined(BYTESEARCH_NEON)
+    case kNeon: return findNeon(begin, end, delim, len);
+#endif
+    default:    return findScalar(begin, end, delim, len);
+    }
+}
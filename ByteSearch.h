@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * 在一段内存里找分隔符，给Buffer::findCRLF/find这类按行、按分隔符解析的协议用
+ * x86-64上运行时检测CPU，支持AVX2就用32字节一次的比较，否则用SSE2（x86-64都支持）；aarch64用NEON；其它平台逐字节
+ * 单字节直接用memchr，glibc的memchr本身已经按CPU选择了SIMD实现
+ * 都在[begin, end)里找，返回第一次出现的位置，找不到返回nullptr
+ */
+namespace ByteSearch
+{
+    enum Impl
+    {
+        kScalar,
+        kSse2,
+        kAvx2,
+        kNeon,
+    };
+
+    // 当前CPU上自动选择的实现
+    Impl defaultImpl();
+    const char* implName(Impl impl);
+    // 当前CPU能不能用impl
+    bool supported(Impl impl);
+
+    const char* findByte(const char *begin, const char *end, char c);
+    const char* findCRLF(const char *begin, const char *end);
+    const char* find(const char *begin, const char *end, const char *delim, size_t len);
+
+    // 指定实现，benchmark对比用  impl不被支持时用kScalar
+    const char* findCRLF(Impl impl, const char *begin, const char *end);
+    const char* find(Impl impl, const char *begin, const char *end, const char *delim, size_t len);
+}
@@ -4,6 +4,7 @@
 #include <functional>
 
 class Buffer;
+class EventLoop;
 class TcpConnection;
 class Timestamp;
 
@@ -14,4 +15,8 @@ using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                         Buffer*,
                                         Timestamp)>;
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using LowWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using LoopChangeCallback = std::function<void (const TcpConnectionPtr&, EventLoop*, bool)>;
+
+using TimerCallback = std::function<void()>;
\ No newline at end of file
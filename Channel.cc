@@ -7,6 +7,7 @@
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
+const int Channel::kEdgeEvent = EPOLLRDHUP | EPOLLET;
 
 // EventLoop: ChannelList Poller
 Channel::Channel(EventLoop *loop, int fd)
@@ -44,6 +45,7 @@ void Channel::remove()
 // fd得到poller通知以后，处理事件的
 void Channel::handleEvent(Timestamp receiveTime)
 {
+    loop_->noteHandling(fd_);
     if (tied_)
     {
         std::shared_ptr<void> guard = tie_.lock();
@@ -61,7 +63,7 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的channel发生的具体事件， 由channel负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_);
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
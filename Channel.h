@@ -36,7 +36,7 @@ public:
 
     int fd() const { return fd_; }
     int events() const { return events_; }
-    int set_revents(int revt) { revents_ = revt; }
+    void set_revents(int revt) { revents_ = revt; }
 
     // 设置fd相应的事件状态
     void enableReading() { events_ |= kReadEvent; update(); }
@@ -44,17 +44,22 @@ public:
     void enableWriting() { events_ |= kWriteEvent; update(); }
     void disableWriting() { events_ &= ~kWriteEvent; update(); }
     void disableAll() { events_ = kNoneEvent; update(); }
+    // 边沿触发：读写事件一次注册，之后不再修改  只能用于supportsEdgeTriggered的Poller
+    void enableEdgeTriggered() { events_ = kReadEvent | kWriteEvent | kEdgeEvent; update(); }
 
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
+    bool isEdgeTriggered() const { return events_ & kEdgeEvent; }
 
     int index() { return index_; }
     void set_index(int idx) { index_ = idx; }
 
     // one loop per thread
     EventLoop* ownerLoop() { return loop_; }
+    // 换到另一个loop  只能在从旧loop的Poller里remove以后调用，TcpConnection迁移时用
+    void setOwnerLoop(EventLoop *loop) { loop_ = loop; }
     void remove();
 private:
 
@@ -64,6 +69,7 @@ private:
     static const int kNoneEvent;    /** 0 */
     static const int kReadEvent;    /** EPOLLIN | EPOLLPRI */
     static const int kWriteEvent;   /** EPOLLOUT */
+    static const int kEdgeEvent;    /** EPOLLRDHUP | EPOLLET */
 
     EventLoop *loop_;               // 事件循环
     const int fd_;                  // fd, Poller监听的对象
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Timestamp.h"
+
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+class Channel;
+
+/**
+ * 基于完成通知的IO接口，由支持的Poller实现（目前只有IoUringPoller）
+ * 和readiness模型不同，读写由内核完成，回调里直接拿到结果，不需要再调用read/write
+ * 所有方法和回调都在Poller所属的loop线程中执行
+ *
+ * tie: 操作在内核中执行期间一直持有，保证回调用到的对象、发送的数据不会被提前释放，可以为空
+ * cancel以后不会再有回调，tie在内核真正结束操作以后才释放
+ */
+class CompletionIo
+{
+public:
+    // n > 0 收到n字节数据，data只在回调期间有效；n == 0 对端关闭；n < 0 为-errno
+    using RecvCallback = std::function<void(const char *data, ssize_t n, Timestamp receiveTime)>;
+    // n >= 0 发送的字节数；n < 0 为-errno
+    using SendCallback = std::function<void(ssize_t n)>;
+    // connfd >= 0 新连接，已经设置了非阻塞；connfd < 0 为-errno
+    using AcceptCallback = std::function<void(int connfd)>;
+
+    virtual ~CompletionIo() = default;
+
+    // 持续接收channel上的数据，直到对端关闭、出错或者cancel
+    virtual void startRecv(Channel *channel, const std::shared_ptr<void> &tie, RecvCallback cb) = 0;
+    // 发送iov指向的数据，回调之前数据必须保持有效  iov数组本身会被拷贝
+    virtual void sendv(Channel *channel, const struct iovec *iov, int iovcnt,
+                       const std::shared_ptr<void> &tie, SendCallback cb) = 0;
+    // 持续accept新连接，直到cancel  EMFILE/ENFILE和监听socket出错时回调完这一次就结束
+    virtual void startAccept(Channel *channel, AcceptCallback cb) = 0;
+    // 取消channel上所有的recv/send/accept
+    virtual void cancel(Channel *channel) = 0;
+};
@@ -0,0 +1,197 @@
+#include "ConnectionPool.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+static const size_t kDefaultMaxConnections = 64;
+static const size_t kDefaultMaxIdle = 16;
+static const int kDefaultConnectRetries = 2;
+static const double kDefaultConnectTimeout = 3.0;
+
+ConnectionPool::ConnectionPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , name_(name)
+    , maxConnections_(kDefaultMaxConnections)
+    , maxIdle_(kDefaultMaxIdle)
+    , maxConnectRetries_(kDefaultConnectRetries)
+    , connectTimeout_(kDefaultConnectTimeout)
+    , nextClientId_(1)
+    , connecting_(0)
+    , alive_(std::make_shared<bool>(true))
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    alive_.reset();
+    std::deque<AcquireCallback> waiters;
+    waiters.swap(waiters_);
+    for (const AcquireCallback &cb : waiters)
+    {
+        cb(TcpConnectionPtr());
+    }
+
+    // 已经建立的连接还保存着指向this的回调，关闭的回调在TcpClient析构以后才执行
+    for (auto &item : clients_)
+    {
+        TcpConnectionPtr conn = item.second->connection();
+        if (conn)
+        {
+            conn->setConnectionCallback([](const TcpConnectionPtr&) {});
+            conn->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+    idle_.clear();
+    clients_.clear(); // ~TcpClient关闭不再使用的连接
+}
+
+void ConnectionPool::acquire(const AcquireCallback &cb)
+{
+    while (!idle_.empty())
+    {
+        TcpConnectionPtr conn(std::move(idle_.back()));
+        idle_.pop_back();
+        if (conn->connected())
+        {
+            cb(conn);
+            return;
+        }
+    }
+    waiters_.push_back(cb);
+    connectMore();
+}
+
+void ConnectionPool::release(const TcpConnectionPtr &conn)
+{
+    // 通常是在连接的messageCallback里面release，现在换掉回调会析构正在执行的函数对象，放到下一轮
+    std::weak_ptr<bool> alive(alive_);
+    loop_->queueInLoop([this, alive, conn]() {
+        if (!alive.expired())
+        {
+            releaseInLoop(conn);
+        }
+    });
+}
+
+void ConnectionPool::releaseInLoop(const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+    conn->setMessageCallback(std::bind(&ConnectionPool::onIdleMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+    handOut(conn);
+}
+
+void ConnectionPool::handOut(const TcpConnectionPtr &conn)
+{
+    if (!waiters_.empty())
+    {
+        AcquireCallback cb(std::move(waiters_.front()));
+        waiters_.pop_front();
+        cb(conn);
+    }
+    else if (idle_.size() < maxIdle_)
+    {
+        idle_.push_back(conn);
+    }
+    else
+    {
+        conn->shutdown();
+    }
+}
+
+void ConnectionPool::newClient()
+{
+    int clientId = nextClientId_++;
+    char buf[32];
+    snprintf(buf, sizeof buf, "-%d", clientId);
+    std::shared_ptr<TcpClient> client(new TcpClient(loop_, serverAddr_, name_ + buf));
+    client->setConnectionCallback(std::bind(&ConnectionPool::onConnection, this, clientId, std::placeholders::_1));
+    client->setMessageCallback(std::bind(&ConnectionPool::onIdleMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    client->setConnectFailedCallback(std::bind(&ConnectionPool::onConnectFailed, this, clientId));
+    client->setMaxConnectRetries(maxConnectRetries_);
+    client->setConnectTimeout(connectTimeout_);
+    clients_[clientId] = client;
+    ++connecting_;
+    client->connect();
+}
+
+void ConnectionPool::connectMore()
+{
+    while (connecting_ < waiters_.size() && clients_.size() < maxConnections_)
+    {
+        newClient();
+    }
+}
+
+void ConnectionPool::onConnection(int clientId, const TcpConnectionPtr &conn)
+{
+    if (connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+    if (conn->connected())
+    {
+        --connecting_;
+        handOut(conn);
+    }
+    else
+    {
+        removeIdle(conn);
+        removeClient(clientId);
+    }
+}
+
+void ConnectionPool::onConnectFailed(int clientId)
+{
+    LOG_ERROR("ConnectionPool[%s] - connect to %s failed\n", name_.c_str(), serverAddr_.toIpPort().c_str());
+    --connecting_;
+    removeClient(clientId);
+    // 剩下正在连接的不够分给所有等待者，多出来的等待者直接失败
+    while (waiters_.size() > connecting_)
+    {
+        AcquireCallback cb(std::move(waiters_.front()));
+        waiters_.pop_front();
+        cb(TcpConnectionPtr());
+    }
+}
+
+void ConnectionPool::onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    LOG_ERROR("ConnectionPool[%s] - %s received %lu bytes while idle, closing\n",
+        name_.c_str(), conn->name().c_str(), buf->readableBytes());
+    buf->retrieveAll();
+    removeIdle(conn);
+    conn->forceClose();
+}
+
+void ConnectionPool::removeIdle(const TcpConnectionPtr &conn)
+{
+    std::vector<TcpConnectionPtr>::iterator it = std::find(idle_.begin(), idle_.end(), conn);
+    if (it != idle_.end())
+    {
+        idle_.erase(it);
+    }
+}
+
+void ConnectionPool::removeClient(int clientId)
+{
+    std::weak_ptr<bool> alive(alive_);
+    loop_->queueInLoop([this, alive, clientId]() {
+        if (alive.expired())
+        {
+            return;
+        }
+        clients_.erase(clientId);
+        connectMore(); // 空出了一个位置
+    });
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * 到同一个上游地址的连接池，只属于一个loop，所有方法都只能在这个loop线程中调用
+ * 代理服务器在每个subloop里建一个（比如在ThreadInitCallback里），请求和上游连接在同一个线程，不用加锁
+ *
+ * acquire拿到一个已经建立的连接，用完以后release放回去，下一次acquire直接复用，省掉握手
+ * 拿到连接以后自己设置messageCallback/writeCompleteCallback，release时恢复成池子的回调
+ * 连接在空闲时被对端关闭或者收到了数据（协议已经乱了），直接从池子里去掉
+ */
+class ConnectionPool : noncopyable
+{
+public:
+    // 连接失败（Connector放弃重试）时conn为空
+    using AcquireCallback = std::function<void(const TcpConnectionPtr &conn)>;
+
+    ConnectionPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name);
+    ~ConnectionPool(); // 关闭所有连接，还在等待的acquire收到空连接
+
+    // 最多同时有多少个连接（使用中 + 空闲 + 正在连接），超过以后acquire排队等release
+    void setMaxConnections(size_t n) { maxConnections_ = n > 0 ? n : 1; }
+    // 空闲连接最多保留几个，多出来的在release时关闭
+    void setMaxIdle(size_t n) { maxIdle_ = n; }
+    // 见Connector::setMaxRetries、Connector::setConnectTimeout，默认失败2次、超时3秒就放弃
+    void setMaxConnectRetries(int n) { maxConnectRetries_ = n; }
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+    // 池子里的连接建立和断开时回调，断开的可能是正在使用的连接  可以不设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+
+    // 有空闲连接时在acquire里直接回调，否则连接建立或者有连接被release时回调
+    void acquire(const AcquireCallback &cb);
+    // 放回池子，可以在conn的messageCallback里调用，下一轮才真正放回  conn已经断开时什么也不做
+    void release(const TcpConnectionPtr &conn);
+
+    size_t idleConnections() const { return idle_.size(); }
+    size_t totalConnections() const { return clients_.size(); }
+    size_t waiters() const { return waiters_.size(); }
+
+private:
+    using ClientMap = std::unordered_map<int, std::shared_ptr<TcpClient>>;
+
+    void releaseInLoop(const TcpConnectionPtr &conn);
+    void newClient();
+    void onConnection(int clientId, const TcpConnectionPtr &conn);
+    void onConnectFailed(int clientId);
+    void onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    // 把连接交给第一个等待者，或者放进idle_
+    void handOut(const TcpConnectionPtr &conn);
+    void removeIdle(const TcpConnectionPtr &conn);
+    // TcpClient的回调里不能析构它自己，放到下一轮
+    void removeClient(int clientId);
+    // 等待者比正在连接的多，并且还没到maxConnections_时补连接
+    void connectMore();
+
+    EventLoop                       *loop_;
+    const InetAddress               serverAddr_;
+    const std::string               name_;
+    size_t                          maxConnections_;
+    size_t                          maxIdle_;
+    int                             maxConnectRetries_;
+    double                          connectTimeout_;
+    ConnectionCallback              connectionCallback_;
+
+    int                             nextClientId_;
+    size_t                          connecting_;    // 还没有建立连接的TcpClient个数
+    ClientMap                       clients_;
+    std::vector<TcpConnectionPtr>   idle_;          // 后进先出，最近用过的连接拥塞窗口还是热的
+    std::deque<AcquireCallback>     waiters_;
+    std::shared_ptr<bool>           alive_;         // 析构以后队列里剩下的release/removeClient不再访问this
+};
@@ -0,0 +1,310 @@
+#include "Connector.h"
+#include "Logger.h"
+#include "Channel.h"
+#include "EventLoop.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+const int Connector::kInitRetryDelayMs;
+const int Connector::kMaxRetryDelayMs;
+
+static int createNonblocking(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 连本机一个没人监听的端口时，内核可能选中同一个端口作为源端口，自己连上自己  AF_UNIX不会
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_storage local;
+    sockaddr_storage peer;
+    socklen_t len = sizeof local;
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr*)&local, &len) < 0)
+    {
+        return false;
+    }
+    len = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &len) < 0)
+    {
+        return false;
+    }
+    if (local.ss_family == AF_INET)
+    {
+        const sockaddr_in *l = (const sockaddr_in*)&local;
+        const sockaddr_in *p = (const sockaddr_in*)&peer;
+        return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+    }
+    if (local.ss_family == AF_INET6)
+    {
+        const sockaddr_in6 *l = (const sockaddr_in6*)&local;
+        const sockaddr_in6 *p = (const sockaddr_in6*)&peer;
+        return l->sin6_port == p->sin6_port && ::memcmp(&l->sin6_addr, &p->sin6_addr, sizeof l->sin6_addr) == 0;
+    }
+    return false;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , retryDelayMs_(kInitRetryDelayMs)
+    , retries_(0)
+    , maxRetries_(-1)
+    , connectTimeout_(0)
+{
+    LOG_DEBUG("Connector ctor[%p]\n", this);
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG("Connector dtor[%p]\n", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    retries_ = 0;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    retryTimer_ = TimerId();
+    if (connect_ && state_ == kDisconnected)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("Connector::startInLoop do not connect\n");
+    }
+}
+
+void Connector::stopInLoop()
+{
+    cancelTimers();
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.length());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    // 暂时的错误：对端没有监听（AF_UNIX是socket文件还不存在）、本地端口用完、网络不通
+    case ENOENT:
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case EHOSTUNREACH:
+    case ETIMEDOUT:
+        retry(sockfd);
+        break;
+
+    default:
+        // EACCES EPERM EAFNOSUPPORT EALREADY EBADF EFAULT ENOTSOCK 重试也没有用
+        LOG_ERROR("Connector::connect %s error:%d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        setState(kDisconnected);
+        if (connectFailedCallback_)
+        {
+            connectFailedCallback_();
+        }
+        break;
+    }
+}
+
+// connect还没有结果，等socket可写
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+    if (connectTimeout_ > 0)
+    {
+        timeoutTimer_ = loop_->runAfter(connectTimeout_,
+            std::bind(&Connector::handleTimeout, shared_from_this(), sockfd));
+    }
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 现在还在Channel::handleEvent里面，不能直接析构channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    LOG_DEBUG("Connector::handleWrite state=%d\n", state_.load());
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+    if (timeoutTimer_.valid())
+    {
+        loop_->cancel(timeoutTimer_);
+        timeoutTimer_ = TimerId();
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_INFO("Connector::handleWrite %s SO_ERROR:%d %s\n",
+            serverAddr_.toIpPort().c_str(), err, ::strerror(err));
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_INFO("Connector::handleWrite - self connect\n");
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        retries_ = 0;
+        if (connect_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    LOG_DEBUG("Connector::handleError state=%d\n", state_.load());
+    if (state_ == kConnecting)
+    {
+        if (timeoutTimer_.valid())
+        {
+            loop_->cancel(timeoutTimer_);
+            timeoutTimer_ = TimerId();
+        }
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_INFO("Connector::handleError SO_ERROR:%d %s\n", err, ::strerror(err));
+        retry(sockfd);
+    }
+}
+
+void Connector::handleTimeout(int sockfd)
+{
+    timeoutTimer_ = TimerId();
+    // 已经有结果了，或者这个fd已经关掉又分配给了下一次connect
+    if (state_ != kConnecting || !channel_ || channel_->fd() != sockfd)
+    {
+        return;
+    }
+    LOG_INFO("Connector::handleTimeout %s connect timeout\n", serverAddr_.toIpPort().c_str());
+    removeAndResetChannel();
+    retry(sockfd);
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (!connect_)
+    {
+        LOG_DEBUG("Connector::retry do not connect\n");
+        return;
+    }
+    if (maxRetries_ >= 0 && retries_ >= maxRetries_)
+    {
+        LOG_INFO("Connector::retry - give up connecting to %s after %d retries\n",
+            serverAddr_.toIpPort().c_str(), retries_);
+        connect_ = false;
+        if (connectFailedCallback_)
+        {
+            connectFailedCallback_();
+        }
+        return;
+    }
+    ++retries_;
+    LOG_INFO("Connector::retry - retry connecting to %s in %d milliseconds\n",
+        serverAddr_.toIpPort().c_str(), retryDelayMs_);
+    retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0,
+        std::bind(&Connector::startInLoop, shared_from_this()));
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+}
+
+void Connector::cancelTimers()
+{
+    if (retryTimer_.valid())
+    {
+        loop_->cancel(retryTimer_);
+        retryTimer_ = TimerId();
+    }
+    if (timeoutTimer_.valid())
+    {
+        loop_->cancel(timeoutTimer_);
+        timeoutTimer_ = TimerId();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 非阻塞connect，TcpClient使用
+ * connect返回EINPROGRESS以后关注可写事件，可写时用SO_ERROR判断是否连上
+ * 连接失败按指数退避重试：kInitRetryDelayMs开始每次翻倍，最多kMaxRetryDelayMs
+ * 连接成功以后把sockfd交给newConnectionCallback_，之后就不管这个fd了
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    // 放弃重试时调用，之后不会再有newConnectionCallback
+    using ConnectFailedCallback = std::function<void()>;
+
+    static const int kInitRetryDelayMs = 500;
+    static const int kMaxRetryDelayMs = 30 * 1000;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    void setConnectFailedCallback(const ConnectFailedCallback &cb) { connectFailedCallback_ = cb; }
+    // 连续失败maxRetries次以后放弃，-1表示一直重试  在start之前设置
+    void setMaxRetries(int maxRetries) { maxRetries_ = maxRetries; }
+    // 一次connect超过seconds秒没有结果就当作失败，0表示等内核超时（SYN重传，大约两分钟）  在start之前设置
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+
+    void start();   // 可以在任意线程调用
+    void restart(); // 只能在loop线程调用，重置退避时间
+    void stop();    // 可以在任意线程调用
+
+private:
+    enum States { kDisconnected, kConnecting, kConnected };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void handleTimeout(int sockfd);
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+    void cancelTimers();
+
+    EventLoop                   *loop_;
+    InetAddress                 serverAddr_;
+    std::atomic_bool            connect_;       // 用户希望连接，stop以后为false
+    std::atomic_int             state_;
+    std::unique_ptr<Channel>    channel_;       // 只在kConnecting时存在
+    NewConnectionCallback       newConnectionCallback_;
+    ConnectFailedCallback       connectFailedCallback_;
+    int                         retryDelayMs_;
+    int                         retries_;
+    int                         maxRetries_;
+    double                      connectTimeout_;
+    TimerId                     retryTimer_;
+    TimerId                     timeoutTimer_;
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
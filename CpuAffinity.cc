@@ -0,0 +1,102 @@
+#include "CpuAffinity.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace CpuAffinity
+{
+    bool bindCurrentThread(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+        if (err != 0)
+        {
+            LOG_ERROR("bind thread to cpu %d failed:%d \n", cpu, err);
+            return false;
+        }
+
+        // 进程可能被设置了交错分配（numactl --interleave），loop线程的内存还是要在本地节点
+        if (::syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) < 0)
+        {
+            LOG_DEBUG("set_mempolicy(MPOL_LOCAL) failed:%d \n", errno);
+        }
+        return true;
+    }
+
+    int nodeOfCpu(int cpu)
+    {
+        char path[64];
+        snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *dir = ::opendir(path);
+        if (dir == nullptr)
+        {
+            return -1;
+        }
+        // 目录下有一个nodeN的链接
+        int node = -1;
+        while (struct dirent *entry = ::readdir(dir))
+        {
+            if (::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+            {
+                node = ::atoi(entry->d_name + 4);
+                break;
+            }
+        }
+        ::closedir(dir);
+        return node;
+    }
+
+    int currentCpu()
+    {
+        return ::sched_getcpu();
+    }
+
+    std::vector<int> nicQueueCpus(const std::string &ifname)
+    {
+        std::vector<int> cpus;
+        FILE *fp = ::fopen("/proc/interrupts", "r");
+        if (fp == nullptr)
+        {
+            return cpus;
+        }
+
+        char line[4096];
+        while (::fgets(line, sizeof line, fp))
+        {
+            // " 45:  123  456  PCI-MSI 524289-edge  eth0-TxRx-0"  行首是中断号
+            char *end;
+            long irq = ::strtol(line, &end, 10);
+            if (end == line || *end != ':' || ::strstr(end, ifname.c_str()) == nullptr)
+            {
+                continue;
+            }
+
+            char path[64];
+            snprintf(path, sizeof path, "/proc/irq/%ld/smp_affinity_list", irq);
+            FILE *affinity = ::fopen(path, "r");
+            if (affinity == nullptr)
+            {
+                continue;
+            }
+            int cpu;
+            if (::fscanf(affinity, "%d", &cpu) == 1)  // "2-3,6"只取第一个
+            {
+                cpus.push_back(cpu);
+            }
+            ::fclose(affinity);
+        }
+        ::fclose(fp);
+        return cpus;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * 线程绑核和NUMA相关的辅助函数  只读/proc和/sys，不依赖libnuma
+ * loop线程在构造EventLoop之前绑核，之后分配的缓冲区、定时器等内存按照first-touch落在本地节点
+ */
+namespace CpuAffinity
+{
+    // 把当前线程绑定到cpu上，并把内存分配策略设为本地节点（MPOL_LOCAL）  失败返回false
+    bool bindCurrentThread(int cpu);
+
+    // cpu所在的NUMA节点，不知道时返回-1
+    int nodeOfCpu(int cpu);
+
+    // 当前线程正在运行的cpu
+    int currentCpu();
+
+    // 网卡各个队列中断的亲和cpu，按照/proc/interrupts中出现的顺序，每个中断取第一个cpu
+    // 中断名里包含ifname的都算，比如eth0-TxRx-0、mlx5_comp0@pci:...需要传入对应的名字
+    // 把loop绑到这些cpu上，收包的软中断和loop在同一个核上
+    std::vector<int> nicQueueCpus(const std::string &ifname);
+}
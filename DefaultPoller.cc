@@ -1,16 +1,31 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "PollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 Poller* Poller::newDefaultPoller(EventLoop *loop)
 {
+    if (const char *uring = ::getenv("MUDUO_USE_URING"))
+    {
+        // MUDUO_USE_URING=poll 只用io_uring做readiness，不使用完成通知的IO
+        Poller *poller = IoUringPoller::create(loop, ::strcmp(uring, "poll") != 0);
+        if (poller)
+        {
+            return poller;
+        }
+        LOG_ERROR("io_uring is not available, fall back to epoll \n");
+    }
+
     if (::getenv("MUDUO_USE_POLL"))
     {
-        return nullptr; // 生成poll的实例
+        return new PollPoller(loop); // 生成poll的实例
     }
     else
     {
         return new EPollPoller(loop); // 生成epoll的实例
     }
-}
\ No newline at end of file
+}
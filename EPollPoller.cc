@@ -3,8 +3,8 @@
 #include "Channel.h"
 
 #include <errno.h>
+#include <algorithm>
 #include <unistd.h>
-#include <strings.h>
 
 // channel未添加到poller中
 const int kNew = -1;  // channel的成员index_ = -1
@@ -17,6 +17,9 @@ EPollPoller::EPollPoller(EventLoop *loop)
     : Poller(loop)
     , epollfd_(::epoll_create1(EPOLL_CLOEXEC))
     , events_(kInitEventListSize)  // vector<epoll_event>
+    , numReady_(0)
+    , maxEvents_(0)
+    , idleWaits_(0)
 {
     if (epollfd_ < 0)
     {
@@ -31,21 +34,48 @@ EPollPoller::~EPollPoller()
 
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // 实际上应该用LOG_DEBUG输出日志更为合理
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    Timestamp now;
+    int numEvents = waitEvents(timeoutMs, 0, &now);
+    fillActiveChannels(numEvents, activeChannels);
+    adjustEventList(numEvents, 0);
+    return now;
+}
+
+int EPollPoller::wait(int timeoutMs, int maxEvents, Timestamp *receiveTime)
+{
+    return waitEvents(timeoutMs, maxEvents, receiveTime);
+}
+
+void EPollPoller::dispatch(Timestamp receiveTime)
+{
+    for (int i = 0; i < numReady_; ++i)
+    {
+        Channel *channel = static_cast<Channel*>(events_[i].data.ptr);
+        channel->set_revents(events_[i].events);
+        channel->handleEvent(receiveTime);
+    }
+    // handleEvent里面可能注册/删除channel，但不会再调用epoll_wait，events_在这之前不能变
+    adjustEventList(numReady_, maxEvents_);
+}
+
+int EPollPoller::waitEvents(int timeoutMs, int maxEvents, Timestamp *receiveTime)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+
+    int capacity = static_cast<int>(events_.size());
+    if (maxEvents > 0 && maxEvents < capacity)
+    {
+        capacity = maxEvents;
+    }
+    maxEvents_ = maxEvents;
 
-    int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
+    int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), capacity, timeoutMs);
     int saveErrno = errno;
-    Timestamp now(Timestamp::now());
+    *receiveTime = Timestamp::now();
 
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happened \n", numEvents);
-        fillActiveChannels(numEvents, activeChannels);
-        if (numEvents == events_.size())
-        {
-            events_.resize(events_.size() * 2);
-        }
+        LOG_DEBUG("%d events happened \n", numEvents);
     }
     else if (numEvents == 0)
     {
@@ -53,13 +83,43 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
     }
     else
     {
+        numEvents = 0;
         if (saveErrno != EINTR)
         {
             errno = saveErrno;
             LOG_ERROR("EPollPoller::poll() err!");
         }
     }
-    return now;
+    numReady_ = numEvents;
+    return numEvents;
+}
+
+void EPollPoller::adjustEventList(int numEvents, int maxEvents)
+{
+    const int size = static_cast<int>(events_.size());
+    if (numEvents == size && (maxEvents <= 0 || size < maxEvents))
+    {
+        // 可能还有没取到的事件，扩大一倍，但没有必要超过每次的预算
+        int newSize = size * 2;
+        if (maxEvents > 0 && newSize > maxEvents)
+        {
+            newSize = maxEvents;
+        }
+        events_.resize(newSize);
+        idleWaits_ = 0;
+    }
+    else if (size > kInitEventListSize && numEvents < size / 4)
+    {
+        if (++idleWaits_ >= kShrinkAfterWaits)
+        {
+            EventList(std::max(size / 2, static_cast<int>(kInitEventListSize))).swap(events_); // resize不会释放内存
+            idleWaits_ = 0;
+        }
+    }
+    else
+    {
+        idleWaits_ = 0;
+    }
 }
 
 // 填写活跃的连接
@@ -77,19 +137,19 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels)
 /**
  *            EventLoop  =>   poller.poll
  *     ChannelList      Poller
- *                     ChannelMap  <fd, channel*>   epollfd
+ *                   ChannelTable  <fd, channel*>   epollfd
  */ 
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("func[%s] => fd[%d] events[%d] index[%d] \n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("func[%s] => fd[%d] events[%d] index[%d] \n", __FUNCTION__, channel->fd(), channel->events(), index);
 
     if (index == kNew || index == kDeleted)
     {
         if (index == kNew)
         {
             int fd = channel->fd();
-            channels_.insert(std::make_pair(fd, channel));
+            channels_.insert(fd, channel);
         }
 
         channel->set_index(kAdded);
@@ -116,7 +176,7 @@ void EPollPoller::removeChannel(Channel *channel)
     int fd = channel->fd();
     channels_.erase(fd);
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
     
     int index = channel->index();
     if (index == kAdded)
@@ -129,14 +189,12 @@ void EPollPoller::removeChannel(Channel *channel)
 // 更新channel通道 epoll_ctl add/mod/del
 void EPollPoller::update(int operation, Channel *channel)
 {
+    // data是union，只用ptr，它占满了整个data，不需要先清零
     epoll_event event;
-    bzero(&event, sizeof event);
-    
-    int fd = channel->fd();
-
     event.events = channel->events();
-    event.data.fd = fd; 
     event.data.ptr = channel;
+
+    int fd = channel->fd();
     
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
@@ -24,9 +24,20 @@ public:
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
     void updateChannel(Channel *channel) override;
     void removeChannel(Channel *channel) override;
+    bool supportsEdgeTriggered() const override { return true; }
+
+    // 直接遍历epoll_wait返回的数组分发，不经过ChannelList
+    // maxEvents传给epoll_wait，没取走的事件留在内核的就绪队列里，下一次wait按顺序返回
+    int wait(int timeoutMs, int maxEvents, Timestamp *receiveTime) override;
+    void dispatch(Timestamp receiveTime) override;
 private:
     static const int kInitEventListSize = 16;
+    static const int kShrinkAfterWaits = 64;    // 连续这么多次用不到四分之一，数组减半
 
+    // 调用epoll_wait，结果在events_的前numReady_个
+    int waitEvents(int timeoutMs, int maxEvents, Timestamp *receiveTime);
+    // 一次返回的事件填满了数组就扩大，一段时间都很空闲就缩小，突发过后把内存还回去
+    void adjustEventList(int numEvents, int maxEvents);
     // 填写活跃的连接
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
     // 更新channel通道
@@ -38,4 +49,7 @@ private:
     
     using EventList = std::vector<epoll_event>;
     EventList  events_;       // 监听事件集合
+    int        numReady_;     // 最近一次epoll_wait返回的事件个数
+    int        maxEvents_;    // 最近一次wait的预算
+    int        idleWaits_;    // 连续用不到events_四分之一的次数
 };
\ No newline at end of file
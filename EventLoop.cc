@@ -2,22 +2,36 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
 #include <memory>
 
 //__thread是一个thread_local的机制，代表这个变量是这个线程独有的全局变量，而不是所有线程共有
 //当一个eventloop被创建起来的时候,这个t_loopInThisThread就会指向这个Eventloop对象。
 //如果这个线程又想创建一个EventLoop对象的话这个t_loopInThisThread非空，就不会再创建了。
-const int kPollTimeMs = 10000; //定义默认的Pooler IO复用接口的超时时间
 __thread EventLoop *t_loopInThisThread = nullptr;
 
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;
 
+const int EventLoop::kDefaultEventBudget;
+const int64_t EventLoop::kLoadWindowNanos;
+
+// 统计用的单调时钟，纳秒
+static int64_t monotonicNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 // 创建wakeupfd，用来notify唤醒subReactor处理新来的channel
 int createEventfd()
 {
@@ -35,11 +49,34 @@ int createEventfd()
 EventLoop::EventLoop()
     : looping_(false)
     , quit_(false)
-    , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
+    , iterationNanos_(monotonicNanos())
     , poller_(Poller::newDefaultPoller(this))       // /获取一个封装着控制epoll操作的对象
+    , timerQueue_(new TimerQueue(this))             // 每个EventLoop都有自己的定时器队列，基于timerfd
     , wakeupFd_(createEventfd())                    // 每个EventLoop对象，都会有自己的eventfd
     , wakeupChannel_(new Channel(this, wakeupFd_))  // 每个channel都要知道自己所属的eventloop
+    , callingPendingFunctors_(false)
+    , wakeupPending_(false)
+    , eventBudget_(kDefaultEventBudget)
+    , busyPollNanos_(0)
+    , lastActiveNanos_(0)
+    , spinning_(false)
+    , statWakeups_(0)
+    , statEvents_(0)
+    , statMaxEvents_(0)
+    , statBudgetExhausted_(0)
+    , statFunctors_(0)
+    , statDispatchNanos_(0)
+    , statFunctorNanos_(0)
+    , iteration_(0)
+    , iterationStart_(0)
+    , currentFd_(-1)
+    , currentTask_(nullptr)
+    , connections_(0)
+    , bufferedBytes_(0)
+    , loadBusyNanos_(0)
+    , loadWindowStart_(monotonicNanos())
+    , loadPpm_(0)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread)
@@ -63,6 +100,12 @@ EventLoop::~EventLoop()
     wakeupChannel_->remove();
     ::close(wakeupFd_);
     t_loopInThisThread = nullptr;
+
+    // 和原来的vector一样，没来得及执行的回调直接销毁
+    while (MpscNode *node = pendingFunctors_.pop())
+    {
+        delete static_cast<PendingFunctor*>(node);
+    }
 }
 
 // 具体的wakeupfd_发生事件后的回调操作
@@ -85,23 +128,32 @@ void EventLoop::loop()
 
     LOG_INFO("EventLoop %p start looping \n", this);
 
+    int timeoutMs = nextPollTimeout(true, monotonicNanos());
     while(!quit_)
     {
-        activeChannels_.clear();
-        // 监听两类fd   一种是client的fd，一种wakeupfd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
-        for (Channel *channel : activeChannels_)
-        {
-            // Poller监听哪些channel发生事件了，然后上报给EventLoop，通知channel处理相应的事件
-            channel->handleEvent(pollReturnTime_);
-        }
+        // 监听两类fd   一种是client的fd，一种wakeupfd  最多取eventBudget_个事件
+        int numEvents = poller_->wait(timeoutMs, eventBudget_, &pollReturnTime_);
+        int64_t start = monotonicNanos();
+        iterationNanos_ = start;
+        iteration_.store(iteration_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        iterationStart_.store(start, std::memory_order_release);
+        // Poller监听哪些channel发生事件了，通知channel处理相应的事件
+        poller_->dispatch(pollReturnTime_);
+        int64_t dispatched = monotonicNanos();
         // 执行当前EventLoop事件循环需要处理的回调操作
         /**
          * IO线程 mainLoop accept fd《=channel subloop
          * mainLoop 事先注册一个回调cb（需要subloop来执行）    wakeup subloop后，执行下面的方法，执行之前mainloop注册的cb操作
          */ 
-        doPendingFunctors();
+        size_t functors = doPendingFunctors();
+        int64_t end = monotonicNanos();
+        updateStats(numEvents, dispatched - start, functors, end - dispatched);
+        metrics_.record(LoopMetrics::kLoopIteration, end - start);
+        iterationStart_.store(0, std::memory_order_relaxed);
+        updateLoad(end - start, end);
+        timeoutMs = nextPollTimeout(numEvents > 0 || functors > 0, end);
     }
+    spinning_ = false;
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
@@ -127,7 +179,7 @@ void EventLoop::quit()
 }
 
 // 在当前loop中执行cb
-void EventLoop::runInLoop(Functor cb)
+void EventLoop::runInLoop(Functor &&cb)
 {
     if (isInLoopThread()) // 在当前的loop线程中，执行cb
     {
@@ -135,37 +187,42 @@ void EventLoop::runInLoop(Functor cb)
     }
     else // 在非当前loop线程中执行cb , 就需要唤醒loop所在线程，执行cb
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
 // 把cb放入队列中，唤醒loop所在的线程，执行cb
-void EventLoop::queueInLoop(Functor cb)
+void EventLoop::queueInLoop(Functor &&cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    // 只有采样到的回调才取时间，doPendingFunctors里记录排队的时间
+    int64_t enqueued = LoopMetrics::sampleInThisThread() ? monotonicNanos() : 0;
+    pendingFunctors_.push(new PendingFunctor(std::move(cb), enqueued));
 
     // 唤醒相应的，需要执行上面回调操作的loop的线程了
     // || callingPendingFunctors_的意思是：当前loop正在执行回调，但是loop又有了新的回调
     if (!isInLoopThread() || callingPendingFunctors_) 
     {
+        // loop正在自旋，下一次poll（超时为0）之后就会执行doPendingFunctors，不需要写eventfd
+        if (spinning_.load())
+        {
+            return;
+        }
+
         /***
         这里还需要结合下EventLoop循环的实现，其中doPendingFunctors()是每轮循环的最后一步处理。 
         如果调用queueInLoop和EventLoop在同一个线程，且callingPendingFunctors_为false时，
         则说明：此时尚未执行到doPendingFunctors()。 那么此时即使不用wakeup，也可以在之后照旧
         执行doPendingFunctors()了。这么做的好处非常明显，可以减少对eventfd的io读写。
         ***/
-        wakeup(); 
         /***
-        为什么要唤醒 EventLoop，我们首先调用了 pendingFunctors_.push_back(cb), 
-        将该函数放在 pendingFunctors_中。EventLoop 的每一轮循环在最后会调用 
-        doPendingFunctors 依次执行这些函数。而 EventLoop 的唤醒是通过 epoll_wait 实现的，
-        如果此时该 EventLoop 中迟迟没有事件触发，那么 epoll_wait 一直就会阻塞。 
-        这样会导致，pendingFunctors_中的任务迟迟不能被执行了。
-        所以必须要唤醒 EventLoop ，从而让pendingFunctors_中的任务尽快被执行。
+        多个生产者同时投递时，只有把wakeupPending_从false改成true的那一个去写eventfd，
+        loop在doPendingFunctors开始时把它清零，之后再入队的回调会重新唤醒。
+        push在exchange之前，清零在放置pendingMarker_之前，所以不会出现回调入队了却没人唤醒的情况。
         ***/
+        if (!wakeupPending_.exchange(true))
+        {
+            wakeup(); 
+        }
     }
 }
 
@@ -181,6 +238,28 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 // EventLoop的方法 =》 Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -192,25 +271,186 @@ void EventLoop::removeChannel(Channel *channel)
     poller_->removeChannel(channel);
 }
 
+bool EventLoop::supportsEdgeTriggered() const
+{
+    return poller_->supportsEdgeTriggered();
+}
+
+CompletionIo* EventLoop::completionIo() const
+{
+    return poller_->completionIo();
+}
+
 bool EventLoop::hasChannel(Channel *channel)
 {
     return poller_->hasChannel(channel);
 }
 
-void EventLoop::doPendingFunctors() // 执行回调
+size_t EventLoop::doPendingFunctors() // 执行回调
 {
-    std::vector<Functor> functors;
+    size_t count = 0;
     callingPendingFunctors_ = true;
+    wakeupPending_.store(false);
 
+    if (!pendingFunctors_.empty())
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
+        // 只执行放置标记之前入队的回调，执行过程中新入队的回调留到下一轮，和原来swap vector的语义一样
+        pendingFunctors_.push(&pendingMarker_);
+        MpscNode *node;
+        while ((node = pendingFunctors_.pop()) != &pendingMarker_)
+        {
+            PendingFunctor *pending = static_cast<PendingFunctor*>(node);
+            if (pending->enqueueNanos != 0)
+            {
+                metrics_.record(LoopMetrics::kQueueDelay, monotonicNanos() - pending->enqueueNanos);
+            }
+            currentFd_.store(-1, std::memory_order_relaxed);
+            currentTask_.store(pending->functor.invoker(), std::memory_order_relaxed);
+            pending->functor(); // 执行当前loop需要执行的回调操作
+            delete pending;
+            ++count;
+        }
     }
-
-    for (const Functor &functor : functors)
+    // 执行过程中新加的也在这一轮执行
+    while (!afterIteration_.empty())
     {
-        functor(); // 执行当前loop需要执行的回调操作
+        runningAfterIteration_.swap(afterIteration_);
+        for (Functor &cb : runningAfterIteration_)
+        {
+            currentFd_.store(-1, std::memory_order_relaxed);
+            currentTask_.store(cb.invoker(), std::memory_order_relaxed);
+            cb();
+            ++count;
+        }
+        runningAfterIteration_.clear();
     }
 
     callingPendingFunctors_ = false;
-}
\ No newline at end of file
+    return count;
+}
+
+void EventLoop::setBusyPoll(int micros)
+{
+    busyPollNanos_ = static_cast<int64_t>(micros) * 1000;
+    lastActiveNanos_ = monotonicNanos();
+}
+
+int EventLoop::nextPollTimeout(bool active, int64_t now)
+{
+    if (busyPollNanos_ <= 0)
+    {
+        return kPollTimeMs;
+    }
+    if (active)
+    {
+        lastActiveNanos_ = now;
+    }
+    if (now - lastActiveNanos_ < busyPollNanos_)
+    {
+        spinning_.store(true);
+        return 0;
+    }
+
+    if (spinning_.load(std::memory_order_relaxed))
+    {
+        /**
+         * 准备阻塞之前先清掉spinning_，再检查一次队列  生产者是先入队再读spinning_
+         * 两边都是seq_cst（入队的exchange、这里的store和fence），生产者看到spinning_为true时，
+         * 这里一定能看到它入队的回调，不会出现回调入队了却没人唤醒、loop又睡了的情况
+         */
+        spinning_.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!pendingFunctors_.empty())
+        {
+            return 0;
+        }
+    }
+    return kPollTimeMs;
+}
+
+void EventLoop::updateStats(int numEvents, int64_t dispatchNanos, size_t functors, int64_t functorNanos)
+{
+    const uint64_t events = static_cast<uint64_t>(numEvents);
+    statWakeups_.store(statWakeups_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    statEvents_.store(statEvents_.load(std::memory_order_relaxed) + events, std::memory_order_relaxed);
+    if (events > statMaxEvents_.load(std::memory_order_relaxed))
+    {
+        statMaxEvents_.store(events, std::memory_order_relaxed);
+    }
+    if (eventBudget_ > 0 && numEvents >= eventBudget_)
+    {
+        statBudgetExhausted_.store(statBudgetExhausted_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    statFunctors_.store(statFunctors_.load(std::memory_order_relaxed) + functors, std::memory_order_relaxed);
+    statDispatchNanos_.store(statDispatchNanos_.load(std::memory_order_relaxed) + dispatchNanos, std::memory_order_relaxed);
+    statFunctorNanos_.store(statFunctorNanos_.load(std::memory_order_relaxed) + functorNanos, std::memory_order_relaxed);
+}
+
+EventLoop::Stats EventLoop::stats() const
+{
+    Stats stats;
+    stats.wakeups = statWakeups_.load(std::memory_order_relaxed);
+    stats.events = statEvents_.load(std::memory_order_relaxed);
+    stats.maxEventsPerWakeup = statMaxEvents_.load(std::memory_order_relaxed);
+    stats.budgetExhausted = statBudgetExhausted_.load(std::memory_order_relaxed);
+    stats.functors = statFunctors_.load(std::memory_order_relaxed);
+    stats.dispatchNanos = statDispatchNanos_.load(std::memory_order_relaxed);
+    stats.functorNanos = statFunctorNanos_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+EventLoop::Activity EventLoop::activity() const
+{
+    Activity activity;
+    // 前后两次读到的iteration相同，iterationStart才是这一轮的
+    uint64_t iteration;
+    do
+    {
+        iteration = iteration_.load(std::memory_order_acquire);
+        activity.iterationStart = iterationStart_.load(std::memory_order_acquire);
+        activity.fd = currentFd_.load(std::memory_order_relaxed);
+        activity.task = currentTask_.load(std::memory_order_relaxed);
+    } while (iteration != iteration_.load(std::memory_order_acquire));
+    activity.iteration = iteration;
+    return activity;
+}
+
+LoopMetrics::Snapshot EventLoop::metricsSnapshot() const
+{
+    LoopMetrics::Snapshot snap = metrics_.snapshot();
+    snap.wakeups = statWakeups_.load(std::memory_order_relaxed);
+    snap.events = statEvents_.load(std::memory_order_relaxed);
+    snap.functors = statFunctors_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+// 每个窗口的忙碌占比按kLoadDecay做EWMA，跨过n个窗口时旧值衰减n次
+static const double kLoadDecay = 0.75;
+
+void EventLoop::updateLoad(int64_t busyNanos, int64_t now)
+{
+    loadBusyNanos_ += busyNanos;
+    int64_t windowStart = loadWindowStart_.load(std::memory_order_relaxed);
+    int64_t elapsed = now - windowStart;
+    if (elapsed < kLoadWindowNanos)
+    {
+        return;
+    }
+    double ratio = std::min(1.0, static_cast<double>(loadBusyNanos_) / elapsed);
+    double decay = std::pow(kLoadDecay, static_cast<double>(elapsed) / kLoadWindowNanos);
+    double load = loadPpm_.load(std::memory_order_relaxed) / 1e6 * decay + ratio * (1 - decay);
+    loadPpm_.store(static_cast<uint32_t>(load * 1e6), std::memory_order_relaxed);
+    loadWindowStart_.store(now, std::memory_order_relaxed);
+    loadBusyNanos_ = 0;
+}
+
+double EventLoop::busyRatio() const
+{
+    double load = loadPpm_.load(std::memory_order_relaxed) / 1e6;
+    int64_t idle = monotonicNanos() - loadWindowStart_.load(std::memory_order_relaxed) - kLoadWindowNanos;
+    if (idle > 0)
+    {
+        load *= std::pow(kLoadDecay, static_cast<double>(idle) / kLoadWindowNanos);
+    }
+    return load;
+}
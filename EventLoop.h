@@ -3,21 +3,56 @@
 #include <functional>
 #include <vector>
 #include <atomic>
-#include <memory>
 #include <mutex>
+#include <memory>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "Task.h"
+#include "LoopMetrics.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class CompletionIo;
 
 // 时间循环类  主要包含了两个大模块 Channel   Poller（epoll的抽象）
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;
+    // 只能移动的回调类型，内部64字节存储，投递常见的bind回调不需要分配内存
+    using Functor = Task;
+
+    // loop的运行统计  只由loop线程更新，任意线程都可以通过stats()读取一份快照
+    // loop线程正在做什么，给LoopWatchdog用  iterationStart为0表示阻塞在poll里
+    struct Activity
+    {
+        uint64_t    iteration;      // poll每返回一次加一
+        int64_t     iterationStart; // 这一轮开始处理的时间，CLOCK_MONOTONIC纳秒
+        int         fd;             // 最近一个开始处理事件的channel，执行回调的时候为-1
+        const void  *task;          // 最近一个开始执行的回调的Task::invoker，分发IO事件的时候为nullptr
+    };
+
+    struct Stats
+    {
+        uint64_t wakeups;               // poll返回的次数
+        uint64_t events;                // 分发的IO事件总数
+        uint64_t maxEventsPerWakeup;
+        uint64_t budgetExhausted;       // 一次返回的事件数达到预算的次数
+        uint64_t functors;              // 执行的pendingFunctors个数
+        int64_t  dispatchNanos;         // 分发IO事件的总时间
+        int64_t  functorNanos;          // 执行pendingFunctors的总时间
+
+        double eventsPerWakeup() const { return wakeups ? static_cast<double>(events) / wakeups : 0; }
+    };
+
+    static const int kDefaultEventBudget = 1024;
+    static const int64_t kLoadWindowNanos = 100 * 1000 * 1000;
 
     EventLoop();
     ~EventLoop();
@@ -26,22 +61,89 @@ public:
     void loop();    // 开启事件循环  
     void quit();    // 退出事件循环
 
+    // loop线程里的时间缓存，poll每返回一次刷新一次  在loop线程里需要当前时间、又不需要比一轮循环更精确时用它们，
+    // 不用每次都取时间
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    // 这一轮开始处理时的CLOCK_MONOTONIC纳秒，算时间间隔用
+    int64_t iterationNanos() const { return iterationNanos_; }
     
-    void runInLoop(Functor cb);         // 在当前loop中执行cb
-    void queueInLoop(Functor cb);       // 把cb放入队列中，唤醒loop所在的线程，执行cb
+    void runInLoop(Functor &&cb);       // 在当前loop中执行cb
+    void queueInLoop(Functor &&cb);     // 把cb放入队列中，唤醒loop所在的线程，执行cb  cb被移动进队列，不会拷贝
+    // 只能在loop线程调用：这一轮的IO事件和pendingFunctors都处理完以后执行cb，不需要唤醒
+    // 比如TcpConnection把一轮里的多次send合并成一次writev
+    void runAfterIteration(Functor &&cb) { afterIteration_.push_back(std::move(cb)); }
     bool isInLoopThread() const { return threadId_ ==  CurrentThread::tid(); }
+    pid_t threadId() const { return threadId_; }
  
     void wakeup();                      // 用来唤醒loop所在的线程的
 
+    // 定时器  都是线程安全的，回调总是在loop所在的线程中执行
+    TimerId runAt(Timestamp time, TimerCallback cb);        // 在time时刻执行cb
+    TimerId runAfter(double delay, TimerCallback cb);       // delay秒以后执行cb
+    TimerId runEvery(double interval, TimerCallback cb);    // 每隔interval秒执行一次cb
+    void cancel(TimerId timerId);
+
     // EventLoop的方法 =》 Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // Poller支持完成通知IO时返回它的实现，否则返回nullptr  不会改变，可以在任意线程调用
+    CompletionIo* completionIo() const;
+    // Poller是否支持边沿触发  不会改变，可以在任意线程调用
+    bool supportsEdgeTriggered() const;
+
+    // 每一轮循环最多分发的IO事件个数，<=0表示不限制  处理完这么多事件就去执行pendingFunctors，
+    // 剩下的事件下一轮再处理，防止大量就绪的连接让跨线程投递的回调一直得不到执行  在loop线程或者loop之前调用
+    void setEventBudget(int maxEvents) { eventBudget_ = maxEvents; }
+    // 忙轮询：最近一次有IO事件或者回调之后的micros微秒内，poll的超时为0，不停地检查IO和pendingFunctors，
+    // 一直空闲超过micros才阻塞在poll里  自旋期间其它线程queueInLoop不写eventfd  0表示关闭  在loop线程或者loop之前调用
+    void setBusyPoll(int micros);
+    bool spinning() const { return spinning_.load(std::memory_order_relaxed); }
+    Stats stats() const;
+
+    // 计数器和延迟直方图  只能在loop线程里更新，比如TcpConnection读写以后加上字节数
+    LoopMetrics& metrics() { return metrics_; }
+    // 任意线程都可以调用，wakeups、events、functors从stats()里取
+    LoopMetrics::Snapshot metricsSnapshot() const;
+
+    // 任意线程都可以调用，不加锁  没有在处理的时候iterationStart为0
+    Activity activity() const;
+    // Channel::handleEvent开始时调用，只在loop线程
+    void noteHandling(int fd)
+    {
+        currentFd_.store(fd, std::memory_order_relaxed);
+        currentTask_.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // 负载均衡用的计数  任意线程都可以读，不加锁
+    // 分配到这个loop上还没有销毁的连接数  由TcpServer在选定loop时增加，连接移除时减少
+    int connections() const { return connections_.load(std::memory_order_relaxed); }
+    void connectionAdded() { connections_.fetch_add(1, std::memory_order_relaxed); }
+    void connectionRemoved() { connections_.fetch_sub(1, std::memory_order_relaxed); }
+    // 这个loop上所有TcpConnection的接收缓冲区和发送队列占用的字节数，见TcpConnection::bufferedBytes
+    // 连接在loop线程里读写以后加上变化量，TcpServer把各个loop的加起来就是整个服务器的
+    int64_t bufferedBytes() const { return bufferedBytes_.load(std::memory_order_relaxed); }
+    void addBufferedBytes(int64_t delta) { bufferedBytes_.fetch_add(delta, std::memory_order_relaxed); }
+    // 最近一段时间处理IO事件和回调的时间占比的EWMA，0到1  每kLoadWindowNanos更新一次，
+    // 阻塞在poll里没有更新的这段时间按空闲衰减
+    double busyRatio() const;
+
 private:
     void handleRead();        // wake up
-    void doPendingFunctors(); // 执行回调
+    size_t doPendingFunctors(); // 执行回调，返回执行的个数
+    void updateStats(int numEvents, int64_t dispatchNanos, size_t functors, int64_t functorNanos);
+    // 根据忙轮询的设置计算下一次poll的超时
+    int nextPollTimeout(bool active, int64_t now);
+    void updateLoad(int64_t busyNanos, int64_t now);
+
+    // pendingFunctors_中的节点，每个回调一个
+    struct PendingFunctor : MpscNode
+    {
+        PendingFunctor(Functor &&cb, int64_t enqueued) : functor(std::move(cb)), enqueueNanos(enqueued) {}
+        Functor functor;
+        int64_t enqueueNanos;   // 入队的时间，0表示这个回调没有采样
+    };
 
 
 private:
@@ -51,14 +153,42 @@ private:
     const pid_t                 threadId_;          // 记录当前loop所在线程的id
 
     Timestamp                   pollReturnTime_;    // poller返回发生事件的channels的时间点
+    int64_t                     iterationNanos_;
     std::unique_ptr<Poller>     poller_;
+    std::unique_ptr<TimerQueue> timerQueue_;        // 必须在poller_之后构造，之前析构
 
-    using ChannelList = std::vector<Channel*>;
     int                         wakeupFd_;                // 主要作用，当mainLoop获取一个新用户的channel，通过轮询算法选择一个subloop，通过该成员唤醒subloop处理channel
     std::unique_ptr<Channel>    wakeupChannel_;
-    ChannelList                 activeChannels_;          // 返回
 
     std::atomic_bool            callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor>        pendingFunctors_;        // 存储loop需要执行的所有的回调操作
-    std::mutex                  mutex_;                  // 互斥锁，用来保护上面vector容器的线程安全操作
+    MpscQueue                   pendingFunctors_;        // 存储loop需要执行的所有的回调操作，无锁队列，任意线程入队，只有loop线程出队
+    MpscNode                    pendingMarker_;          // doPendingFunctors时入队，用来标记本轮要执行的最后一个回调
+    std::atomic_bool            wakeupPending_;          // 已经有生产者写过wakeupFd_，loop还没有开始处理，合并多次唤醒
+    std::vector<Functor>        afterIteration_;         // 只在loop线程访问
+    std::vector<Functor>        runningAfterIteration_;  // 和afterIteration_交换，两个vector的内存都一直复用
+
+    int                         eventBudget_;
+    int64_t                     busyPollNanos_;     // 0表示不自旋
+    int64_t                     lastActiveNanos_;   // 最近一次有事件或者回调的时间
+    std::atomic_bool            spinning_;          // 下一次poll的超时为0，生产者不需要唤醒
+    // 单写者，loop线程读出来加上增量再写回，不需要原子的读改写
+    std::atomic<uint64_t>       statWakeups_;
+    std::atomic<uint64_t>       statEvents_;
+    std::atomic<uint64_t>       statMaxEvents_;
+    std::atomic<uint64_t>       statBudgetExhausted_;
+    std::atomic<uint64_t>       statFunctors_;
+    std::atomic<int64_t>        statDispatchNanos_;
+    std::atomic<int64_t>        statFunctorNanos_;
+    LoopMetrics                 metrics_;
+    // Activity  单写者，loop线程每轮和每个事件、回调写一次
+    std::atomic<uint64_t>       iteration_;
+    std::atomic<int64_t>        iterationStart_;
+    std::atomic_int             currentFd_;
+    std::atomic<const void*>    currentTask_;
+
+    std::atomic_int             connections_;       // 多个线程增减
+    std::atomic<int64_t>        bufferedBytes_;     // 迁移时新旧两个loop的线程都会修改
+    int64_t                     loadBusyNanos_;     // 当前窗口内忙的时间
+    std::atomic<int64_t>        loadWindowStart_;
+    std::atomic<uint32_t>       loadPpm_;           // busyRatio的EWMA，百万分之一  单写者
 };
\ No newline at end of file
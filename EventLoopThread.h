@@ -19,6 +19,11 @@ public:
                     const std::string &name = std::string());
     ~EventLoopThread();
 
+    // 在startLoop之前调用，loop线程绑定到cpu上
+    void setCpu(int cpu) { thread_.setCpu(cpu); }
+    int cpu() const { return thread_.cpu(); }
+    pid_t tid() const { return thread_.tid(); }
+
     EventLoop* startLoop();
 private:
     void threadFunc();
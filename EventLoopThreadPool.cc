@@ -1,18 +1,37 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
+#include "CpuAffinity.h"
 
 #include <memory>
 
+const int EventLoopThreadPool::kHotRounds;
+static const double kMinLoadGap = 0.2;
+
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
     : baseLoop_(baseLoop)
     , name_(nameArg)
     , started_(false)
     , numThreads_(0)
-    , next_(0)
+    , balancer_(new RoundRobinBalancer)
+    , rebalanceThreshold_(0)
+    , rebalanceInterval_(0)
 {}
 
 EventLoopThreadPool::~EventLoopThreadPool()
-{}
+{
+    if (rebalanceTimer_.valid())
+    {
+        baseLoop_->cancel(rebalanceTimer_);
+    }
+}
+
+void EventLoopThreadPool::setRebalanceCallback(const RebalanceCallback &cb, double threshold, double interval)
+{
+    rebalanceCallback_ = cb;
+    rebalanceThreshold_ = threshold;
+    rebalanceInterval_ = interval;
+}
 
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
@@ -25,10 +44,24 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         char buf[name_.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if (!cpus_.empty())
+        {
+            t->setCpu(cpus_[i % cpus_.size()]);
+        }
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop()); // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
     }
 
+    if (!loops_.empty())
+    {
+        balancer_->setLoops(loops_);
+    }
+    if (rebalanceCallback_ && loops_.size() > 1)
+    {
+        hotRounds_.assign(loops_.size(), 0);
+        rebalanceTimer_ = baseLoop_->runEvery(rebalanceInterval_, std::bind(&EventLoopThreadPool::checkBalance, this));
+    }
+
     // 整个服务端只有一个线程，运行着baseloop
     if (numThreads_ == 0 && cb)
     {
@@ -36,19 +69,32 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
-// 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
-EventLoop* EventLoopThreadPool::getNextLoop()
+void EventLoopThreadPool::stop()
+{
+    if (rebalanceTimer_.valid())
+    {
+        baseLoop_->cancel(rebalanceTimer_);
+        rebalanceTimer_ = TimerId();
+    }
+    // 先从getNextLoop里摘掉，再一个一个退出
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    threads.swap(threads_);
+    loops_.clear();
+    hotRounds_.clear();
+    for (std::unique_ptr<EventLoopThread> &thread : threads)
+    {
+        thread.reset(); // ~EventLoopThread里quit并join
+    }
+}
+
+// 如果工作在多线程中，baseLoop_按balancer_的策略分配channel给subloop
+EventLoop* EventLoopThreadPool::getNextLoop(const InetAddress *peerAddr)
 {
     EventLoop *loop = baseLoop_;
 
-    if (!loops_.empty()) // 通过轮询获取下一个处理事件的loop
+    if (!loops_.empty()) // 通过负载均衡策略获取下一个处理事件的loop
     {
-        loop = loops_[next_];
-        ++next_;
-        if (next_ >= loops_.size())
-        {
-            next_ = 0;
-        }
+        loop = balancer_->select(peerAddr);
     }
 
     return loop;
@@ -62,6 +108,72 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
     }
     else
     {
-        loops_;
+        return loops_;
+    }
+}
+
+LoopMetrics::Snapshot EventLoopThreadPool::metrics(int *loops)
+{
+    LoopMetrics::Snapshot total = baseLoop_->metricsSnapshot();
+    int count = 1;
+    for (EventLoop *loop : loops_)
+    {
+        total.merge(loop->metricsSnapshot());
+        ++count;
+    }
+    if (loops)
+    {
+        *loops = count;
+    }
+    return total;
+}
+
+std::vector<EventLoopThreadPool::LoopPlacement> EventLoopThreadPool::getPlacements() const
+{
+    std::vector<LoopPlacement> placements;
+    if (threads_.empty())
+    {
+        // 只有baseLoop，它运行在用户的线程里，这里不改变它的位置
+        LoopPlacement placement = { baseLoop_, baseLoop_->threadId(), -1, -1 };
+        placements.push_back(placement);
+        return placements;
+    }
+    for (size_t i = 0; i < threads_.size(); ++i)
+    {
+        int cpu = threads_[i]->cpu();
+        LoopPlacement placement = { loops_[i], threads_[i]->tid(), cpu,
+                                    cpu >= 0 ? CpuAffinity::nodeOfCpu(cpu) : -1 };
+        placements.push_back(placement);
     }
-}
\ No newline at end of file
+    return placements;
+}
+
+void EventLoopThreadPool::checkBalance()
+{
+    size_t hottest = loops_.size();
+    double hottestLoad = 0;
+    size_t coolest = 0;
+    double coolestLoad = 2;
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        double load = loops_[i]->busyRatio();
+        hotRounds_[i] = load > rebalanceThreshold_ ? hotRounds_[i] + 1 : 0;
+        if (hotRounds_[i] >= kHotRounds && load > hottestLoad)
+        {
+            hottest = i;
+            hottestLoad = load;
+        }
+        if (load < coolestLoad)
+        {
+            coolest = i;
+            coolestLoad = load;
+        }
+    }
+
+    if (hottest == loops_.size() || coolestLoad > rebalanceThreshold_ || hottestLoad - coolestLoad < kMinLoadGap)
+    {
+        return;
+    }
+    hotRounds_[hottest] = 0; // 迁移的效果要过几个窗口才能体现在busyRatio里
+    rebalanceCallback_(loops_[hottest], loops_[coolest]);
+}
@@ -1,40 +1,85 @@
 #pragma once
 #include "noncopyable.h"
+#include "LoadBalancer.h"
+#include "TimerId.h"
+#include "LoopMetrics.h"
 
 #include <functional>
 #include <string>
 #include <vector>
 #include <memory>
+#include <unistd.h>
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>; 
+    using RebalanceCallback = std::function<void(EventLoop *from, EventLoop *to)>;
+
+    static const int kHotRounds = 3;            // 连续这么多次检查都超过阈值才算过热
+
+    // 每个loop线程的位置
+    struct LoopPlacement
+    {
+        EventLoop   *loop;
+        pid_t       tid;
+        int         cpu;        // 绑定的cpu，-1表示没有绑定
+        int         node;       // cpu所在的NUMA节点，不知道时为-1
+    };
 
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    // 第i个loop线程绑定到cpus[i % cpus.size()]上  可以传CpuAffinity::nicQueueCpus的结果，
+    // 让loop和网卡队列的中断在同一个核上  必须在start之前调用
+    void setThreadCpus(const std::vector<int> &cpus) { cpus_ = cpus; }
+
+    // 选择subloop的策略，默认轮询  必须在start之前调用
+    void setLoadBalancer(std::unique_ptr<LoadBalancer> balancer) { balancer_ = std::move(balancer); }
+
+    // 在baseLoop里每interval秒检查一次各个subloop的busyRatio，连续kHotRounds次超过threshold的loop，
+    // 如果最闲的loop没有超过阈值而且比它低kMinLoadGap以上，在baseLoop线程调用cb(过热的loop, 最闲的loop)，
+    // 由cb决定迁移哪些连接  必须在start之前调用
+    void setRebalanceCallback(const RebalanceCallback &cb, double threshold, double interval);
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
+    // 按顺序停止并join所有loop线程，每个loop执行完当前这一轮的回调再退出  在baseLoop线程调用
+    // 调用前要保证loop上没有还在用的连接和定时器  之后getAllLoops只返回baseLoop，不能和metrics、getPlacements并发
+    void stop();
 
-    // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
-    EventLoop* getNextLoop();
+    // 如果工作在多线程中，baseLoop_按balancer_的策略分配channel给subloop  peerAddr给一致性哈希用
+    EventLoop* getNextLoop(const InetAddress *peerAddr = nullptr);
 
     std::vector<EventLoop*> getAllLoops();
+    // 和getAllLoops的顺序一致
+    std::vector<LoopPlacement> getPlacements() const;
+
+    // getAllLoops和baseLoop的LoopMetrics加起来  有subloop时accept计在baseLoop上  线程安全，start之后调用
+    // *loops返回参与聚合的loop个数
+    LoopMetrics::Snapshot metrics(int *loops = nullptr);
 
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 private:
+    void checkBalance();
 
     EventLoop                   *baseLoop_; // EventLoop loop;  
     std::string                 name_;
     bool                        started_;
     int                         numThreads_;
-    int                         next_;
+    std::unique_ptr<LoadBalancer> balancer_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    std::vector<int>        cpus_;
+
+    RebalanceCallback       rebalanceCallback_;
+    double                  rebalanceThreshold_;
+    double                  rebalanceInterval_;
+    std::vector<int>        hotRounds_;     // 每个loop连续过热的次数
+    TimerId                 rebalanceTimer_;
 };
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "HttpContext.h"
+
+#include <ctype.h>
+#include <string.h>
+
+HttpContext::HttpContext(size_t maxHeaderSize, size_t maxBodySize)
+    : maxHeaderSize_(maxHeaderSize)
+    , maxBodySize_(maxBodySize)
+    , state_(kExpectRequestLine)
+    , lineStart_(0)
+    , scanned_(0)
+    , headerLength_(0)
+    , errorStatus_(0)
+    , input_(nullptr)
+    , dispatching_(false)
+    , streaming_(false)
+    , closing_(false)
+{
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    lineStart_ = 0;
+    scanned_ = 0;
+    headerLength_ = 0;
+    errorStatus_ = 0;
+    request_.reset();
+}
+
+HttpContext::ParseResult HttpContext::fail(int status)
+{
+    errorStatus_ = status;
+    return kError;
+}
+
+HttpContext::ParseResult HttpContext::parse(const Buffer *buf, Timestamp receiveTime)
+{
+    const char *base = buf->peek();
+    const char *end = base + buf->readableBytes();
+
+    while (state_ != kExpectBody)
+    {
+        const char *crlf = buf->findCRLF(base + scanned_);
+        if (crlf == nullptr)
+        {
+            if (buf->readableBytes() > maxHeaderSize_)
+            {
+                return fail(431);
+            }
+            // 最后一个字节可能是'\r'，下次从它开始找
+            if (buf->readableBytes() > lineStart_ + 1)
+            {
+                scanned_ = buf->readableBytes() - 1;
+            }
+            return kNeedMore;
+        }
+        const char *lineBegin = base + lineStart_;
+        lineStart_ = scanned_ = crlf + 2 - base;
+        if (scanned_ > maxHeaderSize_)
+        {
+            return fail(431);
+        }
+
+        if (state_ == kExpectRequestLine)
+        {
+            if (crlf == lineBegin)
+            {
+                continue; // RFC 7230 3.5：请求行前面的空行忽略
+            }
+            int status = parseRequestLine(base, lineBegin, crlf);
+            if (status != 0)
+            {
+                return fail(status);
+            }
+            state_ = kExpectHeaders;
+        }
+        else if (crlf == lineBegin)
+        {
+            // 空行，头部结束
+            headerLength_ = scanned_;
+            request_.receiveTime_ = receiveTime;
+
+            request_.base_ = base; // getHeader要用
+            StringPiece connection = request_.getHeader("Connection");
+            bool close = connection.size() == 5 && ::strncasecmp(connection.data(), "close", 5) == 0;
+            bool keepAlive = connection.size() == 10 && ::strncasecmp(connection.data(), "keep-alive", 10) == 0;
+            request_.keepAlive_ = request_.version_ == HttpRequest::kHttp11 ? !close : keepAlive;
+
+            if (request_.hasHeader("Transfer-Encoding"))
+            {
+                return fail(501); // 不支持分块的请求体
+            }
+            StringPiece length = request_.getHeader("Content-Length");
+            if (!length.empty())
+            {
+                size_t n = 0;
+                for (char c : length)
+                {
+                    if (!isdigit(static_cast<unsigned char>(c)) || n > maxBodySize_)
+                    {
+                        return fail(n > maxBodySize_ ? 413 : 400);
+                    }
+                    n = n * 10 + static_cast<size_t>(c - '0');
+                }
+                if (n > maxBodySize_)
+                {
+                    return fail(413);
+                }
+                request_.contentLength_ = n;
+            }
+            state_ = kExpectBody;
+        }
+        else if (!parseHeader(base, lineBegin, crlf))
+        {
+            return fail(400);
+        }
+    }
+
+    if (static_cast<size_t>(end - base) < headerLength_ + request_.contentLength_)
+    {
+        return kNeedMore;
+    }
+    request_.base_ = base;
+    request_.bodyRange_ = HttpRequest::Range(headerLength_, request_.contentLength_);
+    return kGotRequest;
+}
+
+// METHOD SP request-target SP HTTP-version  成功返回0，否则返回应该回的状态码
+int HttpContext::parseRequestLine(const char *base, const char *begin, const char *end)
+{
+    const char *space = static_cast<const char*>(::memchr(begin, ' ', end - begin));
+    if (space == nullptr)
+    {
+        return 400;
+    }
+    StringPiece method(begin, space - begin);
+    request_.methodRange_ = HttpRequest::Range(begin - base, space - begin);
+    struct MethodName
+    {
+        const char          *name;
+        HttpRequest::Method method;
+    };
+    static const MethodName kMethods[] = {
+        { "GET", HttpRequest::kGet },
+        { "POST", HttpRequest::kPost },
+        { "HEAD", HttpRequest::kHead },
+        { "PUT", HttpRequest::kPut },
+        { "DELETE", HttpRequest::kDelete },
+        { "OPTIONS", HttpRequest::kOptions },
+        { "PATCH", HttpRequest::kPatch },
+    };
+    for (const MethodName &m : kMethods)
+    {
+        if (method == m.name)
+        {
+            request_.method_ = m.method;
+            break;
+        }
+    }
+    if (request_.method_ == HttpRequest::kInvalid)
+    {
+        return 501;
+    }
+
+    const char *target = space + 1;
+    space = static_cast<const char*>(::memchr(target, ' ', end - target));
+    if (space == nullptr || space == target)
+    {
+        return 400;
+    }
+    const char *question = static_cast<const char*>(::memchr(target, '?', space - target));
+    if (question)
+    {
+        request_.pathRange_ = HttpRequest::Range(target - base, question - target);
+        request_.queryRange_ = HttpRequest::Range(question + 1 - base, space - question - 1);
+    }
+    else
+    {
+        request_.pathRange_ = HttpRequest::Range(target - base, space - target);
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        return version.size() > 5 && ::memcmp(version.data(), "HTTP/", 5) == 0 ? 505 : 400;
+    }
+    return 0;
+}
+
+// field-name ":" OWS field-value OWS
+bool HttpContext::parseHeader(const char *base, const char *begin, const char *end)
+{
+    if (*begin == ' ' || *begin == '\t')
+    {
+        return false; // obs-fold，RFC 7230要求拒绝
+    }
+    const char *colon = static_cast<const char*>(::memchr(begin, ':', end - begin));
+    if (colon == nullptr || colon == begin || colon[-1] == ' ' || colon[-1] == '\t')
+    {
+        return false;
+    }
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
+    {
+        ++value;
+    }
+    const char *valueEnd = end;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+    {
+        --valueEnd;
+    }
+    HttpRequest::Header header;
+    header.name = HttpRequest::Range(begin - base, colon - begin);
+    header.value = HttpRequest::Range(value - base, valueEnd - value);
+    request_.headers_.push_back(header);
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "Buffer.h"
+#include "Timestamp.h"
+
+#include <functional>
+
+/**
+ * 每个HTTP连接一个，HttpServer创建，只在连接所属的loop线程中访问
+ * 1. 增量解析：parse每次从上次停下的位置继续找CRLF，已经扫描过的字节不再扫描；字段只记录偏移，不拷贝
+ * 2. 连接上的状态：一次onMessage里所有响应先写进output_，最后一起发送；分块响应没结束之前后面的请求先不处理
+ */
+class HttpContext : noncopyable
+{
+public:
+    enum ParseResult
+    {
+        kNeedMore,      // 请求还不完整，等更多数据
+        kGotRequest,    // request()是一个完整的请求，长度是requestLength()
+        kError,         // 请求不合法，errorStatus()是应该回的状态码，之后关闭连接
+    };
+
+    HttpContext(size_t maxHeaderSize, size_t maxBodySize);
+
+    // buf->peek()开始是一个请求  返回kGotRequest以后，处理完请求要retrieve(requestLength())再reset()
+    ParseResult parse(const Buffer *buf, Timestamp receiveTime);
+    const HttpRequest& request() const { return request_; }
+    size_t requestLength() const { return headerLength_ + request_.contentLength_; }
+    int errorStatus() const { return errorStatus_; }
+    void reset();
+
+    // 下面是HttpServer用的连接状态
+    Buffer* output() { return &output_; }
+    // 正在HttpServer::onMessage里处理请求，这时分块响应写的数据要放进output_，排在响应头后面
+    bool dispatching() const { return dispatching_; }
+    void setDispatching(bool on) { dispatching_ = on; }
+    // 有分块响应还没有finish，后面流水线过来的请求留在inputBuffer_里
+    bool streaming() const { return streaming_; }
+    void setStreaming(bool on) { streaming_ = on; }
+    // 已经决定关闭连接，之后收到的数据都丢掉
+    bool closing() const { return closing_; }
+    void setClosing() { closing_ = true; }
+    // 连接的inputBuffer_，分块响应finish以后从这里继续处理  连接存在期间地址不变
+    Buffer* input() const { return input_; }
+    void setInput(Buffer *buf) { input_ = buf; }
+    // 分块响应finish以后在loop线程中回调
+    void setResumeCallback(const std::function<void()> &cb) { resumeCallback_ = cb; }
+    const std::function<void()>& resumeCallback() const { return resumeCallback_; }
+private:
+    enum State
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+    };
+
+    int parseRequestLine(const char *base, const char *begin, const char *end);
+    bool parseHeader(const char *base, const char *begin, const char *end);
+    ParseResult fail(int status);
+
+    const size_t    maxHeaderSize_;
+    const size_t    maxBodySize_;
+    State           state_;
+    size_t          lineStart_;     // 当前行的开头
+    size_t          scanned_;       // 下一次从这个偏移开始找CRLF
+    size_t          headerLength_;  // 请求行+头部+空行的长度
+    int             errorStatus_;
+    HttpRequest     request_;
+
+    Buffer                  output_;
+    Buffer                  *input_;
+    bool                    dispatching_;
+    bool                    streaming_;
+    bool                    closing_;
+    std::function<void()>   resumeCallback_;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <stdint.h>
+#include <strings.h>
+#include <vector>
+
+/**
+ * 一个解析好的HTTP请求，所有字段都是指向连接inputBuffer_的StringPiece，不拷贝
+ * 解析过程中只保存相对请求开头的偏移，Buffer扩容搬家也没关系；交给HttpCallback之前HttpContext设置base_
+ * 只在HttpCallback里有效，回调返回以后这段数据就从Buffer里删掉了，要保存的字段自己toString
+ */
+class HttpRequest
+{
+public:
+    enum Method
+    {
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+        kOptions,
+        kPatch,
+    };
+    enum Version
+    {
+        kUnknown,
+        kHttp10,
+        kHttp11,
+    };
+
+    HttpRequest()
+        : base_(nullptr)
+        , method_(kInvalid)
+        , version_(kUnknown)
+        , contentLength_(0)
+        , keepAlive_(false)
+    {}
+
+    Method method() const { return method_; }
+    StringPiece methodString() const { return piece(methodRange_); }
+    Version version() const { return version_; }
+    // 请求行里的路径，不含'?'后面的部分
+    StringPiece path() const { return piece(pathRange_); }
+    // '?'后面的部分，没有时为空
+    StringPiece query() const { return piece(queryRange_); }
+    StringPiece body() const { return piece(bodyRange_); }
+    Timestamp receiveTime() const { return receiveTime_; }
+    // HTTP/1.1默认保持连接，除非Connection: close；HTTP/1.0要Connection: keep-alive
+    bool keepAlive() const { return keepAlive_; }
+
+    size_t headerCount() const { return headers_.size(); }
+    StringPiece headerName(size_t i) const { return piece(headers_[i].name); }
+    StringPiece headerValue(size_t i) const { return piece(headers_[i].value); }
+    // 头部名字不区分大小写，找不到返回空的StringPiece  同名的头部返回第一个
+    StringPiece getHeader(const StringPiece &name) const
+    {
+        for (const Header &h : headers_)
+        {
+            if (h.name.len == name.size() && ::strncasecmp(base_ + h.name.off, name.data(), name.size()) == 0)
+            {
+                return piece(h.value);
+            }
+        }
+        return StringPiece();
+    }
+    bool hasHeader(const StringPiece &name) const
+    {
+        for (const Header &h : headers_)
+        {
+            if (h.name.len == name.size() && ::strncasecmp(base_ + h.name.off, name.data(), name.size()) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    friend class HttpContext;
+
+    // 相对请求开头的偏移
+    struct Range
+    {
+        Range() : off(0), len(0) {}
+        Range(size_t o, size_t l) : off(static_cast<uint32_t>(o)), len(static_cast<uint32_t>(l)) {}
+        uint32_t off;
+        uint32_t len;
+    };
+    struct Header
+    {
+        Range name;
+        Range value;
+    };
+
+    StringPiece piece(const Range &r) const { return StringPiece(base_ + r.off, r.len); }
+
+    // 下一个请求复用headers_的内存
+    void reset()
+    {
+        base_ = nullptr;
+        method_ = kInvalid;
+        version_ = kUnknown;
+        methodRange_ = pathRange_ = queryRange_ = bodyRange_ = Range();
+        headers_.clear();
+        contentLength_ = 0;
+        keepAlive_ = false;
+    }
+
+    const char          *base_;
+    Method              method_;
+    Version             version_;
+    Range               methodRange_;
+    Range               pathRange_;
+    Range               queryRange_;
+    Range               bodyRange_;
+    std::vector<Header> headers_;
+    size_t              contentLength_;
+    bool                keepAlive_;
+    Timestamp           receiveTime_;
+};
@@ -0,0 +1,297 @@
+#include "HttpResponse.h"
+#include "HttpContext.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// 小的数据块和块头拼成一个string发送，大的块单独发送，不拷贝
+static const size_t kLargeChunk = 64 * 1024;
+static const char kLastChunk[] = "0\r\n\r\n";
+
+static void appendChunkHeader(std::string *out, size_t len)
+{
+    char header[32];
+    int n = ::snprintf(header, sizeof header, "%zx\r\n", len);
+    out->append(header, n);
+}
+
+static void resumeContext(const std::shared_ptr<HttpContext> &context)
+{
+    context->setStreaming(false);
+    if (context->resumeCallback())
+    {
+        context->resumeCallback()();
+    }
+}
+
+HttpStream::HttpStream(const std::weak_ptr<TcpConnection> &conn,
+                const std::shared_ptr<HttpContext> &context,
+                bool chunked,
+                bool headOnly)
+    : conn_(conn)
+    , context_(context)
+    , chunked_(chunked)
+    , headOnly_(headOnly)
+    , finished_(false)
+{
+}
+
+HttpStream::~HttpStream()
+{
+    finish();
+}
+
+bool HttpStream::appendToOutput(const TcpConnectionPtr &conn) const
+{
+    // dispatching_只在loop线程中读写，先判断线程
+    return conn->getLoop()->isInLoopThread() && context_->dispatching();
+}
+
+bool HttpStream::write(const StringPiece &data)
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (finished_ || !conn || !conn->connected())
+    {
+        return false;
+    }
+    if (headOnly_ || data.empty())
+    {
+        return true; // 空块是结束块，不能发
+    }
+    std::string chunk;
+    chunk.reserve(data.size() + 32);
+    if (chunked_)
+    {
+        appendChunkHeader(&chunk, data.size());
+    }
+    chunk.append(data.data(), data.size());
+    if (chunked_)
+    {
+        chunk.append("\r\n", 2);
+    }
+    if (appendToOutput(conn))
+    {
+        context_->output()->append(chunk.data(), chunk.size());
+    }
+    else
+    {
+        conn->send(std::move(chunk));
+    }
+    return true;
+}
+
+bool HttpStream::write(std::string &&data)
+{
+    if (data.size() < kLargeChunk)
+    {
+        return write(StringPiece(data));
+    }
+    TcpConnectionPtr conn = conn_.lock();
+    if (finished_ || !conn || !conn->connected())
+    {
+        return false;
+    }
+    if (headOnly_)
+    {
+        return true;
+    }
+    if (appendToOutput(conn))
+    {
+        // 前面的响应先发出去，保证顺序
+        conn->send(context_->output());
+    }
+    if (chunked_)
+    {
+        std::string header;
+        appendChunkHeader(&header, data.size());
+        conn->send(std::move(header));
+    }
+    conn->send(std::move(data));
+    if (chunked_)
+    {
+        conn->send(std::string("\r\n"));
+    }
+    return true;
+}
+
+bool HttpStream::write(const SlicePtr &data)
+{
+    if (data->size() < kLargeChunk)
+    {
+        return write(StringPiece(data->data(), data->size()));
+    }
+    TcpConnectionPtr conn = conn_.lock();
+    if (finished_ || !conn || !conn->connected())
+    {
+        return false;
+    }
+    if (headOnly_)
+    {
+        return true;
+    }
+    if (appendToOutput(conn))
+    {
+        conn->send(context_->output());
+    }
+    if (chunked_)
+    {
+        std::string header;
+        appendChunkHeader(&header, data->size());
+        conn->send(std::move(header));
+    }
+    conn->send(data);
+    if (chunked_)
+    {
+        conn->send(std::string("\r\n"));
+    }
+    return true;
+}
+
+void HttpStream::finish()
+{
+    if (finished_)
+    {
+        return;
+    }
+    finished_ = true;
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn)
+    {
+        return;
+    }
+    bool inDispatch = appendToOutput(conn);
+    if (chunked_ && !headOnly_)
+    {
+        if (inDispatch)
+        {
+            context_->output()->append(kLastChunk, sizeof kLastChunk - 1);
+        }
+        else
+        {
+            conn->send(std::string(kLastChunk, sizeof kLastChunk - 1));
+        }
+    }
+    if (inDispatch)
+    {
+        // 还在HttpServer::onMessage里，它会接着处理后面的请求
+        context_->setStreaming(false);
+    }
+    else
+    {
+        // 总是放进队列，不在用户的调用栈里回调下一个请求
+        conn->getLoop()->queueInLoop(std::bind(&resumeContext, context_));
+    }
+}
+
+HttpResponse::HttpResponse(bool close)
+    : statusCode_(kUnknown)
+    , closeConnection_(close)
+    , chunked_(false)
+    , http10_(false)
+    , headOnly_(false)
+{
+}
+
+HttpStreamPtr HttpResponse::startChunked()
+{
+    if (chunked_ || !context_)
+    {
+        return HttpStreamPtr();
+    }
+    chunked_ = true;
+    if (http10_)
+    {
+        closeConnection_ = true; // 没有分块编码，只能用关闭连接表示结束
+    }
+    appendHeadersToBuffer(context_->output(), 0);
+    context_->setStreaming(true);
+    return std::make_shared<HttpStream>(conn_, context_, !http10_, headOnly_);
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer *output, size_t bodyLength) const
+{
+    char buf[64];
+    int code = statusCode_ == kUnknown ? k200Ok : statusCode_;
+    int n = ::snprintf(buf, sizeof buf, "HTTP/1.1 %d ", code);
+    output->append(buf, n);
+    if (statusMessage_.empty())
+    {
+        const char *message = statusMessage(code);
+        output->append(message, ::strlen(message));
+    }
+    else
+    {
+        output->append(statusMessage_.data(), statusMessage_.size());
+    }
+    output->append("\r\n", 2);
+
+    if (closeConnection_)
+    {
+        static const char kClose[] = "Connection: close\r\n";
+        output->append(kClose, sizeof kClose - 1);
+    }
+    else if (http10_)
+    {
+        static const char kKeepAlive[] = "Connection: keep-alive\r\n";
+        output->append(kKeepAlive, sizeof kKeepAlive - 1);
+    }
+
+    if (chunked_)
+    {
+        if (!http10_)
+        {
+            static const char kChunked[] = "Transfer-Encoding: chunked\r\n";
+            output->append(kChunked, sizeof kChunked - 1);
+        }
+    }
+    else if (code >= 200 && code != k204NoContent && code != k304NotModified)
+    {
+        n = ::snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", bodyLength);
+        output->append(buf, n);
+    }
+
+    for (const auto &header : headers_)
+    {
+        output->append(header.first.data(), header.first.size());
+        output->append(": ", 2);
+        output->append(header.second.data(), header.second.size());
+        output->append("\r\n", 2);
+    }
+    output->append("\r\n", 2);
+}
+
+const char* HttpResponse::statusMessage(int code)
+{
+    switch (code)
+    {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Slice.h"
+#include "StringPiece.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Buffer;
+class HttpContext;
+
+/**
+ * 分块响应的数据流，HttpResponse::startChunked返回
+ * 可以在回调返回以后、在任意线程里继续write，最后finish  同一时间只能有一个线程使用
+ * HTTP/1.1按chunked编码发送；HTTP/1.0不支持分块，直接发送数据，finish以后关闭连接
+ * 连接断开以后write返回false  没有finish就析构时自动finish
+ */
+class HttpStream : noncopyable
+{
+public:
+    HttpStream(const std::weak_ptr<TcpConnection> &conn,
+                const std::shared_ptr<HttpContext> &context,
+                bool chunked,
+                bool headOnly);
+    ~HttpStream();
+
+    bool write(const StringPiece &data);
+    bool write(std::string &&data);
+    bool write(const SlicePtr &data);
+    // 发送结束块，之后流水线里排着的请求继续处理
+    void finish();
+    bool finished() const { return finished_; }
+private:
+    // 在回调里面调用时写进HttpContext::output_，排在响应头后面；否则直接交给连接发送
+    bool appendToOutput(const TcpConnectionPtr &conn) const;
+
+    std::weak_ptr<TcpConnection> conn_;
+    std::shared_ptr<HttpContext> context_;
+    const bool chunked_;
+    const bool headOnly_;     // HEAD请求，只有响应头，数据都丢掉
+    bool finished_;
+};
+
+using HttpStreamPtr = std::shared_ptr<HttpStream>;
+
+/**
+ * HttpCallback填写的响应  HttpServer负责加上Content-Length、Connection，和同一批请求的其它响应一起发送
+ */
+class HttpResponse : noncopyable
+{
+public:
+    enum StatusCode
+    {
+        kUnknown = 0,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k302Found = 302,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k403Forbidden = 403,
+        k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k413PayloadTooLarge = 413,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+        k503ServiceUnavailable = 503,
+        k505VersionNotSupported = 505,
+    };
+
+    explicit HttpResponse(bool close);
+
+    void setStatusCode(int code) { statusCode_ = code; }
+    int statusCode() const { return statusCode_; }
+    // 不设置时用标准的原因短语
+    void setStatusMessage(const std::string &message) { statusMessage_ = message; }
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+    void setContentType(const std::string &contentType) { addHeader("Content-Type", contentType); }
+    // Content-Length、Transfer-Encoding、Connection由HttpServer生成，不要自己加
+    void addHeader(const std::string &name, const std::string &value) { headers_.emplace_back(name, value); }
+
+    void setBody(const StringPiece &body) { body_.assign(body.data(), body.size()); bodySlice_.reset(); }
+    void setBody(std::string &&body) { body_ = std::move(body); bodySlice_.reset(); }
+    // 共享同一份数据，适合很多连接返回同一个静态内容
+    void setBody(const SlicePtr &body) { body_.clear(); bodySlice_ = body; }
+    size_t bodySize() const { return bodySlice_ ? bodySlice_->size() : body_.size(); }
+
+    // 改成分块响应：马上写出响应头，之后的数据通过返回的HttpStream发送，setBody不再起作用
+    // 只能在HttpCallback里调用一次，调用之后再改状态码和头部没有用  stream没有finish之前，同一个连接上后面的请求先不处理
+    HttpStreamPtr startChunked();
+    bool chunked() const { return chunked_; }
+
+    static const char* statusMessage(int code);
+private:
+    friend class HttpServer;
+
+    // 状态行和头部，bodyLength为Content-Length  chunked时写Transfer-Encoding
+    void appendHeadersToBuffer(Buffer *output, size_t bodyLength) const;
+
+    int                 statusCode_;
+    std::string         statusMessage_;
+    bool                closeConnection_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string         body_;
+    SlicePtr            bodySlice_;
+    bool                chunked_;
+
+    // HttpServer在回调之前设置
+    std::weak_ptr<TcpConnection> conn_;
+    std::shared_ptr<HttpContext> context_;
+    bool                http10_;
+    bool                headOnly_;
+};
@@ -0,0 +1,172 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+
+const size_t HttpServer::kDefaultMaxHeaderSize;
+const size_t HttpServer::kDefaultMaxBodySize;
+
+// 比这个大的响应体不拷贝进合并发送的Buffer，先把前面的响应发出去，再单独发送
+static const size_t kLargeBody = 64 * 1024;
+
+static void defaultHttpCallback(const HttpRequest&, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k404NotFound);
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &name,
+                TcpServer::Option option)
+    : server_(loop, listenAddr, name, option)
+    , httpCallback_(defaultHttpCallback)
+    , maxHeaderSize_(kDefaultMaxHeaderSize)
+    , maxBodySize_(kDefaultMaxBodySize)
+{
+    server_.setConnectionCallback(
+        std::bind(&HttpServer::onConnection, this, std::placeholders::_1)
+    );
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+    // 每个连接的解析状态绑定在它自己的MessageCallback里，随连接一起销毁
+    std::shared_ptr<HttpContext> context = std::make_shared<HttpContext>(maxHeaderSize_, maxBodySize_);
+    context->setResumeCallback(std::bind(&HttpServer::onResume, this,
+        std::weak_ptr<TcpConnection>(conn), std::weak_ptr<HttpContext>(context)));
+    conn->setMessageCallback(std::bind(&HttpServer::onMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, context));
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn,
+                Buffer *buf,
+                Timestamp receiveTime,
+                const std::shared_ptr<HttpContext> &context)
+{
+    if (context->closing())
+    {
+        buf->retrieveAll();
+        return;
+    }
+    if (context->streaming())
+    {
+        return; // 分块响应还没结束，后面的请求留在buf里
+    }
+    context->setInput(buf);
+    processRequests(conn, context, buf, receiveTime);
+}
+
+void HttpServer::onResume(const std::weak_ptr<TcpConnection> &weakConn, const std::weak_ptr<HttpContext> &weakContext)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    std::shared_ptr<HttpContext> context = weakContext.lock();
+    if (!conn || !context || !conn->connected() || context->streaming())
+    {
+        return;
+    }
+    if (context->closing())
+    {
+        conn->shutdown();
+        return;
+    }
+    if (context->input() != nullptr)
+    {
+        processRequests(conn, context, context->input(), conn->getLoop()->pollReturnTime());
+    }
+}
+
+void HttpServer::processRequests(const TcpConnectionPtr &conn,
+                const std::shared_ptr<HttpContext> &context,
+                Buffer *buf,
+                Timestamp receiveTime)
+{
+    context->setDispatching(true);
+    while (!context->streaming() && !context->closing())
+    {
+        HttpContext::ParseResult result = context->parse(buf, receiveTime);
+        if (result == HttpContext::kNeedMore)
+        {
+            break;
+        }
+        if (result == HttpContext::kError)
+        {
+            LOG_DEBUG("HttpServer [%s] bad request from %s, status %d \n",
+                conn->name().c_str(), conn->peerAddress().toIpPort().c_str(), context->errorStatus());
+            HttpResponse response(true);
+            response.setStatusCode(context->errorStatus());
+            response.appendHeadersToBuffer(context->output(), 0);
+            context->setClosing();
+            break;
+        }
+        handleRequest(conn, context);
+        buf->retrieve(context->requestLength());
+        context->reset();
+    }
+    if (context->closing())
+    {
+        buf->retrieveAll();
+    }
+    context->setDispatching(false);
+
+    if (context->output()->readableBytes() > 0)
+    {
+        conn->send(context->output());
+    }
+    if (context->closing() && !context->streaming())
+    {
+        conn->shutdown();
+    }
+}
+
+void HttpServer::handleRequest(const TcpConnectionPtr &conn, const std::shared_ptr<HttpContext> &context)
+{
+    const HttpRequest &req = context->request();
+    HttpResponse response(!req.keepAlive());
+    response.conn_ = conn;
+    response.context_ = context;
+    response.http10_ = req.version() == HttpRequest::kHttp10;
+    response.headOnly_ = req.method() == HttpRequest::kHead;
+
+    httpCallback_(req, &response);
+
+    if (response.closeConnection())
+    {
+        context->setClosing();
+    }
+    if (response.chunked())
+    {
+        return; // 响应头已经写进output，数据由HttpStream发送
+    }
+
+    size_t bodyLength = response.bodySize();
+    response.appendHeadersToBuffer(context->output(), bodyLength);
+    int code = response.statusCode();
+    if (bodyLength == 0 || response.headOnly_ || (code >= 100 && code < 200)
+        || code == HttpResponse::k204NoContent || code == HttpResponse::k304NotModified)
+    {
+        return;
+    }
+    if (bodyLength >= kLargeBody)
+    {
+        conn->send(context->output());
+        if (response.bodySlice_)
+        {
+            conn->send(response.bodySlice_);
+        }
+        else
+        {
+            conn->send(std::move(response.body_));
+        }
+    }
+    else if (response.bodySlice_)
+    {
+        context->output()->append(response.bodySlice_->data(), bodyLength);
+    }
+    else
+    {
+        context->output()->append(response.body_.data(), bodyLength);
+    }
+}
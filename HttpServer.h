@@ -0,0 +1,65 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+class HttpContext;
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器
+ * 1. 请求在连接的inputBuffer_里增量解析，HttpRequest的字段直接指向Buffer，不拷贝
+ * 2. 长连接和流水线：一次onMessage里收到的所有请求依次回调，响应按顺序写进同一个Buffer，最后一起发送，
+ *    一批请求只有一次write
+ * 3. 分块响应见HttpResponse::startChunked，可以在回调返回以后在其它线程继续发送
+ * 4. 请求有错误时回复对应的4xx/5xx，然后关闭连接；不支持分块编码的请求体
+ */
+class HttpServer : noncopyable
+{
+public:
+    // 在连接所属的loop线程中回调，req只在回调里有效
+    using HttpCallback = std::function<void(const HttpRequest&, HttpResponse*)>;
+
+    static const size_t kDefaultMaxHeaderSize = 64 * 1024;
+    static const size_t kDefaultMaxBodySize = 8 * 1024 * 1024;
+
+    HttpServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &name,
+                TcpServer::Option option = TcpServer::kNoReusePort);
+
+    // 线程数、空闲超时、边沿触发等直接在TcpServer上设置  不要修改它的ConnectionCallback和MessageCallback
+    TcpServer* server() { return &server_; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 没有设置时所有请求都回复404
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    // 请求行加头部超过maxHeaderSize回复431，Content-Length超过maxBodySize回复413  必须在start之前调用
+    void setMaxHeaderSize(size_t size) { maxHeaderSize_ = size; }
+    void setMaxBodySize(size_t size) { maxBodySize_ = size; }
+
+    void start() { server_.start(); }
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn,
+                Buffer *buf,
+                Timestamp receiveTime,
+                const std::shared_ptr<HttpContext> &context);
+    // 分块响应finish以后，在loop线程中继续处理流水线里排着的请求
+    void onResume(const std::weak_ptr<TcpConnection> &weakConn, const std::weak_ptr<HttpContext> &weakContext);
+    // 处理buf里所有完整的请求，响应一起发送
+    void processRequests(const TcpConnectionPtr &conn,
+                const std::shared_ptr<HttpContext> &context,
+                Buffer *buf,
+                Timestamp receiveTime);
+    void handleRequest(const TcpConnectionPtr &conn, const std::shared_ptr<HttpContext> &context);
+
+    TcpServer       server_;
+    HttpCallback    httpCallback_;
+    size_t          maxHeaderSize_;
+    size_t          maxBodySize_;
+};
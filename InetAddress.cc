@@ -2,27 +2,102 @@
 
 #include <strings.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    bzero(&addr_, sizeof addr_);
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);
-    addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    bzero(&addr_un_, sizeof addr_un_);
+    if (ip.find(':') != std::string::npos)
+    {
+        addr6_.sin6_family = AF_INET6;
+        addr6_.sin6_port = htons(port);
+        ::inet_pton(AF_INET6, ip.c_str(), &addr6_.sin6_addr);
+        len_ = sizeof addr6_;
+    }
+    else
+    {
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(port);
+        addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+        len_ = sizeof addr_;
+    }
+}
+
+InetAddress InetAddress::unixPath(const std::string &path)
+{
+    InetAddress addr;
+    bzero(&addr.addr_un_, sizeof addr.addr_un_);
+    addr.addr_un_.sun_family = AF_UNIX;
+    size_t len = std::min(path.size(), sizeof addr.addr_un_.sun_path - 1);
+    memcpy(addr.addr_un_.sun_path, path.data(), len);
+    addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len + 1);
+    return addr;
+}
+
+InetAddress InetAddress::unixAbstract(const std::string &name)
+{
+    InetAddress addr;
+    bzero(&addr.addr_un_, sizeof addr.addr_un_);
+    addr.addr_un_.sun_family = AF_UNIX;
+    // 抽象地址以'\0'开头，长度就是名字的长度，不需要结尾的'\0'
+    size_t len = std::min(name.size(), sizeof addr.addr_un_.sun_path - 1);
+    memcpy(addr.addr_un_.sun_path + 1, name.data(), len);
+    addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + len);
+    return addr;
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len)
+{
+    bzero(&addr_un_, sizeof addr_un_);
+    len_ = std::min<socklen_t>(len, sizeof addr_un_);
+    memcpy(&addr_un_, addr, len_);
 }
 
 std::string InetAddress::toIp() const
 {
     // addr_
     char buf[64] = {0};
+    if (family() == AF_INET6)
+    {
+        ::inet_ntop(AF_INET6, &addr6_.sin6_addr, buf, sizeof buf);
+        return buf;
+    }
+    if (isUnix())
+    {
+        size_t pathLen = len_ > offsetof(sockaddr_un, sun_path) ? len_ - offsetof(sockaddr_un, sun_path) : 0;
+        if (pathLen == 0)
+        {
+            return std::string();
+        }
+        if (addr_un_.sun_path[0] == '\0')
+        {
+            return "@" + std::string(addr_un_.sun_path + 1, pathLen - 1);
+        }
+        return std::string(addr_un_.sun_path, strnlen(addr_un_.sun_path, pathLen));
+    }
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     return buf;
 }
 
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        std::string path = toIp();
+        return path.empty() ? "unix" : path;
+    }
     // ip:port
-    char buf[64] = {0};
+    char buf[80] = {0};
+    if (family() == AF_INET6)
+    {
+        buf[0] = '[';
+        ::inet_ntop(AF_INET6, &addr6_.sin6_addr, buf + 1, sizeof buf - 1);
+        size_t end = strlen(buf);
+        snprintf(buf + end, sizeof buf - end, "]:%u", ntohs(addr6_.sin6_port));
+        return buf;
+    }
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
     size_t end = strlen(buf);
     uint16_t port = ntohs(addr_.sin_port);
@@ -32,6 +107,11 @@ std::string InetAddress::toIpPort() const
 
 uint16_t InetAddress::toPort() const
 {
+    if (isUnix())
+    {
+        return 0;
+    }
+    // sin_port和sin6_port的位置相同
     return ntohs(addr_.sin_port);
 }
 
@@ -42,4 +122,4 @@ uint16_t InetAddress::toPort() const
 //     std::cout << addr.toIpPort() << std::endl;
 
 //     return 0;
-// }
\ No newline at end of file
+// }
@@ -2,23 +2,46 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-// 封装socket地址类型
+// 封装socket地址类型  IPv4、IPv6，以及AF_UNIX（文件路径或者Linux的抽象命名空间）
 class InetAddress
 {
 public:
+    // ip里有':'时按IPv6解析
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
     explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
-    {}
+    { setSockAddr(addr); }
+    explicit InetAddress(const sockaddr_in6 &addr)
+    { setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr); }
 
+    // AF_UNIX地址  path是文件系统里的路径；abstract的name不在文件系统里，进程退出后自动消失，不需要unlink
+    static InetAddress unixPath(const std::string &path);
+    static InetAddress unixAbstract(const std::string &name);
+
+    sa_family_t family() const { return addr_.sin_family; }
+    bool isUnix() const { return family() == AF_UNIX; }
+    bool isAbstract() const { return isUnix() && len_ > sizeof(sa_family_t) && addr_un_.sun_path[0] == '\0'; }
+
+    // AF_UNIX时：文件路径，抽象地址是"@name"，对端没有绑定地址时为空
     std::string toIp() const;
+    // AF_UNIX时和toIp一样，没有绑定地址时为"unix"；IPv6是[ip]:port
     std::string toIpPort() const;
     uint16_t toPort() const;
 
-    const sockaddr_in* getSockAddr() const {return &addr_;}
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+    const sockaddr* getSockAddr() const { return reinterpret_cast<const sockaddr*>(&addr6_); }
+    socklen_t length() const { return len_; }
+    void setSockAddr(const sockaddr_in &addr) { setSockAddr(reinterpret_cast<const sockaddr*>(&addr), sizeof addr); }
+    // 长度是accept/getsockname等返回的长度，AF_UNIX地址要用它确定路径的长度
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr_in     addr_;
+        sockaddr_in6    addr6_;
+        sockaddr_un     addr_un_;
+    };
+    socklen_t len_;
+};
@@ -0,0 +1,675 @@
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+
+// channel未添加到poller中
+static const int kNew = -1;
+// channel已添加到poller中
+static const int kAdded = 1;
+// channel添加过，但是现在没有关心的事件
+static const int kDeleted = 2;
+
+// readiness的user_data：最高位为1，中间是注册的代数，低32位是fd
+// 完成操作的user_data：Op的地址  0：不关心结果的取消请求
+static const uint64_t kPollTag = 1ULL << 63;
+
+static uint64_t encodePoll(int fd, uint32_t generation)
+{
+    return kPollTag
+        | (static_cast<uint64_t>(generation & 0x7fffffff) << 32)
+        | static_cast<uint32_t>(fd);
+}
+
+static int sysSetup(unsigned entries, struct io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+IoUringPoller* IoUringPoller::create(EventLoop *loop, bool enableCompletion)
+{
+    IoUringPoller *poller = new IoUringPoller(loop);
+    if (!poller->setupRing())
+    {
+        delete poller;
+        return nullptr;
+    }
+    if (enableCompletion)
+    {
+        poller->completionEnabled_ = poller->setupRecvBuffers();
+    }
+    return poller;
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringFd_(-1)
+    , completionEnabled_(false)
+    , sqRing_(MAP_FAILED)
+    , sqRingSize_(0)
+    , cqRing_(MAP_FAILED)
+    , cqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqHead_(nullptr)
+    , sqTail_(nullptr)
+    , sqArray_(nullptr)
+    , sqMask_(0)
+    , sqEntries_(0)
+    , sqLocalTail_(0)
+    , cqHead_(nullptr)
+    , cqTail_(nullptr)
+    , cqMask_(0)
+    , cqes_(nullptr)
+    , recvBuffers_(nullptr)
+    , nextGeneration_(0)
+{
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    if (ringFd_ >= 0)
+    {
+        // 先取消所有还在内核中的操作，等它们结束，之后才能释放tie和缓冲区
+        for (auto &item : ops_)
+        {
+            Op *op = item.second;
+            op->cancelled = true;
+            struct io_uring_sqe *sqe = getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(op);
+            sqe->user_data = 0;
+        }
+        for (int round = 0; !ops_.empty() && round < 100; ++round)
+        {
+            enter(1, 10);
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            completions_.clear();
+            for (; head != tail; ++head)
+            {
+                completions_.push_back(cqes_[head & cqMask_]);
+            }
+            __atomic_store_n(cqHead_, tail, __ATOMIC_RELEASE);
+            for (const struct io_uring_cqe &cqe : completions_)
+            {
+                if (cqe.user_data != 0 && !(cqe.user_data & kPollTag))
+                {
+                    handleOpCompletion(cqe, Timestamp::now());
+                }
+            }
+        }
+        if (!ops_.empty())
+        {
+            // 内核可能还在使用这些操作的数据，宁可泄漏也不能释放
+            LOG_ERROR("IoUringPoller::~IoUringPoller %lu operations still in flight\n", ops_.size());
+        }
+        ::close(ringFd_);
+    }
+
+    if (recvBuffers_)
+    {
+        ::munmap(recvBuffers_, kRecvBufferCount * kRecvBufferSize);
+    }
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+    }
+}
+
+bool IoUringPoller::setupRing()
+{
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof params);
+    // 只有loop线程提交，完成事件也只在io_uring_enter里处理
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN
+                 | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = kEntries * kCqFactor;
+    ringFd_ = sysSetup(kEntries, &params);
+    if (ringFd_ < 0 && errno == EINVAL)
+    {
+        // 老内核不认识后面这些flag
+        ::memset(&params, 0, sizeof params);
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = kEntries * kCqFactor;
+        ringFd_ = sysSetup(kEntries, &params);
+    }
+    if (ringFd_ < 0)
+    {
+        LOG_ERROR("io_uring_setup error:%d \n", errno);
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        // poll的超时依赖IORING_ENTER_EXT_ARG
+        LOG_ERROR("io_uring does not support IORING_FEAT_EXT_ARG \n");
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sq ring error:%d \n", errno);
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_ERROR("io_uring mmap cq ring error:%d \n", errno);
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d \n", errno);
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool IoUringPoller::setupRecvBuffers()
+{
+    void *buffers = ::mmap(nullptr, kRecvBufferCount * kRecvBufferSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap recv buffers error:%d \n", errno);
+        return false;
+    }
+    recvBuffers_ = static_cast<char*>(buffers);
+
+    // 一次把所有缓冲区交给内核，等结果出来才知道内核是否支持
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = kRecvBufferCount;
+    sqe->addr = reinterpret_cast<uint64_t>(recvBuffers_);
+    sqe->len = kRecvBufferSize;
+    sqe->off = 0;
+    sqe->buf_group = kRecvBufferGroup;
+    sqe->user_data = 0;
+    enter(1, 1000);
+
+    int res = -ETIME;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if (head != tail)
+    {
+        res = cqes_[head & cqMask_].res;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    }
+    if (res < 0)
+    {
+        LOG_ERROR("io_uring provide buffers error:%d, completion io disabled \n", -res);
+        return false;
+    }
+    return true;
+}
+
+// 把bid对应的缓冲区还给内核  和下一次poll一起提交，不需要单独的系统调用
+void IoUringPoller::recycleRecvBuffer(unsigned short bid)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<uint64_t>(recvBuffers_ + static_cast<size_t>(bid) * kRecvBufferSize);
+    sqe->len = kRecvBufferSize;
+    sqe->off = bid;
+    sqe->buf_group = kRecvBufferGroup;
+    sqe->user_data = 0;
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_)
+    {
+        // SQ满了，先把已经填好的提交给内核
+        enter(0, 0);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head >= sqEntries_)
+        {
+            LOG_FATAL("io_uring submission queue is full, errno:%d \n", errno);
+        }
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    return sqe;
+}
+
+// 提交所有填好的sqe，并且等待至少minComplete个完成事件  timeoutMs < 0表示一直等待
+int IoUringPoller::enter(unsigned minComplete, int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+
+    struct io_uring_getevents_arg arg;
+    ::memset(&arg, 0, sizeof arg);
+    if (timeoutMs >= 0)
+    {
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    return sysEnter(ringFd_, toSubmit, minComplete, flags, &arg, sizeof arg);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+
+    // 上一轮返回的channel和events改变了的channel，在这里按照当前的events重新注册
+    flushDirty();
+
+    int ret = enter(1, timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+    {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() err!");
+    }
+
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    completions_.clear();
+    for (; head != tail; ++head)
+    {
+        completions_.push_back(cqes_[head & cqMask_]);
+    }
+    // 先把cqe拷贝出来，回调里面可能会再提交新的请求
+    __atomic_store_n(cqHead_, tail, __ATOMIC_RELEASE);
+
+    LOG_DEBUG("%lu completions \n", completions_.size());
+    for (const struct io_uring_cqe &cqe : completions_)
+    {
+        if (cqe.user_data == 0)
+        {
+            continue;
+        }
+        if (cqe.user_data & kPollTag)
+        {
+            handlePollCompletion(cqe, activeChannels);
+        }
+        else
+        {
+            handleOpCompletion(cqe, now);
+        }
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_DEBUG("func[%s] => fd[%d] events[%d] index[%d] \n", __FUNCTION__, fd, channel->events(), index);
+
+    if (index == kNew)
+    {
+        channels_.insert(fd, channel);
+        PollEntry &entry = polls_[fd];
+        entry.channel = channel;
+        entry.generation = 0;
+        entry.armedEvents = 0;
+        entry.armed = false;
+        entry.dirty = false;
+        markDirty(entry, fd);
+    }
+    else
+    {
+        PollMap::iterator it = polls_.find(fd);
+        if (it != polls_.end())
+        {
+            markDirty(it->second, fd);
+        }
+    }
+    channel->set_index(channel->isNoneEvent() ? kDeleted : kAdded);
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    PollMap::iterator it = polls_.find(fd);
+    if (it != polls_.end())
+    {
+        disarmPoll(it->second);
+        polls_.erase(it);
+    }
+    channel->set_index(kNew);
+}
+
+void IoUringPoller::markDirty(PollEntry &entry, int fd)
+{
+    if (!entry.dirty)
+    {
+        entry.dirty = true;
+        dirtyFds_.push_back(fd);
+    }
+}
+
+void IoUringPoller::flushDirty()
+{
+    for (int fd : dirtyFds_)
+    {
+        PollMap::iterator it = polls_.find(fd);
+        if (it == polls_.end() || !it->second.dirty)
+        {
+            continue;   // 已经被remove了，或者是重复的
+        }
+        PollEntry &entry = it->second;
+        entry.dirty = false;
+        int events = entry.channel->events();
+        if (entry.armed && entry.armedEvents == events)
+        {
+            continue;
+        }
+        disarmPoll(entry);
+        if (events != 0)
+        {
+            armPoll(entry, fd);
+        }
+    }
+    dirtyFds_.clear();
+}
+
+// 单次的POLL_ADD，注册时内核会先检查一次当前的状态，所以和LT模式一样不会丢事件
+void IoUringPoller::armPoll(PollEntry &entry, int fd)
+{
+    entry.generation = ++nextGeneration_;
+    entry.armedEvents = entry.channel->events();
+    entry.armed = true;
+
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<uint32_t>(entry.armedEvents); // EPOLLIN/EPOLLOUT等和POLLIN/POLLOUT的值相同
+    sqe->user_data = encodePoll(fd, entry.generation);
+}
+
+void IoUringPoller::disarmPoll(PollEntry &entry)
+{
+    if (!entry.armed)
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encodePoll(entry.channel->fd(), entry.generation);
+    sqe->user_data = 0;
+    entry.armed = false;
+    entry.generation = ++nextGeneration_; // 之后再收到原来那次注册的完成事件直接丢弃
+}
+
+void IoUringPoller::handlePollCompletion(const struct io_uring_cqe &cqe, ChannelList *activeChannels)
+{
+    int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>((cqe.user_data >> 32) & 0x7fffffff);
+    PollMap::iterator it = polls_.find(fd);
+    if (it == polls_.end() || (it->second.generation & 0x7fffffff) != generation)
+    {
+        return; // 已经取消或者重新注册过了
+    }
+    PollEntry &entry = it->second;
+    entry.armed = false;
+
+    if (cqe.res >= 0)
+    {
+        entry.channel->set_revents(cqe.res);
+        activeChannels->push_back(entry.channel);
+        markDirty(entry, fd);
+    }
+    else if (cqe.res == -ECANCELED)
+    {
+        markDirty(entry, fd);
+    }
+    else
+    {
+        errno = -cqe.res;
+        LOG_ERROR("IoUringPoller poll fd=%d error:%d \n", fd, -cqe.res);
+    }
+}
+
+void IoUringPoller::startRecv(Channel *channel, const std::shared_ptr<void> &tie, RecvCallback cb)
+{
+    Op *op = new Op;
+    op->type = Op::kRecv;
+    op->fd = channel->fd();
+    op->cancelled = false;
+    op->tie = tie;
+    op->recvCallback = std::move(cb);
+    ops_.insert(std::make_pair(op->fd, op));
+    submitOp(op);
+}
+
+void IoUringPoller::sendv(Channel *channel, const struct iovec *iov, int iovcnt,
+                          const std::shared_ptr<void> &tie, SendCallback cb)
+{
+    Op *op = new Op;
+    op->type = Op::kSend;
+    op->fd = channel->fd();
+    op->cancelled = false;
+    op->tie = tie;
+    op->sendCallback = std::move(cb);
+    op->iov.assign(iov, iov + iovcnt);
+    ::memset(&op->msg, 0, sizeof op->msg);
+    op->msg.msg_iov = op->iov.data();
+    op->msg.msg_iovlen = op->iov.size();
+    ops_.insert(std::make_pair(op->fd, op));
+    submitOp(op);
+}
+
+void IoUringPoller::startAccept(Channel *channel, AcceptCallback cb)
+{
+    Op *op = new Op;
+    op->type = Op::kAccept;
+    op->fd = channel->fd();
+    op->cancelled = false;
+    op->acceptCallback = std::move(cb);
+    ops_.insert(std::make_pair(op->fd, op));
+    submitOp(op);
+}
+
+void IoUringPoller::cancel(Channel *channel)
+{
+    auto range = ops_.equal_range(channel->fd());
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        Op *op = it->second;
+        if (op->cancelled)
+        {
+            continue;
+        }
+        // 回调可能正在执行，这里只做标记，Op在最后一个完成事件到来时释放
+        op->cancelled = true;
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(op);
+        sqe->user_data = 0;
+    }
+}
+
+void IoUringPoller::submitOp(Op *op)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->fd = op->fd;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+    switch (op->type)
+    {
+    case Op::kRecv:
+        // 由内核从缓冲区环里挑一块，一次注册持续接收
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kRecvBufferGroup;
+        break;
+    case Op::kSend:
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case Op::kAccept:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        break;
+    }
+}
+
+void IoUringPoller::finishOp(Op *op)
+{
+    auto range = ops_.equal_range(op->fd);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == op)
+        {
+            ops_.erase(it);
+            break;
+        }
+    }
+    delete op; // 这里才释放tie
+}
+
+void IoUringPoller::handleOpCompletion(const struct io_uring_cqe &cqe, Timestamp now)
+{
+    Op *op = reinterpret_cast<Op*>(cqe.user_data);
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+    const int res = cqe.res;
+
+    switch (op->type)
+    {
+    case Op::kRecv:
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+        {
+            unsigned short bid = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (!op->cancelled && res > 0)
+            {
+                op->recvCallback(recvBuffers_ + static_cast<size_t>(bid) * kRecvBufferSize, res, now);
+            }
+            recycleRecvBuffer(bid);
+        }
+        else if (!op->cancelled && res != -ENOBUFS && res != -ECANCELED)
+        {
+            op->recvCallback(nullptr, res, now); // 对端关闭或者出错
+        }
+        if (!more)
+        {
+            // 缓冲区暂时用完了，或者内核因为其它原因结束了multishot，重新开始接收
+            if (!op->cancelled && (res > 0 || res == -ENOBUFS))
+            {
+                submitOp(op);
+            }
+            else
+            {
+                finishOp(op);
+            }
+        }
+        break;
+    case Op::kSend:
+        if (!op->cancelled)
+        {
+            op->sendCallback(res);
+        }
+        finishOp(op);
+        break;
+    case Op::kAccept:
+        if (op->cancelled)
+        {
+            if (res >= 0)
+            {
+                ::close(res);
+            }
+        }
+        else
+        {
+            op->acceptCallback(res);
+        }
+        if (!more)
+        {
+            // 内核先分配fd再取连接，EMFILE/ENFILE时没有等待的连接也会马上失败，重新提交就是空转
+            // 这两种错误和监听socket本身有问题时都不再accept，由调用者决定怎么继续
+            if (!op->cancelled && res != -EINVAL && res != -EBADF && res != -ENOTSOCK
+                && res != -EMFILE && res != -ENFILE)
+            {
+                submitOp(op);
+            }
+            else
+            {
+                finishOp(op);
+            }
+        }
+        break;
+    }
+}
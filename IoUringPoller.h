@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Poller.h"
+#include "CompletionIo.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+class Channel;
+
+/**
+ * 基于io_uring的Poller  直接使用系统调用，不依赖liburing
+ * readiness：每个channel一个单次的POLL_ADD，事件返回以后在下一次poll时按照channel当前的events重新注册，
+ *            所有的注册和等待合并在一次io_uring_enter里，语义和LT模式的epoll一样
+ * completion：实现CompletionIo，multishot recv使用预先交给内核的一组缓冲区（IORING_OP_PROVIDE_BUFFERS），
+ *            sendmsg和multishot accept也由内核完成，省掉每个事件的readv/write/accept系统调用
+ *
+ * 环境变量MUDUO_USE_URING打开，值为poll时只用readiness
+ */
+class IoUringPoller : public Poller, public CompletionIo
+{
+public:
+    // 创建失败（内核不支持、没有权限）返回nullptr
+    static IoUringPoller* create(EventLoop *loop, bool enableCompletion);
+    ~IoUringPoller() override;
+
+    // 重写基类Poller的抽象方法
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+    CompletionIo* completionIo() override { return completionEnabled_ ? this : nullptr; }
+
+    // CompletionIo
+    void startRecv(Channel *channel, const std::shared_ptr<void> &tie, RecvCallback cb) override;
+    void sendv(Channel *channel, const struct iovec *iov, int iovcnt,
+               const std::shared_ptr<void> &tie, SendCallback cb) override;
+    void startAccept(Channel *channel, AcceptCallback cb) override;
+    void cancel(Channel *channel) override;
+
+private:
+    static const unsigned kEntries = 256;               // SQ的大小，CQ是它的kCqFactor倍
+    static const unsigned kCqFactor = 8;
+    static const unsigned kRecvBufferCount = 128;       // recv缓冲区的个数
+    static const unsigned kRecvBufferSize = 16 * 1024;
+    static const unsigned short kRecvBufferGroup = 0;
+
+    // 每个fd的readiness注册状态
+    struct PollEntry
+    {
+        Channel     *channel;
+        uint32_t    generation;     // 每次注册/取消都换一个新值，用来丢弃过期的完成事件
+        int         armedEvents;
+        bool        armed;
+        bool        dirty;          // 在dirtyFds_中，下一次poll时重新注册
+    };
+
+    // 一个在内核中执行的完成操作
+    struct Op
+    {
+        enum Type { kRecv, kSend, kAccept };
+
+        Type                    type;
+        int                     fd;
+        bool                    cancelled;
+        std::shared_ptr<void>   tie;
+        RecvCallback            recvCallback;
+        SendCallback            sendCallback;
+        AcceptCallback          acceptCallback;
+        std::vector<iovec>      iov;
+        struct msghdr           msg;
+    };
+
+    explicit IoUringPoller(EventLoop *loop);
+    bool setupRing();
+    bool setupRecvBuffers();
+
+    struct io_uring_sqe* getSqe();
+    int enter(unsigned minComplete, int timeoutMs);
+
+    void markDirty(PollEntry &entry, int fd);
+    void flushDirty();
+    void armPoll(PollEntry &entry, int fd);
+    void disarmPoll(PollEntry &entry);
+
+    void submitOp(Op *op);
+    void finishOp(Op *op);
+    void handlePollCompletion(const struct io_uring_cqe &cqe, ChannelList *activeChannels);
+    void handleOpCompletion(const struct io_uring_cqe &cqe, Timestamp now);
+    void recycleRecvBuffer(unsigned short bid);
+
+    int                 ringFd_;
+    bool                completionEnabled_;
+
+    // SQ/CQ共享内存
+    void                *sqRing_;
+    size_t              sqRingSize_;
+    void                *cqRing_;
+    size_t              cqRingSize_;
+    struct io_uring_sqe *sqes_;
+    size_t              sqesSize_;
+    unsigned            *sqHead_;
+    unsigned            *sqTail_;
+    unsigned            *sqArray_;
+    unsigned            sqMask_;
+    unsigned            sqEntries_;
+    unsigned            sqLocalTail_;   // 已经填好还没有交给内核的sqe，publish时写入sqTail_
+    unsigned            *cqHead_;
+    unsigned            *cqTail_;
+    unsigned            cqMask_;
+    struct io_uring_cqe *cqes_;
+
+    // recv用的缓冲区，kRecvBufferCount块，每块kRecvBufferSize
+    char                *recvBuffers_;
+
+    uint32_t            nextGeneration_;
+
+    using PollMap = std::unordered_map<int, PollEntry>;
+    using OpMap = std::unordered_multimap<int, Op*>;
+    PollMap             polls_;
+    std::vector<int>    dirtyFds_;
+    OpMap               ops_;           // fd => 这个fd上正在执行的完成操作
+    std::vector<struct io_uring_cqe> completions_;
+};
@@ -0,0 +1,57 @@
+#include "LengthHeaderCodec.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <endian.h>
+#include <string.h>
+
+const size_t LengthHeaderCodec::kHeaderLen;
+const size_t LengthHeaderCodec::kDefaultMaxFrameSize;
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) const
+{
+    // 用一个游标往后走，所有帧处理完以后再retrieve，中间不移动readerIndex_
+    const char *data = buf->peek();
+    size_t readable = buf->readableBytes();
+    size_t consumed = 0;
+    while (readable - consumed >= kHeaderLen)
+    {
+        uint32_t be;
+        ::memcpy(&be, data + consumed, sizeof be);
+        int32_t len = static_cast<int32_t>(be32toh(be));
+        if (len < 0 || static_cast<size_t>(len) > maxFrameSize_)
+        {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] - invalid frame length %d\n", conn->name().c_str(), len);
+            buf->retrieveAll();
+            conn->forceClose();
+            return;
+        }
+        if (readable - consumed < kHeaderLen + static_cast<size_t>(len))
+        {
+            break; // 帧还没有收全，等下一次回调
+        }
+        frameCallback_(conn, StringPiece(data + consumed + kHeaderLen, static_cast<size_t>(len)), receiveTime);
+        consumed += kHeaderLen + static_cast<size_t>(len);
+    }
+    buf->retrieve(consumed);
+}
+
+void LengthHeaderCodec::finishFrame(Buffer *buf)
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const StringPiece &message) const
+{
+    Buffer buf(message.size());
+    buf.append(message.data(), message.size());
+    finishFrame(&buf);
+    conn->send(&buf);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf) const
+{
+    finishFrame(buf);
+    conn->send(buf);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <stdint.h>
+#include <functional>
+
+/**
+ * 4字节长度头（网络字节序，不含头本身）+ 消息体的分帧
+ * 收：作为TcpConnection的messageCallback，一次回调里把inputBuffer_中所有完整的帧依次交给frameCallback_，
+ *     帧是指向inputBuffer_的StringPiece，不拷贝，只在回调里有效；最后一次retrieve掉所有处理过的帧
+ * 发：消息体先写进Buffer，finishFrame把长度头写进Buffer前面预留的kCheapPrepend空间，整帧不用再拷贝
+ * 没有状态，一个codec可以给任意多个连接、任意多个loop共用
+ */
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using FrameCallback = std::function<void (const TcpConnectionPtr&, const StringPiece&, Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+
+    // 长度头超过maxFrameSize（或者是负数）时认为对端出错，关闭连接
+    explicit LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize = kDefaultMaxFrameSize)
+        : frameCallback_(cb)
+        , maxFrameSize_(maxFrameSize)
+    {}
+
+    // conn->setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &codec, _1, _2, _3))
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) const;
+
+    // buf里只有消息体，在前面加上长度头
+    static void finishFrame(Buffer *buf);
+    // 拷贝一次message，加上长度头发送
+    void send(const TcpConnectionPtr &conn, const StringPiece &message) const;
+    // buf里只有消息体，加上长度头发送，调用后buf为空
+    void send(const TcpConnectionPtr &conn, Buffer *buf) const;
+private:
+    FrameCallback   frameCallback_;
+    const size_t    maxFrameSize_;
+};
@@ -0,0 +1,132 @@
+#include "LoadBalancer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+#include <string.h>
+#include <algorithm>
+
+const int ConsistentHashBalancer::kVirtualNodes;
+
+static const double kLoadTolerance = 0.05;
+
+// splitmix64的混合函数，输入相近的值输出也分布得很开
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// IPv4取s_addr，IPv6把16个字节折成一个64位的值
+static uint64_t hashIp(const InetAddress &addr)
+{
+    if (addr.family() == AF_INET6)
+    {
+        const sockaddr_in6 *addr6 = reinterpret_cast<const sockaddr_in6*>(addr.getSockAddr());
+        uint64_t halves[2];
+        ::memcpy(halves, &addr6->sin6_addr, sizeof halves);
+        return halves[0] ^ mix64(halves[1]);
+    }
+    return reinterpret_cast<const sockaddr_in*>(addr.getSockAddr())->sin_addr.s_addr;
+}
+
+std::unique_ptr<LoadBalancer> LoadBalancer::create(Strategy strategy)
+{
+    switch (strategy)
+    {
+    case kLeastConnections:
+        return std::unique_ptr<LoadBalancer>(new LeastConnectionsBalancer);
+    case kLeastLoad:
+        return std::unique_ptr<LoadBalancer>(new LeastLoadBalancer);
+    case kConsistentHash:
+        return std::unique_ptr<LoadBalancer>(new ConsistentHashBalancer);
+    case kRoundRobin:
+    default:
+        return std::unique_ptr<LoadBalancer>(new RoundRobinBalancer);
+    }
+}
+
+EventLoop* RoundRobinBalancer::select(const InetAddress*)
+{
+    EventLoop *loop = loops_[next_ % loops_.size()];
+    next_ = (next_ + 1) % loops_.size();
+    return loop;
+}
+
+EventLoop* LeastConnectionsBalancer::select(const InetAddress*)
+{
+    const size_t n = loops_.size();
+    size_t best = next_ % n;
+    int bestConnections = loops_[best]->connections();
+    for (size_t i = 1; i < n && bestConnections > 0; ++i)
+    {
+        size_t index = (next_ + i) % n;
+        int connections = loops_[index]->connections();
+        if (connections < bestConnections)
+        {
+            best = index;
+            bestConnections = connections;
+        }
+    }
+    next_ = best + 1;
+    return loops_[best];
+}
+
+EventLoop* LeastLoadBalancer::select(const InetAddress*)
+{
+    const size_t n = loops_.size();
+    size_t best = next_ % n;
+    double bestLoad = loops_[best]->busyRatio();
+    int bestConnections = loops_[best]->connections();
+    for (size_t i = 1; i < n; ++i)
+    {
+        size_t index = (next_ + i) % n;
+        double load = loops_[index]->busyRatio();
+        int connections = loops_[index]->connections();
+        // 差别在kLoadTolerance以内的当作一样忙，比较连接数
+        // 新连接要过一个窗口才体现在busyRatio里，只看负载会把一批连接都分到同一个loop上
+        if (load < bestLoad - kLoadTolerance || (load < bestLoad + kLoadTolerance && connections < bestConnections))
+        {
+            best = index;
+            bestLoad = load;
+            bestConnections = connections;
+        }
+    }
+    next_ = best + 1;
+    return loops_[best];
+}
+
+void ConsistentHashBalancer::setLoops(const std::vector<EventLoop*> &loops)
+{
+    LoadBalancer::setLoops(loops);
+    fallback_.setLoops(loops);
+    ring_.clear();
+    ring_.reserve(loops.size() * kVirtualNodes);
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        for (int v = 0; v < kVirtualNodes; ++v)
+        {
+            Node node = { mix64((static_cast<uint64_t>(i) << 32) | static_cast<uint64_t>(v)), loops[i] };
+            ring_.push_back(node);
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+EventLoop* ConsistentHashBalancer::select(const InetAddress *peerAddr)
+{
+    // AF_UNIX的对端一般没有绑定地址，没有可以哈希的东西
+    if (peerAddr == nullptr || peerAddr->isUnix())
+    {
+        return fallback_.select(nullptr);
+    }
+    // 只用ip，同一个客户端的多个连接落在同一个loop上
+    Node key = { mix64(hashIp(*peerAddr)), nullptr };
+    std::vector<Node>::const_iterator it = std::lower_bound(ring_.begin(), ring_.end(), key);
+    if (it == ring_.end())
+    {
+        it = ring_.begin();
+    }
+    return it->loop;
+}
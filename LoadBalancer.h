@@ -0,0 +1,86 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+class EventLoop;
+class InetAddress;
+
+/**
+ * EventLoopThreadPool::getNextLoop选择subloop的策略
+ * setLoops在线程池启动以后调用一次，select只在baseLoop线程中调用
+ * 读loop的计数（EventLoop::connections、busyRatio）都不加锁
+ */
+class LoadBalancer : noncopyable
+{
+public:
+    enum Strategy
+    {
+        kRoundRobin,
+        kLeastConnections,
+        kLeastLoad,         // 忙碌占比的EWMA最低的loop，相同时连接少的优先
+        kConsistentHash,    // 按对端ip做一致性哈希，同一个客户端总是落在同一个loop上
+    };
+
+    static std::unique_ptr<LoadBalancer> create(Strategy strategy);
+
+    virtual ~LoadBalancer() = default;
+
+    virtual void setLoops(const std::vector<EventLoop*> &loops) { loops_ = loops; }
+    // loops_不为空  peerAddr可能是nullptr（不知道对端地址），这时按轮询选择
+    virtual EventLoop* select(const InetAddress *peerAddr) = 0;
+
+protected:
+    std::vector<EventLoop*> loops_;
+};
+
+class RoundRobinBalancer : public LoadBalancer
+{
+public:
+    RoundRobinBalancer() : next_(0) {}
+    EventLoop* select(const InetAddress *peerAddr) override;
+private:
+    size_t next_;
+};
+
+// 从上一次选中的下一个开始找，计数相同的时候轮流分配，不会总是落在第一个loop上
+class LeastConnectionsBalancer : public LoadBalancer
+{
+public:
+    LeastConnectionsBalancer() : next_(0) {}
+    EventLoop* select(const InetAddress *peerAddr) override;
+private:
+    size_t next_;
+};
+
+class LeastLoadBalancer : public LoadBalancer
+{
+public:
+    LeastLoadBalancer() : next_(0) {}
+    EventLoop* select(const InetAddress *peerAddr) override;
+private:
+    size_t next_;
+};
+
+// 每个loop在环上放kVirtualNodes个点，点的位置只和loop的下标有关，loop个数不变时重启后分配也不变
+// 增加一个loop只会移动大约1/n的客户端
+class ConsistentHashBalancer : public LoadBalancer
+{
+public:
+    static const int kVirtualNodes = 128;
+
+    void setLoops(const std::vector<EventLoop*> &loops) override;
+    EventLoop* select(const InetAddress *peerAddr) override;
+private:
+    struct Node
+    {
+        uint64_t    hash;
+        EventLoop   *loop;
+        bool operator<(const Node &rhs) const { return hash < rhs.hash; }
+    };
+
+    std::vector<Node>   ring_;  // 按hash排序
+    RoundRobinBalancer  fallback_;
+};
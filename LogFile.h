@@ -0,0 +1,45 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+/**
+ * 滚动日志文件，只由AsyncLogging的后台线程使用，所以不加锁
+ * 单个文件写满rollSize字节，或者跨天，就切换到一个新文件
+ * 文件名：basename.20260101-120000.hostname.pid.log
+ */
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string &basename,
+            off_t rollSize,
+            int flushInterval = 3,
+            int checkEveryN = 1024);
+    ~LogFile();
+
+    void append(const char *logline, size_t len);
+    void flush();
+    bool rollFile();
+
+private:
+    static std::string getLogFileName(const std::string &basename, time_t *now);
+
+    const std::string       basename_;
+    const off_t             rollSize_;
+    const int               flushInterval_;  // 秒，距离上次flush超过该间隔就flush
+    const int               checkEveryN_;    // 每写入N次检查一次是否需要跨天滚动
+
+    int                     count_;
+    time_t                  startOfPeriod_;  // 当前文件所属的那一天（对齐到0点）
+    time_t                  lastRoll_;
+    time_t                  lastFlush_;
+
+    FILE                    *fp_;
+    off_t                   writtenBytes_;
+    char                    buffer_[64 * 1024]; // 文件的用户态缓冲区
+
+    static const int kRollPerSeconds_ = 60 * 60 * 24;
+};
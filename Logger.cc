@@ -1,7 +1,62 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
-#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace
+{
+void defaultOutput(const char *msg, int len)
+{
+    ::fwrite(msg, 1, len, stdout);
+}
+
+void defaultFlush()
+{
+    ::fflush(stdout);
+}
+
+Logger::OutputFunc g_output = defaultOutput;
+Logger::FlushFunc g_flush = defaultFlush;
+
+// 每个线程缓存格式化好的时间  日志时间只精确到秒，秒数没变就直接复用，不调用localtime和snprintf
+// 用CLOCK_REALTIME_COARSE取时间就够了
+__thread time_t t_lastSecond = -1;
+__thread char t_time[32];
+__thread int t_timeLength = 0;
+
+void formatTime()
+{
+    time_t seconds = Timestamp::now(Timestamp::kRealtimeCoarse).secondsSinceEpoch();
+    if (seconds != t_lastSecond)
+    {
+        t_lastSecond = seconds;
+        tm tm_time;
+        localtime_r(&seconds, &tm_time);
+        t_timeLength = snprintf(t_time, sizeof t_time, "%4d/%02d/%02d %02d:%02d:%02d",
+            tm_time.tm_year + 1900,
+            tm_time.tm_mon + 1,
+            tm_time.tm_mday,
+            tm_time.tm_hour,
+            tm_time.tm_min,
+            tm_time.tm_sec);
+    }
+}
+
+void appendTo(char *line, int *n, int capacity, const char *data, int len)
+{
+    int room = capacity - *n;
+    if (len > room)
+    {
+        len = room;
+    }
+    memcpy(line + *n, data, len);
+    *n += len;
+}
+}
+
+std::atomic_int Logger::logLevel_(MUDUO_MIN_LOG_LEVEL);
 
 // 获取日志唯一的实例对象
 Logger& Logger::instance()
@@ -10,33 +65,53 @@ Logger& Logger::instance()
     return logger;
 }
 
-// 设置日志级别
-void Logger::setLogLevel(int level)
+void Logger::setOutput(OutputFunc out)
 {
-    logLevel_ = level;
+    g_output = out;
+}
+
+void Logger::setFlush(FlushFunc flush)
+{
+    g_flush = flush;
 }
 
 // 写日志  [级别信息] time : msg
-void Logger::log(std::string msg)
+// 整行先在栈上拼好，再交给g_output一次性输出，不在每一行上flush
+void Logger::log(LogLevel level, const char *msg)
 {
-    switch (logLevel_)
+    const char *levelName = "";
+    switch (level)
     {
     case INFO:
-        std::cout << "[INFO]";
+        levelName = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        levelName = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
+        levelName = "[FATAL]";
         break;
     case DEBUG:
-        std::cout << "[DEBUG]";
+        levelName = "[DEBUG]";
         break;
     default:
         break;
     }
 
-    // 打印时间和msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
-}
\ No newline at end of file
+    // 打印时间和msg  各段直接拷贝进来，超长时截断，最后一个字节留给换行
+    formatTime();
+    char line[1024 + 128];
+    const int capacity = static_cast<int>(sizeof line) - 1;
+    int n = 0;
+    appendTo(line, &n, capacity, levelName, static_cast<int>(strlen(levelName)));
+    appendTo(line, &n, capacity, t_time, t_timeLength);
+    appendTo(line, &n, capacity, " : ", 3);
+    appendTo(line, &n, capacity, msg, static_cast<int>(strlen(msg)));
+    line[n++] = '\n';
+    g_output(line, n);
+
+    if (level == FATAL)
+    {
+        g_flush();
+    }
+}
@@ -1,63 +1,55 @@
 #pragma once
 
-#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
 
 #include "noncopyable.h"
 
-// LOG_INFO("%s %d", arg1, arg2)
-#define LOG_INFO(logmsgFormat, ...) \
-    do \
-    { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(INFO); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while(0) 
+// 定义日志的级别  DEBUG < INFO < ERROR < FATAL，数值越大越严重
+enum LogLevel
+{
+    DEBUG, // 调试信息
+    INFO,  // 普通信息
+    ERROR, // 错误信息
+    FATAL, // core信息
+};
+
+// 编译期的最低日志级别，低于该级别的LOG_XXX整个被编译器优化掉
+// 可以通过 -DMUDUO_MIN_LOG_LEVEL=2 之类的方式指定，默认定义了MUDEBUG时为DEBUG，否则为INFO
+#ifndef MUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MUDUO_MIN_LOG_LEVEL 0
+#else
+#define MUDUO_MIN_LOG_LEVEL 1
+#endif
+#endif
 
-#define LOG_ERROR(logmsgFormat, ...) \
+// 先判断级别，级别不够时既不格式化也不做IO，只有一次分支判断
+#define LOG_IMPL(level, logmsgFormat, ...) \
     do \
     { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(ERROR); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while(0) 
+        if (level >= MUDUO_MIN_LOG_LEVEL && Logger::isEnabled(level)) \
+        { \
+            char muduo_log_buf_[1024]; /* 调用方的参数里可能有叫buf的变量，不能和它重名 */ \
+            snprintf(muduo_log_buf_, sizeof muduo_log_buf_, logmsgFormat, ##__VA_ARGS__); \
+            Logger::instance().log(level, muduo_log_buf_); \
+        } \
+    } while(0)
+
+// LOG_INFO("%s %d", arg1, arg2)
+#define LOG_INFO(logmsgFormat, ...) LOG_IMPL(INFO, logmsgFormat, ##__VA_ARGS__)
+
+#define LOG_ERROR(logmsgFormat, ...) LOG_IMPL(ERROR, logmsgFormat, ##__VA_ARGS__)
 
 #define LOG_FATAL(logmsgFormat, ...) \
     do \
     { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(FATAL); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
+        LOG_IMPL(FATAL, logmsgFormat, ##__VA_ARGS__); \
         exit(-1); \
-    } while(0) 
+    } while(0)
 
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...) \
-    do \
-    { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(DEBUG); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while(0) 
-#else
-    #define LOG_DEBUG(logmsgFormat, ...)
-#endif
-
-// 定义日志的级别  INFO  ERROR  FATAL  DEBUG 
-enum LogLevel
-{
-    INFO,  // 普通信息
-    ERROR, // 错误信息
-    FATAL, // core信息
-    DEBUG, // 调试信息
-};
+#define LOG_DEBUG(logmsgFormat, ...) LOG_IMPL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 
 // 输出一个日志类
 class Logger : noncopyable
@@ -65,10 +57,23 @@ class Logger : noncopyable
 public:
     // 获取日志唯一的实例对象
     static Logger& instance();
-    // 设置日志级别
-    void setLogLevel(int level);
-    // 写日志
-    void log(std::string msg);
+    // 设置/获取运行期的日志级别，低于该级别的日志直接丢弃，多线程安全
+    static void setLogLevel(LogLevel level) { logLevel_.store(level, std::memory_order_relaxed); }
+    static LogLevel logLevel() { return static_cast<LogLevel>(logLevel_.load(std::memory_order_relaxed)); }
+
+    static bool isEnabled(LogLevel level)
+    {
+        return level >= logLevel_.load(std::memory_order_relaxed);
+    }
+
+    // 写日志 msg是已经格式化好的日志正文
+    void log(LogLevel level, const char *msg);
+
+    // 日志最终的输出方式，默认写到stdout；接入AsyncLogging时设置为其append
+    using OutputFunc = void (*)(const char *msg, int len);
+    using FlushFunc = void (*)();
+    static void setOutput(OutputFunc out);
+    static void setFlush(FlushFunc flush);
 private:
-    int logLevel_;
+    static std::atomic_int logLevel_;
 };
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "LoopMetrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const int LatencyHistogram::kBuckets;
+const uint32_t LoopMetrics::kSampleEvery;
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0)
+    , sumNanos_(0)
+{
+    for (std::atomic<uint64_t> &bucket : buckets_)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snap;
+    snap.count = count_.load(std::memory_order_relaxed);
+    snap.sumNanos = sumNanos_.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot &other)
+{
+    count += other.count;
+    sumNanos += other.sumNanos;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+int64_t LatencyHistogram::Snapshot::percentileNanos(double p) const
+{
+    // 各个桶是分别读的，count可能和桶的总数差一点，按桶的总数算
+    uint64_t total = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        total += buckets[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100 * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            return bucketBoundNanos(i);
+        }
+    }
+    return bucketBoundNanos(kBuckets - 1);
+}
+
+LoopMetrics::LoopMetrics()
+    : sampleTick_(0)
+{
+    for (std::atomic<uint64_t> &counter : counters_)
+    {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool LoopMetrics::sampleInThisThread()
+{
+    static __thread uint32_t t_tick = 0;
+    return (++t_tick & (kSampleEvery - 1)) == 0;
+}
+
+LoopMetrics::Snapshot LoopMetrics::snapshot() const
+{
+    Snapshot snap;
+    snap.wakeups = 0;
+    snap.events = 0;
+    snap.functors = 0;
+    for (int i = 0; i < kNumCounters; ++i)
+    {
+        snap.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < kNumHistograms; ++i)
+    {
+        snap.histograms[i] = histograms_[i].snapshot();
+    }
+    return snap;
+}
+
+void LoopMetrics::Snapshot::merge(const Snapshot &other)
+{
+    wakeups += other.wakeups;
+    events += other.events;
+    functors += other.functors;
+    for (int i = 0; i < kNumCounters; ++i)
+    {
+        counters[i] += other.counters[i];
+    }
+    for (int i = 0; i < kNumHistograms; ++i)
+    {
+        histograms[i].merge(other.histograms[i]);
+    }
+}
+
+namespace
+{
+
+struct MetricInfo
+{
+    const char *name;
+    const char *help;
+};
+
+const MetricInfo kCounterInfo[LoopMetrics::kNumCounters] = {
+    { "bytes_read_total", "Bytes read from sockets." },
+    { "bytes_written_total", "Bytes written to sockets." },
+    { "accepts_total", "Connections accepted." },
+    { "eagain_total", "Socket writes that returned EAGAIN." },
+    { "epollout_registrations_total", "Times EPOLLOUT was registered for a connection." },
+    { "high_water_hits_total", "Times a connection's output queue crossed its high-water mark." },
+    { "datagrams_read_total", "UDP datagrams received." },
+    { "datagrams_written_total", "UDP datagrams sent." },
+    { "datagrams_dropped_total", "UDP datagrams truncated on receive or dropped on send." },
+    { "tls_handshakes_total", "TLS handshakes completed, including resumed ones." },
+    { "tls_resumed_total", "TLS handshakes completed with session resumption." },
+    { "ktls_offloads_total", "Connection directions switched to kernel TLS." },
+};
+
+const MetricInfo kHistogramInfo[LoopMetrics::kNumHistograms] = {
+    { "loop_iteration_seconds", "Time spent dispatching events and functors per loop iteration." },
+    { "message_callback_seconds", "Sampled duration of message callbacks." },
+    { "queue_delay_seconds", "Sampled delay between queueInLoop and the functor starting." },
+};
+
+void appendCounter(std::string *out, const std::string &prefix, const char *name, const char *help, uint64_t value)
+{
+    char buf[512];
+    snprintf(buf, sizeof buf, "# HELP %s_%s %s\n# TYPE %s_%s counter\n%s_%s %llu\n",
+        prefix.c_str(), name, help, prefix.c_str(), name, prefix.c_str(), name,
+        static_cast<unsigned long long>(value));
+    out->append(buf);
+}
+
+void appendHistogram(std::string *out, const std::string &prefix, const MetricInfo &info,
+                     const LatencyHistogram::Snapshot &hist)
+{
+    char buf[512];
+    snprintf(buf, sizeof buf, "# HELP %s_%s %s\n# TYPE %s_%s histogram\n",
+        prefix.c_str(), info.name, info.help, prefix.c_str(), info.name);
+    out->append(buf);
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LatencyHistogram::kBuckets - 1; ++i)
+    {
+        cumulative += hist.buckets[i];
+        snprintf(buf, sizeof buf, "%s_%s_bucket{le=\"%g\"} %llu\n", prefix.c_str(), info.name,
+            LatencyHistogram::bucketBoundNanos(i) / 1e9, static_cast<unsigned long long>(cumulative));
+        out->append(buf);
+    }
+    cumulative += hist.buckets[LatencyHistogram::kBuckets - 1];
+    snprintf(buf, sizeof buf, "%s_%s_bucket{le=\"+Inf\"} %llu\n%s_%s_sum %.9f\n%s_%s_count %llu\n",
+        prefix.c_str(), info.name, static_cast<unsigned long long>(cumulative),
+        prefix.c_str(), info.name, hist.sumNanos / 1e9,
+        prefix.c_str(), info.name, static_cast<unsigned long long>(cumulative));
+    out->append(buf);
+}
+
+} // namespace
+
+std::string LoopMetrics::Snapshot::toPrometheus(const std::string &prefix, int loops) const
+{
+    std::string out;
+    out.reserve(8192);
+    char buf[256];
+    snprintf(buf, sizeof buf, "# HELP %s_loops Event loops aggregated in this snapshot.\n# TYPE %s_loops gauge\n%s_loops %d\n",
+        prefix.c_str(), prefix.c_str(), prefix.c_str(), loops);
+    out.append(buf);
+    appendCounter(&out, prefix, "poll_wakeups_total", "Times the poller returned.", wakeups);
+    appendCounter(&out, prefix, "events_dispatched_total", "IO events dispatched to channels.", events);
+    appendCounter(&out, prefix, "functors_total", "Pending functors run.", functors);
+    for (int i = 0; i < kNumCounters; ++i)
+    {
+        appendCounter(&out, prefix, kCounterInfo[i].name, kCounterInfo[i].help, counters[i]);
+    }
+    for (int i = 0; i < kNumHistograms; ++i)
+    {
+        appendHistogram(&out, prefix, kHistogramInfo[i], histograms[i]);
+    }
+    return out;
+}
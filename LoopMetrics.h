@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+#include "noncopyable.h"
+
+// 延迟直方图  桶i统计[2^(i+9), 2^(i+10))纳秒，桶0是1us以下，最后一个桶是2^40ns(约18分钟)以上
+// 只由loop线程写，单写者，load加增量再store，不需要原子的读改写；任意线程都可以读
+class LatencyHistogram : noncopyable
+{
+public:
+    static const int kBuckets = 32;
+
+    struct Snapshot
+    {
+        uint64_t count;
+        int64_t  sumNanos;
+        uint64_t buckets[kBuckets];
+
+        void merge(const Snapshot &other);
+        // 第p百分位所在桶的上界，纳秒  p在0到100之间，没有样本时返回0
+        int64_t percentileNanos(double p) const;
+    };
+
+    LatencyHistogram();
+
+    void record(int64_t nanos)
+    {
+        int index = bucketIndex(nanos);
+        bump(buckets_[index], 1);
+        bump(count_, 1);
+        sumNanos_.store(sumNanos_.load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const;
+
+    static int bucketIndex(int64_t nanos)
+    {
+        if (nanos < 1024)
+        {
+            return 0;
+        }
+        int index = 63 - __builtin_clzll(static_cast<uint64_t>(nanos)) - 9;
+        return index < kBuckets ? index : kBuckets - 1;
+    }
+    // 桶index的上界，纳秒
+    static int64_t bucketBoundNanos(int index) { return static_cast<int64_t>(1) << (index + 10); }
+
+private:
+    static void bump(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> count_;
+    std::atomic<int64_t>  sumNanos_;
+    std::atomic<uint64_t> buckets_[kBuckets];
+};
+
+// 每个EventLoop一份的计数器和直方图  所有的更新都在loop线程里，代价是一次load和一次store
+// EventLoop::Stats里已经有的wakeups、events、functors在取快照时从Stats里拷过来
+class LoopMetrics : noncopyable
+{
+public:
+    enum Counter
+    {
+        kBytesRead,
+        kBytesWritten,
+        kAccepts,
+        kEagain,                // 写socket返回EAGAIN的次数
+        kWriteRegistrations,    // 注册EPOLLOUT的次数
+        kHighWaterHits,         // outputBuffer_从低于高水位变成超过高水位的次数
+        kDatagramsRead,         // UdpChannel收到的数据报，GRO合并的按分段以后的个数算
+        kDatagramsWritten,
+        kDatagramsDropped,      // 接收时被截断的，发送队列满了或者发送出错丢掉的
+        kTlsHandshakes,         // 完成的TLS握手，包括恢复的
+        kTlsResumed,            // 其中用session恢复的
+        kKtlsOffloads,          // 交给内核TLS的方向数，一个连接发送和接收各算一次
+        kNumCounters
+    };
+
+    enum Histogram
+    {
+        kLoopIteration,         // dispatch加上pendingFunctors的时间，不包括阻塞在poll里的时间
+        kMessageCallback,       // messageCallback_的执行时间  每kSampleEvery次采样一次
+        kQueueDelay,            // queueInLoop入队到开始执行的时间  每个生产者线程每kSampleEvery次采样一次
+        kNumHistograms
+    };
+
+    // 取时间比计数贵得多（vdso的clock_gettime大概20ns），回调时间和排队时间只采样一部分
+    static const uint32_t kSampleEvery = 8;
+
+    struct Snapshot
+    {
+        uint64_t wakeups;
+        uint64_t events;
+        uint64_t functors;
+        uint64_t counters[kNumCounters];
+        LatencyHistogram::Snapshot histograms[kNumHistograms];
+
+        void merge(const Snapshot &other);
+        // Prometheus文本格式，指标名都以prefix_开头；loops是参与聚合的loop个数
+        std::string toPrometheus(const std::string &prefix = "mymuduo", int loops = 1) const;
+    };
+
+    LoopMetrics();
+
+    void add(Counter counter, uint64_t n = 1)
+    {
+        std::atomic<uint64_t> &c = counters_[counter];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void record(Histogram histogram, int64_t nanos) { histograms_[histogram].record(nanos); }
+
+    // 这一次要不要采样  只在loop线程调用
+    bool sample() { return (++sampleTick_ & (kSampleEvery - 1)) == 0; }
+    // 生产者线程用的采样，每个线程自己计数
+    static bool sampleInThisThread();
+
+    // 不包括wakeups、events、functors，由EventLoop::metrics()填
+    Snapshot snapshot() const;
+
+    static int64_t nowNanos()
+    {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+private:
+    std::atomic<uint64_t> counters_[kNumCounters];
+    LatencyHistogram      histograms_[kNumHistograms];
+    uint32_t              sampleTick_;
+};
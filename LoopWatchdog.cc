@@ -0,0 +1,273 @@
+#include "LoopWatchdog.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+
+const int kMaxFrames = 64;
+const int64_t kBacktraceWaitNanos = 50 * 1000 * 1000;
+
+// 信号处理函数和后台线程之间交换调用栈  同一时间只抓一个线程
+enum CaptureState
+{
+    kIdle,
+    kRequested,     // 已经发了信号
+    kCapturing,     // 信号处理函数正在写frames
+    kDone,
+};
+
+std::atomic_int     g_captureState(kIdle);
+std::atomic<pid_t>  g_captureTid(0);
+void                *g_frames[kMaxFrames];
+int                 g_depth = 0;
+
+int64_t monotonicNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 只做异步信号安全的事情  backtrace在start里预先调用过一次，不会在这里加载libgcc
+void captureHandler(int)
+{
+    if (static_cast<pid_t>(::syscall(SYS_gettid)) != g_captureTid.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    int expected = kRequested;
+    if (!g_captureState.compare_exchange_strong(expected, kCapturing))
+    {
+        return; // 后台线程已经等超时了
+    }
+    g_depth = ::backtrace(g_frames, kMaxFrames);
+    g_captureState.store(kDone, std::memory_order_release);
+}
+
+// dladdr找到符号名并还原成C++的名字  找不到时为空
+std::string symbolName(const void *addr, const char **object)
+{
+    Dl_info info;
+    if (::dladdr(addr, &info) == 0)
+    {
+        return std::string();
+    }
+    if (object)
+    {
+        *object = info.dli_fname;
+    }
+    if (info.dli_sname == nullptr)
+    {
+        return std::string();
+    }
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name(status == 0 && demangled ? demangled : info.dli_sname);
+    ::free(demangled);
+    return name;
+}
+
+void logStall(const LoopWatchdog::Stall &stall)
+{
+    std::string doing = stall.fd >= 0 ? "handling fd " + std::to_string(stall.fd) : "running " + stall.task;
+    LOG_ERROR("EventLoop %p (tid %d) stalled %.3fs in iteration %lu, %s \n",
+        stall.loop, stall.tid, stall.seconds, static_cast<unsigned long>(stall.iteration), doing.c_str());
+    if (!stall.backtrace.empty())
+    {
+        // 日志一行最多1024字节，调用栈逐行打印
+        size_t start = 0;
+        while (start < stall.backtrace.size())
+        {
+            size_t end = stall.backtrace.find('\n', start);
+            if (end == std::string::npos)
+            {
+                end = stall.backtrace.size();
+            }
+            LOG_ERROR("    %s", stall.backtrace.substr(start, end - start).c_str());
+            start = end + 1;
+        }
+    }
+}
+
+} // namespace
+
+int LoopWatchdog::defaultSignal()
+{
+    return SIGRTMIN + 3;
+}
+
+LoopWatchdog::LoopWatchdog(double thresholdSeconds, double checkIntervalSeconds)
+    : thresholdNanos_(static_cast<int64_t>(thresholdSeconds * 1e9))
+    , intervalNanos_(std::max<int64_t>(static_cast<int64_t>(checkIntervalSeconds * 1e9), 1000 * 1000))
+    , stallCallback_(logStall)
+    , captureBacktrace_(false)
+    , signal_(defaultSignal())
+    , running_(false)
+    , thread_(std::bind(&LoopWatchdog::threadFunc, this), "Watchdog")
+{
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void LoopWatchdog::watch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 从现在这一轮开始算，不报告watch之前就已经卡住的
+    Watched watched = { loop, 0 };
+    loops_.push_back(watched);
+}
+
+void LoopWatchdog::unwatch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+        [loop](const Watched &watched) { return watched.loop == loop; }), loops_.end());
+}
+
+void LoopWatchdog::start()
+{
+    if (captureBacktrace_)
+    {
+        // 第一次调用backtrace会加载libgcc_s，不能发生在信号处理函数里
+        void *frame;
+        ::backtrace(&frame, 1);
+        struct sigaction sa;
+        sa.sa_handler = captureHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        if (::sigaction(signal_, &sa, nullptr) < 0)
+        {
+            LOG_ERROR("LoopWatchdog::start sigaction(%d) error \n", signal_);
+            captureBacktrace_ = false;
+        }
+    }
+    running_ = true;
+    thread_.start();
+}
+
+void LoopWatchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void LoopWatchdog::threadFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, std::chrono::nanoseconds(intervalNanos_));
+        if (running_)
+        {
+            // 抓调用栈要等信号处理函数，期间持有锁，unwatch会等这一次检查结束，不会用到已经销毁的loop
+            check(monotonicNanos());
+        }
+    }
+}
+
+void LoopWatchdog::check(int64_t now)
+{
+    for (Watched &watched : loops_)
+    {
+        EventLoop::Activity activity = watched.loop->activity();
+        if (activity.iterationStart == 0
+            || activity.iteration == watched.reported
+            || now - activity.iterationStart < thresholdNanos_)
+        {
+            continue;
+        }
+        watched.reported = activity.iteration;
+
+        Stall stall;
+        stall.loop = watched.loop;
+        stall.tid = watched.loop->threadId();
+        stall.iteration = activity.iteration;
+        stall.seconds = (now - activity.iterationStart) / 1e9;
+        stall.fd = activity.fd;
+        if (activity.fd < 0 && activity.task)
+        {
+            stall.task = describeTask(activity.task);
+        }
+        if (captureBacktrace_)
+        {
+            stall.backtrace = captureBacktrace(stall.tid);
+            // 取调用栈的时候这一轮可能已经结束了，这时的调用栈是别的代码，丢掉
+            if (watched.loop->activity().iteration != activity.iteration)
+            {
+                stall.backtrace.clear();
+            }
+        }
+        stallCallback_(stall);
+    }
+}
+
+std::string LoopWatchdog::captureBacktrace(pid_t tid)
+{
+    g_captureTid.store(tid, std::memory_order_relaxed);
+    g_captureState.store(kRequested);
+    if (::syscall(SYS_tgkill, ::getpid(), tid, signal_) < 0)
+    {
+        g_captureState.store(kIdle);
+        return std::string();
+    }
+
+    int64_t deadline = monotonicNanos() + kBacktraceWaitNanos;
+    while (g_captureState.load(std::memory_order_acquire) != kDone)
+    {
+        int expected = kRequested;
+        if (monotonicNanos() > deadline && g_captureState.compare_exchange_strong(expected, kIdle))
+        {
+            return std::string(); // 信号一直没有处理，比如线程屏蔽了这个信号
+        }
+        ::usleep(1000);
+    }
+
+    std::string trace;
+    char line[512];
+    // 第0帧是captureHandler
+    for (int i = 1; i < g_depth; ++i)
+    {
+        const char *object = "?";
+        std::string name = symbolName(g_frames[i], &object);
+        snprintf(line, sizeof line, "#%-2d %p %s (%s)\n", i - 1, g_frames[i],
+            name.empty() ? "??" : name.c_str(), object);
+        trace += line;
+    }
+    g_captureState.store(kIdle);
+    return trace;
+}
+
+std::string LoopWatchdog::describeTask(const void *invoker)
+{
+    std::string name = symbolName(invoker, nullptr);
+    if (name.empty())
+    {
+        char buf[32];
+        snprintf(buf, sizeof buf, "task %p", invoker);
+        return buf;
+    }
+    return name;
+}
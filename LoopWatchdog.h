@@ -0,0 +1,89 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <unistd.h>
+
+class EventLoop;
+
+/**
+ * loop卡住检测  一个后台线程每隔checkInterval秒看一遍被监视的loop的EventLoop::activity()，
+ * 某一轮处理（IO事件加上pendingFunctors）超过threshold秒还没有结束，就报告一次：
+ * 正在处理哪个channel的fd，或者正在执行哪一种回调（Task::invoker用dladdr解析出来的类型名）
+ * 可以选择给卡住的线程发信号，在信号处理函数里backtrace，拿到它当时的调用栈
+ * loop线程这边每轮两次store，每个事件、回调一次store，没有卡住的时候后台线程只是读几个原子变量
+ *
+ * 使用方法：
+ *   LoopWatchdog watchdog(0.05);
+ *   for (EventLoop *loop : pool.getAllLoops()) watchdog.watch(loop);
+ *   watchdog.start();
+ * 被监视的loop销毁之前必须unwatch或者stop
+ */
+class LoopWatchdog : noncopyable
+{
+public:
+    struct Stall
+    {
+        EventLoop   *loop;
+        pid_t       tid;            // loop线程
+        uint64_t    iteration;      // 卡住的那一轮，同一轮只报告一次
+        double      seconds;        // 发现时这一轮已经执行的时间
+        int         fd;             // 正在处理的channel，执行回调时为-1
+        std::string task;           // 正在执行的回调类型，分发IO事件时为空
+        std::string backtrace;      // 没有开启setCaptureBacktrace或者没有取到时为空
+    };
+    using StallCallback = std::function<void(const Stall&)>;
+
+    // 默认用来抓调用栈的信号
+    static int defaultSignal();
+
+    explicit LoopWatchdog(double thresholdSeconds, double checkIntervalSeconds = 0.01);
+    ~LoopWatchdog();
+
+    // 线程安全
+    void watch(EventLoop *loop);
+    void unwatch(EventLoop *loop);
+
+    // 默认用LOG_ERROR打印  在后台线程里调用  必须在start之前设置
+    void setStallCallback(const StallCallback &cb) { stallCallback_ = cb; }
+    // 发现卡住时向loop线程发signo，在信号处理函数里取调用栈  会设置signo的处理函数，
+    // 整个进程同一时间只能有一个LoopWatchdog开启  可执行程序要加-rdynamic才有函数名  必须在start之前设置
+    // 信号会打断卡住的线程里的nanosleep、带超时的等待这类不能自动重启的阻塞调用，让它提前返回
+    void setCaptureBacktrace(bool on, int signo = defaultSignal()) { captureBacktrace_ = on; signal_ = signo; }
+
+    void start();
+    void stop();
+
+    // 把Task::invoker解析成回调的类型名，解析不了时返回地址
+    static std::string describeTask(const void *invoker);
+
+private:
+    struct Watched
+    {
+        EventLoop   *loop;
+        uint64_t    reported;   // 已经报告过的那一轮
+    };
+
+    void threadFunc();
+    void check(int64_t now);
+    std::string captureBacktrace(pid_t tid);
+
+    const int64_t               thresholdNanos_;
+    const int64_t               intervalNanos_;
+    StallCallback               stallCallback_;
+    bool                        captureBacktrace_;
+    int                         signal_;
+
+    std::mutex                  mutex_;
+    std::condition_variable     cond_;
+    bool                        running_;
+    std::vector<Watched>        loops_;     // mutex_保护
+    Thread                      thread_;
+};
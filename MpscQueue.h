@@ -0,0 +1,99 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <sched.h>
+
+/**
+ * 侵入式无锁队列  多生产者单消费者 (Dmitry Vyukov的MPSC算法)
+ * 生产者push只有一次原子exchange，不会互相等待；只有消费者线程可以pop
+ * 元素需要继承MpscNode，队列本身不分配内存
+ */
+struct MpscNode
+{
+    std::atomic<MpscNode*> next;
+};
+
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(&stub_)
+        , tail_(&stub_)
+    {
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // 任意线程
+    void push(MpscNode *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        // seq_cst：EventLoop停止自旋时依赖这次交换和loop的spinning_之间的全序，见EventLoop::nextPollTimeout
+        MpscNode *prev = head_.exchange(node, std::memory_order_seq_cst);
+        // 在这两句之间，prev和node还没有连起来，消费者看到的是“正在入队”的状态
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 只能在消费者线程调用  队列为空返回nullptr
+    MpscNode* pop()
+    {
+        MpscNode *tail = tail_;
+        MpscNode *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (next == nullptr)
+            {
+                if (head_.load(std::memory_order_acquire) == &stub_)
+                {
+                    return nullptr;
+                }
+                next = waitNext(tail);
+            }
+            tail_ = next;
+            tail = next;
+            next = tail->next.load(std::memory_order_acquire);
+        }
+
+        if (next == nullptr)
+        {
+            if (tail != head_.load(std::memory_order_acquire))
+            {
+                // 有生产者交换了head_但还没有连上next，很快就会完成
+                next = waitNext(tail);
+            }
+            else
+            {
+                // tail是最后一个节点，把stub放到它后面，这样tail就可以出队了
+                push(&stub_);
+                next = waitNext(tail);
+            }
+        }
+
+        tail_ = next;
+        return tail;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const
+    {
+        return tail_ == &stub_
+            && stub_.next.load(std::memory_order_acquire) == nullptr
+            && head_.load(std::memory_order_acquire) == &stub_;
+    }
+
+private:
+    static MpscNode* waitNext(MpscNode *node)
+    {
+        MpscNode *next;
+        while ((next = node->next.load(std::memory_order_acquire)) == nullptr)
+        {
+            ::sched_yield();
+        }
+        return next;
+    }
+
+    std::atomic<MpscNode*>  head_;  // 生产者在这一端入队
+    MpscNode                *tail_; // 消费者在这一端出队
+    MpscNode                stub_;
+};
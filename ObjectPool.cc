@@ -0,0 +1,116 @@
+#include "ObjectPool.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace
+{
+// 线程退出时缓存先析构，之后再释放的对象直接free
+__thread bool t_poolDestroyed = false;
+}
+
+ObjectPool::ObjectPool()
+{
+    for (int i = 0; i < kMaxClasses; ++i)
+    {
+        classes_[i].size = 0;
+        classes_[i].freeList = nullptr;
+        classes_[i].count = 0;
+    }
+}
+
+ObjectPool::~ObjectPool()
+{
+    for (int i = 0; i < kMaxClasses; ++i)
+    {
+        while (classes_[i].freeList)
+        {
+            FreeBlock *block = classes_[i].freeList;
+            classes_[i].freeList = block->next;
+            ::free(block);
+        }
+    }
+    t_poolDestroyed = true;
+}
+
+ObjectPool* ObjectPool::instance()
+{
+    if (t_poolDestroyed)
+    {
+        return nullptr;
+    }
+    static thread_local ObjectPool pool;
+    return &pool;
+}
+
+ObjectPool::SizeClass* ObjectPool::findClass(size_t size)
+{
+    for (int i = 0; i < kMaxClasses; ++i)
+    {
+        if (classes_[i].size == size)
+        {
+            return &classes_[i];
+        }
+        if (classes_[i].size == 0)
+        {
+            classes_[i].size = size;
+            return &classes_[i];
+        }
+    }
+    return nullptr;
+}
+
+void* ObjectPool::allocate(size_t size)
+{
+    if (size < sizeof(FreeBlock))
+    {
+        size = sizeof(FreeBlock);
+    }
+    ObjectPool *pool = instance();
+    SizeClass *cls = pool ? pool->findClass(size) : nullptr;
+    if (cls && cls->freeList)
+    {
+        FreeBlock *block = cls->freeList;
+        cls->freeList = block->next;
+        --cls->count;
+        return block;
+    }
+
+    void *data = ::malloc(size);
+    if (data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return data;
+}
+
+void ObjectPool::deallocate(void *data, size_t size)
+{
+    if (size < sizeof(FreeBlock))
+    {
+        size = sizeof(FreeBlock);
+    }
+    // 在别的线程分配的对象也可以放进这个线程的缓存，这一档还没有用过时建一个
+    ObjectPool *pool = instance();
+    SizeClass *cls = pool ? pool->findClass(size) : nullptr;
+    if (cls && (cls->count + 1) * size <= kMaxCachedBytes)
+    {
+        FreeBlock *block = static_cast<FreeBlock*>(data);
+        block->next = cls->freeList;
+        cls->freeList = block;
+        ++cls->count;
+        return;
+    }
+    ::free(data);
+}
+
+size_t ObjectPool::cachedBlocks()
+{
+    ObjectPool *pool = instance();
+    size_t n = 0;
+    for (int i = 0; pool && i < kMaxClasses; ++i)
+    {
+        n += pool->classes_[i].count;
+    }
+    return n;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <stddef.h>
+
+/**
+ * 固定大小对象的线程局部缓存  和BufferPool一样，one loop per thread，所以也就是每个loop一个
+ * 按对象的实际大小分档，同一种对象每次大小都一样，最多kMaxClasses种大小，更多的直接malloc
+ * 在哪个线程释放就放回哪个线程的缓存，每档缓存的总大小有上限，超出的部分直接free
+ * TcpConnection和shared_ptr的控制块通过PoolAllocator在一次分配里，连接风暴时不经过malloc
+ */
+class ObjectPool : noncopyable
+{
+public:
+    static const int kMaxClasses = 8;
+    static const size_t kMaxCachedBytes = 2 * 1024 * 1024; // 每一档最多缓存的字节数
+
+    static void* allocate(size_t size);
+    // size必须和allocate时一样
+    static void deallocate(void *data, size_t size);
+
+    // 当前线程缓存的对象个数
+    static size_t cachedBlocks();
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct SizeClass
+    {
+        size_t      size;   // 0表示还没有使用
+        FreeBlock   *freeList;
+        size_t      count;
+    };
+
+    ObjectPool();
+    ~ObjectPool();
+
+    static ObjectPool* instance();
+    // 没有对应的档时占用一个空的，档已经用完时返回nullptr
+    SizeClass* findClass(size_t size);
+
+    SizeClass   classes_[kMaxClasses];
+};
+
+/**
+ * 从ObjectPool分配的分配器，给std::allocate_shared用：
+ *   std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(), ...)
+ * 没有状态，所有实例都相等
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(ObjectPool::allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { ObjectPool::deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+inline bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
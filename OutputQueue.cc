@@ -0,0 +1,417 @@
+#include "OutputQueue.h"
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+const int SplicePipe::kPipeSize;
+
+// sendfile/splice一次最多传这么多，Linux上超过的部分也会被截断
+static const size_t kMaxTransfer = 0x7ffff000;
+
+FileRef::~FileRef()
+{
+    ::close(fd_);
+}
+
+FdList::~FdList()
+{
+    for (int fd : fds_)
+    {
+        ::close(fd);
+    }
+}
+
+SplicePipe::SplicePipe()
+    : readFd_(-1)
+    , writeFd_(-1)
+    , capacity_(0)
+    , buffered_(0)
+    , full_(false)
+{
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("SplicePipe pipe2 error:%d \n", errno);
+        return;
+    }
+    readFd_ = fds[0];
+    writeFd_ = fds[1];
+    ::fcntl(writeFd_, F_SETPIPE_SZ, kPipeSize);
+    int size = ::fcntl(writeFd_, F_GETPIPE_SZ);
+    capacity_ = size > 0 ? static_cast<size_t>(size) : 65536;
+}
+
+SplicePipe::~SplicePipe()
+{
+    if (valid())
+    {
+        ::close(readFd_);
+        ::close(writeFd_);
+    }
+}
+
+void SplicePipe::consumed(size_t n)
+{
+    buffered_ -= n;
+    if (full_ && buffered_ <= capacity_ / 2)
+    {
+        full_ = false;
+        if (drainCallback_)
+        {
+            drainCallback_();
+        }
+    }
+}
+
+void OutputQueue::append(const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (segments_.empty()
+        || !segments_.back().inMemory()
+        || segments_.back().shared
+        || segments_.back().owned.size() + len > kChunkSize)
+    {
+        segments_.emplace_back();
+        segments_.back().owned.reserve(len > kChunkSize ? len : kChunkSize);
+    }
+    segments_.back().owned.append(data, len);
+    bytes_ += len;
+}
+
+void OutputQueue::append(std::string &&data, size_t offset)
+{
+    size_t len = data.size() - offset;
+    if (len < kCopyThreshold)
+    {
+        append(data.data() + offset, len);
+        return;
+    }
+    segments_.emplace_back();
+    segments_.back().owned.swap(data);
+    segments_.back().offset = offset;
+    bytes_ += len;
+}
+
+void OutputQueue::append(const SlicePtr &slice, size_t offset)
+{
+    size_t len = slice->size() - offset;
+    if (len < kCopyThreshold)
+    {
+        append(slice->data() + offset, len);
+        return;
+    }
+    segments_.emplace_back();
+    segments_.back().shared = slice;
+    segments_.back().offset = offset;
+    bytes_ += len;
+}
+
+void OutputQueue::appendFile(const FileRefPtr &file, off_t offset, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    segments_.emplace_back();
+    segments_.back().file = file;
+    segments_.back().fileOffset = offset;
+    segments_.back().length = len;
+    bytes_ += len;
+}
+
+void OutputQueue::appendPipe(const SplicePipePtr &pipe, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (segments_.empty() || segments_.back().pipe != pipe)
+    {
+        segments_.emplace_back();
+        segments_.back().pipe = pipe;
+    }
+    segments_.back().length += len;
+    bytes_ += len;
+}
+
+void OutputQueue::appendWithRights(std::string &&data, const FdListPtr &fds)
+{
+    if (data.empty())
+    {
+        return;
+    }
+    segments_.emplace_back();
+    segments_.back().owned.swap(data);
+    segments_.back().rights = fds;
+    bytes_ += segments_.back().owned.size();
+}
+
+void OutputQueue::retrieveAll()
+{
+    segments_.clear();
+    bytes_ = 0;
+}
+
+void OutputQueue::retrieve(size_t len)
+{
+    bytes_ -= len;
+    while (len > 0)
+    {
+        Segment &front = segments_.front();
+        size_t size = front.size();
+        if (len < size)
+        {
+            front.offset += len;
+            break;
+        }
+        len -= size;
+        segments_.pop_front();
+    }
+}
+
+int OutputQueue::fillIovec(struct iovec *vec, int maxIov) const
+{
+    int iovcnt = 0;
+    for (auto it = segments_.begin(); it != segments_.end() && iovcnt < maxIov && it->inMemory(); ++it)
+    {
+        if (zeroCopyThreshold_ > 0 && it->size() >= zeroCopyThreshold_)
+        {
+            break;
+        }
+        if (it->rights && it != segments_.begin())
+        {
+            break;
+        }
+        vec[iovcnt].iov_base = const_cast<char*>(it->data());
+        vec[iovcnt].iov_len = it->size();
+        ++iovcnt;
+    }
+    return iovcnt;
+}
+
+bool OutputQueue::loadFileFront(size_t maxBytes, int *saveErrno)
+{
+    Segment &front = segments_.front();
+    size_t len = std::min(front.size(), maxBytes);
+    std::string data(len, '\0');
+    ssize_t n = ::pread(front.file->fd(), &data[0], len, front.fileOffset + static_cast<off_t>(front.offset));
+    if (n <= 0)
+    {
+        *saveErrno = n < 0 ? errno : EIO;
+        return false;
+    }
+    data.resize(static_cast<size_t>(n));
+    front.offset += static_cast<size_t>(n);
+    if (front.size() == 0)
+    {
+        segments_.pop_front();
+    }
+    // bytes_不变，只是换了一种存放方式
+    segments_.emplace_front();
+    segments_.front().owned.swap(data);
+    return true;
+}
+
+ssize_t OutputQueue::sendFileFront(int fd, int *saveErrno)
+{
+    const Segment &front = segments_.front();
+    off_t offset = front.fileOffset + static_cast<off_t>(front.offset);
+    ssize_t n = ::sendfile(fd, front.file->fd(), &offset, std::min(front.size(), kMaxTransfer));
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (n == 0)
+    {
+        // 文件被截断了
+        *saveErrno = EIO;
+        return -1;
+    }
+    else
+    {
+        retrieve(static_cast<size_t>(n));
+    }
+    return n;
+}
+
+ssize_t OutputQueue::spliceFront(int fd, int *saveErrno)
+{
+    SplicePipePtr pipe = segments_.front().pipe; // retrieve以后段可能已经释放了
+    ssize_t n = ::splice(pipe->readFd(), NULL, fd, NULL, std::min(segments_.front().size(), kMaxTransfer),
+                         SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (n == 0)
+    {
+        *saveErrno = EIO;
+        return -1;
+    }
+    else
+    {
+        retrieve(static_cast<size_t>(n));
+        pipe->consumed(static_cast<size_t>(n));
+    }
+    return n;
+}
+
+ssize_t OutputQueue::sendZeroCopyFront(int fd, int *saveErrno)
+{
+    Segment &front = segments_.front();
+    if (!front.shared)
+    {
+        // 发送完以后段就删掉了，数据要能单独持有到内核确认
+        front.shared.reset(new Slice(std::move(front.owned)));
+        front.owned.clear();
+    }
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(front.data());
+    vec.iov_len = std::min(front.size(), kMaxTransfer);
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+
+    ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY);
+    if (n < 0 && errno == ENOBUFS)
+    {
+        // 还没确认的发送太多，超过了optmem_max，这一次普通发送
+        n = ::sendmsg(fd, &msg, 0);
+        if (n < 0)
+        {
+            *saveErrno = errno;
+            return n;
+        }
+        retrieve(static_cast<size_t>(n));
+        return n;
+    }
+    if (n < 0)
+    {
+        *saveErrno = errno;
+        return n;
+    }
+    ZeroCopySend send = { zeroCopySeq_++, front.shared, static_cast<size_t>(n) };
+    zeroCopyPending_.push_back(std::move(send));
+    zeroCopyPendingBytes_ += static_cast<size_t>(n);
+    retrieve(static_cast<size_t>(n));
+    return n;
+}
+
+// fd附在这一次sendmsg发送的数据上，只要发送出去了一个字节就算已经交给了对端
+ssize_t OutputQueue::sendRightsFront(int fd, int *saveErrno)
+{
+    const std::vector<int> &fds = segments_.front().rights->fds();
+    struct iovec vec[IOV_MAX];
+    int iovcnt = fillIovec(vec, IOV_MAX);
+
+    std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)), 0);
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+    ssize_t n = ::sendmsg(fd, &msg, 0);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+        return n;
+    }
+    segments_.front().rights.reset();   // 对端已经持有这些fd，关掉本进程dup出来的
+    retrieve(static_cast<size_t>(n));
+    return n;
+}
+
+void OutputQueue::zeroCopyCompleted(uint32_t lo, uint32_t hi)
+{
+    // 编号会回绕，用无符号减法比较
+    uint32_t span = hi - lo;
+    // 通常按发送的顺序确认，确认的是队首的一段
+    while (!zeroCopyPending_.empty() && static_cast<uint32_t>(zeroCopyPending_.front().seq - lo) <= span)
+    {
+        zeroCopyPendingBytes_ -= zeroCopyPending_.front().len;
+        zeroCopyPending_.pop_front();
+    }
+    if (zeroCopyPending_.empty())
+    {
+        return;
+    }
+    // 前面的发送还没确认（比如重传），后面的先确认了  队列按编号排列（乱序确认删掉的会留下空缺），
+    // 相对队首的距离是递增的，二分找到lo
+    uint32_t base = zeroCopyPending_.front().seq;
+    auto first = std::lower_bound(zeroCopyPending_.begin(), zeroCopyPending_.end(), lo,
+        [base](const ZeroCopySend &send, uint32_t seq) {
+            return static_cast<uint32_t>(send.seq - base) < static_cast<uint32_t>(seq - base);
+        });
+    auto last = first;
+    while (last != zeroCopyPending_.end() && static_cast<uint32_t>(last->seq - lo) <= span)
+    {
+        zeroCopyPendingBytes_ -= last->len;
+        ++last;
+    }
+    zeroCopyPending_.erase(first, last);
+}
+
+ssize_t OutputQueue::writeFd(int fd, int *saveErrno)
+{
+    if (segments_.empty())
+    {
+        return 0;
+    }
+    if (segments_.front().file)
+    {
+        return sendFileFront(fd, saveErrno);
+    }
+    if (segments_.front().pipe)
+    {
+        return spliceFront(fd, saveErrno);
+    }
+    if (segments_.front().rights)
+    {
+        return sendRightsFront(fd, saveErrno);
+    }
+    if (zeroCopyFront())
+    {
+        return sendZeroCopyFront(fd, saveErrno);
+    }
+
+    struct iovec vec[IOV_MAX];
+    int iovcnt = fillIovec(vec, IOV_MAX);
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else
+    {
+        retrieve(static_cast<size_t>(n));
+    }
+    return n;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Slice.h"
+#include "ObjectPool.h"
+
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// sendFile发送的文件  保存dup出来的fd，最后一个引用释放时关闭，调用方的fd可以马上关掉
+class FileRef : noncopyable
+{
+public:
+    explicit FileRef(int fd) : fd_(fd) {}
+    ~FileRef();
+    int fd() const { return fd_; }
+private:
+    const int fd_;
+};
+
+using FileRefPtr = std::shared_ptr<const FileRef>;
+
+// SCM_RIGHTS要传给对端的fd  保存dup出来的fd，发送出去或者连接销毁以后关闭
+class FdList : noncopyable
+{
+public:
+    explicit FdList(std::vector<int> &&fds) : fds_(std::move(fds)) {}
+    ~FdList();
+    const std::vector<int>& fds() const { return fds_; }
+private:
+    const std::vector<int> fds_;
+};
+
+using FdListPtr = std::shared_ptr<const FdList>;
+
+/**
+ * splice转发用的管道：源连接把socket里的数据splice进管道，目的连接的发送队列再从管道splice到socket
+ * 管道里的数据就是目的连接队列里所有pipe段的数据，顺序一致  两端必须在同一个loop线程里
+ * 管道写满时源连接暂停读，目的连接发送到只剩一半以后回调drainCallback_
+ */
+class SplicePipe : noncopyable
+{
+public:
+    using DrainCallback = std::function<void()>;
+
+    static const int kPipeSize = 1024 * 1024;   // F_SETPIPE_SZ，超过/proc/sys/fs/pipe-max-size时用默认的64K
+
+    SplicePipe();   // 创建失败时valid()为false
+    ~SplicePipe();
+
+    bool valid() const { return readFd_ >= 0; }
+    int readFd() const { return readFd_; }
+    int writeFd() const { return writeFd_; }
+    size_t capacity() const { return capacity_; }
+    size_t buffered() const { return buffered_; }
+    size_t writable() const { return capacity_ - buffered_; }
+
+    void setDrainCallback(const DrainCallback &cb) { drainCallback_ = cb; }
+    void produced(size_t n) { buffered_ += n; }
+    // 源连接写不进去了，暂停读  之后管道里剩下不到一半时回调drainCallback_
+    void markFull() { full_ = true; }
+    bool full() const { return full_; }
+    // 从管道里发送掉了n字节
+    void consumed(size_t n);
+private:
+    int             readFd_;
+    int             writeFd_;
+    size_t          capacity_;
+    size_t          buffered_;
+    bool            full_;       // 写满过，等drain
+    DrainCallback   drainCallback_;
+};
+
+using SplicePipePtr = std::shared_ptr<SplicePipe>;
+
+/**
+ * TcpConnection的发送队列，由一段一段的数据块组成，不要求在内存上连续
+ * 小块数据拷贝进队尾的数据块里合并；大块的string直接移动进来；共享的Slice只保存引用计数，不拷贝
+ * writeFd用writev一次发送多个数据块（最多IOV_MAX个），发送完的数据块立刻释放
+ * 也可以放文件段（sendfile发送）和管道段（splice发送），数据不进用户态  这两种段在队首时writeFd单独发送它，
+ * fillIovec遇到它们就停下
+ * 打开MSG_ZEROCOPY以后，不小于阈值的内存数据块也在队首单独发送，发送出去的数据在内核确认之前由zeroCopyPending_持有
+ * AF_UNIX的数据块可以带fd（SCM_RIGHTS），fd跟着这个数据块的第一个字节用sendmsg发送，fillIovec在它前面停下
+ */
+class OutputQueue : noncopyable
+{
+public:
+    static const size_t kChunkSize = 4096;          // 拷贝进来的小数据合并到这么大的块里
+    static const size_t kCopyThreshold = 1024;      // 比这个小的string/Slice直接拷贝，避免writev的段数太多
+
+    OutputQueue() : bytes_(0), zeroCopyThreshold_(0), zeroCopySeq_(0), zeroCopyPendingBytes_(0) {}
+
+    size_t readableBytes() const { return bytes_; }
+    bool empty() const { return bytes_ == 0; }
+
+    // 不小于threshold的内存数据块用send(MSG_ZEROCOPY)发送，0表示不用  socket必须已经设置了SO_ZEROCOPY
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
+    // 已经发送出去、内核还没有确认的字节数，这些内存还不能释放
+    size_t zeroCopyPendingBytes() const { return zeroCopyPendingBytes_; }
+    // 错误队列里的通知：第lo到第hi次（包含hi）MSG_ZEROCOPY发送已经完成，释放对应的数据
+    void zeroCopyCompleted(uint32_t lo, uint32_t hi);
+
+    // 拷贝[data, data+len]
+    void append(const char *data, size_t len);
+    // 接管data的内存，从data[offset]开始发送
+    void append(std::string &&data, size_t offset = 0);
+    // 引用slice，从slice->data()[offset]开始发送
+    void append(const SlicePtr &slice, size_t offset = 0);
+    // 文件[offset, offset+len)，用sendfile发送
+    void appendFile(const FileRefPtr &file, off_t offset, size_t len);
+    // 管道里接下来的len字节，用splice发送  和队尾同一个管道的段合并
+    void appendPipe(const SplicePipePtr &pipe, size_t len);
+    // data和fds一起发送，data不能为空  只能用于AF_UNIX的socket
+    void appendWithRights(std::string &&data, const FdListPtr &fds);
+
+    void retrieveAll();
+    // 删除最前面len字节
+    void retrieve(size_t len);
+
+    // 用最前面的内存数据块填充vec，最多maxIov个，返回填充的个数  队首是文件段时返回0
+    // 打开MSG_ZEROCOPY时在第一个不小于阈值的数据块之前停下，也在队首之后第一个带fd的数据块之前停下
+    int fillIovec(struct iovec *vec, int maxIov) const;
+    // 队首是文件段时，把最多maxBytes字节pread到内存里，放在它前面  完成通知模式没有sendfile，用这个代替
+    // 返回false表示读文件出错或者文件比指定的短，*saveErrno为错误码
+    bool loadFileFront(size_t maxBytes, int *saveErrno);
+
+    // 通过fd发送数据，已发送的部分从队列中删除
+    // 文件比指定的短时返回-1，*saveErrno为EIO，这个连接后面的数据已经没办法按顺序发送了
+    ssize_t writeFd(int fd, int *saveErrno);
+private:
+    struct Segment
+    {
+        Segment() : fileOffset(0), length(0), offset(0) {}
+
+        bool inMemory() const { return !file && !pipe; }
+        const char* data() const { return (shared ? shared->data() : owned.data()) + offset; }
+        size_t size() const
+        {
+            if (!inMemory())
+            {
+                return length - offset;
+            }
+            return (shared ? shared->size() : owned.size()) - offset;
+        }
+
+        SlicePtr        shared;     // 非空表示引用的是共享数据
+        std::string     owned;      // 否则数据保存在这里
+        FileRefPtr      file;       // 非空表示文件段
+        SplicePipePtr   pipe;       // 非空表示管道段
+        FdListPtr       rights;     // 非空表示内存数据块带着fd，还没有发送出去
+        off_t           fileOffset; // 文件段在文件里的起始位置
+        size_t          length;     // 文件段、管道段的总长度
+        size_t          offset;     // 已经发送出去的字节数
+    };
+
+    // 内核确认之前一直持有数据  同一个数据块可能分几次发送，每次都持有一个引用
+    struct ZeroCopySend
+    {
+        uint32_t    seq;        // 内核给每次成功的MSG_ZEROCOPY发送依次编号，从0开始
+        SlicePtr    data;
+        size_t      len;
+    };
+
+    bool zeroCopyFront() const
+    {
+        return zeroCopyThreshold_ > 0 && segments_.front().inMemory() && !segments_.front().rights
+            && segments_.front().size() >= zeroCopyThreshold_;
+    }
+    ssize_t sendFileFront(int fd, int *saveErrno);
+    ssize_t spliceFront(int fd, int *saveErrno);
+    ssize_t sendZeroCopyFront(int fd, int *saveErrno);
+    ssize_t sendRightsFront(int fd, int *saveErrno);
+
+    // libstdc++的deque构造时就分配map和第一个块，从ObjectPool分配，连接建立和销毁时不经过malloc
+    std::deque<Segment, PoolAllocator<Segment>>     segments_;
+    size_t                  bytes_;
+
+    size_t                      zeroCopyThreshold_;
+    uint32_t                    zeroCopySeq_;       // 下一次MSG_ZEROCOPY发送的编号，和内核的计数一致
+    std::deque<ZeroCopySend, PoolAllocator<ZeroCopySend>>    zeroCopyPending_;   // 按编号排列
+    size_t                      zeroCopyPendingBytes_;
+};
@@ -0,0 +1,114 @@
+#include "PollPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <errno.h>
+#include <assert.h>
+
+// channel未添加到poller中
+static const int kNew = -1;  // channel的成员index_ = -1
+
+PollPoller::PollPoller(EventLoop *loop)
+    : Poller(loop)
+{
+}
+
+PollPoller::~PollPoller() = default;
+
+Timestamp PollPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, pollfds_.size());
+
+    int numEvents = ::poll(pollfds_.data(), pollfds_.size(), timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (numEvents > 0)
+    {
+        LOG_DEBUG("%d events happened \n", numEvents);
+        fillActiveChannels(numEvents, activeChannels);
+    }
+    else if (numEvents == 0)
+    {
+        LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+    }
+    else
+    {
+        if (saveErrno != EINTR)
+        {
+            errno = saveErrno;
+            LOG_ERROR("PollPoller::poll() err!");
+        }
+    }
+    return now;
+}
+
+// 填写活跃的连接  找到numEvents个revents非0的就可以停下来
+void PollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels) const
+{
+    for (size_t i = 0; i < pollfds_.size() && numEvents > 0; ++i)
+    {
+        if (pollfds_[i].revents > 0)
+        {
+            --numEvents;
+            Channel *channel = pollChannels_[i];
+            channel->set_revents(pollfds_[i].revents);
+            activeChannels->push_back(channel);
+        }
+    }
+}
+
+void PollPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    LOG_DEBUG("func[%s] => fd[%d] events[%d] index[%d] \n", __FUNCTION__, channel->fd(), channel->events(), index);
+
+    if (index == kNew)
+    {
+        struct pollfd pfd;
+        pfd.fd = channel->fd();
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+        pollfds_.push_back(pfd);
+        pollChannels_.push_back(channel);
+        channel->set_index(static_cast<int>(pollfds_.size()) - 1);
+        channels_.insert(pfd.fd, channel);
+    }
+    else  // channel已经在poller上注册过了，index就是下标
+    {
+        assert(0 <= index && index < static_cast<int>(pollfds_.size()));
+        assert(pollChannels_[index] == channel);
+        struct pollfd &pfd = pollfds_[index];
+        pfd.fd = channel->isNoneEvent() ? -channel->fd() - 1 : channel->fd();
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+    }
+}
+
+// 从poller中删除channel  和最后一个元素交换以后pop_back
+void PollPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    const int index = channel->index();
+    if (index == kNew)
+    {
+        return;
+    }
+    assert(0 <= index && index < static_cast<int>(pollfds_.size()));
+    assert(pollChannels_[index] == channel);
+
+    const size_t last = pollfds_.size() - 1;
+    if (static_cast<size_t>(index) != last)
+    {
+        pollfds_[index] = pollfds_[last];
+        pollChannels_[index] = pollChannels_[last];
+        pollChannels_[index]->set_index(index);
+    }
+    pollfds_.pop_back();
+    pollChannels_.pop_back();
+    channel->set_index(kNew);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <poll.h>
+
+class Channel;
+
+/**
+ * poll的使用  没有epoll的环境下使用，也作为性能对比的基准
+ * pollfds_是一个紧凑的数组，channel的index就是它在数组中的下标
+ * 删除的时候和最后一个元素交换，O(1)
+ * 暂时不关心任何事件的channel把fd置为-fd-1，poll会忽略它
+ */
+class PollPoller : public Poller
+{
+public:
+    PollPoller(EventLoop *loop);
+    ~PollPoller() override;
+
+    // 重写基类Poller的抽象方法
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+private:
+    // 填写活跃的连接
+    void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+
+    using PollFdList = std::vector<struct pollfd>;
+    PollFdList  pollfds_;       // 监听事件集合，和pollChannels_一一对应
+    std::vector<Channel*> pollChannels_;
+};
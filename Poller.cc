@@ -6,8 +6,24 @@ Poller::Poller(EventLoop *loop)
 {
 }
 
+int Poller::wait(int timeoutMs, int maxEvents, Timestamp *receiveTime)
+{
+    (void)maxEvents;
+    activeChannels_.clear();
+    *receiveTime = poll(timeoutMs, &activeChannels_);
+    return static_cast<int>(activeChannels_.size());
+}
+
+void Poller::dispatch(Timestamp receiveTime)
+{
+    for (Channel *channel : activeChannels_)
+    {
+        // Poller监听哪些channel发生事件了，通知channel处理相应的事件
+        channel->handleEvent(receiveTime);
+    }
+}
+
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return channels_.find(channel->fd()) == channel;
 }
\ No newline at end of file
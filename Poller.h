@@ -3,11 +3,56 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 
+#include <stddef.h>
+#include <algorithm>
 #include <vector>
-#include <unordered_map>
 
 class Channel;
 class EventLoop;
+class CompletionIo;
+
+/**
+ * fd => Channel*  fd是从小到大分配的连续整数，直接用vector的下标，不需要哈希
+ * 每个连接固定占用一个指针的空间，数组只会增长到进程用过的最大fd
+ * 某个fd是否已经加入由Poller根据Channel::index()判断，这里不重复检查
+ */
+class ChannelTable
+{
+public:
+    ChannelTable() : size_(0) {}
+
+    Channel* find(int fd) const
+    {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd] : nullptr;
+    }
+
+    void insert(int fd, Channel *channel)
+    {
+        if (static_cast<size_t>(fd) >= channels_.size())
+        {
+            channels_.resize(std::max(static_cast<size_t>(fd) + 1, channels_.size() * 2), nullptr);
+        }
+        if (channels_[fd] == nullptr)
+        {
+            ++size_;
+        }
+        channels_[fd] = channel;
+    }
+
+    void erase(int fd)
+    {
+        if (static_cast<size_t>(fd) < channels_.size() && channels_[fd] != nullptr)
+        {
+            channels_[fd] = nullptr;
+            --size_;
+        }
+    }
+
+    size_t size() const { return size_; }
+private:
+    std::vector<Channel*> channels_;
+    size_t size_;
+};
 
 // muduo库中多路事件分发器的核心IO复用模块
 class Poller : noncopyable
@@ -22,16 +67,28 @@ public:
     virtual Timestamp poll(int timeoutMs, ChannelList *activeChannels) = 0;
     virtual void updateChannel(Channel *channel) = 0;
     virtual void removeChannel(Channel *channel) = 0;
+
+    // EventLoop使用的两步接口：wait等待事件，最多maxEvents个（<=0表示不限制），返回事件个数
+    // dispatch对最近一次wait返回的事件调用channel的handleEvent
+    // 默认实现通过poll填进activeChannels_，一次全部分发，maxEvents不起作用  没分发的事件水平触发下一次还会返回
+    virtual int wait(int timeoutMs, int maxEvents, Timestamp *receiveTime);
+    virtual void dispatch(Timestamp receiveTime);
     
     // 判断参数channel是否在当前Poller当中
     bool hasChannel(Channel *channel) const;
 
+    // 支持完成通知IO的Poller返回自己的实现，其它返回nullptr
+    virtual CompletionIo* completionIo() { return nullptr; }
+
+    // 是否支持边沿触发（EPOLLET）  不支持的Poller上channel只能使用水平触发
+    virtual bool supportsEdgeTriggered() const { return false; }
+
     // EventLoop可以通过该接口获取默认的IO复用的具体实现
     static Poller* newDefaultPoller(EventLoop *loop);
 protected:
-    // map的key：sockfd  value：sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel*>;
-    ChannelMap channels_;
+    // 下标：sockfd  value：sockfd所属的channel通道类型
+    ChannelTable channels_;
 private:
+    ChannelList activeChannels_; // 默认wait/dispatch使用
     EventLoop *ownerLoop_; // 定义Poller所属的事件循环EventLoop
 };
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <string>
+
+/**
+ * 不可修改的一段发送数据，通过shared_ptr<const Slice>在多个连接、多个loop之间共享
+ * 比如广播时同一条序列化好的消息发给成千上万个连接，只需要持有同一个Slice，不需要拷贝
+ */
+class Slice : noncopyable
+{
+public:
+    explicit Slice(std::string &&data) : data_(std::move(data)) {}
+    Slice(const char *data, size_t len) : data_(data, len) {}
+
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+private:
+    const std::string data_;
+};
+
+using SlicePtr = std::shared_ptr<const Slice>;
@@ -3,12 +3,18 @@
 #include "InetAddress.h"
 
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>         
 #include <sys/socket.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <linux/filter.h>
 #include <sys/socket.h>
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
 Socket::~Socket()
 {
     close(sockfd_);
@@ -16,12 +22,28 @@ Socket::~Socket()
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (0 != ::bind(sockfd_, (sockaddr*)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.length()))
     {
-        LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
+        LOG_FATAL("bind sockfd:%d %s fail:%d \n", sockfd_, localaddr.toIpPort().c_str(), errno);
     }
 }
 
+void Socket::removeStaleUnixPath(const InetAddress &addr, int type)
+{
+    int probe = ::socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+    {
+        return;
+    }
+    // 非阻塞connect在对端的backlog满了时返回EAGAIN，也说明有人在listen
+    if (::connect(probe, addr.getSockAddr(), addr.length()) < 0 && errno == ECONNREFUSED)
+    {
+        LOG_INFO("Socket - remove stale unix socket %s \n", addr.toIp().c_str());
+        ::unlink(addr.toIp().c_str());
+    }
+    ::close(probe);
+}
+
 void Socket::listen()
 {
     if (0 != ::listen(sockfd_, 1024))
@@ -38,13 +60,13 @@ int Socket::accept(InetAddress *peeraddr)
      * Reactor模型 one loop per thread
      * poller + non-blocking IO
      */ 
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr*)&addr, len);
     }
     return connfd;
 }
@@ -79,4 +101,55 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+
+void Socket::setBusyPoll(int micros)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &micros, sizeof micros) < 0)
+    {
+        LOG_ERROR("setsockopt SO_BUSY_POLL error:%d \n", errno);
+    }
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("setsockopt SO_ZEROCOPY error:%d \n", errno);
+        return false;
+    }
+    return true;
+}
+
+void Socket::setResetOnClose()
+{
+    struct linger opt = { 1, 0 };
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_LINGER, &opt, sizeof opt) < 0)
+    {
+        LOG_ERROR("setsockopt SO_LINGER error:%d \n", errno);
+    }
+}
+
+void Socket::setTcpCork(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("setsockopt TCP_CORK error:%d \n", errno);
+    }
+}
+
+void Socket::setReusePortCpuSteering(unsigned groupSize)
+{
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU) }, // A = cpu
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, groupSize },                                  // A %= groupSize
+        { BPF_RET | BPF_A, 0, 0, 0 },                                                     // return A
+    };
+    struct sock_fprog prog = { static_cast<unsigned short>(sizeof code / sizeof code[0]), code };
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) < 0)
+    {
+        LOG_ERROR("setsockopt SO_ATTACH_REUSEPORT_CBPF error:%d \n", errno);
+    }
+}
@@ -16,6 +16,9 @@ public:
 
     int fd() const { return sockfd_; }
     void bindAddress(const InetAddress &localaddr);
+    // 文件系统里的AF_UNIX地址，进程退出以后socket文件还留着，再bind会返回EADDRINUSE
+    // 用type（SOCK_STREAM/SOCK_DGRAM）连一下，没有人在用（ECONNREFUSED）才删掉；还有人在用的话不动，让bind失败
+    static void removeStaleUnixPath(const InetAddress &addr, int type);
     void listen();
     int accept(InetAddress *peeraddr);
 
@@ -25,6 +28,17 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_BUSY_POLL  阻塞读之前在网卡驱动里忙等micros微秒，超过系统设置的上限需要CAP_NET_ADMIN
+    void setBusyPoll(int micros);
+    // SO_ZEROCOPY  之后send可以带MSG_ZEROCOPY，内核版本低于4.14时返回false
+    bool setZeroCopy(bool on);
+    // SO_LINGER{1, 0}  close时丢掉发送缓冲区里的数据，直接发RST
+    void setResetOnClose();
+    // TCP_CORK  打开以后内核攒满一个MSS才发送，关闭时马上发出剩下的数据
+    void setTcpCork(bool on);
+    // 给这个socket所在的reuseport组挂cBPF程序：新连接交给下标为(处理SYN的cpu % groupSize)的监听socket
+    // 下标是组内socket listen的顺序
+    void setReusePortCpuSteering(unsigned groupSize);
 private:
     const int sockfd_;
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+
+/**
+ * 不拥有内存的一段字符串，相当于C++17的std::string_view
+ * 用来把Buffer里的一段数据交给用户而不拷贝，只在底层内存不变的时候有效
+ */
+class StringPiece
+{
+public:
+    StringPiece() : data_(nullptr), size_(0) {}
+    StringPiece(const char *data, size_t len) : data_(data), size_(len) {}
+    StringPiece(const char *str) : data_(str), size_(::strlen(str)) {}
+    StringPiece(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    void removePrefix(size_t n) { data_ += n; size_ -= n; }
+    void removeSuffix(size_t n) { size_ -= n; }
+
+    std::string toString() const { return std::string(data_, size_); }
+
+    bool operator==(const StringPiece &rhs) const
+    {
+        return size_ == rhs.size_ && (size_ == 0 || ::memcmp(data_, rhs.data_, size_) == 0);
+    }
+    bool operator!=(const StringPiece &rhs) const { return !(*this == rhs); }
+private:
+    const char *data_;
+    size_t size_;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+ * EventLoop里面使用的回调类型，只能移动不能拷贝
+ * 和std::function<void()>相比，内部有64字节的存储空间，
+ * bind(成员函数, shared_ptr<TcpConnection>, std::string)这类常见的回调可以直接放在里面，不需要分配内存
+ * 放不下的可调用对象才会在堆上分配
+ */
+class Task
+{
+public:
+    static const size_t kInlineSize = 64;
+
+    Task() noexcept : ops_(nullptr) {}
+    Task(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&f)
+        : ops_(nullptr)
+    {
+        using Fn = typename std::decay<F>::type;
+        init<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    Task(Task &&other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Task& operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_)
+            {
+                other.ops_->move(&storage_, &other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops_->invoke(&storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    // 可调用对象类型对应的invoke函数的地址，同一种回调的地址相同  LoopWatchdog用dladdr把它解析成类型名
+    const void* invoker() const { return ops_ ? reinterpret_cast<const void*>(ops_->invoke) : nullptr; }
+
+private:
+    using Storage = typename std::aligned_storage<kInlineSize, alignof(max_align_t)>::type;
+
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);    // 把src移动到dst，并销毁src
+        void (*destroy)(void *storage);
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= kInlineSize
+            && alignof(Fn) <= alignof(max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *storage) { (*static_cast<Fn*>(storage))(); }
+        static void move(void *dst, void *src)
+        {
+            Fn *from = static_cast<Fn*>(src);
+            new (dst) Fn(std::move(*from));
+            from->~Fn();
+        }
+        static void destroy(void *storage) { static_cast<Fn*>(storage)->~Fn(); }
+        static const Ops ops;
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static Fn*& get(void *storage) { return *static_cast<Fn**>(storage); }
+        static void invoke(void *storage) { (*get(storage))(); }
+        static void move(void *dst, void *src) { *static_cast<Fn**>(dst) = get(src); }
+        static void destroy(void *storage) { delete get(storage); }
+        static const Ops ops;
+    };
+
+    // 放得下的直接构造在storage_里
+    template <typename Fn, typename F>
+    void init(F &&f, std::true_type)
+    {
+        new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    // 放不下的在堆上构造，storage_里只保存指针
+    template <typename Fn, typename F>
+    void init(F &&f, std::false_type)
+    {
+        *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    void reset()
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    Storage     storage_;
+    const Ops   *ops_;
+};
+
+template <typename Fn>
+const Task::Ops Task::InlineOps<Fn>::ops = {
+    &Task::InlineOps<Fn>::invoke, &Task::InlineOps<Fn>::move, &Task::InlineOps<Fn>::destroy
+};
+
+template <typename Fn>
+const Task::Ops Task::HeapOps<Fn>::ops = {
+    &Task::HeapOps<Fn>::invoke, &Task::HeapOps<Fn>::move, &Task::HeapOps<Fn>::destroy
+};
@@ -0,0 +1,197 @@
+#include "TcpClient.h"
+#include "Logger.h"
+#include "EventLoop.h"
+#include "ObjectPool.h"
+
+#include <stdio.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d TcpClient Loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+static void defaultConnectionCallback(const TcpConnectionPtr &conn)
+{
+    LOG_INFO("TcpClient - %s -> %s is %s\n", conn->localAddress().toIpPort().c_str(),
+        conn->peerAddress().toIpPort().c_str(), conn->connected() ? "UP" : "DOWN");
+}
+
+static void defaultMessageCallback(const TcpConnectionPtr&, Buffer *buf, Timestamp)
+{
+    buf->retrieveAll();
+}
+
+// TcpClient已经析构，连接关闭以后不能再回调TcpClient::removeConnection
+static void removeConnectionAfterClient(const TcpConnectionPtr &conn)
+{
+    EventLoop *loop = conn->getLoop();
+    loop->connectionRemoved();
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+static void removeConnector(const ConnectorPtr&)
+{
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                const InetAddress &serverAddr,
+                const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_(defaultConnectionCallback)
+    , messageCallback_(defaultMessageCallback)
+    , retry_(false)
+    , connect_(false)
+    , edgeTriggered_(false)
+    , zeroCopyThreshold_(0)
+    , autoCork_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    connector_->setConnectFailedCallback(std::bind(&TcpClient::connectFailed, this));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接可能比TcpClient活得久，换掉指向this的关闭回调
+        CloseCallback cb = removeConnectionAfterClient;
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    else
+    {
+        connector_->stop();
+        // stopInLoop还在队列里，connector_要等它执行完再析构
+        loop_->runAfter(1, std::bind(removeConnector, connector_));
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s\n",
+        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    sockaddr_storage peer;
+    ::bzero(&peer, sizeof peer);
+    socklen_t addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    InetAddress peerAddr;
+    peerAddr.setSockAddr((sockaddr*)&peer, addrlen);
+
+    sockaddr_storage local;
+    ::bzero(&local, sizeof local);
+    addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress localAddr;
+    localAddr.setSockAddr((sockaddr*)&local, addrlen);
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_++);
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn(std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(), loop_,
+                            connName,
+                            sockfd,
+                            localAddr,
+                            peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    conn->setAutoCork(autoCork_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1)
+    );
+    if (tlsContext_ && !conn->startTls(tlsContext_, tlsServerName_))
+    {
+        LOG_ERROR("TcpClient::newConnection [%s] - TLS not available, close \n", connName.c_str());
+        return; // 不能退回明文，conn析构时关闭sockfd
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    // 和服务器的连接一样计入loop的连接数，LoadBalancer和迁移都按这个计数
+    loop_->connectionAdded();
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (connection_ == conn)
+        {
+            connection_.reset();
+        }
+    }
+
+    EventLoop *ioLoop = conn->getLoop();
+    ioLoop->connectionRemoved();
+    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - Reconnecting to %s\n",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        // 迁移过的连接在别的loop里关闭，Connector只能在loop_里用
+        loop_->runInLoop(std::bind(&Connector::restart, connector_));
+    }
+}
+
+void TcpClient::connectFailed()
+{
+    connect_ = false;
+    if (connectFailedCallback_)
+    {
+        connectFailedCallback_();
+    }
+}
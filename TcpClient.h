@@ -0,0 +1,89 @@
+#pragma once
+
+/**
+ * 用户使用muduo编写客户端程序
+ * 和TcpServer一样产生TcpConnection，回调的类型和语义都相同
+ */
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+#include "TlsContext.h"
+
+#include <string>
+#include <mutex>
+#include <atomic>
+
+class EventLoop;
+
+class TcpClient : noncopyable
+{
+public:
+    // 连接失败，Connector放弃重试
+    using ConnectFailedCallback = std::function<void()>;
+
+    TcpClient(EventLoop *loop,
+                const InetAddress &serverAddr,
+                const std::string &nameArg);
+    ~TcpClient(); // 连接还在时强制关闭
+
+    void connect();
+    void disconnect();  // 发送完缓冲区里的数据再关闭
+    void stop();        // 不再连接/重试
+
+    // 线程安全，连接断开以后为空
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+
+    // 已经建立的连接断开以后自动重连
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+    // 见Connector::setMaxRetries、Connector::setConnectTimeout  在connect之前调用
+    void setMaxConnectRetries(int maxRetries) { connector_->setMaxRetries(maxRetries); }
+    void setConnectTimeout(double seconds) { connector_->setConnectTimeout(seconds); }
+
+    // 不是线程安全的，在connect之前设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    void setConnectFailedCallback(const ConnectFailedCallback &cb) { connectFailedCallback_ = cb; }
+    // 见TcpConnection::setEdgeTriggered
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    // 见TcpConnection::setZeroCopyThreshold
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    // 见TcpConnection::setAutoCork
+    void setAutoCork(bool on) { autoCork_ = on; }
+    // 连接跑TLS，见TcpConnection::startTls  serverName用于SNI，context验证证书时检查它  重连时带上一次的session
+    void setTlsContext(const TlsContextPtr &context, const std::string &serverName = std::string())
+    { tlsContext_ = context; tlsServerName_ = serverName; }
+
+private:
+    // 在loop线程中调用
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+    void connectFailed();
+
+    EventLoop                   *loop_;
+    ConnectorPtr                connector_;
+    const std::string           name_;
+    ConnectionCallback          connectionCallback_;
+    MessageCallback             messageCallback_;
+    WriteCompleteCallback       writeCompleteCallback_;
+    ConnectFailedCallback       connectFailedCallback_;
+    std::atomic_bool            retry_;
+    std::atomic_bool            connect_;
+    bool                        edgeTriggered_;
+    size_t                      zeroCopyThreshold_;
+    bool                        autoCork_;
+    TlsContextPtr               tlsContext_;
+    std::string                 tlsServerName_;
+    int                         nextConnId_;    // 只在loop线程中使用
+    mutable std::mutex          mutex_;
+    TcpConnectionPtr            connection_;    // 由mutex_保护
+};
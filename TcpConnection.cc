@@ -3,16 +3,42 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "CompletionIo.h"
+#include "TlsFilter.h"
 
 #include <functional>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/errqueue.h>
 #include <sys/types.h>         
 #include <sys/socket.h>
+#include <string.h>
 #include <strings.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
 #include <string>
 
+// 完成通知模式下文件段每次读到内存里的大小
+static const size_t kFileReadChunk = 64 * 1024;
+// 边沿触发时读够这么多就先回调一次，回调里暂停读的话剩下的留在内核里，inputBuffer_不会无限增长
+static const ssize_t kEdgeReadChunk = 256 * 1024;
+// TLS每次从socket读的密文
+static const size_t kTlsReadChunk = 64 * 1024;
+
+const size_t TcpConnection::kCorkFlushBytes;
+const size_t TcpConnection::kTlsQueueBytes;
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
     if (loop == nullptr)
@@ -23,269 +49,2016 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
 }
 
 TcpConnection::TcpConnection(EventLoop *loop, 
-                const std::string &nameArg, 
+                std::string nameArg, 
+                int sockfd,
+                const InetAddress& localAddr,
+                const InetAddress& peerAddr)
+    : TcpConnection(loop, 0, nullptr, std::move(nameArg), sockfd, localAddr, peerAddr)
+{
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                uint64_t id,
+                std::shared_ptr<const std::string> namePrefix,
+                int sockfd,
+                const InetAddress& localAddr,
+                const InetAddress& peerAddr)
+    : TcpConnection(loop, id, std::move(namePrefix), std::string(), sockfd, localAddr, peerAddr)
+{
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                uint64_t id,
+                std::shared_ptr<const std::string> namePrefix,
+                std::string nameArg,
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , id_(id)
+    , namePrefix_(std::move(namePrefix))
+    , name_(std::move(nameArg))
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , throttled_(0)
+    , peerClosed_(false)
+    , memoryThrottled_(false)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64*1024*1024) // 64M
+    , lowWaterMark_(0)
+    , aboveHighWater_(false)
+    , completionIo_(loop->completionIo())
+    , sendInFlight_(false)
+    , edgeTriggered_(false)
+    , zeroCopyThreshold_(0)
+    , autoCork_(false)
+    , corkScheduled_(false)
+    , corked_(false)
+    , migrating_(false)
+    , bytesReceived_(0)
+    , fdPassing_(false)
+    , tlsEstablished_(false)
+    , tlsPumping_(false)
+    , spliced_(false)
+    , idleWheel_(nullptr)
+    , bufferIdleTimeout_(0)
+    , lastActiveTime_(0)
+    , bufferedBytes_(0)
 {
-    // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
-    );
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this)
-    );
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this)
-    );
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this)
-    );
+    setupChannel();
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
+    socket_.setKeepAlive(true);
 }
 
 
+const std::string& TcpConnection::name() const
+{
+    // 连接风暴时大部分连接都没有人问名字，不为它拼字符串、分配内存
+    if (namePrefix_)
+    {
+        std::call_once(nameOnce_, [this]() {
+            name_ = *namePrefix_ + "#" + std::to_string(id_);
+        });
+    }
+    return name_;
+}
+
 TcpConnection::~TcpConnection()
 {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
-        name_.c_str(), channel_->fd(), (int)state_);
+        name().c_str(), channel_.fd(), (int)state_);
+    // 迁移的回调还在旧loop的队列里loop就退出了，connectDestroyed留在migrateBacklog_里没有执行
+    // 最后一个引用随着~EventLoop销毁队列释放，这时channel还注册在poller上
+    EventLoop *loop = getLoop();
+    if (loop->isInLoopThread() && loop->hasChannel(&channel_))
+    {
+        channel_.disableAll();
+        channel_.remove();
+    }
+    for (int fd : receivedFds_)
+    {
+        ::close(fd);
+    }
+    // 还有没确认的MSG_ZEROCOPY发送，内核还在从这些内存发送数据，普通close之后也会继续发，
+    // 发出去的是这块内存重新分配给别人以后的内容  让close丢掉没发送的数据，outputBuffer_在socket_关闭以后才释放
+    if (outputBuffer_.zeroCopyPendingBytes() > 0)
+    {
+        socket_.setResetOnClose();
+    }
+}
+
+void TcpConnection::setupChannel()
+{
+    // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
+    // 只捕获this的lambda放得进std::function的内部存储，std::bind(&TcpConnection::handleRead, this, _1)放不下，要分配内存
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
 }
 
 void TcpConnection::send(const std::string &buf)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (inOwnerLoop())
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
+            // 不能只绑定buf.c_str()，调用方的string可能在回调执行之前就析构了
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                buf
             ));
         }
     }
 }
 
-/**
- * 发送数据  应用写的快， 而内核发送数据慢， 需要把待发送数据写入缓冲区， 而且设置了水位回调
- */ 
-void TcpConnection::sendInLoop(const void* data, size_t len)
+void TcpConnection::send(std::string &&buf)
 {
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
-
-    // 之前调用过该connection的shutdown，不能再进行发送了
-    if (state_ == kDisconnected)
+    if (state_ == kConnected)
     {
-        LOG_ERROR("disconnected, give up writing!");
-        return;
+        if (inOwnerLoop())
+        {
+            sendStringInLoop(buf); // 没发送完的部分移动进队列
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                std::move(buf)
+            ));
+        }
     }
+}
 
-    // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
     {
-        nwrote = ::write(channel_->fd(), data, len);
-        if (nwrote >= 0)
+        if (inOwnerLoop())
         {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
-            {
-                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this())
-                );
-            }
+            sendBufferInLoop(*buf);
         }
-        else // nwrote < 0
+        else
         {
-            nwrote = 0;
-            if (errno != EWOULDBLOCK)
-            {
-                LOG_ERROR("TcpConnection::sendInLoop");
-                if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE  RESET
-                {
-                    faultError = true;
-                }
-            }
+            Buffer data;
+            data.swap(*buf);
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendBufferInLoop,
+                shared_from_this(),
+                std::move(data)
+            ));
         }
     }
+}
 
-    // 说明当前这一次write，并没有把数据全部发送出去，剩余的数据需要保存到缓冲区当中，然后给channel
-    // 注册epollout事件，poller发现tcp的发送缓冲区有空间，会通知相应的sock-channel，调用writeCallback_回调方法
-    // 也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
-    if (!faultError && remaining > 0) 
+void TcpConnection::send(const SlicePtr &slice)
+{
+    if (state_ == kConnected)
     {
-        // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_
-            && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+        if (inOwnerLoop())
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
-            );
+            sendSliceInLoop(slice);
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        else
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendSliceInLoop,
+                shared_from_this(),
+                slice
+            ));
         }
     }
 }
 
-// 关闭连接
-void TcpConnection::shutdown()
+void TcpConnection::sendFile(int fd, off_t offset, size_t len)
 {
     if (state_ == kConnected)
     {
-        setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this)
-        );
+        int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupFd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendFile dup fd=%d error:%d \n", fd, errno);
+            return;
+        }
+        FileRefPtr file(new FileRef(dupFd));
+        if (inOwnerLoop())
+        {
+            sendFileInLoop(file, offset, len);
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendFileInLoop,
+                shared_from_this(),
+                file, offset, len
+            ));
+        }
     }
 }
 
-void TcpConnection::shutdownInLoop()
+void TcpConnection::sendWithFds(const std::string &data, const std::vector<int> &fds)
+{
+    if (state_ != kConnected)
+    {
+        return;
+    }
+    if (completionIo_ || data.empty())
+    {
+        LOG_ERROR("TcpConnection::sendWithFds [%s] not supported \n", name().c_str());
+        return;
+    }
+    std::vector<int> dupFds;
+    dupFds.reserve(fds.size());
+    for (int fd : fds)
+    {
+        int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupFd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendWithFds dup fd=%d error:%d \n", fd, errno);
+            FdList drop(std::move(dupFds)); // 关掉已经dup出来的
+            return;
+        }
+        dupFds.push_back(dupFd);
+    }
+    FdListPtr list(new FdList(std::move(dupFds)));
+    if (inOwnerLoop())
+    {
+        std::string copy(data);
+        sendWithFdsInLoop(copy, list);
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(
+            &TcpConnection::sendWithFdsInLoop,
+            shared_from_this(),
+            data, list
+        ));
+    }
+}
+
+bool TcpConnection::startTls(const TlsContextPtr &context, const std::string &serverName)
 {
-    if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    if (!context || completionIo_ || state_ != kConnecting || tls_)
+    {
+        LOG_ERROR("TcpConnection::startTls [%s] not supported \n", name().c_str());
+        return false;
+    }
+    // 客户端按对端和SNI缓存session
+    std::unique_ptr<TlsFilter> filter(new TlsFilter(context, peerAddr_.toIpPort() + "/" + serverName, serverName));
+    if (!filter->valid())
     {
-        socket_->shutdownWrite(); // 关闭写端
+        return false;
     }
+    tls_ = std::move(filter);
+    return true;
 }
 
-// 连接建立
-void TcpConnection::connectEstablished()
+// message是回调里保存的那一份，可以直接移动进发送队列
+void TcpConnection::sendStringInLoop(std::string &message)
 {
-    setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
+    if (tls_ && !tls_->txOffloaded())
+    {
+        sendTlsInLoop(message.data(), message.size());
+        return;
+    }
+    if (useZeroCopy(message.size()))
+    {
+        bool wasIdle = !hasPendingOutput() && outputBuffer_.empty();
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(std::move(message));
+        flushQueued(oldLen, wasIdle);
+        return;
+    }
+    size_t nwrote = 0;
+    if (writeDirectly(message.data(), message.size(), &nwrote) && nwrote < message.size())
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(std::move(message), nwrote);
+        onOutputQueued(oldLen);
+    }
+}
 
-    // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+void TcpConnection::sendBufferInLoop(Buffer &buf)
+{
+    sendInLoop(buf.peek(), buf.readableBytes());
+    buf.retrieveAll();
 }
 
-// 连接销毁
-void TcpConnection::connectDestroyed()
+// 没发送完的部分只保存slice的引用，不拷贝
+void TcpConnection::sendSliceInLoop(const SlicePtr &slice)
 {
-    if (state_ == kConnected)
+    if (tls_ && !tls_->txOffloaded())
     {
-        setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        sendTlsInLoop(slice->data(), slice->size());
+        return;
+    }
+    if (useZeroCopy(slice->size()))
+    {
+        bool wasIdle = !hasPendingOutput() && outputBuffer_.empty();
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(slice);
+        flushQueued(oldLen, wasIdle);
+        return;
+    }
+    size_t nwrote = 0;
+    if (writeDirectly(slice->data(), slice->size(), &nwrote) && nwrote < slice->size())
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(slice, nwrote);
+        onOutputQueued(oldLen);
     }
-    channel_->remove(); // 把channel从poller中删除掉
 }
 
-/**
- * handleRead函数主要是用于当已经建立的连接，
- * 对方发送数据给你了此时这个文件描述符的读事件就绪调用的回调方法就是这个。
- * 将用户发过来的数据拷贝到接收缓冲区当中然后再调用用户自定义的消息到来时的回调函数
-*/
-void TcpConnection::handleRead(Timestamp receiveTime)
+void TcpConnection::sendFileInLoop(const FileRefPtr &file, off_t offset, size_t len)
 {
-    int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0)
+    if (state_ == kDisconnected)
     {
-        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        LOG_ERROR("disconnected, give up writing!");
+        return;
     }
-    else if (n == 0)
+    if (tls_ && !tls_->txOffloaded())
     {
-        handleClose();
+        // 用户态加密的文件不能sendfile，由pumpTls每次读一段加密
+        TlsPlain plain;
+        plain.file = file;
+        plain.offset = offset;
+        plain.len = len;
+        tlsBacklog_.push_back(std::move(plain));
+        pumpTls();
+        return;
     }
-    else
+    bool wasIdle = !hasPendingOutput() && outputBuffer_.empty() && !sendInFlight_;
+    size_t oldLen = outputBuffer_.readableBytes();
+    outputBuffer_.appendFile(file, offset, len);
+    flushQueued(oldLen, wasIdle);
+}
+
+void TcpConnection::sendWithFdsInLoop(std::string &data, const FdListPtr &fds)
+{
+    if (state_ == kDisconnected)
     {
-        errno = savedErrno;
-        LOG_ERROR("TcpConnection::handleRead");
-        handleError();
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    if (tls_)
+    {
+        LOG_ERROR("TcpConnection::sendWithFds [%s] not supported with TLS \n", name().c_str());
+        return;
     }
+    bool wasIdle = !hasPendingOutput() && outputBuffer_.empty();
+    size_t oldLen = outputBuffer_.readableBytes();
+    outputBuffer_.appendWithRights(std::move(data), fds);
+    flushQueued(oldLen, wasIdle);
 }
 
-// handleWrite:负责处理Tcp连接的可写事件
+// 只由splice的源连接调用，数据已经在pipe里了
+void TcpConnection::sendPipeInLoop(const SplicePipePtr &pipe, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    bool wasIdle = !hasPendingOutput() && outputBuffer_.empty();
+    size_t oldLen = outputBuffer_.readableBytes();
+    outputBuffer_.appendPipe(pipe, len);
+    flushQueued(oldLen, wasIdle);
+}
 
-// TCP缓冲区能不能容纳得了这么多的数据了。如果此时TCP缓冲区不能容纳得了这么多数据那么处理？
-// 首先他会将这些数据保存到用户层定义的发送缓冲区当中并且向事件监听器注册写事件
-// 当事件监听器检测到写事件就绪就会调用TcpConnection对象当中的handlwrite将剩余的数据写入到TCP的发送缓冲区当中
-// 当我们调用handlwrite时如果还是不能完全写入到TCP的发送缓冲区当中，此时尽可能的将数据写入到发送缓冲区当中依然保持事件
-// 如果此时我们一次性将数据写入到缓冲区当中，此时需要将写事件从事件监听器当中删除这样做的目的是为了不让epoll_wait一直通知我们写事件就绪，在这里是毫无意义的。
-void TcpConnection::handleWrite()
+// 用户态TLS：加密以后放进发送队列  握手还没完成或者前面有没加密完的文件时排在tlsBacklog_后面
+void TcpConnection::sendTlsInLoop(const char *data, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    if (!tlsEstablished_ || !tlsBacklog_.empty())
+    {
+        TlsPlain plain;
+        plain.data.assign(data, len);
+        plain.offset = 0;
+        plain.len = len;
+        tlsBacklog_.push_back(std::move(plain));
+        pumpTls();
+        return;
+    }
+    std::string out;
+    if (!tls_->encrypt(data, len, &out))
+    {
+        abortOutput(EIO);
+        return;
+    }
+    queueTlsOutput(out);
+}
+
+void TcpConnection::queueTlsOutput(std::string &out)
+{
+    if (out.empty() || state_ == kDisconnected)
+    {
+        return;
+    }
+    bool wasIdle = !hasPendingOutput() && outputBuffer_.empty();
+    size_t oldLen = outputBuffer_.readableBytes();
+    outputBuffer_.append(std::move(out));
+    if (wasIdle && autoCork_)
+    {
+        scheduleCorkFlush();
+        onOutputQueued(oldLen);
+        return;
+    }
+    flushQueued(oldLen, wasIdle);
+}
+
+void TcpConnection::pumpTls()
 {
-    if (channel_->isWriting())
+    // flushQueued里发送完了会回到onOutputDrained，由外层的循环接着加密
+    if (tlsPumping_ || !tlsEstablished_)
+    {
+        return;
+    }
+    tlsPumping_ = true;
+    while (!tlsBacklog_.empty() && state_ != kDisconnected && !tls_->txOffloaded()
+        && outputBuffer_.readableBytes() < kTlsQueueBytes)
     {
+        TlsPlain &front = tlsBacklog_.front();
+        std::string out;
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        bool done = true;
+        if (front.file)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            size_t chunk = std::min(front.len, kFileReadChunk);
+            std::string data(chunk, '\0');
+            ssize_t n = ::pread(front.file->fd(), &data[0], chunk, front.offset);
+            if (n <= 0)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                savedErrno = n < 0 ? errno : EIO; // 文件比len短
+            }
+            else if (!tls_->encrypt(data.data(), static_cast<size_t>(n), &out))
+            {
+                savedErrno = EIO;
+            }
+            else
+            {
+                front.offset += n;
+                front.len -= static_cast<size_t>(n);
+                done = front.len == 0;
             }
         }
-        else
+        else if (!tls_->encrypt(front.data.data(), front.data.size(), &out))
         {
-            LOG_ERROR("TcpConnection::handleWrite");
+            savedErrno = EIO;
+        }
+        if (savedErrno != 0)
+        {
+            tlsBacklog_.clear();
+            tlsPumping_ = false;
+            abortOutput(savedErrno);
+            return;
+        }
+        if (done)
+        {
+            tlsBacklog_.pop_front();
         }
+        queueTlsOutput(out);
     }
-    else
+    tlsPumping_ = false;
+}
+
+void TcpConnection::tryKtlsTx()
+{
+    if (!outputBuffer_.empty() || !tls_->enableKtlsTx(channel_.fd()))
+    {
+        return;
+    }
+    getLoop()->metrics().add(LoopMetrics::kKtlsOffloads);
+    LOG_DEBUG("TcpConnection::tryKtlsTx [%s] - kernel TLS transmit \n", name().c_str());
+    if (tlsBacklog_.empty())
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        return;
+    }
+    // 之后由内核加密，文件也可以sendfile了
+    for (TlsPlain &plain : tlsBacklog_)
+    {
+        if (plain.file)
+        {
+            outputBuffer_.appendFile(plain.file, plain.offset, plain.len);
+        }
+        else
+        {
+            outputBuffer_.append(std::move(plain.data));
+        }
     }
+    tlsBacklog_.clear();
+    flushQueued(0, true);
 }
 
-// poller => channel::closeCallback => TcpConnection::handleClose
-void TcpConnection::handleClose()
+bool TcpConnection::useZeroCopy(size_t len) const
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
-    setState(kDisconnected);
-    channel_->disableAll();
-
-    TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 执行连接关闭的回调
-    closeCallback_(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+    if (state_ == kDisconnected)
+    {
+        return false; // writeDirectly里打日志
+    }
+    size_t threshold = outputBuffer_.zeroCopyThreshold();
+    return threshold > 0 && len >= threshold;
 }
 
-void TcpConnection::handleError()
+void TcpConnection::flushQueued(size_t oldLen, bool wasIdle)
 {
-    int optval;
-    socklen_t optlen = sizeof optval;
-    int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (wasIdle && !completionIo_)
     {
-        err = errno;
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+        if (n > 0)
+        {
+            getLoop()->metrics().add(LoopMetrics::kBytesWritten, static_cast<uint64_t>(n));
+            touchActive();
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            getLoop()->metrics().add(LoopMetrics::kEagain);
+        }
+        checkLowWaterMark();
+        if (outputBuffer_.empty())
+        {
+            onOutputDrained();
+            return;
+        }
+        if (n < 0 && savedErrno == EIO)
+        {
+            abortOutput(savedErrno);
+            return;
+        }
+    }
+    onOutputQueued(oldLen);
+}
+
+void TcpConnection::abortOutput(int savedErrno)
+{
+    LOG_ERROR("TcpConnection::abortOutput [%s] - error:%d, %lu bytes dropped \n",
+        name().c_str(), savedErrno, outputBuffer_.readableBytes());
+    outputBuffer_.retrieveAll();
+    if (!edgeTriggered_ && channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+    forceClose();
+}
+
+bool TcpConnection::startSplice(const TcpConnectionPtr &dst)
+{
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread() || dst->getLoop() != loop
+        || completionIo_ || dst->completionIo_
+        || tls_ || dst->tls_
+        || state_ != kConnected || !dst->connected()
+        || migrating() || dst->migrating()
+        || splicePipe_ || !dst->spliceSource_.expired())
+    {
+        LOG_ERROR("TcpConnection::startSplice [%s] => [%s] not supported\n", name().c_str(), dst->name().c_str());
+        return false;
+    }
+    SplicePipePtr pipe(new SplicePipe);
+    if (!pipe->valid())
+    {
+        return false;
+    }
+    std::weak_ptr<TcpConnection> weakSelf(shared_from_this());
+    pipe->setDrainCallback([weakSelf]() {
+        TcpConnectionPtr conn(weakSelf.lock());
+        if (conn)
+        {
+            // 现在在dst的handleWrite里面，不能直接读
+            conn->getLoop()->queueInLoop(std::bind(&TcpConnection::resumeSplice, conn));
+        }
+    });
+    splicePipe_ = pipe;
+    spliceTarget_ = dst;
+    dst->spliceSource_ = weakSelf;
+    spliced_ = true;
+    dst->spliced_ = true;
+
+    if (inputBuffer_.readableBytes() > 0)
+    {
+        dst->send(&inputBuffer_);
+    }
+    if (edgeTriggered_)
+    {
+        // 已经在接收缓冲区里的数据不会再有通知
+        loop->queueInLoop(std::bind(&TcpConnection::resumeSplice, shared_from_this()));
+    }
+    return true;
+}
+
+/**
+ * 发送数据  应用写的快， 而内核发送数据慢， 需要把待发送数据写入缓冲区， 而且设置了水位回调
+ */ 
+void TcpConnection::sendInLoop(const void* data, size_t len)
+{
+    if (tls_ && !tls_->txOffloaded())
+    {
+        sendTlsInLoop(static_cast<const char*>(data), len);
+        return;
+    }
+    size_t nwrote = 0;
+    if (writeDirectly(static_cast<const char*>(data), len, &nwrote) && nwrote < len)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.append(static_cast<const char*>(data) + nwrote, len - nwrote);
+        onOutputQueued(oldLen);
+    }
+}
+
+bool TcpConnection::writeDirectly(const char *data, size_t len, size_t *nwrote)
+{
+    *nwrote = 0;
+
+    // 之前调用过该connection的shutdown，不能再进行发送了
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return false;
+    }
+
+    // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
+    if (!hasPendingOutput() && outputBuffer_.readableBytes() == 0)
+    {
+        if (autoCork_)
+        {
+            scheduleCorkFlush(); // 调用方把数据放进队列，这一轮结束时再发送
+            return true;
+        }
+        ssize_t n = ::write(channel_.fd(), data, len);
+        if (n >= 0)
+        {
+            *nwrote = static_cast<size_t>(n);
+            getLoop()->metrics().add(LoopMetrics::kBytesWritten, *nwrote);
+            touchActive();
+            if (*nwrote == len && writeCompleteCallback_)
+            {
+                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
+                getLoop()->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else // n < 0
+        {
+            if (errno == EWOULDBLOCK)
+            {
+                getLoop()->metrics().add(LoopMetrics::kEagain);
+            }
+            else
+            {
+                LOG_ERROR("TcpConnection::sendInLoop");
+                if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE  RESET
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// 说明当前这一次write，并没有把数据全部发送出去，剩余的数据需要保存到缓冲区当中，然后给channel
+// 注册epollout事件，poller发现tcp的发送缓冲区有空间，会通知相应的sock-channel，调用writeCallback_回调方法
+// 也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
+void TcpConnection::onOutputQueued(size_t oldLen)
+{
+    size_t newLen = outputBuffer_.readableBytes();
+    updateBufferedBytes();
+    if (newLen >= highWaterMark_ && oldLen < highWaterMark_)
+    {
+        getLoop()->metrics().add(LoopMetrics::kHighWaterHits);
+    }
+    if (newLen >= highWaterMark_
+        && oldLen < highWaterMark_
+        && highWaterMarkCallback_)
+    {
+        getLoop()->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), newLen)
+        );
+    }
+    if (newLen >= highWaterMark_ && !aboveHighWater_
+        && (lowWaterMarkCallback_ || !backpressureSources_.empty()))
+    {
+        aboveHighWater_ = true;
+        for (const std::weak_ptr<TcpConnection> &weakSource : backpressureSources_)
+        {
+            TcpConnectionPtr source(weakSource.lock());
+            if (source)
+            {
+                source->throttleRead(true);
+            }
+        }
+    }
+    if (corkScheduled_)
+    {
+        if (newLen >= kCorkFlushBytes)
+        {
+            flushCork();
+        }
+        return;
+    }
+    if (completionIo_)
+    {
+        // 直接交给内核发送，发送完成以后回调handleSendComplete
+        if (!sendInFlight_)
+        {
+            startSend();
+        }
+    }
+    else if (!edgeTriggered_ && !channel_.isWriting())
+    {
+        getLoop()->metrics().add(LoopMetrics::kWriteRegistrations);
+        channel_.enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+    }
+    // 边沿触发的写事件一直注册着，刚才的write返回了EAGAIN，发送缓冲区有空间时一定会再通知
+}
+
+void TcpConnection::onOutputDrained()
+{
+    if (tls_ && tlsEstablished_ && !tls_->txOffloaded())
+    {
+        // 之前的密文都发出去了，正好可以交给内核
+        bool backlogged = !tlsBacklog_.empty();
+        tryKtlsTx();
+        if (backlogged)
+        {
+            pumpTls();
+            return;
+        }
+    }
+    // 握手消息发送完不算
+    if (writeCompleteCallback_ && (!tls_ || tlsEstablished_))
+    {
+        // 唤醒loop_对应的thread线程，执行回调
+        getLoop()->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this())
+        );
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+bool TcpConnection::hasPendingOutput() const
+{
+    if (corkScheduled_)
+    {
+        return true;
+    }
+    if (edgeTriggered_)
+    {
+        return outputBuffer_.readableBytes() > 0;
+    }
+    return channel_.isWriting();
+}
+
+void TcpConnection::scheduleCorkFlush()
+{
+    corkScheduled_ = true;
+    EventLoop *loop = getLoop();
+    loop->runAfterIteration(std::bind(&TcpConnection::flushCorkAfterIteration, shared_from_this(), loop));
+}
+
+void TcpConnection::flushCorkAfterIteration(EventLoop *loop)
+{
+    // 中途迁移走了，迁移之前已经发送过，现在corkScheduled_属于新loop
+    if (getLoop() == loop)
+    {
+        flushCork();
+    }
+}
+
+void TcpConnection::flushCork()
+{
+    if (!corkScheduled_)
+    {
+        return;
+    }
+    corkScheduled_ = false;
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (outputBuffer_.empty())
+    {
+        if (state_ == kDisconnecting)
+        {
+            shutdownInLoop();
+        }
+        return;
+    }
+    if (completionIo_)
+    {
+        if (!sendInFlight_)
+        {
+            startSend();
+        }
+    }
+    else if (edgeTriggered_)
+    {
+        handleWriteUntilEagain(); // 写事件一直注册着，只有写到EAGAIN才会再通知
+    }
+    else
+    {
+        flushQueued(outputBuffer_.readableBytes(), true);
+    }
+}
+
+void TcpConnection::setCork(bool on)
+{
+    if (state_ == kConnected)
+    {
+        if (inOwnerLoop())
+        {
+            setCorkInLoop(on);
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(&TcpConnection::setCorkInLoop, shared_from_this(), on));
+        }
+    }
+}
+
+void TcpConnection::setCorkInLoop(bool on)
+{
+    if (corked_ != on && state_ != kDisconnected)
+    {
+        corked_ = on;
+        socket_.setTcpCork(on);
+    }
+}
+
+void TcpConnection::flush()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        if (inOwnerLoop())
+        {
+            flushInLoop();
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+        }
+    }
+}
+
+void TcpConnection::flushInLoop()
+{
+    flushCork();
+    if (corked_ && state_ != kDisconnected)
+    {
+        // 关掉再打开，内核马上发出不满一个包的数据
+        socket_.setTcpCork(false);
+        socket_.setTcpCork(true);
+    }
+}
+
+void TcpConnection::startSend()
+{
+    struct iovec vec[64];
+    int iovcnt = outputBuffer_.fillIovec(vec, 64);
+    if (iovcnt == 0)
+    {
+        // 队首是文件段
+        int savedErrno = 0;
+        if (!outputBuffer_.loadFileFront(kFileReadChunk, &savedErrno))
+        {
+            abortOutput(savedErrno);
+            return;
+        }
+        iovcnt = outputBuffer_.fillIovec(vec, 64);
+    }
+    sendInFlight_ = true;
+    completionIo_->sendv(&channel_, vec, iovcnt, shared_from_this(),
+        std::bind(&TcpConnection::handleSendComplete, this, std::placeholders::_1));
+}
+
+void TcpConnection::setBusyPoll(int micros)
+{
+    socket_.setBusyPoll(micros);
+}
+
+// 关闭连接
+void TcpConnection::shutdown()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnecting);
+        if (inOwnerLoop())
+        {
+            shutdownInLoop();
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+        }
+    }
+}
+
+void TcpConnection::shutdownInLoop()
+{
+    // 说明outputBuffer中的数据已经全部发送完成  TLS还要等tlsBacklog_加密发送完
+    if (!hasPendingOutput() && !sendInFlight_ && tlsBacklog_.empty())
+    {
+        if (tls_ && tlsEstablished_)
+        {
+            tls_->sendCloseNotify(channel_.fd());
+        }
+        socket_.shutdownWrite(); // 关闭写端
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        queueInOwnerLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose(); // 和对端关闭连接走同一条路径
+    }
+}
+
+// 一段时间没有收到数据，而且接收缓冲区里没有残留的数据，就把内存还给BufferPool
+void TcpConnection::releaseIdleBuffer()
+{
+    if (timeDifference(Timestamp::now(), lastReceiveTime_) >= bufferIdleTimeout_)
+    {
+        inputBuffer_.shrinkIfEmpty();
+        updateBufferedBytes();
+    }
+}
+
+void TcpConnection::touchActive()
+{
+    // 用这一轮poll返回的时间，不用每次读写都取一次时间
+    lastActiveTime_.store(getLoop()->pollReturnTime().microSecondsSinceEpoch(), std::memory_order_relaxed);
+    if (idleWheel_)
+    {
+        idleWheel_->touch(this);
+    }
+}
+
+void TcpConnection::runMessageCallback(Timestamp receiveTime)
+{
+    LoopMetrics &metrics = getLoop()->metrics();
+    if (!metrics.sample())
+    {
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        return;
+    }
+    int64_t start = LoopMetrics::nowNanos();
+    messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    metrics.record(LoopMetrics::kMessageCallback, LoopMetrics::nowNanos() - start);
+}
+
+void TcpConnection::updateBufferedBytes()
+{
+    size_t bytes = inputBuffer_.capacity() + outputBuffer_.readableBytes() + outputBuffer_.zeroCopyPendingBytes();
+    size_t old = bufferedBytes_.load(std::memory_order_relaxed);
+    if (bytes != old)
+    {
+        bufferedBytes_.store(bytes, std::memory_order_relaxed);
+        getLoop()->addBufferedBytes(static_cast<int64_t>(bytes) - static_cast<int64_t>(old));
+    }
+}
+
+void TcpConnection::releaseBufferedBytes()
+{
+    size_t old = bufferedBytes_.exchange(0, std::memory_order_relaxed);
+    getLoop()->addBufferedBytes(-static_cast<int64_t>(old));
+}
+
+bool TcpConnection::inOwnerLoop() const
+{
+    return getLoop()->isInLoopThread() && !migrating();
+}
+
+void TcpConnection::queueInOwnerLoop(Task &&cb)
+{
+    std::unique_lock<std::mutex> lock(migrateMutex_);
+    if (migrating_)
+    {
+        migrateBacklog_.push_back(std::move(cb));
+    }
+    else
+    {
+        getLoop()->queueInLoop(std::move(cb));
+    }
+}
+
+/**
+ * 迁移分三步
+ * 1. 任意线程：设置migrating_，之后的send/shutdown/forceClose都进入migrateBacklog_
+ * 2. 旧loop：之前投递的回调都执行完了，从旧的Poller注销，换一个属于新loop的Channel，修改loop_
+ * 3. 新loop：注册读写事件，然后按顺序执行migrateBacklog_
+ * 旧loop在第2步之前照常处理IO事件，回调里的send也进入migrateBacklog_，不会和之前的数据乱序
+ */
+void TcpConnection::migrateTo(EventLoop *loop, TimingWheel *idleWheel)
+{
+    {
+        std::unique_lock<std::mutex> lock(migrateMutex_);
+        if (migrating_)
+        {
+            return; // 已经在迁移了
+        }
+        migrating_ = true;
+    }
+    getLoop()->queueInLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop, idleWheel));
+}
+
+void TcpConnection::migrateInLoop(EventLoop *loop, TimingWheel *idleWheel)
+{
+    EventLoop *oldLoop = getLoop();
+    if (state_ != kConnected || loop == oldLoop || completionIo_ || loop->completionIo() || spliced_)
+    {
+        finishMigration();
+        return;
+    }
+
+    flushCork(); // 合并的数据在旧loop里发出去，新loop里重新开始合并
+    bool writing = !edgeTriggered_ && channel_.isWriting();
+    channel_.disableAll();
+    channel_.remove();
+    if (idleWheel_)
+    {
+        idleWheel_->remove(this);
+    }
+    if (bufferTimer_.valid())
+    {
+        oldLoop->cancel(bufferTimer_);
+        bufferTimer_ = TimerId();
+    }
+
+    if (loopChangeCallback_)
+    {
+        loopChangeCallback_(shared_from_this(), oldLoop, false);
+    }
+    channel_.setOwnerLoop(loop); // 已经从旧loop的Poller里删掉了，回调不变
+    idleWheel_ = idleWheel;
+    releaseBufferedBytes(); // 从旧loop的计数里减掉，在新loop里重新累加
+    oldLoop->connectionRemoved();
+    loop->connectionAdded();
+    loop_.store(loop, std::memory_order_release);
+    loop->queueInLoop(std::bind(&TcpConnection::migrateEstablished, shared_from_this(), writing));
+}
+
+void TcpConnection::migrateEstablished(bool writing)
+{
+    channel_.tie(shared_from_this());
+    if (edgeTriggered_)
+    {
+        channel_.enableEdgeTriggered(); // 注册时已经就绪的读写事件也会通知一次
+        if (!isReading())
+        {
+            channel_.disableReading();
+        }
+    }
+    else
+    {
+        if (isReading())
+        {
+            channel_.enableReading();
+        }
+        if (writing)
+        {
+            channel_.enableWriting();
+        }
+    }
+    if (idleWheel_)
+    {
+        idleWheel_->add(shared_from_this());
+    }
+    startBufferTimer();
+    updateBufferedBytes();
+    if (loopChangeCallback_)
+    {
+        loopChangeCallback_(shared_from_this(), getLoop(), true);
+    }
+    finishMigration();
+}
+
+void TcpConnection::finishMigration()
+{
+    std::vector<Task> backlog;
+    {
+        std::unique_lock<std::mutex> lock(migrateMutex_);
+        migrating_ = false;
+        backlog.swap(migrateBacklog_);
+    }
+    for (Task &cb : backlog)
+    {
+        cb();
+    }
+}
+
+void TcpConnection::startBufferTimer()
+{
+    if (bufferIdleTimeout_ > 0)
+    {
+        // 定时器不能延长连接的生命期，只保存weak_ptr
+        std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+        bufferTimer_ = getLoop()->runEvery(bufferIdleTimeout_, [weakConn]() {
+            TcpConnectionPtr conn(weakConn.lock());
+            if (conn)
+            {
+                conn->releaseIdleBuffer();
+            }
+        });
+    }
+}
+
+// 连接建立
+void TcpConnection::connectEstablished()
+{
+    setState(kConnected);
+    channel_.tie(shared_from_this());
+    if (completionIo_)
+    {
+        edgeTriggered_ = false;
+        completionIo_->startRecv(&channel_, shared_from_this(),
+            std::bind(&TcpConnection::handleRecvComplete, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+    else if (edgeTriggered_ && getLoop()->supportsEdgeTriggered())
+    {
+        channel_.enableEdgeTriggered(); // 读写事件只注册这一次
+    }
+    else
+    {
+        edgeTriggered_ = false;
+        channel_.enableReading(); // 向poller注册channel的epollin事件
+    }
+    if (!isReading())
+    {
+        updateReading(); // 建立之前就调用了stopRead
+    }
+    // 完成通知模式下发送由内核完成，不经过outputBuffer_.writeFd
+    if (zeroCopyThreshold_ > 0 && !completionIo_ && !localAddr_.isUnix() && socket_.setZeroCopy(true))
+    {
+        outputBuffer_.setZeroCopyThreshold(zeroCopyThreshold_);
+    }
+    if (idleWheel_)
+    {
+        idleWheel_->add(shared_from_this());
+    }
+    startBufferTimer();
+    lastActiveTime_.store(Timestamp::now().microSecondsSinceEpoch(), std::memory_order_relaxed);
+
+    if (tls_)
+    {
+        // 握手完成以后再回调connectionCallback_  客户端先发ClientHello
+        if (!tls_->isServer())
+        {
+            tlsInput(nullptr, 0, Timestamp::now());
+        }
+        return;
+    }
+    // 新连接建立，执行回调
+    connectionCallback_(shared_from_this());
+}
+
+// 连接销毁
+void TcpConnection::connectDestroyed()
+{
+    if (!inOwnerLoop())
+    {
+        // 投递到旧loop的时候连接正在迁移，等迁移完成以后在新loop里销毁
+        queueInOwnerLoop(std::bind(&TcpConnection::connectDestroyed, shared_from_this()));
+        return;
+    }
+    if (state_ == kConnected)
+    {
+        setState(kDisconnected);
+        channel_.disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
+        if (!tls_ || tlsEstablished_)
+        {
+            connectionCallback_(shared_from_this());
+        }
+    }
+    if (idleWheel_)
+    {
+        idleWheel_->remove(this);
+    }
+    if (bufferTimer_.valid())
+    {
+        getLoop()->cancel(bufferTimer_);
+    }
+    if (completionIo_)
+    {
+        completionIo_->cancel(&channel_); // 内核中的recv/send结束以后才会释放最后一个引用
+    }
+    if (outputBuffer_.zeroCopyPendingBytes() > 0)
+    {
+        handleZeroCopyCompletions(); // 已经到达的完成通知，都确认了的话析构时可以正常close
+    }
+    channel_.remove(); // 把channel从poller中删除掉
+    releaseBufferedBytes();
+}
+
+/**
+ * handleRead函数主要是用于当已经建立的连接，
+ * 对方发送数据给你了此时这个文件描述符的读事件就绪调用的回调方法就是这个。
+ * 将用户发过来的数据拷贝到接收缓冲区当中然后再调用用户自定义的消息到来时的回调函数
+*/
+void TcpConnection::handleRead(Timestamp receiveTime)
+{
+    if (!isReading())
+    {
+        updateReading(); // 暂停读之前poller已经返回的事件
+        return;
+    }
+    if (splicePipe_)
+    {
+        handleSpliceRead();
+        return;
+    }
+    if (tls_ && !tls_->rxOffloaded())
+    {
+        handleTlsRead(receiveTime);
+        return;
+    }
+    if (edgeTriggered_)
+    {
+        handleReadUntilEagain(receiveTime);
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, fdPassing_ ? &receivedFds_ : nullptr);
+    if (n > 0)
+    {
+        bytesReceived_ += static_cast<uint64_t>(n);
+        getLoop()->metrics().add(LoopMetrics::kBytesRead, static_cast<uint64_t>(n));
+        lastReceiveTime_ = receiveTime;
+        touchActive();
+        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
+        runMessageCallback(receiveTime);
+        updateBufferedBytes();
+    }
+    else if (n == 0)
+    {
+        handleClose();
+    }
+    else if (tls_ && savedErrno == EIO)
+    {
+        // 内核TLS收到了不是应用数据的记录，一般是对端的close_notify
+        if (!tls_->readControlRecord(channel_.fd()))
+        {
+            handleClose();
+        }
+    }
+    else
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+    }
+}
+
+// handleWrite:负责处理Tcp连接的可写事件
+
+// TCP缓冲区能不能容纳得了这么多的数据了。如果此时TCP缓冲区不能容纳得了这么多数据那么处理？
+// 首先他会将这些数据保存到用户层定义的发送缓冲区当中并且向事件监听器注册写事件
+// 当事件监听器检测到写事件就绪就会调用TcpConnection对象当中的handlwrite将剩余的数据写入到TCP的发送缓冲区当中
+// 当我们调用handlwrite时如果还是不能完全写入到TCP的发送缓冲区当中，此时尽可能的将数据写入到发送缓冲区当中依然保持事件
+// 如果此时我们一次性将数据写入到缓冲区当中，此时需要将写事件从事件监听器当中删除这样做的目的是为了不让epoll_wait一直通知我们写事件就绪，在这里是毫无意义的。
+void TcpConnection::handleWrite()
+{
+    if (edgeTriggered_)
+    {
+        handleWriteUntilEagain();
+    }
+    else if (channel_.isWriting())
+    {
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno); // 已发送的数据已经从队列中删除
+        if (n > 0)
+        {
+            getLoop()->metrics().add(LoopMetrics::kBytesWritten, static_cast<uint64_t>(n));
+            touchActive();
+            checkLowWaterMark();
+            if (outputBuffer_.readableBytes() == 0)
+            {
+                channel_.disableWriting();
+                onOutputDrained();
+            }
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            getLoop()->metrics().add(LoopMetrics::kEagain);
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::handleWrite");
+            if (savedErrno == EIO)
+            {
+                abortOutput(savedErrno);
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+
+// 边沿触发：这次可读通知之后内核不会再提醒已经在接收缓冲区里的数据，一直读到EAGAIN
+void TcpConnection::handleReadUntilEagain(Timestamp receiveTime)
+{
+    int savedErrno = 0;
+    ssize_t n;
+    while (true)
+    {
+        ssize_t total = 0;
+        while (total < kEdgeReadChunk && (n = inputBuffer_.readFd(channel_.fd(), &savedErrno, fdPassing_ ? &receivedFds_ : nullptr)) > 0)
+        {
+            total += n;
+        }
+
+        if (total > 0)
+        {
+            bytesReceived_ += static_cast<uint64_t>(total);
+            getLoop()->metrics().add(LoopMetrics::kBytesRead, static_cast<uint64_t>(total));
+            lastReceiveTime_ = receiveTime;
+            touchActive();
+            runMessageCallback(receiveTime);
+            updateBufferedBytes();
+        }
+
+        if (state_ == kDisconnected || !isReading())
+        {
+            // messageCallback_里面已经关闭了连接；或者暂停了读，startRead重新注册EPOLLIN时会再通知
+            return;
+        }
+        if (n <= 0)
+        {
+            break; // 读到了EAGAIN、对端关闭或者出错
+        }
+    }
+    if (n == 0)
+    {
+        handleClose();
+    }
+    else if (tls_ && savedErrno == EIO)
+    {
+        if (tls_->readControlRecord(channel_.fd()))
+        {
+            handleReadUntilEagain(receiveTime); // 边沿触发，后面的数据不会再通知
+        }
+        else
+        {
+            handleClose();
+        }
+    }
+    else if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+    {
+        // 出错以后不会再有新的通知，和对端关闭一样处理
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+        handleClose();
+    }
+}
+
+// 边沿触发：写事件一直注册着，没有数据要发送的通知直接忽略；有数据就写到EAGAIN或者写完
+void TcpConnection::handleWriteUntilEagain()
+{
+    if (outputBuffer_.readableBytes() == 0)
+    {
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t total = 0;
+    ssize_t n;
+    while (outputBuffer_.readableBytes() > 0
+        && (n = outputBuffer_.writeFd(channel_.fd(), &savedErrno)) > 0)
+    {
+        total += n;
+    }
+
+    if (total > 0)
+    {
+        getLoop()->metrics().add(LoopMetrics::kBytesWritten, static_cast<uint64_t>(total));
+        touchActive();
+    }
+    checkLowWaterMark();
+    if (outputBuffer_.readableBytes() == 0)
+    {
+        onOutputDrained();
+    }
+    else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+    {
+        getLoop()->metrics().add(LoopMetrics::kEagain);
+    }
+    else
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleWrite");
+        if (savedErrno == EIO)
+        {
+            abortOutput(savedErrno);
+        }
+    }
+}
+
+// 用户态TLS的handleRead  水平触发一次通知读一次，边沿触发读到EAGAIN
+// 接收方向要交给内核时只读到记录的边界，不让OpenSSL手里剩下半条记录
+void TcpConnection::handleTlsRead(Timestamp receiveTime)
+{
+    char buf[kTlsReadChunk];
+    for (;;)
+    {
+        size_t want = sizeof buf;
+        if (tls_->wantKtlsRx() && tls_->bytesToRecordBoundary() > 0)
+        {
+            want = std::min(want, tls_->bytesToRecordBoundary());
+        }
+        ssize_t n = ::read(channel_.fd(), buf, want);
+        if (n > 0)
+        {
+            bytesReceived_ += static_cast<uint64_t>(n);
+            getLoop()->metrics().add(LoopMetrics::kBytesRead, static_cast<uint64_t>(n));
+            lastReceiveTime_ = receiveTime;
+            touchActive();
+            if (!tlsInput(buf, static_cast<size_t>(n), receiveTime))
+            {
+                return;
+            }
+        }
+        else if (n == 0)
+        {
+            handleClose();
+            return;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return;
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::handleRead");
+            handleError();
+            handleClose();
+            return;
+        }
+
+        if (state_ == kDisconnected || !isReading())
+        {
+            return;
+        }
+        if (tls_->rxOffloaded())
+        {
+            // 接收缓冲区里剩下的已经由内核解密了  水平触发时poller会再通知
+            if (edgeTriggered_)
+            {
+                handleReadUntilEagain(receiveTime);
+            }
+            return;
+        }
+        if (!edgeTriggered_)
+        {
+            return;
+        }
+    }
+}
+
+bool TcpConnection::tlsInput(const char *data, size_t len, Timestamp receiveTime)
+{
+    size_t before = inputBuffer_.readableBytes();
+    std::string out;
+    TlsFilter::Result result = tls_->feed(data, len, &inputBuffer_, &out);
+    if (!out.empty() && tls_->txOffloaded())
+    {
+        // 发送已经交给内核了，OpenSSL不能再写（比如回应对端的KeyUpdate）
+        LOG_ERROR("TcpConnection::tlsInput [%s] - post-handshake message after kTLS \n", name().c_str());
+        result = TlsFilter::kError;
+        out.clear();
+    }
+    queueTlsOutput(out); // 握手消息、session ticket、alert
+    if (result == TlsFilter::kError)
+    {
+        LOG_ERROR("TcpConnection::tlsInput [%s] - TLS error, close \n", name().c_str());
+        handleClose();
+        return false;
+    }
+    if (!tlsEstablished_ && tls_->handshakeDone())
+    {
+        tlsHandshakeDone();
+        if (state_ == kDisconnected)
+        {
+            return false;
+        }
+    }
+    if (inputBuffer_.readableBytes() > before)
+    {
+        runMessageCallback(receiveTime);
+    }
+    updateBufferedBytes();
+    if (result == TlsFilter::kClosed)
+    {
+        handleClose();
+        return false;
+    }
+    if (state_ == kDisconnected)
+    {
+        return false;
+    }
+    if (tls_->wantKtlsRx() && tls_->enableKtlsRx(channel_.fd()))
+    {
+        getLoop()->metrics().add(LoopMetrics::kKtlsOffloads);
+        LOG_DEBUG("TcpConnection::tlsInput [%s] - kernel TLS receive \n", name().c_str());
+    }
+    return true;
+}
+
+void TcpConnection::tlsHandshakeDone()
+{
+    LoopMetrics &metrics = getLoop()->metrics();
+    metrics.add(LoopMetrics::kTlsHandshakes);
+    if (tls_->resumed())
+    {
+        metrics.add(LoopMetrics::kTlsResumed);
+    }
+    LOG_DEBUG("TcpConnection::tlsHandshakeDone [%s] - %s %s%s \n", name().c_str(),
+        tls_->version(), tls_->cipher(), tls_->resumed() ? " resumed" : "");
+    tlsEstablished_ = true;
+    // 服务器的session ticket还在队列里时，等发送完在onOutputDrained里再切换
+    tryKtlsTx();
+    pumpTls(); // 握手期间send的数据
+    connectionCallback_(shared_from_this());
+}
+
+// 源连接：socket => pipe，再把这段管道数据交给dst发送  水平触发一次通知splice一次，边沿触发读到EAGAIN
+void TcpConnection::handleSpliceRead()
+{
+    TcpConnectionPtr dst(spliceTarget_.lock());
+    if (!dst || dst->state_ == kDisconnected)
+    {
+        if (state_ != kDisconnected)
+        {
+            LOG_INFO("TcpConnection::handleSpliceRead [%s] - splice target closed\n", name().c_str());
+            handleClose();
+        }
+        return;
+    }
+
+    const int fd = channel_.fd();
+    size_t total = 0;
+    int savedErrno = 0;
+    bool eof = false;
+    while (true)
+    {
+        size_t room = splicePipe_->writable();
+        if (room == 0)
+        {
+            pauseSplice();
+            break;
+        }
+        ssize_t n = ::splice(fd, NULL, splicePipe_->writeFd(), NULL, room, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+        if (n > 0)
+        {
+            total += static_cast<size_t>(n);
+            splicePipe_->produced(static_cast<size_t>(n));
+            dst->sendPipeInLoop(splicePipe_, static_cast<size_t>(n));
+            if (!edgeTriggered_)
+            {
+                break;
+            }
+            continue;
+        }
+        if (n == 0)
+        {
+            eof = true;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // 管道按页存放，没到capacity也可能写满  socket里还有数据说明是管道满了
+            int avail = 0;
+            if (splicePipe_->buffered() > 0 && ::ioctl(fd, FIONREAD, &avail) == 0 && avail > 0)
+            {
+                pauseSplice();
+            }
+        }
+        else
+        {
+            savedErrno = errno;
+        }
+        break;
+    }
+
+    if (total > 0)
+    {
+        bytesReceived_ += total;
+        getLoop()->metrics().add(LoopMetrics::kBytesRead, total);
+        lastReceiveTime_ = getLoop()->pollReturnTime();
+        touchActive();
+    }
+    if (eof)
+    {
+        handleClose();
+    }
+    else if (savedErrno != 0)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleSpliceRead");
+        handleError();
+        handleClose();
+    }
+}
+
+void TcpConnection::pauseSplice()
+{
+    splicePipe_->markFull();
+    if (!edgeTriggered_ && channel_.isReading())
+    {
+        channel_.disableReading();
+    }
+}
+
+// dst把管道发送掉一半，或者dst关闭了
+void TcpConnection::resumeSplice()
+{
+    if (!splicePipe_ || state_ == kDisconnected || !isReading())
+    {
+        return; // 暂停读的时候管道空出来了，startRead时再注册EPOLLIN
+    }
+    if (!channel_.isReading())
+    {
+        channel_.enableReading();
+    }
+    handleSpliceRead();
+}
+
+void TcpConnection::startRead()
+{
+    if (inOwnerLoop())
+    {
+        startReadInLoop();
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    if (inOwnerLoop())
+    {
+        stopReadInLoop();
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::startReadInLoop()
+{
+    if (!reading_)
+    {
+        reading_ = true;
+        updateReading();
+    }
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    if (reading_)
+    {
+        reading_ = false;
+        updateReading();
+    }
+}
+
+void TcpConnection::throttleRead(bool pause)
+{
+    if (inOwnerLoop())
+    {
+        throttleReadInLoop(pause);
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::throttleReadInLoop, shared_from_this(), pause));
+    }
+}
+
+void TcpConnection::throttleReadInLoop(bool pause)
+{
+    if (pause)
+    {
+        ++throttled_;
+    }
+    else if (throttled_ > 0)
+    {
+        --throttled_;
+    }
+    updateReading();
+}
+
+void TcpConnection::setMemoryThrottled(bool on)
+{
+    if (inOwnerLoop())
+    {
+        setMemoryThrottledInLoop(on);
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::setMemoryThrottledInLoop, shared_from_this(), on));
+    }
+}
+
+void TcpConnection::setMemoryThrottledInLoop(bool on)
+{
+    if (memoryThrottled_ != on)
+    {
+        memoryThrottled_ = on;
+        throttleReadInLoop(on);
+    }
+}
+
+void TcpConnection::updateReading()
+{
+    if (state_ == kDisconnected || state_ == kConnecting)
+    {
+        return; // connectEstablished时才注册，isReading()为false就不会回调messageCallback
+    }
+    if (completionIo_)
+    {
+        // 内核里的recv一直都在，只能暂停回调
+        if (isReading() && (inputBuffer_.readableBytes() > 0 || peerClosed_))
+        {
+            getLoop()->queueInLoop(std::bind(&TcpConnection::deliverPendingInput, shared_from_this()));
+        }
+        return;
+    }
+    // splice管道满的时候由resumeSplice注册
+    bool want = isReading() && !(splicePipe_ && splicePipe_->full());
+    if (want && !channel_.isReading())
+    {
+        channel_.enableReading(); // 边沿触发重新注册时，已经可读也会通知一次
+    }
+    else if (!want && channel_.isReading())
+    {
+        channel_.disableReading();
+    }
+}
+
+void TcpConnection::deliverPendingInput()
+{
+    if (state_ == kDisconnected || !isReading())
+    {
+        return;
+    }
+    if (inputBuffer_.readableBytes() > 0)
+    {
+        runMessageCallback(getLoop()->pollReturnTime());
+        updateBufferedBytes();
+    }
+    if (peerClosed_ && state_ != kDisconnected && isReading())
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::setBackpressure(const TcpConnectionPtr &source, size_t highWaterMark, size_t lowWaterMark)
+{
+    std::weak_ptr<TcpConnection> weakSource(source); // 互相持有shared_ptr会循环引用
+    if (inOwnerLoop())
+    {
+        setBackpressureInLoop(weakSource, highWaterMark, lowWaterMark);
+    }
+    else
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::setBackpressureInLoop, shared_from_this(),
+            weakSource, highWaterMark, lowWaterMark));
+    }
+}
+
+void TcpConnection::setBackpressureInLoop(const std::weak_ptr<TcpConnection> &source, size_t highWaterMark, size_t lowWaterMark)
+{
+    highWaterMark_ = highWaterMark;
+    lowWaterMark_ = lowWaterMark;
+    backpressureSources_.push_back(source);
+    TcpConnectionPtr conn(source.lock());
+    if (conn && aboveHighWater_)
+    {
+        conn->throttleRead(true); // 已经超过高水位了，新加的source也要暂停
+    }
+}
+
+void TcpConnection::checkLowWaterMark()
+{
+    updateBufferedBytes();
+    if (aboveHighWater_ && outputBuffer_.readableBytes() <= lowWaterMark_)
+    {
+        if (lowWaterMarkCallback_)
+        {
+            getLoop()->queueInLoop(
+                std::bind(lowWaterMarkCallback_, shared_from_this(), outputBuffer_.readableBytes())
+            );
+        }
+        releaseBackpressure();
+    }
+}
+
+void TcpConnection::releaseBackpressure()
+{
+    if (!aboveHighWater_)
+    {
+        return;
+    }
+    aboveHighWater_ = false;
+    for (const std::weak_ptr<TcpConnection> &weakSource : backpressureSources_)
+    {
+        TcpConnectionPtr source(weakSource.lock());
+        if (source)
+        {
+            source->throttleRead(false);
+        }
+    }
+}
+
+// 完成通知模式下的handleRead，数据已经由内核读好了
+void TcpConnection::handleRecvComplete(const char *data, ssize_t n, Timestamp receiveTime)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (n > 0)
+    {
+        inputBuffer_.append(data, n);
+        bytesReceived_ += static_cast<uint64_t>(n);
+        getLoop()->metrics().add(LoopMetrics::kBytesRead, static_cast<uint64_t>(n));
+        lastReceiveTime_ = receiveTime;
+        touchActive();
+        if (isReading())
+        {
+            runMessageCallback(receiveTime);
+        }
+        updateBufferedBytes();
+    }
+    else if (n == 0 && !isReading() && inputBuffer_.readableBytes() > 0)
+    {
+        peerClosed_ = true; // 暂停期间收到的数据处理完再关闭
+    }
+    else if (n == 0)
+    {
+        handleClose();
+    }
+    else
+    {
+        // recv结束了，不会再有数据，和对端关闭一样处理
+        errno = static_cast<int>(-n);
+        LOG_ERROR("TcpConnection::handleRecvComplete");
+        handleError();
+        handleClose();
+    }
+}
+
+// 完成通知模式下的handleWrite
+void TcpConnection::handleSendComplete(ssize_t n)
+{
+    sendInFlight_ = false;
+    if (n > 0)
+    {
+        outputBuffer_.retrieve(static_cast<size_t>(n));
+        getLoop()->metrics().add(LoopMetrics::kBytesWritten, static_cast<uint64_t>(n));
+        touchActive();
+        checkLowWaterMark();
+        if (outputBuffer_.readableBytes() == 0)
+        {
+            onOutputDrained();
+        }
+        else if (state_ != kDisconnected)
+        {
+            startSend();
+        }
+    }
+    else
+    {
+        errno = static_cast<int>(-n);
+        LOG_ERROR("TcpConnection::handleSendComplete");
+        // 暂停读的时候recv不会把对端关闭报上来（见handleRecvComplete），发送失败时直接关闭
+        if (state_ != kDisconnected && (!isReading() || peerClosed_))
+        {
+            handleClose();
+        }
+    }
+}
+
+// poller => channel::closeCallback => TcpConnection::handleClose
+void TcpConnection::handleClose()
+{
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(), (int)state_);
+    setState(kDisconnected);
+    channel_.disableAll();
+
+    TcpConnectionPtr connPtr(shared_from_this());
+    releaseBackpressure();
+    TcpConnectionPtr source(spliceSource_.lock());
+    if (source)
+    {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::resumeSplice, source));
+    }
+    if (!tls_ || tlsEstablished_) // 握手没有完成的连接用户没见过
+    {
+        connectionCallback_(connPtr); // 执行连接关闭的回调
+    }
+    closeCallback_(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+}
+
+void TcpConnection::handleError()
+{
+    // MSG_ZEROCOPY的完成通知放在错误队列里，epoll报告EPOLLERR，但连接本身没有出错
+    bool notified = zeroCopyThreshold_ > 0 && handleZeroCopyCompletions();
+    int optval;
+    socklen_t optlen = sizeof optval;
+    int err = 0;
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        err = errno;
     }
     else
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    if (notified && err == 0)
+    {
+        return;
+    }
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
+}
+
+bool TcpConnection::handleZeroCopyCompletions()
+{
+    bool notified = false;
+    bool copied = false;
+    char control[128];
+    for (;;)
+    {
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_.fd(), &msg, MSG_ERRQUEUE) < 0)
+        {
+            break; // EAGAIN，错误队列读完了
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            // [ee_info, ee_data]这几次发送已经完成，内核可能把连续几次的通知合并成一条
+            outputBuffer_.zeroCopyCompleted(serr->ee_info, serr->ee_data);
+            notified = true;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                copied = true;
+            }
+        }
+    }
+    if (copied && outputBuffer_.zeroCopyThreshold() > 0)
+    {
+        // 网卡不支持scatter-gather或者是loopback，内核还是拷贝了，再用只会多一些通知的开销
+        LOG_INFO("TcpConnection::handleZeroCopyCompletions [%s] - kernel copied, MSG_ZEROCOPY disabled\n", name().c_str());
+        outputBuffer_.setZeroCopyThreshold(0);
+    }
+    if (notified)
+    {
+        updateBufferedBytes(); // 确认发送完成的数据已经释放
+    }
+    return notified;
 }
\ No newline at end of file
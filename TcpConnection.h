@@ -5,14 +5,25 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "TimerId.h"
+#include "Slice.h"
+#include "OutputQueue.h"
+#include "Task.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "TlsContext.h"
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <vector>
 
-class Channel;
 class EventLoop;
-class Socket;
+class CompletionIo;
+class TlsFilter;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -23,23 +34,96 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
 {
 public:
     TcpConnection(EventLoop *loop, 
-                const std::string &name, 
+                std::string name,   // 移动进来，不再拷贝
+                int sockfd,
+                const InetAddress& localAddr,
+                const InetAddress& peerAddr);
+    // TcpServer用：只保存id和所有连接共享的前缀，名字"namePrefix#id"在第一次调用name()时才生成
+    TcpConnection(EventLoop *loop,
+                uint64_t id,
+                std::shared_ptr<const std::string> namePrefix,
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr);
     ~TcpConnection();
 
-    EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
+    // 迁移以后会变，在其它线程调用时返回的可能是迁移之前的loop
+    EventLoop* getLoop() const { return loop_.load(std::memory_order_acquire); }
+    // TcpServer分配的连接id，进程内不重复  用名字构造的连接为0
+    uint64_t id() const { return id_; }
+    // 线程安全
+    const std::string& name() const;
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
-    void send(const std::string &buf);
+    // 发送数据  都是线程安全的
+    // 在其它线程调用时，数据的所有权被移动/共享到loop线程，调用返回后参数可以立刻销毁
+    void send(const std::string &buf);  // 其它线程调用时会拷贝一次
+    void send(std::string &&buf);       // 移动，不拷贝
+    void send(Buffer *buf);             // 和buf交换内容，调用后buf为空
+    void send(const SlicePtr &slice);   // 共享同一份数据，适合广播
+    // 发送文件fd的[offset, offset+len)，sendfile直接从page cache发送，不经过用户态
+    // fd会被dup，调用返回后可以马上关掉；和其它数据一样按顺序发送，计入高水位，发送完回调writeCompleteCallback
+    // 完成通知模式没有sendfile，每次pread一段到内存再发送  文件比len短时关闭连接
+    void sendFile(int fd, off_t offset, size_t len);
+    // AF_UNIX：data和fds一起发送（SCM_RIGHTS），对端收到data的第一个字节时同时收到fds  data不能为空
+    // fds会被dup，调用返回后可以马上关掉；和其它数据一样按顺序发送  完成通知模式不支持
+    void sendWithFds(const std::string &data, const std::vector<int> &fds);
+    // 打开以后用recvmsg读，对端传过来的fd保存下来，在messageCallback里用takeReceivedFds取走
+    // 在连接所属的loop线程里调用，在connectionCallback里或者之前设置才不会漏掉第一条消息带的fd
+    void setFdPassing(bool on) { fdPassing_ = on; }
+    // 取走到目前为止收到的fd，之后由调用方负责关闭  没取走的在连接销毁时关闭
+    std::vector<int> takeReceivedFds() { std::vector<int> fds; fds.swap(receivedFds_); return fds; }
+    // 代理用：之后这个连接收到的数据splice进管道，再从管道splice到dst，不经过用户态，也不再回调messageCallback
+    // inputBuffer_里还没处理的数据先发给dst  dst关闭以后这个连接也关闭；这个连接关闭以后，管道里剩下的数据dst照常发送
+    // 只能在loop线程调用，两个连接必须属于同一个loop，不能是完成通知模式，之后都不能迁移  不满足时返回false
+    bool startSplice(const TcpConnectionPtr &dst);
+    // 这个连接跑TLS：握手完成以后才回调connectionCallback，messageCallback拿到的是解密以后的明文，send的数据加密以后发送
+    // 握手完成之前send的数据先保存着，握手完成以后按顺序发送  握手失败或者收到篡改的数据时关闭连接，不回调connectionCallback
+    // 内核支持时发送和接收分别交给内核TLS，之后sendFile也是sendfile；用户态加密时文件每次读一段加密
+    // serverName是客户端的SNI  在connectEstablished之前调用  完成通知模式不支持，不能和startSplice、sendWithFds一起用
+    bool startTls(const TlsContextPtr &context, const std::string &serverName = std::string());
+    // 没有TLS时为空  只在连接所属的loop线程中使用
+    const TlsFilter* tls() const { return tls_.get(); }
+    // 暂停/继续读  暂停期间EPOLLIN不注册，数据留在内核的接收缓冲区里，TCP窗口关闭以后对端就发不过来了
+    // 线程安全，按和send一样的顺序生效  完成通知模式下内核里一直有recv，暂停期间收到的数据放在inputBuffer_里，
+    // 继续读以后再回调messageCallback
+    void startRead();
+    void stopRead();
+    // 用户没有stopRead，也没有被setBackpressure暂停  只在连接所属的loop线程中读
+    bool isReading() const { return reading_ && throttled_ == 0; }
     // 关闭连接
     void shutdown();
+    // 不等待数据发送完，直接关闭连接
+    void forceClose();
+
+    // 空闲超时使用的时间轮，必须和连接属于同一个loop，在connectEstablished之前设置
+    void setIdleWheel(TimingWheel *wheel) { idleWheel_ = wheel; }
+    // 接收缓冲区空闲超过seconds秒就把内存还给BufferPool，0表示不释放  在connectEstablished之前设置
+    void setBufferIdleTimeout(double seconds) { bufferIdleTimeout_ = seconds; }
+    // 使用边沿触发，Poller不支持或者使用完成通知IO时仍然是水平触发  在connectEstablished之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    // 给socket设置SO_BUSY_POLL
+    void setBusyPoll(int micros);
+    // 不小于threshold字节的数据用send(MSG_ZEROCOPY)发送，网卡直接从用户内存DMA，不拷贝进内核  0表示不用
+    // 只对send(std::string&&)、send(SlicePtr)这种不需要拷贝进发送队列的数据有意义，数据一直持有到内核确认发送完成
+    // 内核太旧、完成通知模式时不起作用；内核报告还是拷贝了（比如loopback）以后自动关掉  在connectEstablished之前设置
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    // 已经交给内核、还在等MSG_ZEROCOPY完成通知的字节数  只在连接所属的loop线程中读
+    size_t zeroCopyPendingBytes() const { return outputBuffer_.zeroCopyPendingBytes(); }
+    // 自动合并发送：loop线程中的send不马上write，先放进发送队列，这一轮循环结束时一次writev发出去，
+    // 攒够kCorkFlushBytes也马上发送  一次onMessage里多次send、同一轮里别的连接发过来的广播都只有一次系统调用
+    // 代价是同一轮里后面处理的事件多一点延迟  在connectEstablished之前设置
+    void setAutoCork(bool on) { autoCork_ = on; }
+    // 批量写：打开TCP_CORK，内核攒满MSS才发包，setCork(false)或者flush时发出剩下的不满一个包的数据
+    // 和send一样线程安全，按调用的顺序生效
+    void setCork(bool on);
+    // 关闭Nagle算法，小包马上发出去  只是一次setsockopt，任意线程都可以调用
+    void setTcpNoDelay(bool on) { socket_.setTcpNoDelay(on); }
+    // 马上发出自动合并还没发送的数据，打开了TCP_CORK时让内核把不满一个包的数据也发出去
+    void flush();
 
     void setConnectionCallback(const ConnectionCallback& cb)
     { connectionCallback_ = cb; }
@@ -53,33 +137,180 @@ public:
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
 
+    // 发送队列超过高水位以后，又降到不高于lowWaterMark时回调  在connectEstablished之前设置
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb, size_t lowWaterMark)
+    { lowWaterMarkCallback_ = cb; lowWaterMark_ = lowWaterMark; }
+
+    // 反压：这个连接的发送队列超过highWaterMark时source停止读，降到不高于lowWaterMark时继续读
+    // 代理里把下游连接的数据源设成上游连接，下游慢的时候上游也不读，两边的缓冲区都有上限
+    // source可以属于其它loop，可以是这个连接自己（回显类的服务）；可以调用多次添加多个source，高低水位以最后一次为准
+    // 一个source被多个连接暂停时，所有连接都降到低水位以下才继续读  和用户的stopRead互不影响  线程安全
+    void setBackpressure(const TcpConnectionPtr &source, size_t highWaterMark, size_t lowWaterMark);
+
     void setCloseCallback(const CloseCallback& cb)
     { closeCallback_ = cb; }
 
+    // 迁移时连接换了loop：离开旧loop时在旧loop线程中回调(conn, 旧loop, false)，
+    // 在新loop注册好以后、执行迁移中积压的回调之前，在新loop线程中回调(conn, 新loop, true)
+    // 放弃迁移时不回调  TcpServer用它把连接从一个loop的分片移到另一个
+    void setLoopChangeCallback(const LoopChangeCallback& cb)
+    { loopChangeCallback_ = cb; }
+
+    // 把连接迁移到另一个loop  线程安全，异步完成
+    // 之前投递的回调在旧loop里执行完，迁移过程中投递的send/shutdown等在新loop里按顺序执行，
+    // outputBuffer_和inputBuffer_里的数据原样带过去  idleWheel是新loop的时间轮，不检测空闲超时时为空
+    // 完成通知模式下内核里还有recv/sendv，不支持迁移；连接不在kConnected状态时也不迁移
+    void migrateTo(EventLoop *loop, TimingWheel *idleWheel = nullptr);
+    bool migrating() const { return migrating_.load(std::memory_order_acquire); }
+    // 收到的字节总数  只在连接所属的loop线程中读
+    uint64_t bytesReceived() const { return bytesReceived_; }
+    // 最近一次收到数据或者发送出去数据的时间，都没有时是连接建立的时间  任意线程都可以读
+    Timestamp lastActiveTime() const { return Timestamp(lastActiveTime_.load(std::memory_order_relaxed)); }
+    // 接收缓冲区的容量加上发送队列里的字节数（文件段也算，还有等MSG_ZEROCOPY确认的数据），读写以后更新，
+    // 变化量同时加到所属loop的EventLoop::bufferedBytes上  任意线程都可以读
+    size_t bufferedBytes() const { return bufferedBytes_.load(std::memory_order_relaxed); }
+    // TcpServer的内存预算用：暂停/恢复读，重复调用只算一次，和stopRead、setBackpressure互不影响  线程安全
+    void setMemoryThrottled(bool on);
+
     // 连接建立
     void connectEstablished();
     // 连接销毁
     void connectDestroyed();
 private:
+    // 上面两个构造函数都委托给这个
+    TcpConnection(EventLoop *loop,
+                uint64_t id,
+                std::shared_ptr<const std::string> namePrefix,
+                std::string name,
+                int sockfd,
+                const InetAddress& localAddr,
+                const InetAddress& peerAddr);
+
+    friend class TimingWheel;
+
     enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
     void setState(StateE state) { state_ = state; }
 
+    static const size_t kCorkFlushBytes = 64 * 1024;
+    static const size_t kTlsQueueBytes = 256 * 1024;
+
     void handleRead(Timestamp receiveTime);
     void handleWrite();
+    void handleReadUntilEagain(Timestamp receiveTime);
+    void handleWriteUntilEagain();
     void handleClose();
     void handleError();
+    // EPOLLERR时读错误队列里的MSG_ZEROCOPY完成通知，返回是否读到了
+    bool handleZeroCopyCompletions();
+    // loop的Poller支持完成通知IO时，读写由内核完成，结果从这里回调
+    void handleRecvComplete(const char *data, ssize_t n, Timestamp receiveTime);
+    void handleSendComplete(ssize_t n);
+    void startSend();
 
     void sendInLoop(const void* message, size_t len);
+    void sendStringInLoop(std::string &message);
+    void sendBufferInLoop(Buffer &buf);
+    void sendSliceInLoop(const SlicePtr &slice);
+    void sendFileInLoop(const FileRefPtr &file, off_t offset, size_t len);
+    void sendWithFdsInLoop(std::string &data, const FdListPtr &fds);
+    void sendPipeInLoop(const SplicePipePtr &pipe, size_t len);
+    void sendTlsInLoop(const char *data, size_t len);
+    // TLS的密文放进发送队列
+    void queueTlsOutput(std::string &out);
+    // 加密tlsBacklog_里的明文，发送队列里的密文攒到kTlsQueueBytes就停下，发送完再继续
+    void pumpTls();
+    // 发送队列空了的时候把发送交给内核TLS，tlsBacklog_里的明文直接放进发送队列
+    void tryKtlsTx();
+    void handleTlsRead(Timestamp receiveTime);
+    // 从socket读到的密文交给tls_，返回false表示连接已经关闭
+    bool tlsInput(const char *data, size_t len, Timestamp receiveTime);
+    void tlsHandshakeDone();
+    // 要用MSG_ZEROCOPY发送的数据不走writeDirectly，先放进队列
+    bool useZeroCopy(size_t len) const;
+    // 文件段、管道段不能用write直接发送，先放进队列  之前队列是空的就马上发送一次
+    void flushQueued(size_t oldLen, bool wasIdle);
+    // 发送队列里的文件读不出来了，后面的数据没办法按顺序发送，丢掉队列关闭连接
+    void abortOutput(int savedErrno);
+    void handleSpliceRead();
+    void pauseSplice();
+    void resumeSplice();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 作为source被下游暂停/恢复
+    void throttleRead(bool pause);
+    void throttleReadInLoop(bool pause);
+    // 按isReading()和splice管道的状态注册或者取消EPOLLIN
+    void updateReading();
+    // 完成通知模式下暂停期间收到的数据
+    void deliverPendingInput();
+    void setBackpressureInLoop(const std::weak_ptr<TcpConnection> &source, size_t highWaterMark, size_t lowWaterMark);
+    // 发送了一部分数据以后检查低水位，同时更新bufferedBytes_
+    void checkLowWaterMark();
+    // 降到低水位或者连接关闭，恢复所有被暂停的source
+    void releaseBackpressure();
+    void setMemoryThrottledInLoop(bool on);
+    // 重新计算bufferedBytes_，变化量加到所属loop上
+    void updateBufferedBytes();
+    // 连接销毁或者迁移走的时候，从所属loop的计数里减掉
+    void releaseBufferedBytes();
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void releaseIdleBuffer();
+    // 有读写进展：记录lastActiveTime_，刷新空闲超时的时间轮
+    void touchActive();
+    // 调用messageCallback_，采样到时记录执行时间
+    void runMessageCallback(Timestamp receiveTime);
+    void setupChannel();
+    void startBufferTimer();
+
+    // 当前线程就是连接所属的loop线程，而且没有在迁移
+    bool inOwnerLoop() const;
+    // 投递到连接所属的loop执行  迁移的时候先保存在migrateBacklog_里
+    void queueInOwnerLoop(Task &&cb);
+    void migrateInLoop(EventLoop *loop, TimingWheel *idleWheel);
+    void migrateEstablished(bool writing);
+    // 迁移结束或者放弃迁移，在连接所属的loop线程中执行积压的回调
+    void finishMigration();
 
-    EventLoop *loop_;           // 这里绝对不是baseLoop，因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;    // 保存已连接套接字文件描述符
+    // 发送队列为空时直接write，返回false表示连接已断开或者出错，剩下的数据不用再保存
+    bool writeDirectly(const char *data, size_t len, size_t *nwrote);
+    // 有数据放进了outputBuffer_，检查高水位并注册写事件
+    void onOutputQueued(size_t oldLen);
+    // outputBuffer_中的数据全部发送完成
+    void onOutputDrained();
+    // 还有数据等着可写事件发送，或者合并的发送还没有发出去
+    bool hasPendingOutput() const;
+    // 第一次合并发送时调用，这一轮循环结束时flushCork
+    void scheduleCorkFlush();
+    void flushCorkAfterIteration(EventLoop *loop);
+    void flushCork();
+    void setCorkInLoop(bool on);
+    void flushInLoop();
+
+    std::atomic<EventLoop*> loop_; // 这里绝对不是baseLoop，因为TcpConnection都是在subLoop里面管理的  迁移时在旧loop里修改
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_; // 为空表示构造时给了名字
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;
     std::atomic_int state_;     // 封装已经建立连接的文件描述符以及各种事件发生时对应的回调函数
-    bool reading_;
+    bool reading_;              // 用户调用stopRead以后为false
+    int throttled_;             // 作为source被多少个下游连接暂停了
+    bool peerClosed_;           // 完成通知模式下暂停读的时候对端关闭了
+    bool memoryThrottled_;      // 被TcpServer的内存预算暂停了，算在throttled_里
+
+    Buffer inputBuffer_;  // 接收数据的缓冲区 => 接收用户发过来的数据
+    OutputQueue outputBuffer_; // 发送数据的缓冲区 => 用来保存暂时发生不出去的数据，分块存储，writev发送
+                               // 声明在socket_前面：析构时先close，再释放MSG_ZEROCOPY还在用的内存
+    /*
+    TCP的发送缓冲区也是有大小限制的，如果此时无法将数据一次性拷贝到TCP缓冲区当中，
+    那么剩余的数据可以暂时保存在我们自己定义的缓冲区当中并将给文件描述对应的写事件注册到对应的Poller当中，
+    等到写事件就绪了，在调用回调方法将剩余的数据发送给客户端。
+    */
 
     // 这里和Acceptor类似   Acceptor=》mainLoop    TcpConenction=》subLoop
-    std::unique_ptr<Socket> socket_;                   
-    std::unique_ptr<Channel> channel_;
+    // 直接放在连接对象里，和TcpConnection、shared_ptr的控制块一起从ObjectPool分配
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;                     //当前主机的ip和端口号
     const InetAddress peerAddr_;                      //远端地址
@@ -89,14 +320,53 @@ private:
     MessageCallback messageCallback_;                // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_;    // 消息发送完成以后的回调
     HighWaterMarkCallback highWaterMarkCallback_;
+    LowWaterMarkCallback lowWaterMarkCallback_;
     CloseCallback closeCallback_;
+    LoopChangeCallback loopChangeCallback_;
     size_t highWaterMark_;
+    size_t lowWaterMark_;
+    bool aboveHighWater_;               // 超过了高水位还没有降到低水位，有低水位回调或者反压时才记录
+    std::vector<std::weak_ptr<TcpConnection>> backpressureSources_;
 
-    Buffer inputBuffer_;  // 接收数据的缓冲区 => 接收用户发过来的数据
-    Buffer outputBuffer_; // 发送数据的缓冲区 => 用来保存暂时发生不出去的数据
-    /*
-    TCP的发送缓冲区也是有大小限制的，如果此时无法将数据一次性拷贝到TCP缓冲区当中，
-    那么剩余的数据可以暂时保存在我们自己定义的缓冲区当中并将给文件描述对应的写事件注册到对应的Poller当中，
-    等到写事件就绪了，在调用回调方法将剩余的数据发送给客户端。
-    */
+    CompletionIo *completionIo_;        // 为空表示使用readiness模式
+    bool sendInFlight_;                 // 有一个sendv在内核中，outputBuffer_前面的数据不能动
+    bool edgeTriggered_;                // 读写事件一次注册，读写都要做到EAGAIN
+    size_t zeroCopyThreshold_;          // connectEstablished时设置SO_ZEROCOPY成功才交给outputBuffer_
+    bool autoCork_;
+    bool corkScheduled_;                // outputBuffer_里有合并的数据，等这一轮循环结束再发送
+    bool corked_;                       // 打开了TCP_CORK
+
+    std::mutex migrateMutex_;           // 保护migrateBacklog_，其它线程投递回调时加锁，不会和loop线程竞争
+    std::atomic_bool migrating_;
+    std::vector<Task> migrateBacklog_;
+    uint64_t bytesReceived_;
+    bool fdPassing_;
+    std::vector<int> receivedFds_;      // 收到了还没有被takeReceivedFds取走的fd
+
+    // 还没有加密的数据：握手完成之前send的，用户态TLS下的文件和排在文件后面的
+    struct TlsPlain
+    {
+        std::string data;
+        FileRefPtr  file;   // 不为空时是文件的[offset, offset+len)
+        off_t       offset;
+        size_t      len;
+    };
+    std::unique_ptr<TlsFilter> tls_;
+    bool tlsEstablished_;               // 握手完成，已经回调过connectionCallback
+    bool tlsPumping_;
+    std::deque<TlsPlain> tlsBacklog_;
+
+    SplicePipePtr splicePipe_;          // startSplice以后，收到的数据进这个管道
+    std::weak_ptr<TcpConnection> spliceTarget_;
+    std::weak_ptr<TcpConnection> spliceSource_; // 往这个连接splice数据的源连接，关闭时通知它
+    bool spliced_;                      // 是splice的某一端，不能迁移
+
+    TimingWheel *idleWheel_;            // 为空表示不检测空闲超时
+    TimingWheel::Entry idleEntry_;      // 在时间轮中的位置，只由idleWheel_访问
+
+    double bufferIdleTimeout_;
+    TimerId bufferTimer_;
+    Timestamp lastReceiveTime_;
+    std::atomic<int64_t> lastActiveTime_;   // 微秒  TcpServer淘汰空闲连接时在其它线程读
+    std::atomic<size_t> bufferedBytes_;     // 已经加到getLoop()->bufferedBytes()上的字节数
 };
\ No newline at end of file
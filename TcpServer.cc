@@ -1,9 +1,16 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "ObjectPool.h"
 
 #include <strings.h>
+#include <unistd.h>
+#include <algorithm>
 #include <functional>
+#include <future>
+#include <unordered_set>
+
+const double TcpServer::kMemoryCheckInterval = 0.1;
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -21,12 +28,37 @@ TcpServer::TcpServer(EventLoop *loop,
                 : loop_(CheckLoopNotNull(loop))
                 , ipPort_(listenAddr.toIpPort())
                 , name_(nameArg)
-                , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
+                , listenAddr_(listenAddr)
+                , acceptor_(new Acceptor(loop, listenAddr, option != kNoReusePort && !listenAddr.isUnix()))
+                , acceptorPerLoop_(option == kReusePortPerLoop && !listenAddr.isUnix())
+                , cpuSteering_(false)
+                , acceptBatch_(Acceptor::kDefaultAcceptBatch)
+                , idleTimeout_(0)
+                , bufferIdleTimeout_(0)
+                , edgeTriggered_(false)
+                , zeroCopyThreshold_(0)
+                , autoCork_(false)
+                , backpressureHighWaterMark_(0)
+                , backpressureLowWaterMark_(0)
+                , busyPollMicros_(0)
+                , maxConnections_(0)
+                , numConnections_(0)
+                , acceptMemoryHigh_(0)
+                , acceptMemoryLow_(0)
+                , readMemoryHigh_(0)
+                , readMemoryLow_(0)
+                , shedMemoryLimit_(0)
+                , shedIdleSeconds_(0)
+                , acceptPaused_(false)
+                , readThrottled_(false)
                 , threadPool_(new EventLoopThreadPool(loop, name_))
                 , connectionCallback_()
                 , messageCallback_()
-                , nextConnId_(1)
                 , started_(0)
+                , stopState_(kRunning)
+                , finishQueued_(false)
+                , nextConnId_(1)
+                , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + ipPort_))
 {
     // 当有先用户连接时，会执行TcpServer::newConnection回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, 
@@ -35,16 +67,47 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    if (memoryTimer_.valid())
+    {
+        loop_->cancel(memoryTimer_);
+    }
+    // stop结束以后连接、时间轮、subloop都已经没有了，下面的循环什么也不做
+    // 先关掉subloop的监听socket，之后不会再有newConnectionInLoop
+    closeLoopAcceptors();
+    // mainLoop的Acceptor在这个线程里，不会再收到连接  先让每个loop执行完已经投递的回调：
+    // 投递到subloop的createConnection，迁移到一半、已经投递到新loop的migrateEstablished
+    for (auto &item : shards_)
+    {
+        if (item.first != loop_)
+        {
+            std::promise<void> done;
+            item.first->runInLoop([&done]() { done.set_value(); });
+            done.get_future().wait();
+        }
+    }
+    // 每个分片在自己的loop里销毁连接
+    for (auto &item : shards_)
     {
-        // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源了
-        TcpConnectionPtr conn(item.second); 
-        item.second.reset();
+        ConnectionShard *shard = item.second.get();
+        std::promise<void> destroyed;
+        item.first->runInLoop([shard, &destroyed]() {
+            for (auto &entry : shard->connections)
+            {
+                // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源了
+                TcpConnectionPtr conn(std::move(entry.second.conn));
+                conn->connectDestroyed();
+            }
+            shard->connections.clear();
+            destroyed.set_value();
+        });
+        destroyed.get_future().wait();
+    }
 
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn)
-        );
+    // 时间轮要在所属loop里，排在上面的connectDestroyed之后析构
+    for (auto &item : idleWheels_)
+    {
+        std::shared_ptr<TimingWheel> wheel(std::move(item.second));
+        item.first->runInLoop([wheel]() mutable { wheel.reset(); });
     }
 }
 
@@ -60,70 +123,647 @@ void TcpServer::start()
     if (started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            shards_[ioLoop].reset(new ConnectionShard);
+        }
+        if (idleTimeout_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                idleWheels_[ioLoop].reset(new TimingWheel(ioLoop, idleTimeout_));
+            }
+        }
+        if (busyPollMicros_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->runInLoop(std::bind(&EventLoop::setBusyPoll, ioLoop, busyPollMicros_));
+            }
+        }
+        if (acceptMemoryHigh_ > 0 || readMemoryHigh_ > 0 || shedMemoryLimit_ > 0)
+        {
+            memoryTimer_ = loop_->runEvery(kMemoryCheckInterval, std::bind(&TcpServer::checkMemory, this));
+        }
+        if (acceptorPerLoop_ && threadPool_->getAllLoops().front() != loop_)
+        {
+            startLoopAcceptors();
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
     }
 }
 
+// mainLoop的acceptor_只bind不listen，不会进入reuseport组，连接都由subloop的监听socket接收
+void TcpServer::startLoopAcceptors()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        EventLoop *ioLoop = loops[i];
+        std::shared_ptr<Acceptor> acceptor(new Acceptor(ioLoop, listenAddr_, true));
+        acceptor->setAcceptBatch(acceptBatch_);
+        acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnectionInLoop, this, ioLoop,
+            std::placeholders::_1, std::placeholders::_2));
+        loopAcceptors_[ioLoop] = acceptor;
+
+        // 一个一个按顺序listen，reuseport组里socket的下标和loop的下标一致，cBPF返回的下标才对得上
+        bool attachSteering = cpuSteering_ && i == 0;
+        unsigned groupSize = static_cast<unsigned>(loops.size());
+        std::promise<void> listened;
+        ioLoop->runInLoop([&acceptor, &listened, attachSteering, groupSize]() {
+            acceptor->listen();
+            if (attachSteering)
+            {
+                acceptor->setCpuSteering(groupSize);
+            }
+            listened.set_value();
+        });
+        listened.get_future().wait();
+    }
+}
+
+void TcpServer::closeLoopAcceptors()
+{
+    for (auto &item : loopAcceptors_)
+    {
+        std::shared_ptr<Acceptor> acceptor(std::move(item.second));
+        std::promise<void> closed;
+        item.first->runInLoop([&acceptor, &closed]() {
+            acceptor.reset();
+            closed.set_value();
+        });
+        closed.get_future().wait();
+    }
+    loopAcceptors_.clear();
+}
+
 // 有一个新的客户端的连接，acceptor会执行这个回调操作 sockfd(connfd)
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询算法，选择一个subLoop，来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop(); 
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    if (!admitConnection(sockfd, peerAddr))
+    {
+        return;
+    }
+    // 轮询算法，选择一个subLoop，来管理channel  选定时就计数，连接风暴时LoadBalancer看到的连接数是准的
+    EventLoop *ioLoop = threadPool_->getNextLoop(&peerAddr);
+    ioLoop->connectionAdded();
+    // TcpConnection在ioLoop里构造，和销毁在同一个线程，ObjectPool里的缓存才能复用
+    ioLoop->runInLoop(std::bind(&TcpServer::createConnection, this, ioLoop, sockfd, peerAddr));
+}
 
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    if (!admitConnection(sockfd, peerAddr))
+    {
+        return;
+    }
+    ioLoop->connectionAdded();
+    createConnection(ioLoop, sockfd, peerAddr);
+}
+
+bool TcpServer::admitConnection(int sockfd, const InetAddress &peerAddr)
+{
+    // 先加再比较，kReusePortPerLoop时多个subloop同时接收连接也不会超过
+    if (numConnections_.fetch_add(1, std::memory_order_relaxed) >= maxConnections_ && maxConnections_ > 0)
+    {
+        numConnections_.fetch_sub(1, std::memory_order_relaxed);
+        LOG_ERROR("TcpServer::newConnection [%s] - too many connections, close %s \n",
+            name_.c_str(), peerAddr.toIpPort().c_str());
+        ::close(sockfd);
+        return false;
+    }
+    return true;
+}
+
+void TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    uint64_t id = nextConnId_.fetch_add(1, std::memory_order_relaxed);
+
+    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s#%lu] from %s \n",
+        name_.c_str(), connNamePrefix_->c_str(), static_cast<unsigned long>(id), peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
+    sockaddr_storage local;
     ::bzero(&local, sizeof local);
     socklen_t addrlen = sizeof local;
     if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
     {
         LOG_ERROR("sockets::getLocalAddr");
     }
-    InetAddress localAddr(local);
+    InetAddress localAddr;
+    localAddr.setSockAddr((sockaddr*)&local, addrlen);
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象, 并设置用户设置的回调函数
-    TcpConnectionPtr conn(new TcpConnection(
+    // 连接对象和shared_ptr的控制块一次分配，从ioLoop线程的ObjectPool里取  名字用到时才生成
+    TcpConnectionPtr conn(std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(),
                             ioLoop,
-                            connName,
+                            id,
+                            connNamePrefix_,
                             sockfd,   // Socket Channel
                             localAddr,
                             peerAddr));
-    connections_[connName] = conn;
+    if (tlsContext_ && !conn->startTls(tlsContext_))
+    {
+        // 不能退回明文，conn析构时关闭sockfd
+        LOG_ERROR("TcpServer::newConnection [%s] - TLS not available, close %s \n",
+            name_.c_str(), peerAddr.toIpPort().c_str());
+        releaseConnection(ioLoop);
+        return;
+    }
+    ConnectionShard::Entry &entry = shards_.find(ioLoop)->second->connections[id];
+    entry.conn = conn;
+    entry.rebalanceBytes = 0;
     // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    if (idleTimeout_ > 0)
+    {
+        conn->setIdleWheel(idleWheels_.find(ioLoop)->second.get());
+    }
+    conn->setBufferIdleTimeout(bufferIdleTimeout_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    conn->setAutoCork(autoCork_);
+    if (backpressureHighWaterMark_ > 0)
+    {
+        conn->setBackpressure(conn, backpressureHighWaterMark_, backpressureLowWaterMark_);
+    }
+    if (busyPollMicros_ > 0)
+    {
+        conn->setBusyPoll(busyPollMicros_);
+    }
 
     // 设置了如何关闭连接的回调   conn->shutDown()
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
-    );
+    // 只捕获this的lambda复制进连接的std::function时不分配内存
+    conn->setCloseCallback([this](const TcpConnectionPtr &c) { removeConnection(c); });
+    conn->setLoopChangeCallback([this](const TcpConnectionPtr &c, EventLoop *loop, bool attached) {
+        changeConnectionLoop(c, loop, attached);
+    });
 
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    // 已经在ioLoop中，直接调用TcpConnection::connectEstablished
+    conn->connectEstablished();
+    applyStopState(conn);
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn)
-    );
+    LOG_INFO("TcpServer::removeConnection [%s] - connection %s\n", 
+        name_.c_str(), conn->name().c_str());
+
+    EventLoop *ioLoop = conn->getLoop();
+    shards_.find(ioLoop)->second->connections.erase(conn->id());
+    // 现在还在这个连接的Channel::handleEvent里，这一轮循环结束时再注销Channel
+    ioLoop->runAfterIteration(std::bind(&TcpConnection::connectDestroyed, conn));
+    releaseConnection(ioLoop);
+}
+
+void TcpServer::releaseConnection(EventLoop *ioLoop)
+{
+    ioLoop->connectionRemoved();
+    if (numConnections_.fetch_sub(1, std::memory_order_acq_rel) == 1
+        && stopState_.load(std::memory_order_acquire) != kRunning)
+    {
+        // 排在上面的connectDestroyed后面，finishStop析构时间轮、退出loop的时候连接已经销毁了
+        ioLoop->runAfterIteration(std::bind(&TcpServer::queueFinishStop, this));
+    }
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+void TcpServer::changeConnectionLoop(const TcpConnectionPtr &conn, EventLoop *loop, bool attached)
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n", 
-        name_.c_str(), conn->name().c_str());
+    ConnectionShard *shard = shards_.find(loop)->second.get();
+    if (attached)
+    {
+        ConnectionShard::Entry &entry = shard->connections[conn->id()];
+        entry.conn = conn;
+        entry.rebalanceBytes = conn->bytesReceived();
+        applyStopState(conn);
+    }
+    else
+    {
+        shard->connections.erase(conn->id());
+    }
+}
 
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop(); 
-    ioLoop->queueInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn)
-    );
-}
\ No newline at end of file
+void TcpServer::stop(double drainTimeout, const StoppedCallback &cb)
+{
+    loop_->runInLoop(std::bind(&TcpServer::stopInLoop, this, drainTimeout, cb));
+}
+
+void TcpServer::stopInLoop(double drainTimeout, const StoppedCallback &cb)
+{
+    int expected = kRunning;
+    if (!stopState_.compare_exchange_strong(expected, kDraining))
+    {
+        return;
+    }
+    LOG_INFO("TcpServer::stop [%s] - draining %d connections, timeout %.1fs \n",
+        name_.c_str(), numConnections(), drainTimeout);
+    stoppedCallback_ = cb;
+    // 内存预算的检查会重新打开accept
+    if (memoryTimer_.valid())
+    {
+        loop_->cancel(memoryTimer_);
+        memoryTimer_ = TimerId();
+    }
+    closeLoopAcceptors();
+    acceptor_.reset();
+
+    // 已经投递到subloop的createConnection排在drainInLoop前面，后面的会看到kDraining
+    for (auto &item : shards_)
+    {
+        item.first->runInLoop(std::bind(&TcpServer::drainInLoop, this, item.first));
+    }
+    drainTimer_ = loop_->runAfter(drainTimeout, std::bind(&TcpServer::forceCloseAll, this));
+    if (numConnections_.load(std::memory_order_acquire) == 0)
+    {
+        queueFinishStop();
+    }
+}
+
+void TcpServer::queueFinishStop()
+{
+    // 最后一个连接关闭和stopInLoop看到没有连接可能同时发生，只投递一次
+    if (!finishQueued_.exchange(true))
+    {
+        loop_->queueInLoop(std::bind(&TcpServer::finishStop, this));
+    }
+}
+
+void TcpServer::drainInLoop(EventLoop *ioLoop)
+{
+    // 被内存预算暂停了读的连接读不到对端的FIN，关不掉
+    releaseThrottledInLoop(ioLoop);
+    for (auto &entry : shards_.find(ioLoop)->second->connections)
+    {
+        entry.second.conn->shutdown();
+    }
+}
+
+void TcpServer::forceCloseAll()
+{
+    drainTimer_ = TimerId();
+    int expected = kDraining;
+    if (!stopState_.compare_exchange_strong(expected, kForceClosing))
+    {
+        return;
+    }
+    LOG_INFO("TcpServer::stop [%s] - drain timeout, force closing %d connections \n",
+        name_.c_str(), numConnections());
+    for (auto &item : shards_)
+    {
+        item.first->runInLoop(std::bind(&TcpServer::closeAllInLoop, this, item.first));
+    }
+}
+
+void TcpServer::closeAllInLoop(EventLoop *ioLoop)
+{
+    // forceClose投递到连接的loop里关闭，不会在遍历的时候删除
+    for (auto &entry : shards_.find(ioLoop)->second->connections)
+    {
+        entry.second.conn->forceClose();
+    }
+}
+
+void TcpServer::applyStopState(const TcpConnectionPtr &conn)
+{
+    int state = stopState_.load(std::memory_order_acquire);
+    if (state == kRunning)
+    {
+        return;
+    }
+    // 投递出去，迁移过来的连接先执行完迁移过程中投递的send
+    conn->getLoop()->queueInLoop([conn, state]() {
+        if (state == kDraining)
+        {
+            conn->shutdown();
+        }
+        else
+        {
+            conn->forceClose();
+        }
+    });
+}
+
+void TcpServer::finishStop()
+{
+    stopState_.store(kStopped, std::memory_order_release);
+    if (drainTimer_.valid())
+    {
+        loop_->cancel(drainTimer_);
+        drainTimer_ = TimerId();
+    }
+    // 连接都已经connectDestroyed  每个loop先执行完已经投递的drainInLoop、closeAllInLoop，
+    // 再在loop里析构时间轮，都完成以后才能退出loop
+    for (auto &item : shards_)
+    {
+        std::shared_ptr<TimingWheel> wheel;
+        auto it = idleWheels_.find(item.first);
+        if (it != idleWheels_.end())
+        {
+            wheel = std::move(it->second);
+        }
+        std::promise<void> done;
+        item.first->runInLoop([&wheel, &done]() {
+            wheel.reset();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    idleWheels_.clear();
+    threadPool_->stop();
+    shards_.clear();
+    LOG_INFO("TcpServer::stop [%s] - stopped \n", name_.c_str());
+
+    StoppedCallback cb;
+    cb.swap(stoppedCallback_);
+    if (cb)
+    {
+        cb();
+    }
+}
+
+void TcpServer::migrateConnection(const TcpConnectionPtr &conn, EventLoop *loop)
+{
+    TimingWheel *wheel = nullptr;
+    if (idleTimeout_ > 0)
+    {
+        IdleWheelMap::const_iterator it = idleWheels_.find(loop);
+        if (it != idleWheels_.end())
+        {
+            wheel = it->second.get();
+        }
+    }
+    conn->migrateTo(loop, wheel);
+}
+
+void TcpServer::setRebalance(double threshold, double intervalSeconds)
+{
+    threadPool_->setRebalanceCallback(std::bind(&TcpServer::rebalance, this,
+        std::placeholders::_1, std::placeholders::_2), threshold, intervalSeconds);
+}
+
+void TcpServer::rebalance(EventLoop *from, EventLoop *to)
+{
+    // 连接收到的字节数只能在它所属的loop里读
+    from->runInLoop(std::bind(&TcpServer::rebalanceInLoop, this, from, to));
+}
+
+// 只有一个连接占了这个loop大部分流量时，迁移它只是把热点换个地方，下一轮又会迁回来
+static const double kMaxMigrateShare = 0.6;
+
+// 从上一次检查以来收到数据最多、但是不超过loop总流量kMaxMigrateShare的连接迁移到to
+void TcpServer::rebalanceInLoop(EventLoop *from, EventLoop *to)
+{
+    TcpConnectionPtr candidate;
+    uint64_t candidateBytes = 0;
+    uint64_t totalBytes = 0;
+    std::vector<std::pair<TcpConnectionPtr, uint64_t>> conns;
+    for (auto &item : shards_.find(from)->second->connections)
+    {
+        ConnectionShard::Entry &entry = item.second;
+        if (entry.conn->migrating())
+        {
+            continue;
+        }
+        uint64_t received = entry.conn->bytesReceived();
+        conns.push_back(std::make_pair(entry.conn, received - entry.rebalanceBytes));
+        totalBytes += received - entry.rebalanceBytes;
+        entry.rebalanceBytes = received;
+    }
+    if (conns.size() < 2)
+    {
+        return;
+    }
+    for (const auto &item : conns)
+    {
+        if (item.second > candidateBytes && item.second <= totalBytes * kMaxMigrateShare)
+        {
+            candidate = item.first;
+            candidateBytes = item.second;
+        }
+    }
+    if (candidate)
+    {
+        LOG_INFO("TcpServer::rebalance [%s] - connection %s %p => %p\n",
+            name_.c_str(), candidate->name().c_str(), from, to);
+        migrateConnection(candidate, to);
+    }
+}
+
+size_t TcpServer::bufferedBytes() const
+{
+    int64_t total = 0;
+    for (EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        total += ioLoop->bufferedBytes();
+    }
+    // 迁移时先从旧loop减掉再加到新loop，中间可能短暂地读到负数
+    return total > 0 ? static_cast<size_t>(total) : 0;
+}
+
+std::string TcpServer::metricsText(const std::string &prefix) const
+{
+    int loops = 0;
+    LoopMetrics::Snapshot snap = threadPool_->metrics(&loops);
+    return snap.toPrometheus(prefix, loops);
+}
+
+void TcpServer::checkMemory()
+{
+    size_t total = bufferedBytes();
+    if (acceptMemoryHigh_ > 0)
+    {
+        if (!acceptPaused_ && total >= acceptMemoryHigh_)
+        {
+            LOG_ERROR("TcpServer::checkMemory [%s] - %zu bytes buffered, stop accepting \n", name_.c_str(), total);
+            setAccepting(false);
+        }
+        else if (acceptPaused_ && total <= acceptMemoryLow_)
+        {
+            LOG_INFO("TcpServer::checkMemory [%s] - %zu bytes buffered, resume accepting \n", name_.c_str(), total);
+            setAccepting(true);
+        }
+    }
+    if (readMemoryHigh_ > 0)
+    {
+        if (total >= readMemoryHigh_)
+        {
+            readThrottled_ = true;
+            size_t excess = total - readMemoryLow_;
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                int64_t bytes = ioLoop->bufferedBytes();
+                if (bytes > 0)
+                {
+                    ioLoop->runInLoop(std::bind(&TcpServer::throttleHeaviestInLoop, this, ioLoop,
+                        static_cast<size_t>(static_cast<double>(excess) * bytes / total)));
+                }
+            }
+        }
+        else if (total <= readMemoryLow_ && readThrottled_)
+        {
+            readThrottled_ = false;
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->runInLoop(std::bind(&TcpServer::releaseThrottledInLoop, this, ioLoop));
+            }
+        }
+    }
+    if (shedMemoryLimit_ > 0 && total > shedMemoryLimit_)
+    {
+        size_t excess = total - shedMemoryLimit_;
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            int64_t bytes = ioLoop->bufferedBytes();
+            if (bytes > 0)
+            {
+                ioLoop->runInLoop(std::bind(&TcpServer::shedIdleInLoop, this, ioLoop,
+                    static_cast<size_t>(static_cast<double>(excess) * bytes / total)));
+            }
+        }
+    }
+}
+
+void TcpServer::setAccepting(bool on)
+{
+    acceptPaused_ = !on;
+    if (loopAcceptors_.empty())
+    {
+        if (on)
+        {
+            acceptor_->resume();
+        }
+        else
+        {
+            acceptor_->pause();
+        }
+        return;
+    }
+    for (auto &item : loopAcceptors_)
+    {
+        std::shared_ptr<Acceptor> acceptor(item.second);
+        item.first->runInLoop([acceptor, on]() {
+            if (on)
+            {
+                acceptor->resume();
+            }
+            else
+            {
+                acceptor->pause();
+            }
+        });
+    }
+}
+
+// 已经暂停的连接占用的内存先算进去，不够再从没有暂停的连接里按占用从多到少挑
+void TcpServer::throttleHeaviestInLoop(EventLoop *ioLoop, size_t excess)
+{
+    ConnectionShard *shard = shards_.find(ioLoop)->second.get();
+    std::unordered_set<TcpConnection*> throttled;
+    std::vector<std::weak_ptr<TcpConnection>> alive; // 顺便去掉已经销毁、迁移走的连接
+    for (const std::weak_ptr<TcpConnection> &weakConn : shard->memoryThrottled)
+    {
+        TcpConnectionPtr conn(weakConn.lock());
+        if (conn && conn->getLoop() == ioLoop)
+        {
+            throttled.insert(conn.get());
+            alive.push_back(conn);
+        }
+        else if (conn)
+        {
+            conn->setMemoryThrottled(false);
+        }
+    }
+    shard->memoryThrottled.swap(alive);
+    size_t paused = 0;
+    std::vector<std::pair<size_t, TcpConnectionPtr>> candidates;
+    for (const auto &item : shard->connections)
+    {
+        const TcpConnectionPtr &conn = item.second.conn;
+        size_t bytes = conn->bufferedBytes();
+        if (throttled.count(conn.get()))
+        {
+            paused += bytes;
+        }
+        else if (bytes > 0)
+        {
+            candidates.push_back(std::make_pair(bytes, conn));
+        }
+    }
+    if (paused >= excess)
+    {
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<size_t, TcpConnectionPtr> &a, const std::pair<size_t, TcpConnectionPtr> &b) {
+            return a.first > b.first;
+        });
+    size_t count = 0;
+    for (const auto &item : candidates)
+    {
+        if (paused >= excess)
+        {
+            break;
+        }
+        item.second->setMemoryThrottled(true);
+        shard->memoryThrottled.push_back(item.second);
+        paused += item.first;
+        ++count;
+    }
+    LOG_ERROR("TcpServer::checkMemory [%s] - pause reading on %zu connections \n", name_.c_str(), count);
+}
+
+void TcpServer::releaseThrottledInLoop(EventLoop *ioLoop)
+{
+    ConnectionShard *shard = shards_.find(ioLoop)->second.get();
+    if (shard->memoryThrottled.empty())
+    {
+        return;
+    }
+    LOG_INFO("TcpServer::checkMemory [%s] - resume reading on %zu connections \n",
+        name_.c_str(), shard->memoryThrottled.size());
+    for (const std::weak_ptr<TcpConnection> &weakConn : shard->memoryThrottled)
+    {
+        TcpConnectionPtr conn(weakConn.lock());
+        if (conn)
+        {
+            conn->setMemoryThrottled(false);
+        }
+    }
+    shard->memoryThrottled.clear();
+}
+
+void TcpServer::shedIdleInLoop(EventLoop *ioLoop, size_t excess)
+{
+    Timestamp deadline = addTime(Timestamp::now(), -shedIdleSeconds_);
+    std::vector<std::pair<Timestamp, TcpConnectionPtr>> candidates;
+    for (const auto &item : shards_.find(ioLoop)->second->connections)
+    {
+        const TcpConnectionPtr &conn = item.second.conn;
+        Timestamp lastActive = conn->lastActiveTime();
+        if (conn->connected() && conn->bufferedBytes() > 0 && lastActive < deadline)
+        {
+            candidates.push_back(std::make_pair(lastActive, conn));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<Timestamp, TcpConnectionPtr> &a, const std::pair<Timestamp, TcpConnectionPtr> &b) {
+            return a.first < b.first;
+        });
+    size_t freed = 0;
+    for (const auto &item : candidates)
+    {
+        if (freed >= excess)
+        {
+            break;
+        }
+        LOG_ERROR("TcpServer::checkMemory [%s] - shed idle connection %s \n",
+            name_.c_str(), item.second->name().c_str());
+        freed += item.second->bufferedBytes();
+        item.second->forceClose();
+    }
+}
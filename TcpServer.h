@@ -11,23 +11,30 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "TimingWheel.h"
+#include "TlsContext.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    using StoppedCallback = std::function<void()>;
+
+    static const double kMemoryCheckInterval;
 
     enum Option
     {
         kNoReusePort,
         kReusePort,
+        kReusePortPerLoop,  // 每个subloop一个SO_REUSEPORT的监听socket，accept和建立连接都在subloop里完成
     };
 
     TcpServer(EventLoop *loop,
@@ -43,24 +50,169 @@ public:
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
+    // subloop线程绑核，见EventLoopThreadPool::setThreadCpus  必须在start之前调用
+    void setThreadCpus(const std::vector<int> &cpus) { threadPool_->setThreadCpus(cpus); }
+    // start之后每个subloop所在的线程和cpu
+    std::vector<EventLoopThreadPool::LoopPlacement> loopPlacements() const { return threadPool_->getPlacements(); }
+    // 连接超过seconds秒没有读写活动就关闭，0表示不检测  必须在start之前调用
+    void setIdleTimeout(int seconds) { idleTimeout_ = seconds; }
+    // 连接的接收缓冲区空闲超过seconds秒就把内存还给BufferPool，0表示不释放
+    void setBufferIdleTimeout(double seconds) { bufferIdleTimeout_ = seconds; }
+    // 连接使用epoll边沿触发，读写事件只注册一次，省掉每次发送缓冲区满时的epoll_ctl(MOD)
+    // Poller不支持边沿触发时不起作用  必须在start之前调用
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    // 不小于threshold字节的数据用MSG_ZEROCOPY发送，见TcpConnection::setZeroCopyThreshold  必须在start之前调用
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    // 连接在loop线程中的send合并到这一轮循环结束时一次发送，见TcpConnection::setAutoCork  必须在start之前调用
+    void setAutoCork(bool on) { autoCork_ = on; }
+    // 每个连接发送队列超过highWaterMark就暂停读自己，降到lowWaterMark再继续，见TcpConnection::setBackpressure
+    // 对端只发不收时，连接占用的内存以highWaterMark加上一次回调产生的数据为上限  0表示不限制  必须在start之前调用
+    void setBackpressure(size_t highWaterMark, size_t lowWaterMark)
+    { backpressureHighWaterMark_ = highWaterMark; backpressureLowWaterMark_ = lowWaterMark; }
+    // 延迟敏感的服务：所有subloop空闲micros微秒以后才阻塞（EventLoop::setBusyPoll），
+    // 新连接的socket同时设置SO_BUSY_POLL  每个subloop会占满一个CPU  必须在start之前调用
+    void setBusyPoll(int micros) { busyPollMicros_ = micros; }
+    // kReusePortPerLoop时给reuseport组挂一个cBPF程序，按照处理SYN的cpu选择监听socket（cpu % subloop个数）
+    // 配合setThreadCpus把第i个subloop绑在cpu i上，连接从收包到处理都在同一个核  必须在start之前调用
+    void setCpuSteering(bool on) { cpuSteering_ = on; }
+    // 新连接分配给哪个subloop，见LoadBalancer  kReusePortPerLoop时由内核分配，不使用  必须在start之前调用
+    void setLoadBalancer(LoadBalancer::Strategy strategy) { threadPool_->setLoadBalancer(LoadBalancer::create(strategy)); }
+    void setLoadBalancer(std::unique_ptr<LoadBalancer> balancer) { threadPool_->setLoadBalancer(std::move(balancer)); }
+    // 见Acceptor::setAcceptBatch  必须在start之前调用
+    void setAcceptBatch(int batch) { acceptBatch_ = batch; acceptor_->setAcceptBatch(batch); }
+    // 把连接迁移到loop，见TcpConnection::migrateTo  线程安全  连接随着迁移从旧loop的分片移到新loop的分片
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *loop);
+    // 自动迁移：subloop的busyRatio持续超过threshold时，把一个连接迁移到最闲的loop，
+    // 每interval秒最多迁移一个  见EventLoopThreadPool::setRebalanceCallback  必须在start之前调用
+    void setRebalance(double threshold, double intervalSeconds = 1.0);
+    // 连接数达到maxConnections以后，新连接accept出来马上关闭，不创建TcpConnection  0表示不限制  必须在start之前调用
+    void setMaxConnections(int maxConnections) { maxConnections_ = maxConnections; }
+    // 所有连接跑TLS，见TcpConnection::startTls  建立不了TLS的连接（完成通知模式的loop）直接关闭  必须在start之前调用
+    void setTlsContext(const TlsContextPtr &context) { tlsContext_ = context; }
+    // 当前的连接数  线程安全
+    int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    // 所有连接的接收缓冲区和发送队列占用的字节数，各个loop的EventLoop::bufferedBytes加起来  线程安全
+    size_t bufferedBytes() const;
+    // 所有loop的计数器和延迟直方图，见EventLoopThreadPool::metrics  线程安全
+    LoopMetrics::Snapshot metrics() const { return threadPool_->metrics(); }
+    // metrics()的Prometheus文本格式，可以直接作为/metrics的响应
+    std::string metricsText(const std::string &prefix = "mymuduo") const;
+
+    // 内存预算  start以后每kMemoryCheckInterval秒在baseLoop里检查一次bufferedBytes()，
+    // 下面的策略可以同时使用，0表示不启用  都必须在start之前调用
+    // 超过highWaterMark停止accept，新连接留在内核的backlog里，降到lowWaterMark以下继续accept
+    void setAcceptMemoryLimit(size_t highWaterMark, size_t lowWaterMark)
+    { acceptMemoryHigh_ = highWaterMark; acceptMemoryLow_ = lowWaterMark; }
+    // 超过highWaterMark时暂停占用内存最多的那些连接的读（TcpConnection::setMemoryThrottled），
+    // 直到被暂停的连接占用的内存不少于超出lowWaterMark的部分；降到lowWaterMark以下全部恢复
+    void setReadMemoryLimit(size_t highWaterMark, size_t lowWaterMark)
+    { readMemoryHigh_ = highWaterMark; readMemoryLow_ = lowWaterMark; }
+    // 超过limit时关闭超过idleSeconds秒既没有收到也没有发送出去数据、占用了内存的连接，空闲最久的先关，
+    // 直到关掉的连接占用的内存不少于超出的部分  连接关闭要在各自的loop里完成，下一次检查时可能还没有减下来
+    void setShedMemoryLimit(size_t limit, double idleSeconds)
+    { shedMemoryLimit_ = limit; shedIdleSeconds_ = idleSeconds; }
+
     // 开启服务器监听
     void start();
+    // 平滑关闭，用于滚动重启  关掉所有监听socket不再接收新连接，已有的连接shutdown()：发送队列发完以后关闭写端，
+    // 继续读、回调onMessage直到对端关闭；drainTimeout秒以后还没关闭的强制关闭  连接都销毁以后按顺序停止并join
+    // 所有subloop线程，最后在baseLoop里调用cb，cb里或者之后可以析构TcpServer（cb之前不能析构）
+    // 线程安全，只有第一次调用有效  SO_REUSEPORT时关闭前还在这个socket的accept队列里的连接会被内核重置，
+    // 除非打开了net.ipv4.tcp_migrate_req，内核把它们转给组里其他的监听socket
+    void stop(double drainTimeout, const StoppedCallback &cb = StoppedCallback());
+    // stop的cb已经调用过了
+    bool stopped() const { return stopState_.load(std::memory_order_acquire) == kStopped; }
     
 private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // kReusePortPerLoop时ioLoop自己的Acceptor的回调
+    void newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 超过setMaxConnections时关掉sockfd，返回false
+    bool admitConnection(int sockfd, const InetAddress &peerAddr);
+    // 在ioLoop线程中创建TcpConnection并建立连接
+    void createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    void startLoopAcceptors();
+    // 在各自的loop里关掉subloop的监听socket，等它们都关掉再返回
+    void closeLoopAcceptors();
+    // 连接的closeCallback，在连接所属的loop里调用，不经过baseLoop
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 连接数减一  stop过程中最后一个连接销毁以后结束stop
+    void releaseConnection(EventLoop *ioLoop);
+    // stop过程中新建立或者迁移过来的连接，马上shutdown或者关闭
+    void applyStopState(const TcpConnectionPtr &conn);
+    void stopInLoop(double drainTimeout, const StoppedCallback &cb);
+    void drainInLoop(EventLoop *ioLoop);
+    // drainTimeout到了，强制关闭剩下的连接
+    void forceCloseAll();
+    void closeAllInLoop(EventLoop *ioLoop);
+    // 没有连接了，投递到baseLoop结束stop
+    void queueFinishStop();
+    void finishStop();
+    // 连接的loopChangeCallback
+    void changeConnectionLoop(const TcpConnectionPtr &conn, EventLoop *loop, bool attached);
+    void rebalance(EventLoop *from, EventLoop *to);
+    void rebalanceInLoop(EventLoop *from, EventLoop *to);
+    // 内存预算的定时检查，在baseLoop中执行
+    void checkMemory();
+    void setAccepting(bool on);
+    // 超出的部分按各个loop占用的内存分摊，每个loop在自己的线程里处理自己的分片
+    void throttleHeaviestInLoop(EventLoop *ioLoop, size_t excess);
+    void releaseThrottledInLoop(EventLoop *ioLoop);
+    void shedIdleInLoop(EventLoop *ioLoop, size_t excess);
 
 private: 
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    // 一个loop的连接，按id索引  只在所属loop中访问，建立、销毁、迁移都不加锁
+    struct ConnectionShard
+    {
+        struct Entry
+        {
+            TcpConnectionPtr    conn;
+            uint64_t            rebalanceBytes; // 上一次rebalance检查时连接收到的字节数
+        };
+        std::unordered_map<uint64_t, Entry> connections;
+        std::vector<std::weak_ptr<TcpConnection>> memoryThrottled; // 因为内存预算被暂停读的连接
+    };
+
+    using ShardMap = std::unordered_map<EventLoop*, std::unique_ptr<ConnectionShard>>;
+    using IdleWheelMap = std::unordered_map<EventLoop*, std::shared_ptr<TimingWheel>>;
+    using AcceptorMap = std::unordered_map<EventLoop*, std::shared_ptr<Acceptor>>;
 
     EventLoop                           *loop_; // baseLoop 用户定义的loop
 
     const std::string                   ipPort_;
     const std::string                   name_;
+    const InetAddress                   listenAddr_;
 
     std::unique_ptr<Acceptor>           acceptor_; // 运行在mainLoop，任务就是监听新连接事件
+    const bool                          acceptorPerLoop_;
+    bool                                cpuSteering_;
+    int                                 acceptBatch_;
+    AcceptorMap                         loopAcceptors_; // kReusePortPerLoop时每个subloop一个，在所属loop中listen和析构
+
+    int                                 idleTimeout_;
+    IdleWheelMap                        idleWheels_; // 每个loop一个时间轮，只在所属loop中访问和析构
+    double                              bufferIdleTimeout_;
+    bool                                edgeTriggered_;
+    size_t                              zeroCopyThreshold_;
+    bool                                autoCork_;
+    size_t                              backpressureHighWaterMark_;
+    size_t                              backpressureLowWaterMark_;
+    int                                 busyPollMicros_;
+    int                                 maxConnections_;
+    std::atomic_int                     numConnections_;
+    TlsContextPtr                       tlsContext_;
+
+    size_t                              acceptMemoryHigh_;
+    size_t                              acceptMemoryLow_;
+    size_t                              readMemoryHigh_;
+    size_t                              readMemoryLow_;
+    size_t                              shedMemoryLimit_;
+    double                              shedIdleSeconds_;
+    // 下面的只在baseLoop中访问
+    TimerId                             memoryTimer_;
+    bool                                acceptPaused_;
+    bool                                readThrottled_; // 有loop因为内存预算暂停了连接的读
 
     std::shared_ptr<EventLoopThreadPool> threadPool_; // one loop per thread
 
@@ -71,6 +223,20 @@ private:
 
     std::atomic_int                     started_;
 
-    int                                 nextConnId_;
-    ConnectionMap                       connections_; // 保存所有的连接
+    enum StopState
+    {
+        kRunning,
+        kDraining,      // 连接在shutdown
+        kForceClosing,  // 超时，剩下的连接强制关闭
+        kStopped,
+    };
+    std::atomic_int                     stopState_; // subloop建立连接时要读
+    std::atomic_bool                    finishQueued_;
+    // 下面的只在baseLoop中访问
+    TimerId                             drainTimer_;
+    StoppedCallback                     stoppedCallback_;
+
+    std::atomic<uint64_t>               nextConnId_;
+    const std::shared_ptr<const std::string> connNamePrefix_; // "name-ip:port"，连接的名字是"前缀#id"
+    ShardMap                            shards_; // 每个loop一个分片，start时建好以后不再增删
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include "CpuAffinity.h"
 
 #include <semaphore.h>
 
@@ -9,6 +10,7 @@ Thread::Thread(ThreadFunc func, const std::string &name)
     : started_(false)
     , joined_(false)
     , tid_(0)
+    , cpu_(-1)
     , func_(std::move(func))
     , name_(name)
 {
@@ -35,6 +37,11 @@ void Thread::start()        // 一个Thread对象，记录的就是一个新线
 
     // 开启线程
     thread_ = std::shared_ptr<std::thread>(new std::thread([&](){
+        // 先绑核，func_里面分配的内存才会在这个cpu所在的节点上
+        if (cpu_ >= 0)
+        {
+            CpuAffinity::bindCurrentThread(cpu_);
+        }
         // 获取线程的tid值
         tid_ = CurrentThread::tid();
         sem_post(&sem);
@@ -17,6 +17,10 @@ public:
     explicit Thread(ThreadFunc, const std::string &name = std::string());
     ~Thread();
 
+    // 线程启动以后、执行func之前绑定到cpu上  必须在start之前调用，-1表示不绑定
+    void setCpu(int cpu) { cpu_ = cpu; }
+    int cpu() const { return cpu_; }
+
     void start();                       
     void join();
 
@@ -32,6 +36,7 @@ private:
     bool                                    joined_;
     std::shared_ptr<std::thread>            thread_;
     pid_t                                   tid_;
+    int                                     cpu_;
     std::string                             name_;
     
     ThreadFunc                              func_;  
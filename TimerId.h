@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * 给用户使用的定时器标识，用于EventLoop::cancel
+ * 只保存定时器的序号，不保存Timer指针，所以定时器到期被删除以后，再cancel也是安全的
+ */
+class TimerId
+{
+public:
+    TimerId() : sequence_(0) {}
+    explicit TimerId(int64_t seq) : sequence_(seq) {}
+
+    int64_t sequence() const { return sequence_; }
+    bool valid() const { return sequence_ > 0; }
+private:
+    int64_t sequence_;
+};
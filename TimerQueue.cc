@@ -0,0 +1,240 @@
+#include "TimerQueue.h"
+#include "Timer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d timerfd_create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return timerfd;
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+
+    for (auto &item : timers_)
+    {
+        delete item.second;
+    }
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    TimerId id(timer->sequence());
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return id;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    timers_[timer->sequence()] = timer;
+    heapPush(timer);
+    // 新的定时器成为了最早到期的，需要重新设置timerfd
+    if (heap_.front() == timer)
+    {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    auto it = timers_.find(timerId.sequence());
+    if (it == timers_.end())
+    {
+        return; // 已经到期删除，或者已经取消
+    }
+    Timer *timer = it->second;
+    timers_.erase(it);
+    if (timer->heapIndex() >= 0)
+    {
+        heapRemove(timer);
+        delete timer;
+    }
+    // 否则该定时器正在handleRead中执行回调（在回调里取消自己），执行完以后由handleRead删除
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany = 0;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+    armedExpiration_ = Timestamp::invalid();
+
+    Timestamp now(Timestamp::now());
+    expired_.clear();
+    while (!heap_.empty() && !(now < heap_.front()->expiration()))
+    {
+        Timer *timer = heap_.front();
+        heapRemove(timer);
+        expired_.push_back(timer);
+    }
+
+    for (Timer *timer : expired_)
+    {
+        timer->run();
+    }
+
+    for (Timer *timer : expired_)
+    {
+        auto it = timers_.find(timer->sequence());
+        if (it != timers_.end() && timer->repeat())
+        {
+            timer->restart(now);
+            heapPush(timer);
+        }
+        else
+        {
+            if (it != timers_.end())
+            {
+                timers_.erase(it);
+            }
+            delete timer;
+        }
+    }
+    expired_.clear();
+
+    resetTimerfd();
+}
+
+bool TimerQueue::earlier(const Timer *lhs, const Timer *rhs) const
+{
+    if (lhs->expiration() < rhs->expiration())
+    {
+        return true;
+    }
+    // 同一时刻到期的定时器，先添加的先执行
+    return lhs->expiration() == rhs->expiration() && lhs->sequence() < rhs->sequence();
+}
+
+void TimerQueue::heapPush(Timer *timer)
+{
+    timer->setHeapIndex(static_cast<int>(heap_.size()));
+    heap_.push_back(timer);
+    siftUp(heap_.size() - 1);
+}
+
+void TimerQueue::heapRemove(Timer *timer)
+{
+    size_t index = static_cast<size_t>(timer->heapIndex());
+    size_t last = heap_.size() - 1;
+    if (index != last)
+    {
+        heapSwap(index, last);
+    }
+    heap_.pop_back();
+    timer->setHeapIndex(-1);
+
+    if (index < heap_.size())
+    {
+        siftUp(index);
+        siftDown(index);
+    }
+}
+
+void TimerQueue::siftUp(size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (!earlier(heap_[index], heap_[parent]))
+        {
+            break;
+        }
+        heapSwap(index, parent);
+        index = parent;
+    }
+}
+
+void TimerQueue::siftDown(size_t index)
+{
+    const size_t size = heap_.size();
+    while (true)
+    {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        if (left < size && earlier(heap_[left], heap_[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < size && earlier(heap_[right], heap_[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            break;
+        }
+        heapSwap(index, smallest);
+        index = smallest;
+    }
+}
+
+void TimerQueue::heapSwap(size_t i, size_t j)
+{
+    std::swap(heap_[i], heap_[j]);
+    heap_[i]->setHeapIndex(static_cast<int>(i));
+    heap_[j]->setHeapIndex(static_cast<int>(j));
+}
+
+void TimerQueue::resetTimerfd()
+{
+    if (heap_.empty())
+    {
+        return; // 没有定时器了，timerfd上即使还有一次多余的通知也没关系
+    }
+
+    Timestamp expiration = heap_.front()->expiration();
+    if (armedExpiration_.valid() && armedExpiration_ == expiration)
+    {
+        return;
+    }
+    armedExpiration_ = expiration;
+
+    // timerfd使用的是相对时间，至少100微秒，避免设置成0（0表示关闭定时器）
+    int64_t microseconds = expiration.microSecondsSinceEpoch()
+                        - Timestamp::now().microSecondsSinceEpoch();
+    if (microseconds < 100)
+    {
+        microseconds = 100;
+    }
+
+    struct itimerspec newValue;
+    memset(&newValue, 0, sizeof newValue);
+    newValue.it_value.tv_sec = static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
+    newValue.it_value.tv_nsec = static_cast<long>((microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    if (::timerfd_settime(timerfd_, 0, &newValue, NULL) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Channel.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+
+#include <vector>
+#include <unordered_map>
+
+class EventLoop;
+class Timer;
+
+/**
+ * 每个EventLoop一个TimerQueue，用一个timerfd驱动
+ * 所有定时器放在按到期时间排序的最小堆中，timerfd总是设置为堆顶定时器的到期时间
+ * 堆中的Timer记录了自己的下标，所以插入和取消都是O(log n)
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全，可以在其它线程中调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+    size_t size() const { return heap_.size(); }
+private:
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+
+    // timerfd上的读事件，处理所有到期的定时器
+    void handleRead();
+
+    // 最小堆的操作
+    bool earlier(const Timer *lhs, const Timer *rhs) const;
+    void heapPush(Timer *timer);
+    void heapRemove(Timer *timer);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+    void heapSwap(size_t i, size_t j);
+
+    // 把timerfd设置为堆顶定时器的到期时间
+    void resetTimerfd();
+
+    EventLoop                               *loop_;
+    const int                               timerfd_;
+    Channel                                 timerfdChannel_;
+
+    std::vector<Timer*>                     heap_;      // 按到期时间排序的最小堆
+    std::unordered_map<int64_t, Timer*>     timers_;    // sequence => Timer，包括正在执行回调的定时器
+    std::vector<Timer*>                     expired_;   // 本次到期的定时器，复用内存
+    Timestamp                               armedExpiration_; // 当前timerfd设置的到期时间
+};
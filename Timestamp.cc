@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 
+#include <stdio.h>
 #include <time.h>
 
 Timestamp::Timestamp():microSecondsSinceEpoch_(0) {}
@@ -8,22 +9,51 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
     : microSecondsSinceEpoch_(microSecondsSinceEpoch)
     {}
 
-Timestamp Timestamp::now()
+Timestamp Timestamp::now(Clock clock)
 {
-    return Timestamp(time(NULL));
+    static const clockid_t kClockIds[] = {
+        CLOCK_REALTIME, CLOCK_REALTIME_COARSE, CLOCK_MONOTONIC, CLOCK_MONOTONIC_COARSE
+    };
+    struct timespec ts;
+    ::clock_gettime(kClockIds[clock], &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
 }
 
 std::string Timestamp::toString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = secondsSinceEpoch();
+    tm tm_time;
+    localtime_r(&seconds, &tm_time);
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d", 
-        tm_time->tm_year + 1900,
-        tm_time->tm_mon + 1,
-        tm_time->tm_mday,
-        tm_time->tm_hour,
-        tm_time->tm_min,
-        tm_time->tm_sec);
+        tm_time.tm_year + 1900,
+        tm_time.tm_mon + 1,
+        tm_time.tm_mday,
+        tm_time.tm_hour,
+        tm_time.tm_min,
+        tm_time.tm_sec);
+    return buf;
+}
+
+std::string Timestamp::toFormattedString(bool showMicroseconds) const
+{
+    if (!showMicroseconds)
+    {
+        return toString();
+    }
+    char buf[64] = {0};
+    time_t seconds = secondsSinceEpoch();
+    int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+    tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    snprintf(buf, sizeof buf, "%4d/%02d/%02d %02d:%02d:%02d.%06d",
+        tm_time.tm_year + 1900,
+        tm_time.tm_mon + 1,
+        tm_time.tm_mday,
+        tm_time.tm_hour,
+        tm_time.tm_min,
+        tm_time.tm_sec,
+        microseconds);
     return buf;
 }
 
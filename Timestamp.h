@@ -2,15 +2,80 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
 
-// 时间类
+// 时间类  微秒精度
 class Timestamp
 {
 public:
+    // now(clock)用的时钟  COARSE是内核每个tick更新一次的缓存值（1到4ms的精度），读的时候不访问时钟源，
+    // 比精确的版本快几倍  MONOTONIC不受修改系统时间影响，但不是从Epoch开始的时间，只能用来算时间差
+    enum Clock
+    {
+        kRealtime,
+        kRealtimeCoarse,
+        kMonotonic,
+        kMonotonicCoarse,
+    };
+
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpoch);
-    static Timestamp now();
+    static Timestamp now() { return now(kRealtime); }
+    static Timestamp now(Clock clock);
+    static Timestamp invalid() { return Timestamp(); }
+
     std::string toString() const;
+    // 2026/10/14 07:56:07.123456，showMicroseconds为false时和toString一样
+    std::string toFormattedString(bool showMicroseconds = true) const;
+
+    Timestamp& operator+=(int64_t microSeconds) { microSecondsSinceEpoch_ += microSeconds; return *this; }
+    Timestamp& operator-=(int64_t microSeconds) { microSecondsSinceEpoch_ -= microSeconds; return *this; }
+
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const
+    { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator!=(Timestamp lhs, Timestamp rhs) { return !(lhs == rhs); }
+inline bool operator>(Timestamp lhs, Timestamp rhs) { return rhs < lhs; }
+inline bool operator<=(Timestamp lhs, Timestamp rhs) { return !(rhs < lhs); }
+inline bool operator>=(Timestamp lhs, Timestamp rhs) { return !(lhs < rhs); }
+
+// 两个时间点相差的微秒数 high - low
+inline int64_t operator-(Timestamp high, Timestamp low)
+{
+    return high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+}
+
+// 加减微秒  加减秒数用addTime
+inline Timestamp operator+(Timestamp timestamp, int64_t microSeconds) { return timestamp += microSeconds; }
+inline Timestamp operator-(Timestamp timestamp, int64_t microSeconds) { return timestamp -= microSeconds; }
+
+// 两个时间点之间相差的秒数 high - low
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp的基础上加上seconds秒
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
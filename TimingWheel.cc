@@ -0,0 +1,90 @@
+#include "TimingWheel.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, int timeoutSeconds)
+    : loop_(loop)
+    , timeoutSeconds_(timeoutSeconds)
+    , buckets_(timeoutSeconds + 1) // 多一个桶，保证至少空闲timeout秒才超时
+    , cursor_(0)
+{
+    tickTimer_ = loop_->runEvery(1.0, std::bind(&TimingWheel::onTick, this));
+}
+
+TimingWheel::~TimingWheel()
+{
+    loop_->cancel(tickTimer_);
+}
+
+void TimingWheel::add(const TcpConnectionPtr &conn)
+{
+    Entry &entry = conn->idleEntry_;
+    if (entry.linked)
+    {
+        touch(conn.get());
+        return;
+    }
+    Bucket &bucket = buckets_[cursor_];
+    entry.node = bucket.insert(bucket.end(), conn);
+    entry.bucket = cursor_;
+    entry.linked = true;
+}
+
+void TimingWheel::touch(TcpConnection *conn)
+{
+    Entry &entry = conn->idleEntry_;
+    // 同一秒内的多次活动，只有第一次需要挪动节点
+    if (!entry.linked || entry.bucket == cursor_)
+    {
+        return;
+    }
+    Bucket &current = buckets_[cursor_];
+    current.splice(current.end(), buckets_[entry.bucket], entry.node);
+    entry.bucket = cursor_;
+}
+
+void TimingWheel::remove(TcpConnection *conn)
+{
+    Entry &entry = conn->idleEntry_;
+    if (entry.linked)
+    {
+        buckets_[entry.bucket].erase(entry.node);
+        entry.linked = false;
+    }
+}
+
+void TimingWheel::onTick()
+{
+    cursor_ = (cursor_ + 1) % buckets_.size();
+    // 新的当前桶里剩下的，就是timeout秒内都没有活动的连接
+    Bucket &current = buckets_[cursor_];
+    expired_.swap(current);
+
+    while (!expired_.empty())
+    {
+        TcpConnectionPtr conn = expired_.front().lock();
+        if (!conn)
+        {
+            expired_.pop_front();
+            continue;
+        }
+
+        Entry &entry = conn->idleEntry_;
+        if (conn->connected())
+        {
+            LOG_INFO("TimingWheel::onTick connection [%s] idle for %d seconds, shutdown \n",
+                conn->name().c_str(), timeoutSeconds_);
+            // 先走正常的shutdown，发完数据再关闭写端；再空闲一轮对端还不关闭，就强制关闭
+            current.splice(current.end(), expired_, expired_.begin());
+            entry.bucket = cursor_;
+            conn->shutdown();
+        }
+        else
+        {
+            expired_.pop_front();
+            entry.linked = false;
+            conn->forceClose();
+        }
+    }
+}
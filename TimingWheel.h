@@ -0,0 +1,53 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+
+#include <list>
+#include <vector>
+#include <memory>
+
+class EventLoop;
+
+/**
+ * 哈希时间轮，用于踢掉空闲连接  每个subloop一个，只在所属loop的线程中使用
+ * 一共timeout+1个桶，每秒前进一格；连接有读写活动时被挪到当前的桶里
+ * 一个连接在timeout秒内都没有活动，时间轮转回它所在的桶时就超时了
+ *
+ * 桶里存的是连接的weak_ptr，不会延长连接的生命周期
+ * TcpConnection里记录了自己所在的桶和链表节点，所以加入、刷新、删除都是O(1)，不分配内存
+ */
+class TimingWheel : noncopyable
+{
+public:
+    using Bucket = std::list<std::weak_ptr<TcpConnection>>;
+
+    // 每个TcpConnection在时间轮中的位置
+    struct Entry
+    {
+        Entry() : linked(false), bucket(0) {}
+
+        bool                linked;
+        size_t              bucket;
+        Bucket::iterator    node;
+    };
+
+    TimingWheel(EventLoop *loop, int timeoutSeconds);
+    ~TimingWheel();
+
+    int timeoutSeconds() const { return timeoutSeconds_; }
+
+    void add(const TcpConnectionPtr &conn);
+    void touch(TcpConnection *conn);  // 连接上有读写活动
+    void remove(TcpConnection *conn);
+private:
+    void onTick(); // 每秒执行一次
+
+    EventLoop                   *loop_;
+    const int                   timeoutSeconds_;
+    std::vector<Bucket>         buckets_;
+    size_t                      cursor_;    // 当前的桶，新的活动都放在这里
+    Bucket                      expired_;   // 复用的临时链表
+    TimerId                     tickTimer_;
+};
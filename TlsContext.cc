@@ -0,0 +1,207 @@
+#include "TlsContext.h"
+#include "TlsFilter.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+
+#include <openssl/ssl.h>
+
+// 服务器发来新的session（TLS 1.3是握手以后的NewSessionTicket）
+static int newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    TlsFilter *filter = static_cast<TlsFilter*>(SSL_get_app_data(ssl));
+    if (filter == nullptr)
+    {
+        return 0;
+    }
+    filter->onNewSession(session);
+    return 1; // 接管了session的引用
+}
+
+static void keylogCallback(const SSL *ssl, const char *line)
+{
+    TlsFilter *filter = static_cast<TlsFilter*>(SSL_get_app_data(ssl));
+    if (filter)
+    {
+        filter->onKeylog(line);
+    }
+}
+
+TlsContext::TlsContext(SSL_CTX *ctx, bool server)
+    : ctx_(ctx)
+    , server_(server)
+    , ktls_(false)
+    , resumption_(true)
+{
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    // 空闲连接不占着OpenSSL的读写缓冲区，连接多的时候省内存
+    SSL_CTX_set_mode(ctx_, SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_RENEGOTIATION);
+    if (server_)
+    {
+        static const unsigned char kSessionIdContext[] = "mymuduo";
+        SSL_CTX_set_session_id_context(ctx_, kSessionIdContext, sizeof kSessionIdContext - 1);
+    }
+    else
+    {
+        // 不用OpenSSL的内部缓存，自己按对端保存
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
+    }
+    setKtls(true);
+}
+
+TlsContext::~TlsContext()
+{
+    for (auto &entry : sessions_)
+    {
+        for (SSL_SESSION *session : entry.second)
+        {
+            SSL_SESSION_free(session);
+        }
+    }
+    SSL_CTX_free(ctx_);
+}
+
+std::shared_ptr<TlsContext> TlsContext::newServer(const std::string &certFile, const std::string &keyFile)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == nullptr)
+    {
+        TlsFilter::logSslError("TlsContext", "SSL_CTX_new");
+        return nullptr;
+    }
+    if (SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1)
+    {
+        TlsFilter::logSslError("TlsContext", "load certificate");
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    return std::shared_ptr<TlsContext>(new TlsContext(ctx, true));
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClient(const std::string &caFile)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == nullptr)
+    {
+        TlsFilter::logSslError("TlsContext", "SSL_CTX_new");
+        return nullptr;
+    }
+    if (caFile.empty())
+    {
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    }
+    else
+    {
+        if (SSL_CTX_load_verify_locations(ctx, caFile.c_str(), nullptr) != 1)
+        {
+            TlsFilter::logSslError("TlsContext", "load CA");
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    }
+    return std::shared_ptr<TlsContext>(new TlsContext(ctx, false));
+}
+
+void TlsContext::setKtls(bool on)
+{
+    ktls_ = on;
+    // 只有要交给内核的时候才需要traffic secret，不用的时候不让OpenSSL格式化keylog
+    SSL_CTX_set_keylog_callback(ctx_, on ? keylogCallback : nullptr);
+}
+
+void TlsContext::setSessionResumption(bool on)
+{
+    resumption_ = on;
+    if (server_)
+    {
+        SSL_CTX_set_session_cache_mode(ctx_, on ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_num_tickets(ctx_, on ? 2 : 0);
+        if (on)
+        {
+            SSL_CTX_clear_options(ctx_, SSL_OP_NO_TICKET);
+        }
+        else
+        {
+            SSL_CTX_set_options(ctx_, SSL_OP_NO_TICKET);
+        }
+    }
+}
+
+SSL_SESSION* TlsContext::takeSession(const std::string &peer)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = sessions_.find(peer);
+    if (it == sessions_.end())
+    {
+        return nullptr;
+    }
+    SSL_SESSION *session = it->second.back();
+    it->second.pop_back();
+    if (it->second.empty())
+    {
+        sessions_.erase(it);
+    }
+    return session;
+}
+
+void TlsContext::saveSession(const std::string &peer, SSL_SESSION *session)
+{
+    if (!resumption_ || !SSL_SESSION_is_resumable(session))
+    {
+        SSL_SESSION_free(session);
+        return;
+    }
+    SSL_SESSION *old = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::vector<SSL_SESSION*> &saved = sessions_[peer];
+        if (saved.size() >= kMaxSessionsPerPeer)
+        {
+            old = saved.front();
+            saved.erase(saved.begin());
+        }
+        saved.push_back(session);
+    }
+    if (old)
+    {
+        SSL_SESSION_free(old);
+    }
+}
+
+#else // MYMUDUO_HAVE_OPENSSL
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, bool server)
+    : ctx_(ctx)
+    , server_(server)
+    , ktls_(false)
+    , resumption_(false)
+{
+}
+
+TlsContext::~TlsContext()
+{
+}
+
+std::shared_ptr<TlsContext> TlsContext::newServer(const std::string&, const std::string&)
+{
+    LOG_ERROR("TlsContext::newServer - built without OpenSSL \n");
+    return nullptr;
+}
+
+std::shared_ptr<TlsContext> TlsContext::newClient(const std::string&)
+{
+    LOG_ERROR("TlsContext::newClient - built without OpenSSL \n");
+    return nullptr;
+}
+
+void TlsContext::setKtls(bool on) { ktls_ = on; }
+void TlsContext::setSessionResumption(bool on) { resumption_ = on; }
+ssl_session_st* TlsContext::takeSession(const std::string&) { return nullptr; }
+void TlsContext::saveSession(const std::string&, ssl_session_st*) {}
+
+#endif // MYMUDUO_HAVE_OPENSSL
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 头文件里不引入OpenSSL，用的地方才需要它的头文件
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+/**
+ * TLS配置，包装一个SSL_CTX  一个TcpServer/TcpClient的所有连接共用一个，线程安全
+ * 服务器：TLS 1.3用session ticket恢复，ticket的密钥在SSL_CTX里，同一个TlsContext上的连接都能恢复；TLS 1.2用内部的session缓存
+ * 客户端：按对端保存最近拿到的几个session，下次连同一个对端时带上一个，服务器接受的话跳过证书验证和密钥交换
+ * 握手完成以后默认把连接交给内核TLS（TCP_ULP "tls"），内核没有tls模块、不是TLS 1.3、密码套件内核不支持时继续在用户态加解密
+ * 编译时没有找到OpenSSL的话newServer/newClient返回空
+ */
+class TlsContext : noncopyable
+{
+public:
+    // certFile是PEM格式的证书链，keyFile是PEM格式的私钥  失败返回空
+    static std::shared_ptr<TlsContext> newServer(const std::string &certFile, const std::string &keyFile);
+    // caFile为空时不验证服务器的证书
+    static std::shared_ptr<TlsContext> newClient(const std::string &caFile = std::string());
+    ~TlsContext();
+
+    bool isServer() const { return server_; }
+    // 下面这些在第一个连接建立之前设置
+    void setKtls(bool on);
+    bool ktls() const { return ktls_; }
+    // 关掉以后每次都是完整握手，用来对比恢复省下的开销
+    void setSessionResumption(bool on);
+    bool sessionResumption() const { return resumption_; }
+
+    ssl_ctx_st* native() const { return ctx_; }
+
+    // 客户端的session缓存  takeSession取出来以后缓存里就没有了（TLS 1.3的ticket最好只用一次），返回的session由调用方释放
+    ssl_session_st* takeSession(const std::string &peer);
+    // 接管session的引用  每个对端最多保存kMaxSessionsPerPeer个，同时连同一个对端的连接各用各的，满了丢掉最老的
+    void saveSession(const std::string &peer, ssl_session_st *session);
+private:
+    static const size_t kMaxSessionsPerPeer = 8;
+
+    TlsContext(ssl_ctx_st *ctx, bool server);
+
+    ssl_ctx_st  *ctx_;
+    const bool  server_;
+    bool        ktls_;
+    bool        resumption_;
+
+    std::mutex  mutex_;     // 保护sessions_，多个loop的连接同时握手
+    std::unordered_map<std::string, std::vector<ssl_session_st*>> sessions_;   // 最新的在后面
+};
+
+using TlsContextPtr = std::shared_ptr<TlsContext>;
@@ -0,0 +1,660 @@
+#include "TlsFilter.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#ifdef MYMUDUO_HAVE_OPENSSL
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <linux/tls.h>
+#include <algorithm>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+static const unsigned char kContentAlert = 21;
+static const unsigned char kContentHandshake = 22;
+static const size_t kRecordHeaderSize = 5;
+static const size_t kMaxRecordPlain = 16 * 1024;
+// SSL_read每次至少给这么多空间，一条记录的明文最多16K
+static const size_t kPlainChunk = 16 * 1024;
+// SSL_write一次的长度是int
+static const size_t kWriteChunk = 1024 * 1024;
+
+void TlsFilter::logSslError(const char *where, const char *what)
+{
+    char errbuf[256];
+    unsigned long err = ERR_get_error();
+    ERR_error_string_n(err, errbuf, sizeof errbuf);
+    LOG_ERROR("%s %s failed: %s \n", where, what, errbuf);
+    ERR_clear_error();
+}
+
+// 每条记录的头（SSL3_RT_HEADER）和每个握手消息都会回调
+static void msgCallback(int writeP, int, int contentType, const void *buf, size_t len, SSL*, void *arg)
+{
+    TlsFilter *filter = static_cast<TlsFilter*>(arg);
+    const unsigned char *p = static_cast<const unsigned char*>(buf);
+    if (contentType == SSL3_RT_HEADER && len >= kRecordHeaderSize)
+    {
+        filter->onRecordHeader(writeP != 0, p);
+    }
+    else if (contentType == SSL3_RT_HANDSHAKE && len > 0)
+    {
+        filter->onHandshakeMessage(writeP != 0, p, len);
+    }
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// RFC 8446 7.1 HKDF-Expand-Label(secret, label, "", outLen)
+static bool hkdfExpandLabel(const EVP_MD *md, const std::string &secret, const char *label,
+                            unsigned char *out, size_t outLen)
+{
+    unsigned char info[32];
+    size_t labelLen = strlen(label);
+    size_t fullLen = 6 + labelLen;
+    info[0] = static_cast<unsigned char>(outLen >> 8);
+    info[1] = static_cast<unsigned char>(outLen);
+    info[2] = static_cast<unsigned char>(fullLen);
+    ::memcpy(info + 3, "tls13 ", 6);
+    ::memcpy(info + 9, label, labelLen);
+    info[3 + fullLen] = 0; // context为空
+    size_t infoLen = 4 + fullLen;
+
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    bool ok = pctx != nullptr
+        && EVP_PKEY_derive_init(pctx) > 0
+        && EVP_PKEY_CTX_set_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(pctx, reinterpret_cast<const unsigned char*>(secret.data()),
+                                      static_cast<int>(secret.size())) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(pctx, info, static_cast<int>(infoLen)) > 0
+        && EVP_PKEY_derive(pctx, out, &outLen) > 0;
+    EVP_PKEY_CTX_free(pctx);
+    return ok;
+}
+
+static void cleanse(std::string *secret)
+{
+    if (!secret->empty())
+    {
+        OPENSSL_cleanse(&(*secret)[0], secret->size());
+        secret->clear();
+    }
+}
+
+TlsFilter::TlsFilter(const TlsContextPtr &context, const std::string &sessionKey, const std::string &serverName)
+    : context_(context)
+    , ssl_(SSL_new(context->native()))
+    , rbio_(nullptr)
+    , wbio_(nullptr)
+    , sessionKey_(sessionKey)
+    , handshakeDone_(false)
+    , receivedData_(false)
+    , ktlsFailed_(false)
+    , ulpAttached_(false)
+    , txOffloaded_(false)
+    , rxOffloaded_(false)
+    , txFinished_(false)
+    , rxFinished_(false)
+    , txRecords_(0)
+    , rxRecords_(0)
+    , recordHeaderLen_(0)
+    , recordRemaining_(0)
+{
+    if (ssl_ == nullptr)
+    {
+        logSslError("TlsFilter", "SSL_new");
+        return;
+    }
+    rbio_ = BIO_new(BIO_s_mem());
+    wbio_ = BIO_new(BIO_s_mem());
+    if (rbio_ == nullptr || wbio_ == nullptr)
+    {
+        logSslError("TlsFilter", "BIO_new");
+        BIO_free(rbio_);
+        BIO_free(wbio_);
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+        return;
+    }
+    // 读空的时候返回-1要求重试，OpenSSL报SSL_ERROR_WANT_READ而不是对端关闭
+    BIO_set_mem_eof_return(rbio_, -1);
+    BIO_set_mem_eof_return(wbio_, -1);
+    SSL_set_bio(ssl_, rbio_, wbio_); // 两个BIO归ssl_所有
+    SSL_set_app_data(ssl_, this);
+    if (context_->ktls())
+    {
+        SSL_set_msg_callback(ssl_, msgCallback);
+        SSL_set_msg_callback_arg(ssl_, this);
+    }
+
+    if (context_->isServer())
+    {
+        SSL_set_accept_state(ssl_);
+        return;
+    }
+    SSL_set_connect_state(ssl_);
+    if (!serverName.empty())
+    {
+        SSL_set_tlsext_host_name(ssl_, serverName.c_str());
+        if (SSL_get_verify_mode(ssl_) & SSL_VERIFY_PEER)
+        {
+            SSL_set1_host(ssl_, serverName.c_str());
+        }
+    }
+    if (context_->sessionResumption())
+    {
+        SSL_SESSION *session = context_->takeSession(sessionKey_);
+        if (session)
+        {
+            SSL_set_session(ssl_, session);
+            SSL_SESSION_free(session);
+        }
+    }
+}
+
+TlsFilter::~TlsFilter()
+{
+    cleanse(&txSecret_);
+    cleanse(&rxSecret_);
+    if (ssl_)
+    {
+        SSL_free(ssl_);
+    }
+}
+
+TlsFilter::Result TlsFilter::feed(const char *data, size_t len, Buffer *plain, std::string *out)
+{
+    if (len > 0)
+    {
+        if (context_->ktls() && !rxOffloaded_)
+        {
+            trackRecords(data, len);
+        }
+        BIO_write(rbio_, data, static_cast<int>(len)); // 内存BIO按需增长，不会写不进去
+    }
+
+    if (!handshakeDone_)
+    {
+        int ret = SSL_do_handshake(ssl_);
+        if (ret == 1)
+        {
+            handshakeDone_ = true;
+        }
+        else
+        {
+            int err = SSL_get_error(ssl_, ret);
+            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            {
+                drainOutput(out); // 告诉对端为什么失败的alert
+                logSslError("TlsFilter", "handshake");
+                return kError;
+            }
+        }
+    }
+
+    if (handshakeDone_)
+    {
+        // 读出所有完整记录的明文，握手以后的NewSessionTicket也在这里处理
+        for (;;)
+        {
+            plain->ensureWriteableBytes(kPlainChunk);
+            int n = SSL_read(ssl_, plain->beginWrite(), static_cast<int>(plain->writableBytes()));
+            if (n > 0)
+            {
+                plain->hasWritten(static_cast<size_t>(n));
+                receivedData_ = true;
+                continue;
+            }
+            int err = SSL_get_error(ssl_, n);
+            if (err == SSL_ERROR_WANT_READ)
+            {
+                break;
+            }
+            if (err == SSL_ERROR_ZERO_RETURN)
+            {
+                // 回应close_notify  没有发过close_notify就释放SSL的话，OpenSSL把当前session标记成不能恢复，
+                // 客户端最后收到的ticket就白存了
+                closeNotified();
+                drainOutput(out);
+                return kClosed;
+            }
+            drainOutput(out);
+            logSslError("TlsFilter", "SSL_read");
+            return kError;
+        }
+    }
+    drainOutput(out);
+    return kOk;
+}
+
+bool TlsFilter::encrypt(const char *data, size_t len, std::string *out)
+{
+    while (len > 0)
+    {
+        int chunk = static_cast<int>(std::min(len, kWriteChunk));
+        int n = SSL_write(ssl_, data, chunk);
+        if (n <= 0)
+        {
+            logSslError("TlsFilter", "SSL_write");
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    drainOutput(out);
+    return true;
+}
+
+void TlsFilter::sendCloseNotify(int fd)
+{
+    if (!handshakeDone_)
+    {
+        return;
+    }
+    if (txOffloaded_)
+    {
+        // 内核TLS用cmsg指定记录类型
+        unsigned char alert[2] = { 1, 0 }; // warning, close_notify
+        union
+        {
+            struct cmsghdr  align;
+            char            buf[CMSG_SPACE(sizeof(unsigned char))];
+        } control;
+        struct iovec vec = { alert, sizeof alert };
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &vec;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof control.buf;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(cmsg) = kContentAlert;
+        ::sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        return;
+    }
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+    std::string out;
+    drainOutput(&out);
+    if (!out.empty())
+    {
+        ::send(fd, out.data(), out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+}
+
+void TlsFilter::closeNotified()
+{
+    if (txOffloaded_)
+    {
+        // OpenSSL不能再写，只标记一下，回应的close_notify省掉
+        SSL_set_shutdown(ssl_, SSL_get_shutdown(ssl_) | SSL_SENT_SHUTDOWN);
+        return;
+    }
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+}
+
+bool TlsFilter::resumed() const
+{
+    return SSL_session_reused(ssl_) == 1;
+}
+
+const char* TlsFilter::version() const
+{
+    return SSL_get_version(ssl_);
+}
+
+const char* TlsFilter::cipher() const
+{
+    return SSL_get_cipher_name(ssl_);
+}
+
+bool TlsFilter::ktlsUsable() const
+{
+    return context_->ktls() && !ktlsFailed_ && handshakeDone_ && SSL_version(ssl_) == TLS1_3_VERSION;
+}
+
+bool TlsFilter::enableKtlsTx(int fd)
+{
+    if (!ktlsUsable() || txOffloaded_ || txSecret_.empty() || BIO_ctrl_pending(wbio_) != 0)
+    {
+        return false;
+    }
+    if (!installKtls(fd, TLS_TX, txSecret_, txRecords_))
+    {
+        return false;
+    }
+    txOffloaded_ = true;
+    cleanse(&txSecret_);
+    return true;
+}
+
+bool TlsFilter::wantKtlsRx() const
+{
+    // 客户端收到过应用数据才切换，服务器握手以后发的session ticket不会落到内核手里
+    return ktlsUsable() && !rxOffloaded_ && !rxSecret_.empty() && (isServer() || receivedData_);
+}
+
+size_t TlsFilter::bytesToRecordBoundary() const
+{
+    if (recordRemaining_ > 0)
+    {
+        return recordRemaining_;
+    }
+    return recordHeaderLen_ > 0 ? kRecordHeaderSize - recordHeaderLen_ : 0;
+}
+
+bool TlsFilter::enableKtlsRx(int fd)
+{
+    if (!wantKtlsRx() || bytesToRecordBoundary() != 0
+        || BIO_ctrl_pending(rbio_) != 0 || SSL_has_pending(ssl_))
+    {
+        return false;
+    }
+    if (!installKtls(fd, TLS_RX, rxSecret_, rxRecords_))
+    {
+        return false;
+    }
+    rxOffloaded_ = true;
+    cleanse(&rxSecret_);
+    return true;
+}
+
+bool TlsFilter::readControlRecord(int fd)
+{
+    char buf[kMaxRecordPlain];
+    union
+    {
+        struct cmsghdr  align;
+        char            buf[CMSG_SPACE(sizeof(unsigned char))];
+    } control;
+    struct iovec vec = { buf, sizeof buf };
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    ssize_t n = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (n < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    unsigned char type = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE)
+    {
+        type = *CMSG_DATA(cmsg);
+    }
+    if (type == kContentHandshake && n > 0 && static_cast<unsigned char>(buf[0]) == SSL3_MT_NEWSESSION_TICKET)
+    {
+        return true; // 切换以后服务器又发的ticket，用不上，丢掉
+    }
+    if (type == kContentAlert && n >= 2 && buf[1] == 0)
+    {
+        closeNotified(); // close_notify
+        return false;
+    }
+    if (type != kContentAlert)
+    {
+        // KeyUpdate之类的，内核没法继续解密
+        LOG_ERROR("TlsFilter::readControlRecord fd=%d - unexpected record type %d \n", fd, type);
+    }
+    return false;
+}
+
+void TlsFilter::onRecordHeader(bool write, const unsigned char*)
+{
+    if (write)
+    {
+        if (txFinished_)
+        {
+            ++txRecords_;
+        }
+    }
+    else if (rxFinished_)
+    {
+        ++rxRecords_;
+    }
+}
+
+void TlsFilter::onHandshakeMessage(bool write, const unsigned char *msg, size_t)
+{
+    // Finished之后的记录用application traffic secret加密，序号从0开始
+    if (msg[0] == SSL3_MT_FINISHED)
+    {
+        if (write)
+        {
+            txFinished_ = true;
+        }
+        else
+        {
+            rxFinished_ = true;
+        }
+    }
+}
+
+void TlsFilter::onKeylog(const char *line)
+{
+    // "CLIENT_TRAFFIC_SECRET_0 <client random> <secret>"，都是十六进制
+    const char *space = strchr(line, ' ');
+    if (space == nullptr)
+    {
+        return;
+    }
+    std::string label(line, space - line);
+    bool clientSecret = label == "CLIENT_TRAFFIC_SECRET_0";
+    if (!clientSecret && label != "SERVER_TRAFFIC_SECRET_0")
+    {
+        return;
+    }
+    const char *hex = strchr(space + 1, ' ');
+    if (hex == nullptr)
+    {
+        return;
+    }
+    std::string *secret = clientSecret == !isServer() ? &txSecret_ : &rxSecret_;
+    cleanse(secret);
+    for (++hex; hex[0] && hex[1]; hex += 2)
+    {
+        int hi = hexValue(hex[0]);
+        int lo = hexValue(hex[1]);
+        if (hi < 0 || lo < 0)
+        {
+            break;
+        }
+        secret->push_back(static_cast<char>(hi << 4 | lo));
+    }
+}
+
+void TlsFilter::onNewSession(SSL_SESSION *session)
+{
+    context_->saveSession(sessionKey_, session);
+}
+
+void TlsFilter::drainOutput(std::string *out)
+{
+    size_t pending = BIO_ctrl_pending(wbio_);
+    if (pending == 0)
+    {
+        return;
+    }
+    size_t old = out->size();
+    out->resize(old + pending);
+    int n = BIO_read(wbio_, &(*out)[old], static_cast<int>(pending));
+    out->resize(old + static_cast<size_t>(std::max(n, 0)));
+}
+
+bool TlsFilter::installKtls(int fd, int direction, const std::string &secret, uint64_t seq)
+{
+    const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl_);
+    const EVP_MD *md = SSL_CIPHER_get_handshake_digest(cipher);
+    union
+    {
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        struct tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+    } info;
+    ::memset(&info, 0, sizeof info);
+    unsigned char key[32];
+    unsigned char iv[12];
+    unsigned char recSeq[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        recSeq[i] = static_cast<unsigned char>(seq >> (56 - 8 * i));
+    }
+
+    size_t infoLen = 0;
+    bool derived = false;
+    switch (SSL_CIPHER_get_protocol_id(cipher))
+    {
+    case 0x1301: // TLS_AES_128_GCM_SHA256
+        derived = hkdfExpandLabel(md, secret, "key", key, 16) && hkdfExpandLabel(md, secret, "iv", iv, 12);
+        info.aes128.info.version = TLS_1_3_VERSION;
+        info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        ::memcpy(info.aes128.key, key, 16);
+        ::memcpy(info.aes128.salt, iv, 4);
+        ::memcpy(info.aes128.iv, iv + 4, 8);
+        ::memcpy(info.aes128.rec_seq, recSeq, 8);
+        infoLen = sizeof info.aes128;
+        break;
+    case 0x1302: // TLS_AES_256_GCM_SHA384
+        derived = hkdfExpandLabel(md, secret, "key", key, 32) && hkdfExpandLabel(md, secret, "iv", iv, 12);
+        info.aes256.info.version = TLS_1_3_VERSION;
+        info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        ::memcpy(info.aes256.key, key, 32);
+        ::memcpy(info.aes256.salt, iv, 4);
+        ::memcpy(info.aes256.iv, iv + 4, 8);
+        ::memcpy(info.aes256.rec_seq, recSeq, 8);
+        infoLen = sizeof info.aes256;
+        break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case 0x1303: // TLS_CHACHA20_POLY1305_SHA256
+        derived = hkdfExpandLabel(md, secret, "key", key, 32) && hkdfExpandLabel(md, secret, "iv", iv, 12);
+        info.chacha.info.version = TLS_1_3_VERSION;
+        info.chacha.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        ::memcpy(info.chacha.key, key, 32);
+        ::memcpy(info.chacha.iv, iv, 12);
+        ::memcpy(info.chacha.rec_seq, recSeq, 8);
+        infoLen = sizeof info.chacha;
+        break;
+#endif
+    default:
+        break;
+    }
+    OPENSSL_cleanse(key, sizeof key);
+    OPENSSL_cleanse(iv, sizeof iv);
+
+    bool ok = derived;
+    if (ok && !ulpAttached_)
+    {
+        if (::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof "tls") < 0)
+        {
+            // 内核没有tls模块（ENOENT），这个连接以后都在用户态加解密
+            LOG_DEBUG("TlsFilter::installKtls fd=%d - TCP_ULP tls error:%d \n", fd, errno);
+            ok = false;
+        }
+        else
+        {
+            ulpAttached_ = true;
+        }
+    }
+    if (ok && ::setsockopt(fd, SOL_TLS, direction, &info, static_cast<socklen_t>(infoLen)) < 0)
+    {
+        LOG_DEBUG("TlsFilter::installKtls fd=%d - %s error:%d \n", fd, direction == TLS_TX ? "TLS_TX" : "TLS_RX", errno);
+        ok = false;
+    }
+    OPENSSL_cleanse(&info, sizeof info);
+    if (!ok)
+    {
+        ktlsFailed_ = true;
+    }
+    return ok;
+}
+
+void TlsFilter::trackRecords(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (recordRemaining_ > 0)
+        {
+            size_t n = std::min(len, recordRemaining_);
+            recordRemaining_ -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
+        size_t n = std::min(len, kRecordHeaderSize - recordHeaderLen_);
+        ::memcpy(recordHeader_ + recordHeaderLen_, data, n);
+        recordHeaderLen_ += n;
+        data += n;
+        len -= n;
+        if (recordHeaderLen_ == kRecordHeaderSize)
+        {
+            recordRemaining_ = static_cast<size_t>(recordHeader_[3]) << 8 | recordHeader_[4];
+            recordHeaderLen_ = 0;
+        }
+    }
+}
+
+#else // MYMUDUO_HAVE_OPENSSL
+
+void TlsFilter::logSslError(const char *where, const char *what)
+{
+    LOG_ERROR("%s %s failed: built without OpenSSL \n", where, what);
+}
+
+// 没有OpenSSL时TlsContext创建不出来，TcpConnection::startTls不会构造TlsFilter
+TlsFilter::TlsFilter(const TlsContextPtr &context, const std::string &sessionKey, const std::string&)
+    : context_(context), ssl_(nullptr), rbio_(nullptr), wbio_(nullptr), sessionKey_(sessionKey)
+    , handshakeDone_(false), receivedData_(false), ktlsFailed_(true), ulpAttached_(false)
+    , txOffloaded_(false), rxOffloaded_(false), txFinished_(false), rxFinished_(false)
+    , txRecords_(0), rxRecords_(0), recordHeaderLen_(0), recordRemaining_(0)
+{
+}
+
+TlsFilter::~TlsFilter() {}
+TlsFilter::Result TlsFilter::feed(const char*, size_t, Buffer*, std::string*) { return kError; }
+bool TlsFilter::encrypt(const char*, size_t, std::string*) { return false; }
+void TlsFilter::sendCloseNotify(int) {}
+bool TlsFilter::resumed() const { return false; }
+const char* TlsFilter::version() const { return "none"; }
+const char* TlsFilter::cipher() const { return "none"; }
+bool TlsFilter::enableKtlsTx(int) { return false; }
+bool TlsFilter::enableKtlsRx(int) { return false; }
+bool TlsFilter::wantKtlsRx() const { return false; }
+size_t TlsFilter::bytesToRecordBoundary() const { return 0; }
+bool TlsFilter::readControlRecord(int) { return false; }
+void TlsFilter::onRecordHeader(bool, const unsigned char*) {}
+void TlsFilter::onHandshakeMessage(bool, const unsigned char*, size_t) {}
+void TlsFilter::onKeylog(const char*) {}
+void TlsFilter::onNewSession(ssl_session_st*) {}
+
+#endif // MYMUDUO_HAVE_OPENSSL
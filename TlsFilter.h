@@ -0,0 +1,107 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TlsContext.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+struct ssl_st;
+struct bio_st;
+class Buffer;
+
+/**
+ * 一个连接上的TLS  OpenSSL通过两个内存BIO工作：从socket读到的密文写进rbio_，OpenSSL要发送的密文从wbio_取出来
+ * 交给TcpConnection的发送队列，socket的非阻塞读写还是由loop完成，OpenSSL不碰fd
+ * TLS 1.3握手完成以后发送和接收可以分别交给内核TLS：keylog回调拿到两个方向的traffic secret，
+ * 用HKDF导出key和iv；msg回调数每个方向Finished之后的记录数，作为内核的起始序号
+ * 交给内核以后发送队列里放的就是明文，sendfile也由内核加密，接收到的直接是明文
+ * 只在连接所属的loop线程使用
+ */
+class TlsFilter : noncopyable
+{
+public:
+    enum Result
+    {
+        kOk,
+        kClosed,    // 收到了close_notify
+        kError,     // 握手失败或者数据被篡改，连接不能再用
+    };
+
+    // sessionKey是客户端session缓存的键，serverName用于SNI，验证证书时也检查主机名
+    TlsFilter(const TlsContextPtr &context, const std::string &sessionKey, const std::string &serverName);
+    ~TlsFilter();
+
+    bool valid() const { return ssl_ != nullptr; }
+    bool isServer() const { return context_->isServer(); }
+
+    // 推进握手、解密  data是从socket读到的密文，客户端开始握手时为空
+    // 解出来的明文追加到plain，要发送的密文（握手消息、alert、session ticket）追加到out
+    Result feed(const char *data, size_t len, Buffer *plain, std::string *out);
+    // 握手完成以后，用户态加密len字节追加到out
+    bool encrypt(const char *data, size_t len, std::string *out);
+    // 发送close_notify  发送队列必须已经空了，直接写socket，写不进去就算了
+    void sendCloseNotify(int fd);
+
+    bool handshakeDone() const { return handshakeDone_; }
+    bool resumed() const;
+    // 协商出来的版本和密码套件，日志用
+    const char* version() const;
+    const char* cipher() const;
+
+    // 内核TLS  发送方向要在发送队列为空的时候切换，之前OpenSSL写出去的记录对端都要收到
+    bool enableKtlsTx(int fd);
+    bool enableKtlsRx(int fd);
+    bool txOffloaded() const { return txOffloaded_; }
+    bool rxOffloaded() const { return rxOffloaded_; }
+    // 接收方向还想切换到内核  切换时OpenSSL里不能有剩下的密文，正好读到记录的边界上才行
+    bool wantKtlsRx() const;
+    // wantKtlsRx时，到下一个记录边界还差的字节数，读socket的时候最多读这么多  0表示已经在边界上
+    size_t bytesToRecordBoundary() const;
+    // 接收交给内核以后，read遇到不是应用数据的记录返回EIO  读出这条记录，对端关闭或者无法继续时返回false
+    bool readControlRecord(int fd);
+
+    // 取出OpenSSL错误队列里的第一个错误记日志，再清空错误队列  where是调用方的类名，TlsContext也用它
+    static void logSslError(const char *where, const char *what);
+
+    // OpenSSL回调
+    void onRecordHeader(bool write, const unsigned char *header);
+    void onHandshakeMessage(bool write, const unsigned char *msg, size_t len);
+    void onKeylog(const char *line);
+    void onNewSession(ssl_session_st *session);
+private:
+    // 把wbio_里的密文取到out
+    void drainOutput(std::string *out);
+    // 收到了对端的close_notify，回应一个，session保持可以恢复
+    void closeNotified();
+    bool ktlsUsable() const;
+    bool installKtls(int fd, int direction, const std::string &secret, uint64_t seq);
+    // 跟踪喂给OpenSSL的密文的记录边界
+    void trackRecords(const char *data, size_t len);
+
+    TlsContextPtr   context_;
+    ssl_st          *ssl_;
+    bio_st          *rbio_;
+    bio_st          *wbio_;
+    const std::string sessionKey_;
+    bool            handshakeDone_;
+    bool            receivedData_;      // 收到过应用数据，客户端可以确定服务器的session ticket已经收完了
+    bool            ktlsFailed_;        // 内核不支持，不再尝试
+    bool            ulpAttached_;
+    bool            txOffloaded_;
+    bool            rxOffloaded_;
+
+    // 内核TLS用的状态  Finished之后每个方向的记录数就是内核要接着用的序号
+    bool            txFinished_;
+    bool            rxFinished_;
+    uint64_t        txRecords_;
+    uint64_t        rxRecords_;
+    std::string     txSecret_;
+    std::string     rxSecret_;
+
+    // 记录边界  recordHeader_攒不满5字节的记录头，recordRemaining_是当前记录还没收到的字节
+    unsigned char   recordHeader_[5];
+    size_t          recordHeaderLen_;
+    size_t          recordRemaining_;
+};
@@ -0,0 +1,374 @@
+#include "UdpChannel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+const int UdpChannel::kBatchSize;
+const int UdpChannel::kMaxBatchesPerEvent;
+const size_t UdpChannel::kDefaultMaxDatagram;
+const size_t UdpChannel::kGroBufferSize;
+const size_t UdpChannel::kMaxPendingDatagrams;
+const int UdpChannel::kMaxGsoSegments;
+
+// 一次GSO发送的整个负载不能超过一个IP包的上限
+static const size_t kMaxGsoBytes = 65000;
+static const size_t kRecvControlSize = CMSG_SPACE(sizeof(int));
+static const size_t kSendControlSize = CMSG_SPACE(sizeof(uint16_t));
+
+static int createNonblocking(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+InetAddress UdpBatch::peerAddress(size_t i) const
+{
+    InetAddress addr;
+    addr.setSockAddr(datagrams_[i].peer, datagrams_[i].peerLen);
+    return addr;
+}
+
+UdpChannel::UdpChannel(EventLoop *loop, const InetAddress &localAddr, bool reuseport)
+    : loop_(loop)
+    , socket_(createNonblocking(localAddr.family()))
+    , channel_(loop, socket_.fd())
+    , localAddr_(localAddr)
+    , maxDatagram_(kDefaultMaxDatagram)
+    , gro_(false)
+    , gso_(false)
+    , inCallback_(false)
+    , bufferSize_(0)
+    , outboxHead_(0)
+{
+    if (localAddr.isUnix())
+    {
+        if (!localAddr.isAbstract())
+        {
+            Socket::removeStaleUnixPath(localAddr, SOCK_DGRAM);
+        }
+    }
+    else
+    {
+        socket_.setReuseAddr(true);
+        socket_.setReusePort(reuseport);
+    }
+    socket_.bindAddress(localAddr);
+    channel_.setReadCallback(std::bind(&UdpChannel::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpChannel::handleWrite, this));
+}
+
+UdpChannel::~UdpChannel()
+{
+    channel_.disableAll();
+    channel_.remove();
+}
+
+void UdpChannel::start()
+{
+    int on = 1;
+    if (gro_ && ::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &on, sizeof on) < 0)
+    {
+        LOG_INFO("UdpChannel::start %s UDP_GRO not supported:%d \n", localAddr_.toIpPort().c_str(), errno);
+        gro_ = false;
+    }
+    // 设置成0不改变行为，只看内核认不认识这个选项
+    int zero = 0;
+    if (gso_ && ::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_SEGMENT, &zero, sizeof zero) < 0)
+    {
+        LOG_INFO("UdpChannel::start %s UDP_SEGMENT not supported:%d \n", localAddr_.toIpPort().c_str(), errno);
+        gso_ = false;
+    }
+
+    bufferSize_ = gro_ ? kGroBufferSize : maxDatagram_;
+    recvBuffers_.resize(bufferSize_ * kBatchSize);
+    recvMsgs_.assign(kBatchSize, mmsghdr());
+    recvIovecs_.resize(kBatchSize);
+    recvPeers_.resize(kBatchSize);
+    recvControl_.assign(kRecvControlSize * kBatchSize, 0);
+    for (int i = 0; i < kBatchSize; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvBuffers_[bufferSize_ * i];
+        recvIovecs_[i].iov_len = bufferSize_;
+        recvMsgs_[i].msg_hdr.msg_iov = &recvIovecs_[i];
+        recvMsgs_[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs_[i].msg_hdr.msg_name = &recvPeers_[i];
+    }
+    batch_.datagrams_.reserve(gro_ ? kBatchSize * kMaxGsoSegments : kBatchSize);
+
+    sendMsgs_.assign(kBatchSize, mmsghdr());
+    sendIovecs_.resize(kBatchSize);
+    sendControl_.assign(kSendControlSize * kBatchSize, 0);
+
+    channel_.enableReading();
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    for (int round = 0; round < kMaxBatchesPerEvent; ++round)
+    {
+        for (int i = 0; i < kBatchSize; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_control = gro_ ? &recvControl_[kRecvControlSize * i] : nullptr;
+            hdr.msg_controllen = gro_ ? kRecvControlSize : 0;
+            hdr.msg_flags = 0;
+        }
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpChannel::handleRead %s recvmmsg error:%d \n", localAddr_.toIpPort().c_str(), errno);
+            }
+            break;
+        }
+
+        batch_.datagrams_.clear();
+        uint64_t bytes = 0;
+        uint64_t truncated = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                ++truncated;
+                continue;
+            }
+            int segmentSize = 0;
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); gro_ && cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    ::memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof segmentSize);
+                }
+            }
+            collect(i, recvMsgs_[i].msg_len, segmentSize);
+            bytes += recvMsgs_[i].msg_len;
+        }
+        LoopMetrics &metrics = loop_->metrics();
+        metrics.add(LoopMetrics::kDatagramsRead, batch_.size());
+        metrics.add(LoopMetrics::kBytesRead, bytes);
+        if (truncated > 0)
+        {
+            metrics.add(LoopMetrics::kDatagramsDropped, truncated);
+        }
+
+        if (!batch_.empty() && batchCallback_)
+        {
+            inCallback_ = true;
+            batchCallback_(this, batch_, receiveTime);
+            inCallback_ = false;
+            flush();
+        }
+        if (n < kBatchSize)
+        {
+            break; // 接收队列已经读空了
+        }
+    }
+}
+
+void UdpChannel::collect(int i, size_t len, int segmentSize)
+{
+    const char *data = &recvBuffers_[bufferSize_ * i];
+    const sockaddr *peer = reinterpret_cast<const sockaddr*>(&recvPeers_[i]);
+    socklen_t peerLen = recvMsgs_[i].msg_hdr.msg_namelen;
+    size_t step = segmentSize > 0 ? static_cast<size_t>(segmentSize) : len;
+    if (step == 0 || step >= len)
+    {
+        UdpBatch::Datagram datagram = { data, len, peer, peerLen };
+        batch_.datagrams_.push_back(datagram);
+        return;
+    }
+    for (size_t offset = 0; offset < len; offset += step)
+    {
+        UdpBatch::Datagram datagram = { data + offset, std::min(step, len - offset), peer, peerLen };
+        batch_.datagrams_.push_back(datagram);
+    }
+}
+
+void UdpChannel::send(const sockaddr *peer, socklen_t peerLen, const char *data, size_t len)
+{
+    if (pendingDatagrams() >= kMaxPendingDatagrams)
+    {
+        loop_->metrics().add(LoopMetrics::kDatagramsDropped);
+        return;
+    }
+    OutDatagram datagram;
+    datagram.peerLen = std::min<socklen_t>(peerLen, sizeof datagram.peer);
+    ::memcpy(&datagram.peer, peer, datagram.peerLen);
+    datagram.offset = outData_.size();
+    datagram.len = len;
+    outData_.append(data, len);
+    outbox_.push_back(datagram);
+    if (!inCallback_ && !channel_.isWriting())
+    {
+        flush();
+    }
+}
+
+// 同一个对端、大小相同的连续数据报，只有最后一个可以短一些
+int UdpChannel::gsoRun(size_t first) const
+{
+    const OutDatagram &head = outbox_[first];
+    if (head.len == 0)
+    {
+        return 1;
+    }
+    size_t total = head.len;
+    int run = 1;
+    for (size_t i = first + 1; i < outbox_.size() && run < kMaxGsoSegments; ++i)
+    {
+        const OutDatagram &next = outbox_[i];
+        if (next.len == 0 || next.len > head.len || total + next.len > kMaxGsoBytes
+            || next.peerLen != head.peerLen || ::memcmp(&next.peer, &head.peer, head.peerLen) != 0)
+        {
+            break;
+        }
+        total += next.len;
+        ++run;
+        if (next.len < head.len)
+        {
+            break;
+        }
+    }
+    return run;
+}
+
+void UdpChannel::flush()
+{
+    LoopMetrics &metrics = loop_->metrics();
+    int covered[kBatchSize];    // 每个消息包含几个数据报
+    while (outboxHead_ < outbox_.size())
+    {
+        int msgs = 0;
+        size_t next = outboxHead_;
+        while (msgs < kBatchSize && next < outbox_.size())
+        {
+            int run = gso_ ? gsoRun(next) : 1;
+            OutDatagram &first = outbox_[next];
+            const OutDatagram &last = outbox_[next + run - 1];
+            // 发送队列里的数据是连续追加的，一组数据报就是一段连续的内存
+            sendIovecs_[msgs].iov_base = &outData_[0] + first.offset;
+            sendIovecs_[msgs].iov_len = last.offset + last.len - first.offset;
+            msghdr &hdr = sendMsgs_[msgs].msg_hdr;
+            hdr.msg_name = &first.peer;
+            hdr.msg_namelen = first.peerLen;
+            hdr.msg_iov = &sendIovecs_[msgs];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = nullptr;
+            hdr.msg_controllen = 0;
+            hdr.msg_flags = 0;
+            if (run > 1)
+            {
+                hdr.msg_control = &sendControl_[kSendControlSize * msgs];
+                hdr.msg_controllen = kSendControlSize;
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segmentSize = static_cast<uint16_t>(first.len);
+                ::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+            }
+            covered[msgs] = run;
+            ++msgs;
+            next += static_cast<size_t>(run);
+        }
+
+        int n = ::sendmmsg(socket_.fd(), sendMsgs_.data(), msgs, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            int savedErrno = errno;
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK || savedErrno == ENOBUFS)
+            {
+                metrics.add(LoopMetrics::kEagain);
+                compactOutbox();
+                if (!channel_.isWriting())
+                {
+                    metrics.add(LoopMetrics::kWriteRegistrations);
+                    channel_.enableWriting();
+                }
+                return;
+            }
+            if (covered[0] > 1 && (savedErrno == EINVAL || savedErrno == EIO))
+            {
+                // 分段比路径MTU大，或者网卡和驱动不支持  以后不再合并，这一组重新一个一个发
+                LOG_ERROR("UdpChannel::flush %s UDP_SEGMENT failed:%d, disable GSO \n",
+                    localAddr_.toIpPort().c_str(), savedErrno);
+                gso_ = false;
+                continue;
+            }
+            // 这个数据报发不出去，比如对端地址不对、数据报太大，丢掉它继续发后面的
+            LOG_ERROR("UdpChannel::flush %s sendmmsg error:%d \n", localAddr_.toIpPort().c_str(), savedErrno);
+            dropOutbox(static_cast<size_t>(covered[0]));
+            continue;
+        }
+
+        size_t datagrams = 0;
+        uint64_t bytes = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            datagrams += static_cast<size_t>(covered[i]);
+            bytes += sendIovecs_[i].iov_len;
+        }
+        metrics.add(LoopMetrics::kDatagramsWritten, datagrams);
+        metrics.add(LoopMetrics::kBytesWritten, bytes);
+        outboxHead_ += datagrams;
+        // n < msgs时第n个消息出了错，下一次sendmmsg会返回它的错误
+    }
+    compactOutbox();
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+}
+
+void UdpChannel::handleWrite()
+{
+    flush();
+}
+
+void UdpChannel::dropOutbox(size_t n)
+{
+    loop_->metrics().add(LoopMetrics::kDatagramsDropped, n);
+    outboxHead_ += n;
+}
+
+// 删掉已经发送的数据报  全部发送完时只clear，保留内存
+void UdpChannel::compactOutbox()
+{
+    if (outboxHead_ == outbox_.size())
+    {
+        outbox_.clear();
+        outData_.clear();
+    }
+    else if (outboxHead_ > 0)
+    {
+        size_t base = outbox_[outboxHead_].offset;
+        outData_.erase(0, base);
+        outbox_.erase(outbox_.begin(), outbox_.begin() + static_cast<std::ptrdiff_t>(outboxHead_));
+        for (OutDatagram &datagram : outbox_)
+        {
+            datagram.offset -= base;
+        }
+    }
+    outboxHead_ = 0;
+}
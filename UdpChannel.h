@@ -0,0 +1,129 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+class EventLoop;
+class UdpChannel;
+
+// recvmmsg一次收到的一批数据报  数据在UdpChannel的接收缓冲区里，只在批回调里有效
+class UdpBatch : noncopyable
+{
+public:
+    struct Datagram
+    {
+        const char      *data;
+        size_t          len;
+        const sockaddr  *peer;
+        socklen_t       peerLen;
+    };
+
+    size_t size() const { return datagrams_.size(); }
+    bool empty() const { return datagrams_.empty(); }
+    const Datagram& operator[](size_t i) const { return datagrams_[i]; }
+    InetAddress peerAddress(size_t i) const;
+private:
+    friend class UdpChannel;
+    std::vector<Datagram> datagrams_;   // 每批clear以后复用，不重新分配
+};
+
+/**
+ * 一个loop里的UDP socket  可读时用recvmmsg一次收kBatchSize个数据报，整批交给batchCallback_
+ * 接收缓冲区在start时一次分配好，之后每批复用
+ * send先把数据报攒在发送队列里，批回调返回以后（不在回调里时马上）用sendmmsg一次发出去  EAGAIN时注册EPOLLOUT继续发
+ * 打开GRO时内核把同一个流的多个数据报合并成一次接收，这里按分段大小拆开，回调看到的仍然是一个一个的数据报
+ * 打开GSO时发给同一个对端、大小相同的连续数据报合成一次发送，由内核或者网卡分段
+ * 除了构造，都只能在loop线程调用，也必须在loop线程析构
+ */
+class UdpChannel : noncopyable
+{
+public:
+    using BatchCallback = std::function<void(UdpChannel*, const UdpBatch&, Timestamp)>;
+
+    static const int kBatchSize = 64;               // recvmmsg/sendmmsg一次最多处理的消息数
+    static const int kMaxBatchesPerEvent = 16;      // 一次可读事件最多读这么多批，不让一个socket占住loop
+    static const size_t kDefaultMaxDatagram = 2048; // 没有GRO时每个接收缓冲区的大小，更大的数据报被截断丢弃
+    static const size_t kGroBufferSize = 65536;     // GRO合并以后最大64K
+    static const size_t kMaxPendingDatagrams = 4096;// 发送队列里最多这么多个数据报，再发送的直接丢弃
+    static const int kMaxGsoSegments = 64;          // 一次GSO发送最多这么多个分段
+
+    // reuseport为true时打开SO_REUSEPORT，多个loop各自bind同一个地址，内核按四元组把流分到各个socket上
+    UdpChannel(EventLoop *loop, const InetAddress &localAddr, bool reuseport);
+    ~UdpChannel();
+
+    // 下面这些在start之前设置
+    void setBatchCallback(const BatchCallback &cb) { batchCallback_ = cb; }
+    void setMaxDatagramSize(size_t size) { maxDatagram_ = size; }
+    void setGro(bool on) { gro_ = on; }
+    void setGso(bool on) { gso_ = on; }
+
+    // 分配接收缓冲区，注册EPOLLIN  内核不支持UDP_GRO、UDP_SEGMENT时对应的选项自动关掉
+    void start();
+
+    void send(const InetAddress &peer, const char *data, size_t len)
+    { send(peer.getSockAddr(), peer.length(), data, len); }
+    // 回复批里的数据报时直接用Datagram的peer，不用构造InetAddress
+    void send(const sockaddr *peer, socklen_t peerLen, const char *data, size_t len);
+    // 马上发送队列里的数据报  批回调里不需要调用
+    void flush();
+
+    EventLoop* getLoop() const { return loop_; }
+    const InetAddress& localAddress() const { return localAddr_; }
+    int fd() const { return socket_.fd(); }
+    bool groEnabled() const { return gro_; }
+    bool gsoEnabled() const { return gso_; }
+    size_t pendingDatagrams() const { return outbox_.size() - outboxHead_; }
+private:
+    // 发送队列里的一个数据报  数据在outData_[offset, offset+len)，都是连续追加的，GSO合并时一个iovec就够了
+    struct OutDatagram
+    {
+        sockaddr_storage    peer;
+        socklen_t           peerLen;
+        size_t              offset;
+        size_t              len;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    // 收到的第i个消息拆成数据报放进batch_
+    void collect(int i, size_t len, int segmentSize);
+    // 从outboxHead_开始的数据报能和first合成一次GSO发送的个数
+    int gsoRun(size_t first) const;
+    void dropOutbox(size_t n);
+    void compactOutbox();
+
+    EventLoop       *loop_;
+    Socket          socket_;
+    Channel         channel_;
+    const InetAddress localAddr_;
+    BatchCallback   batchCallback_;
+    size_t          maxDatagram_;
+    bool            gro_;
+    bool            gso_;
+    bool            inCallback_;    // 批回调里的send先攒着，回调返回以后一起发
+
+    // 接收  kBatchSize个消息头、对端地址、控制消息和bufferSize_大小的缓冲区，start时分配
+    size_t                          bufferSize_;
+    std::vector<char>               recvBuffers_;
+    std::vector<struct mmsghdr>     recvMsgs_;
+    std::vector<struct iovec>       recvIovecs_;
+    std::vector<sockaddr_storage>   recvPeers_;
+    std::vector<char>               recvControl_;
+    UdpBatch                        batch_;
+
+    // 发送
+    std::vector<OutDatagram>        outbox_;
+    size_t                          outboxHead_;    // 前面的已经发送出去了
+    std::string                     outData_;
+    std::vector<struct mmsghdr>     sendMsgs_;
+    std::vector<struct iovec>       sendIovecs_;
+    std::vector<char>               sendControl_;
+};
@@ -0,0 +1,77 @@
+#include "UdpServer.h"
+#include "Logger.h"
+
+#include <future>
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainLoop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , ipPort_(listenAddr.toIpPort())
+    , name_(nameArg)
+    , listenAddr_(listenAddr)
+    , threadPool_(new EventLoopThreadPool(loop, name_))
+    , maxDatagram_(UdpChannel::kDefaultMaxDatagram)
+    , gro_(false)
+    , gso_(false)
+    , started_(0)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    for (EventLoop *ioLoop : loops_)
+    {
+        std::unique_ptr<UdpChannel> channel(std::move(channels_[ioLoop]));
+        std::promise<void> closed;
+        ioLoop->runInLoop([&channel, &closed]() {
+            channel.reset();
+            closed.set_value();
+        });
+        closed.get_future().wait();
+    }
+}
+
+void UdpServer::start()
+{
+    if (started_++ != 0)
+    {
+        return;
+    }
+    threadPool_->start(threadInitCallback_);
+    loops_ = threadPool_->getAllLoops();
+    bool reuseport = loops_.size() > 1;
+    for (EventLoop *ioLoop : loops_)
+    {
+        // 按顺序一个一个bind，和TcpServer的kReusePortPerLoop一样，socket在reuseport组里的下标和loop一致
+        std::promise<UdpChannel*> created;
+        ioLoop->runInLoop([this, ioLoop, reuseport, &created]() {
+            UdpChannel *channel = new UdpChannel(ioLoop, listenAddr_, reuseport);
+            channel->setBatchCallback(batchCallback_);
+            channel->setMaxDatagramSize(maxDatagram_);
+            channel->setGro(gro_);
+            channel->setGso(gso_);
+            channel->start();
+            created.set_value(channel);
+        });
+        channels_[ioLoop].reset(created.get_future().get());
+    }
+    LOG_INFO("UdpServer::start [%s] at %s with %zu socket(s) \n", name_.c_str(), ipPort_.c_str(), loops_.size());
+}
+
+std::vector<UdpChannel*> UdpServer::channels() const
+{
+    std::vector<UdpChannel*> result;
+    for (EventLoop *ioLoop : loops_)
+    {
+        result.push_back(channels_.at(ioLoop).get());
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/**
+ * UDP服务器  每个loop一个UdpChannel，有subloop时都bind同一个地址（SO_REUSEPORT），内核按四元组把流分到各个loop上，
+ * mainLoop不收数据  没有subloop时只在mainLoop上收
+ */
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "noncopyable.h"
+#include "EventLoopThreadPool.h"
+#include "UdpChannel.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg);
+    ~UdpServer();
+
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setThreadCpus(const std::vector<int> &cpus) { threadPool_->setThreadCpus(cpus); }
+
+    // 在各自loop线程里回调，回调里的send在回调返回以后一次sendmmsg发出去  下面这些必须在start之前调用
+    void setBatchCallback(const UdpChannel::BatchCallback &cb) { batchCallback_ = cb; }
+    // 见UdpChannel
+    void setMaxDatagramSize(size_t size) { maxDatagram_ = size; }
+    void setGro(bool on) { gro_ = on; }
+    void setGso(bool on) { gso_ = on; }
+
+    // 启动loop线程，在每个loop里创建UdpChannel  多次调用没有副作用
+    void start();
+
+    const std::string& name() const { return name_; }
+    const std::string& ipPort() const { return ipPort_; }
+    // 每个loop的UdpChannel，start之后不变  只能在对应的loop线程里使用
+    std::vector<UdpChannel*> channels() const;
+    // 所有loop的计数器和直方图  线程安全，start之后调用
+    LoopMetrics::Snapshot metrics() const { return threadPool_->metrics(); }
+private:
+    using ChannelMap = std::unordered_map<EventLoop*, std::unique_ptr<UdpChannel>>;
+
+    EventLoop                           *loop_;
+    const std::string                   ipPort_;
+    const std::string                   name_;
+    const InetAddress                   listenAddr_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback                  threadInitCallback_;
+    UdpChannel::BatchCallback           batchCallback_;
+    size_t                              maxDatagram_;
+    bool                                gro_;
+    bool                                gso_;
+    std::vector<EventLoop*>             loops_;
+    ChannelMap                          channels_;  // 在所属loop里创建和析构
+    std::atomic_int                     started_;
+};
@@ -0,0 +1,155 @@
+/**
+ * 新建连接的速率：客户端线程不停地connect，服务器建立连接以后客户端用RST关掉
+ *   single_batch1  : mainLoop一个Acceptor，每次可读事件只accept一个连接
+ *   single         : mainLoop一个Acceptor，每次可读事件accept到EAGAIN，accept以后轮询交给subloop
+ *   reuseport      : kReusePortPerLoop，每个subloop一个SO_REUSEPORT的监听socket，内核按四元组哈希分配
+ *   reuseport_cbpf : 同上，再挂上按cpu选择监听socket的cBPF程序
+ * 输出里的per_loop是每个subloop建立的连接个数
+ *
+ * ./acceptrate_bench [connections] [subloops] [clients]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const int kMaxPendingAccepts = 64;
+static const int kMaxLoops = 64;
+
+static void run(const char *mode, TcpServer::Option option, bool cpuSteering, int acceptBatch,
+                int total, int numLoops, int numClients)
+{
+    const uint16_t port = 19402;
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::atomic<int64_t> connected(0);  // 客户端connect成功的个数
+    std::atomic<int64_t> accepted(0);
+    std::atomic<int64_t> closed(0);
+    std::atomic<int64_t> perLoop[kMaxLoops];
+    for (int i = 0; i < kMaxLoops; ++i)
+    {
+        perLoop[i] = 0;
+    }
+
+    std::thread server([&]() {
+        EventLoop loop;
+        // start以后才知道每个subloop的下标，回调里只读  要比server晚析构，server析构时subloop还在处理剩下的数据
+        std::unordered_map<EventLoop*, int> loopIndex;
+        TcpServer server(&loop, InetAddress(port), "AcceptRateBench", option);
+        server.setThreadNum(numLoops);
+        server.setCpuSteering(cpuSteering);
+        server.setAcceptBatch(acceptBatch);
+        server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                ++perLoop[loopIndex.find(conn->getLoop())->second];
+                ++accepted;
+            }
+            else
+            {
+                ++closed;
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        server.start();
+        std::vector<EventLoopThreadPool::LoopPlacement> placements = server.loopPlacements();
+        for (size_t i = 0; i < placements.size(); ++i)
+        {
+            loopIndex[placements[i].loop] = static_cast<int>(i);
+        }
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    std::atomic_int next(0);
+    int64_t start = nowNanos();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < numClients; ++c)
+    {
+        clients.emplace_back([&]() {
+            struct linger lin = { 1, 0 };   // close时直接RST，客户端不进入TIME_WAIT，不会用完端口
+            while (next++ < total)
+            {
+                int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+                if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+                {
+                    perror("connect");
+                    exit(1);
+                }
+                ++connected;
+                // listen队列满了SYN会被丢掉，要等1秒重传，测出来的就不是服务器了
+                while (connected - accepted > kMaxPendingAccepts)
+                {
+                    ::sched_yield();
+                }
+                ::close(fd);
+            }
+        });
+    }
+    for (std::thread &thr : clients)
+    {
+        thr.join();
+    }
+    while (closed < total)
+    {
+        ::usleep(1000);
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    serverLoop.load()->quit();
+    server.join();
+
+    std::string distribution;
+    for (int i = 0; i < numLoops; ++i)
+    {
+        distribution += (i == 0 ? "" : ",") + std::to_string(perLoop[i].load());
+    }
+    printf("{\"bench\":\"acceptrate\",\"mode\":\"%s\",\"subloops\":%d,\"clients\":%d,\"connections\":%d,\"accept_batch\":%d,"
+            "\"connections_per_sec\":%.0f,\"us_per_connection\":%.2f,\"per_loop\":[%s]}\n",
+            mode, numLoops, numClients, total, acceptBatch,
+            static_cast<double>(total) * 1e9 / elapsed,
+            static_cast<double>(elapsed) / 1e3 / total,
+            distribution.c_str());
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int total = argc > 1 ? atoi(argv[1]) : 50000;
+    int numLoops = argc > 2 ? atoi(argv[2]) : 4;
+    int numClients = argc > 3 ? atoi(argv[3]) : 4;
+    if (numLoops < 1 || numLoops > kMaxLoops)
+    {
+        numLoops = 4;
+    }
+
+    Logger::setLogLevel(FATAL);   // RST关闭的连接每个都会打印handleError
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    run("single_batch1", TcpServer::kReusePort, false, 1, total, numLoops, numClients);
+    run("single", TcpServer::kReusePort, false, Acceptor::kDefaultAcceptBatch, total, numLoops, numClients);
+    run("reuseport", TcpServer::kReusePortPerLoop, false, Acceptor::kDefaultAcceptBatch, total, numLoops, numClients);
+    run("reuseport_cbpf", TcpServer::kReusePortPerLoop, true, Acceptor::kDefaultAcceptBatch, total, numLoops, numClients);
+    return 0;
+}
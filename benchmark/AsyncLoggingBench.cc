@@ -0,0 +1,105 @@
+/**
+ * 日志前端的吞吐量和调用点延迟
+ *   sync  : 每一行直接fwrite + fflush到文件（相当于原来std::cout << std::endl的写法）
+ *   async : Logger输出重定向到AsyncLogging，由后台线程写滚动文件
+ *   disabled : 运行期日志级别设为ERROR，LOG_INFO只剩一次级别判断
+ *
+ * ./asynclogging_bench [threads] [linesPerThread]
+ */
+#include "Logger.h"
+#include "AsyncLogging.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static FILE *g_file = nullptr;
+static AsyncLogging *g_asyncLog = nullptr;
+
+static void syncOutput(const char *msg, int len)
+{
+    ::fwrite(msg, 1, len, g_file);
+    ::fflush(g_file);
+}
+
+static void asyncOutput(const char *msg, int len)
+{
+    g_asyncLog->append(msg, len);
+}
+
+static void run(const char *mode, int numThreads, int numLines)
+{
+    std::vector<std::vector<int32_t>> latencies(numThreads);
+    std::vector<std::thread> threads;
+
+    int64_t start = nowNanos();
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&latencies, t, numLines]() {
+            std::vector<int32_t> &lat = latencies[t];
+            lat.reserve(numLines);
+            for (int i = 0; i < numLines; ++i)
+            {
+                int64_t begin = nowNanos();
+                LOG_INFO("thread %d line %d abcdefghijklmnopqrstuvwxyz 0123456789", t, i);
+                lat.push_back(static_cast<int32_t>(nowNanos() - begin));
+            }
+        });
+    }
+    for (std::thread &thr : threads)
+    {
+        thr.join();
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    std::vector<int32_t> all;
+    all.reserve(static_cast<size_t>(numThreads) * numLines);
+    for (const std::vector<int32_t> &lat : latencies)
+    {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    std::sort(all.begin(), all.end());
+    const size_t total = all.size();
+
+    printf("{\"bench\":\"logging\",\"mode\":\"%s\",\"threads\":%d,\"lines\":%zu,"
+            "\"lines_per_sec\":%.0f,\"p50_ns\":%d,\"p99_ns\":%d,\"p999_ns\":%d}\n",
+            mode, numThreads, total,
+            static_cast<double>(total) * 1e9 / elapsed,
+            all[total / 2], all[total * 99 / 100], all[total * 999 / 1000]);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numThreads = argc > 1 ? atoi(argv[1]) : 8;
+    int numLines = argc > 2 ? atoi(argv[2]) : 100000;
+
+    g_file = ::fopen("/tmp/asynclogging_bench_sync.log", "w");
+    if (g_file == nullptr)
+    {
+        perror("fopen");
+        return 1;
+    }
+    Logger::setOutput(syncOutput);
+    run("sync", numThreads, numLines);
+    ::fclose(g_file);
+
+    {
+        AsyncLogging log("/tmp/asynclogging_bench", 500 * 1000 * 1000);
+        g_asyncLog = &log;
+        log.start();
+        Logger::setOutput(asyncOutput);
+        run("async", numThreads, numLines);
+        Logger::setLogLevel(ERROR);
+        run("disabled", numThreads, numLines);
+        Logger::setLogLevel(INFO);
+        log.stop();
+    }
+
+    return 0;
+}
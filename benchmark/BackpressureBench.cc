@@ -0,0 +1,179 @@
+/**
+ * 慢下游代理的内存占用：上游尽快发送total字节，代理转发给下游，下游每读64KB停1ms
+ *   none         : 只是转发，下游发送队列一直增长，上游发多快代理就收多快
+ *   backpressure : 下游setBackpressure(上游, high, low)，超过高水位上游停止读
+ * 每种模式fork一个子进程，peak_rss_kb是子进程的VmHWM，包含压测端的内存
+ *
+ * ./backpressure_bench [total_mb] [high_kb] [low_kb]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <string>
+#include <thread>
+
+static const uint16_t kPort = 18130;
+
+static bool gBackpressure = false;
+static size_t gHighWaterMark = 1 << 20;
+static size_t gLowWaterMark = 256 << 10;
+// 只在loop线程中访问  第一个连接是下游，第二个是上游
+static TcpConnectionPtr gDownstream;
+static TcpConnectionPtr gUpstream;
+
+static long peakRssKb()
+{
+    FILE *fp = ::fopen("/proc/self/status", "r");
+    if (fp == nullptr)
+    {
+        return 0;
+    }
+    char line[256];
+    long value = 0;
+    while (::fgets(line, sizeof line, fp))
+    {
+        if (::sscanf(line, "VmHWM: %ld", &value) == 1)
+        {
+            break;
+        }
+    }
+    ::fclose(fp);
+    return value;
+}
+
+static void onConnection(const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        if (conn == gUpstream && gDownstream)
+        {
+            gDownstream->shutdown(); // 发完以后下游读到EOF
+        }
+        return;
+    }
+    if (!gDownstream)
+    {
+        gDownstream = conn;
+    }
+    else
+    {
+        gUpstream = conn;
+        if (gBackpressure)
+        {
+            gDownstream->setBackpressure(gUpstream, gHighWaterMark, gLowWaterMark);
+        }
+    }
+}
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    if (conn == gUpstream)
+    {
+        gDownstream->send(buf);
+    }
+    else
+    {
+        buf->retrieveAll();
+    }
+}
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+static void runMode(const char *name, size_t total)
+{
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    loop->runInLoop([loop]() {
+        TcpServer *server = new TcpServer(loop, InetAddress(kPort), "proxy");
+        server->setConnectionCallback(onConnection);
+        server->setMessageCallback(onMessage);
+        server->start();
+    });
+    ::usleep(100 * 1000);
+
+    int sink = connectTo(kPort);
+    ::usleep(50 * 1000); // 保证下游先建立
+    int source = connectTo(kPort);
+    int64_t start = nowNanos();
+    std::thread writer([source, total]() {
+        std::string chunk(64 * 1024, 'x');
+        size_t sent = 0;
+        while (sent < total)
+        {
+            ssize_t n = ::write(source, chunk.data(), std::min(chunk.size(), total - sent));
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        ::shutdown(source, SHUT_WR);
+    });
+
+    std::string buf(64 * 1024, '\0');
+    size_t received = 0;
+    ssize_t n;
+    while ((n = ::read(sink, &buf[0], buf.size())) > 0)
+    {
+        received += static_cast<size_t>(n);
+        ::usleep(1000); // 慢下游
+    }
+    writer.join();
+    double elapsed = (nowNanos() - start) / 1e9;
+    printf("{\"bench\":\"backpressure\",\"mode\":\"%s\",\"total_mb\":%zu,\"received_mb\":%zu,"
+            "\"high_kb\":%zu,\"low_kb\":%zu,\"mb_per_sec\":%.1f,\"peak_rss_kb\":%ld}\n",
+            name, total >> 20, received >> 20, gHighWaterMark >> 10, gLowWaterMark >> 10,
+            (received >> 20) / elapsed, peakRssKb());
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t total = static_cast<size_t>(argc > 1 ? atoi(argv[1]) : 64) << 20;
+    gHighWaterMark = static_cast<size_t>(argc > 2 ? atoi(argv[2]) : 1024) << 10;
+    gLowWaterMark = static_cast<size_t>(argc > 3 ? atoi(argv[3]) : 256) << 10;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    const char *names[] = { "none", "backpressure" };
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        pid_t pid = ::fork();
+        if (pid == 0)
+        {
+            gBackpressure = mode == 1;
+            runMode(names[mode], total);
+        }
+        ::waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
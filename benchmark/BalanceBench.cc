@@ -0,0 +1,251 @@
+/**
+ * 负载不均匀时不同的subloop分配策略
+ * 少量heavy连接不停地发送大块数据，服务器每块都要计算很多遍校验和；其余的chatty连接一问一答，统计往返延迟
+ * 每numLoops个连接里第一个是heavy，轮询和最少连接数会把heavy连接都分到同一个loop上
+ * heavy连接建立以后等一会，让loop的busyRatio跟上
+ *   round_robin       : 原来的轮询
+ *   least_connections : 连接数最少的loop
+ *   least_load        : busyRatio的EWMA最低的loop
+ *   consistent_hash   : 按对端ip哈希，这里所有连接都来自127.0.0.1，全部在同一个loop上，只是用来对比
+ *   round_robin_rebalance : 轮询分配，再打开setRebalance，持续忙的loop把连接迁移到空闲的loop上
+ *
+ * ./balance_bench [connections] [subloops] [heavy] [rounds]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const int kMaxLoops = 64;
+static const size_t kHeavyBlock = 64 * 1024;
+static const int kBurnPasses = 8;
+static const size_t kPingSize = 16;
+
+static int connectTo(const InetAddress &addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return fd;
+}
+
+static bool readFull(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = ::read(fd, buf + got, len - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void run(const char *mode, LoadBalancer::Strategy strategy, bool rebalance,
+                int total, int numLoops, int numHeavy, int rounds)
+{
+    const uint16_t port = 19403;
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::atomic<uint64_t> checksum(0);
+    std::atomic<int64_t> heavyBytes[kMaxLoops];
+    std::atomic_int perLoop[kMaxLoops];
+    for (int i = 0; i < kMaxLoops; ++i)
+    {
+        heavyBytes[i] = 0;
+        perLoop[i] = 0;
+    }
+
+    std::thread server([&]() {
+        EventLoop loop;
+        // start以后才知道每个subloop的下标，回调里只读  要比server晚析构，server析构时subloop还在处理剩下的数据
+        std::unordered_map<EventLoop*, int> loopIndex;
+        TcpServer server(&loop, InetAddress(port), "BalanceBench");
+        server.setThreadNum(numLoops);
+        server.setLoadBalancer(strategy);
+        if (rebalance)
+        {
+            server.setRebalance(0.5, 0.2);
+        }
+        server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                ++perLoop[loopIndex.find(conn->getLoop())->second];
+            }
+        });
+        server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            if (buf->peek()[0] == 'H')
+            {
+                // heavy：模拟解析/压缩之类的计算
+                uint64_t sum = 0;
+                for (int pass = 0; pass < kBurnPasses; ++pass)
+                {
+                    const unsigned char *p = reinterpret_cast<const unsigned char*>(buf->peek());
+                    for (size_t i = 0; i < buf->readableBytes(); ++i)
+                    {
+                        sum = sum * 31 + p[i];
+                    }
+                }
+                checksum += sum;
+                heavyBytes[loopIndex.find(conn->getLoop())->second] += buf->readableBytes();
+                buf->retrieveAll();
+            }
+            else
+            {
+                while (buf->readableBytes() >= kPingSize)
+                {
+                    conn->send(buf->retrieveAsString(kPingSize));
+                }
+            }
+        });
+        server.start();
+        std::vector<EventLoopThreadPool::LoopPlacement> placements = server.loopPlacements();
+        for (size_t i = 0; i < placements.size(); ++i)
+        {
+            loopIndex[placements[i].loop] = static_cast<int>(i);
+        }
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    std::atomic_bool stop(false);
+    std::vector<std::thread> heavy;
+    std::vector<int> heavyFds;
+    std::vector<int> chatty;
+    for (int i = 0; i < total; ++i)
+    {
+        if (i % numLoops == 0 && static_cast<int>(heavy.size()) < numHeavy)
+        {
+            int fd = connectTo(addr);
+            heavyFds.push_back(fd);
+            heavy.emplace_back([fd, &stop]() {
+                std::string block(kHeavyBlock, 'H');
+                while (!stop)
+                {
+                    if (::write(fd, block.data(), block.size()) < 0)
+                    {
+                        break;
+                    }
+                }
+            });
+            ::usleep(300 * 1000);
+        }
+        else
+        {
+            chatty.push_back(connectTo(addr));
+        }
+    }
+
+    std::vector<int64_t> rtts;
+    rtts.reserve(chatty.size() * rounds);
+    char ping[kPingSize];
+    memset(ping, 'P', sizeof ping);
+    char pong[kPingSize];
+    int64_t start = nowNanos();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int fd : chatty)
+        {
+            int64_t sent = nowNanos();
+            if (::write(fd, ping, sizeof ping) != static_cast<ssize_t>(sizeof ping) || !readFull(fd, pong, sizeof pong))
+            {
+                perror("ping");
+                exit(1);
+            }
+            rtts.push_back(nowNanos() - sent);
+        }
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    stop = true;
+    for (int fd : heavyFds)
+    {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+    for (std::thread &thr : heavy)
+    {
+        thr.join();
+    }
+    for (int fd : heavyFds)
+    {
+        ::close(fd);
+    }
+    for (int fd : chatty)
+    {
+        ::close(fd);
+    }
+    serverLoop.load()->quit();
+    server.join();
+
+    std::sort(rtts.begin(), rtts.end());
+    std::string connections;
+    std::string heavyMB;
+    for (int i = 0; i < numLoops; ++i)
+    {
+        connections += (i == 0 ? "" : ",") + std::to_string(perLoop[i].load());
+        heavyMB += (i == 0 ? "" : ",") + std::to_string(heavyBytes[i].load() >> 20);
+    }
+    printf("{\"bench\":\"balance\",\"mode\":\"%s\",\"subloops\":%d,\"connections\":%d,\"heavy\":%d,"
+            "\"pings\":%zu,\"pings_per_sec\":%.0f,\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"rtt_max_us\":%.1f,"
+            "\"per_loop\":[%s],\"heavy_mb_per_loop\":[%s]}\n",
+            mode, numLoops, total, numHeavy, rtts.size(),
+            static_cast<double>(rtts.size()) * 1e9 / elapsed,
+            rtts[rtts.size() / 2] / 1e3,
+            rtts[rtts.size() * 99 / 100] / 1e3,
+            rtts.back() / 1e3,
+            connections.c_str(), heavyMB.c_str());
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int total = argc > 1 ? atoi(argv[1]) : 64;
+    int numLoops = argc > 2 ? atoi(argv[2]) : 4;
+    int numHeavy = argc > 3 ? atoi(argv[3]) : 2;
+    int rounds = argc > 4 ? atoi(argv[4]) : 200;
+    if (numLoops < 1 || numLoops > kMaxLoops)
+    {
+        numLoops = 4;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);   // 结束时shutdown heavy连接，发送线程可能还在write
+    Logger::setLogLevel(FATAL);   // heavy连接被RST时每个都会打印handleError
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    run("round_robin", LoadBalancer::kRoundRobin, false, total, numLoops, numHeavy, rounds);
+    run("least_connections", LoadBalancer::kLeastConnections, false, total, numLoops, numHeavy, rounds);
+    run("least_load", LoadBalancer::kLeastLoad, false, total, numLoops, numHeavy, rounds);
+    run("consistent_hash", LoadBalancer::kConsistentHash, false, total, numLoops, numHeavy, rounds);
+    run("round_robin_rebalance", LoadBalancer::kRoundRobin, true, total, numLoops, numHeavy, rounds);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * 连接频繁建立/断开时Buffer内存的开销
+ * 每一轮构造一个Buffer、写入一段数据、读出、析构，相当于一个短连接的接收缓冲区
+ *   vector : 原来的实现，std::vector<char>，构造时分配并清零kCheapPrepend + 1K
+ *   pool   : 现在的Buffer，第一次写入时从BufferPool取内存，析构时放回当前线程的缓存
+ *
+ * ./bufferpool_bench [rounds] [messageBytes]
+ */
+#include "Buffer.h"
+#include "BufferPool.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// 原来Buffer的存储方式，只保留和这里有关的部分
+class VectorBuffer
+{
+public:
+    VectorBuffer() : buffer_(Buffer::kCheapPrepend + Buffer::kInitialSize), writerIndex_(Buffer::kCheapPrepend) {}
+
+    void append(const char *data, size_t len)
+    {
+        if (buffer_.size() - writerIndex_ < len)
+        {
+            buffer_.resize(writerIndex_ + len);
+        }
+        std::copy(data, data + len, &buffer_[writerIndex_]);
+        writerIndex_ += len;
+    }
+
+    size_t readableBytes() const { return writerIndex_ - Buffer::kCheapPrepend; }
+private:
+    std::vector<char> buffer_;
+    size_t writerIndex_;
+};
+
+template <typename B>
+static void run(const char *mode, int rounds, const std::string &message)
+{
+    size_t total = 0;
+    int64_t start = nowNanos();
+    for (int i = 0; i < rounds; ++i)
+    {
+        B buf;
+        buf.append(message.data(), message.size());
+        total += buf.readableBytes();
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    printf("{\"bench\":\"bufferpool\",\"mode\":\"%s\",\"rounds\":%d,\"message_bytes\":%zu,"
+            "\"ns_per_round\":%.1f,\"checksum\":%zu}\n",
+            mode, rounds, message.size(),
+            static_cast<double>(elapsed) / rounds, total);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+    size_t messageBytes = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 4000;
+    std::string message(messageBytes, 'x');
+
+    run<VectorBuffer>("vector", rounds, message);
+    run<Buffer>("pool", rounds, message);
+    return 0;
+}
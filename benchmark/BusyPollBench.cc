@@ -0,0 +1,148 @@
+/**
+ * 忙轮询（EventLoop::setBusyPoll / TcpServer::setBusyPoll）对延迟的影响
+ *   functor  : 另一个线程queueInLoop，从投递到执行的延迟  自旋时不写eventfd
+ *   pingpong : loopback上64字节的请求/回复往返时间
+ * 每次之间间隔intervalUs，模拟稀疏的行情消息，间隔小于自旋时间时loop一直在自旋
+ *
+ * ./busypoll_bench [samples] [intervalUs] [spinUs]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void report(const char *test, const char *mode, std::vector<int64_t> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    printf("{\"bench\":\"busypoll\",\"test\":\"%s\",\"mode\":\"%s\",\"samples\":%zu,"
+            "\"p50_us\":%.2f,\"p99_us\":%.2f}\n",
+            test, mode, latencies.size(),
+            latencies[latencies.size() / 2] / 1e3,
+            latencies[latencies.size() * 99 / 100] / 1e3);
+    fflush(stdout);
+}
+
+static void runFunctor(const char *mode, int spinUs, int samples, int intervalUs)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    if (spinUs > 0)
+    {
+        loop->runInLoop(std::bind(&EventLoop::setBusyPoll, loop, spinUs));
+    }
+
+    std::vector<int64_t> latencies(samples);
+    std::atomic_int executed(0);
+    for (int i = 0; i < samples; ++i)
+    {
+        int64_t posted = nowNanos();
+        loop->queueInLoop([&latencies, &executed, posted, i]() {
+            latencies[i] = nowNanos() - posted;
+            executed.store(i + 1, std::memory_order_release);
+        });
+        while (executed.load(std::memory_order_acquire) != i + 1)
+        {
+            // 等这一个执行完再投递下一个，测的是单个回调的延迟  CPU比线程少时让出CPU给loop
+            ::sched_yield();
+        }
+        ::usleep(intervalUs);
+    }
+    report("functor", mode, latencies);
+}
+
+static void runPingPong(const char *mode, int spinUs, uint16_t port, int samples, int intervalUs)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&serverLoop, spinUs, port]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "BusyPollBench");
+        if (spinUs > 0)
+        {
+            server.setBusyPoll(spinUs);
+        }
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    char message[64] = { 0 };
+    char reply[64];
+    std::vector<int64_t> latencies(samples);
+    for (int i = 0; i < samples; ++i)
+    {
+        int64_t start = nowNanos();
+        if (::write(fd, message, sizeof message) != sizeof message)
+        {
+            perror("write");
+            exit(1);
+        }
+        size_t got = 0;
+        while (got < sizeof reply)
+        {
+            ssize_t n = ::read(fd, reply + got, sizeof reply - got);
+            if (n <= 0)
+            {
+                perror("read");
+                exit(1);
+            }
+            got += n;
+        }
+        latencies[i] = nowNanos() - start;
+        ::usleep(intervalUs);
+    }
+    ::close(fd);
+    serverLoop.load()->quit();
+    server.join();
+    report("pingpong", mode, latencies);
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 20000;
+    int intervalUs = argc > 2 ? atoi(argv[2]) : 50;
+    int spinUs = argc > 3 ? atoi(argv[3]) : 1000;
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    runFunctor("block", 0, samples, intervalUs);
+    runFunctor("spin", spinUs, samples, intervalUs);
+    runPingPong("block", 0, 19501, samples, intervalUs);
+    runPingPong("spin", spinUs, 19502, samples, intervalUs);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * 按行解析的开销：在典型大小的HTTP请求头里逐行找CRLF，以及找头部结束的\r\n\r\n
+ *   std_search : 各个协议处理里常见的std::search
+ *   scalar     : memchr找'\r'再检查下一个字节
+ *   sse2/avx2/neon : ByteSearch的SIMD实现，当前CPU不支持的跳过
+ * 头部：small（~80字节，3行）、typical（~450字节，浏览器请求）、large（~4K，带长cookie）
+ *
+ * ./bytesearch_bench [iterations]
+ */
+#include "ByteSearch.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+static std::string makeHeader(const char *kind)
+{
+    std::string h = "GET /index.html?id=12345 HTTP/1.1\r\nHost: www.example.com\r\n";
+    if (std::string(kind) == "small")
+    {
+        return h + "Connection: keep-alive\r\n\r\n";
+    }
+    h += "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+         "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+         "Accept-Language: en-US,en;q=0.9\r\n"
+         "Accept-Encoding: gzip, deflate, br\r\n"
+         "Connection: keep-alive\r\n"
+         "Upgrade-Insecure-Requests: 1\r\n";
+    if (std::string(kind) == "large")
+    {
+        h += "Cookie: ";
+        for (int i = 0; i < 60; ++i)
+        {
+            h += "session_token_" + std::to_string(i) + "=abcdefghijklmnopqrstuvwxyz0123456789; ";
+        }
+        h += "\r\n";
+    }
+    return h + "\r\n";
+}
+
+typedef const char* (*CrlfFunc)(ByteSearch::Impl, const char*, const char*);
+
+static const char* stdSearchCRLF(ByteSearch::Impl, const char *begin, const char *end)
+{
+    static const char crlf[] = "\r\n";
+    const char *p = std::search(begin, end, crlf, crlf + 2);
+    return p == end ? nullptr : p;
+}
+
+static const char* stdSearchEnd(const char *begin, const char *end)
+{
+    static const char eoh[] = "\r\n\r\n";
+    const char *p = std::search(begin, end, eoh, eoh + 4);
+    return p == end ? nullptr : p;
+}
+
+static void run(const char *kind, const char *mode, ByteSearch::Impl impl, bool useStd, int iterations)
+{
+    std::string header = makeHeader(kind);
+    const char *begin = header.data();
+    const char *end = begin + header.size();
+    CrlfFunc crlf = useStd ? stdSearchCRLF
+                           : static_cast<CrlfFunc>(&ByteSearch::findCRLF);
+
+    size_t lines = 0;
+    int64_t start = nowNanos();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const char *p = begin; p < end; )
+        {
+            const char *eol = crlf(impl, p, end);
+            if (eol == nullptr)
+            {
+                break;
+            }
+            ++lines;
+            p = eol + 2;
+        }
+    }
+    int64_t lineNanos = nowNanos() - start;
+
+    size_t found = 0;
+    start = nowNanos();
+    for (int i = 0; i < iterations; ++i)
+    {
+        const char *p = useStd ? stdSearchEnd(begin, end) : ByteSearch::find(impl, begin, end, "\r\n\r\n", 4);
+        found += static_cast<size_t>(p - begin);
+    }
+    int64_t endNanos = nowNanos() - start;
+
+    printf("{\"bench\":\"bytesearch\",\"header\":\"%s\",\"bytes\":%zu,\"mode\":\"%s\",\"lines_ns\":%.1f,\"end_of_headers_ns\":%.1f,"
+           "\"lines_gb_per_sec\":%.2f,\"check\":%zu}\n",
+            kind, header.size(), mode,
+            static_cast<double>(lineNanos) / iterations, static_cast<double>(endNanos) / iterations,
+            static_cast<double>(header.size()) * iterations / lineNanos, lines / iterations + found / iterations);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    const char *kinds[] = { "small", "typical", "large" };
+    const ByteSearch::Impl impls[] = { ByteSearch::kScalar, ByteSearch::kSse2, ByteSearch::kAvx2, ByteSearch::kNeon };
+    for (const char *kind : kinds)
+    {
+        run(kind, "std_search", ByteSearch::kScalar, true, iterations);
+        for (ByteSearch::Impl impl : impls)
+        {
+            if (ByteSearch::supported(impl))
+            {
+                run(kind, ByteSearch::implName(impl), impl, false, iterations);
+            }
+        }
+    }
+    return 0;
+}
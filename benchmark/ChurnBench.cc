@@ -0,0 +1,178 @@
+/**
+ * 连接建立/断开的抖动
+ *   table : 只测Poller里fd => Channel*的查找表，原来的unordered_map和现在的ChannelTable
+ *           模拟一次连接的生命周期：insert，update时查找两次，erase
+ *   tcp   : 真实的TcpServer，客户端保持window个连接，每建立一个新连接就用RST关掉最老的一个
+ *
+ * ./churn_bench [cycles] [window]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Poller.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 原来Poller::channels_的用法
+struct MapTable
+{
+    std::unordered_map<int, Channel*> channels;
+    Channel* find(int fd) const
+    {
+        auto it = channels.find(fd);
+        return it != channels.end() ? it->second : nullptr;
+    }
+    void insert(int fd, Channel *channel) { channels.insert(std::make_pair(fd, channel)); }
+    void erase(int fd) { channels.erase(fd); }
+};
+
+template <typename Table>
+static void runTable(const char *mode, int numFds, int cycles)
+{
+    Table table;
+    Channel *dummy = reinterpret_cast<Channel*>(&table);
+    for (int fd = 0; fd < numFds; ++fd)
+    {
+        table.insert(fd, dummy);
+    }
+
+    std::mt19937 rng(12345);
+    std::vector<int> fds(cycles);
+    for (int &fd : fds)
+    {
+        fd = static_cast<int>(rng() % numFds);
+    }
+
+    int64_t hits = 0;
+    int64_t start = nowNanos();
+    for (int fd : fds)
+    {
+        table.erase(fd);
+        table.insert(fd, dummy);
+        hits += table.find(fd) == dummy;
+        hits += table.find(fd) == dummy;
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    printf("{\"bench\":\"churn\",\"mode\":\"%s\",\"fds\":%d,\"cycles\":%d,\"ns_per_cycle\":%.1f,\"hits\":%ld}\n",
+            mode, numFds, cycles, static_cast<double>(elapsed) / cycles, hits);
+    fflush(stdout);
+}
+
+static const int kMaxPendingAccepts = 64;
+
+static void runTcp(int cycles, size_t window)
+{
+    const uint16_t port = 19401;
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::atomic<int64_t> accepted(0);
+    std::atomic<int64_t> closed(0);
+    std::thread server([&serverLoop, &accepted, &closed, port]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "ChurnBench");
+        server.setConnectionCallback([&accepted, &closed](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                ++accepted;
+            }
+            else
+            {
+                ++closed;
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    struct linger lin = { 1, 0 };   // close时直接RST，客户端不进入TIME_WAIT，不会用完端口
+    std::deque<int> live;
+    int64_t start = nowNanos();
+    for (int i = 0; i < cycles; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        live.push_back(fd);
+        // 客户端跑得比服务器快时listen队列会满，SYN被丢掉以后要等1秒重传，测出来的就不是服务器了
+        while (i + 1 - accepted > kMaxPendingAccepts)
+        {
+            ::sched_yield();
+        }
+        if (live.size() > window)
+        {
+            ::close(live.front());
+            live.pop_front();
+        }
+    }
+    while (!live.empty())
+    {
+        ::close(live.front());
+        live.pop_front();
+    }
+    while (closed < cycles)
+    {
+        ::usleep(1000);
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    serverLoop.load()->quit();
+    server.join();
+
+    printf("{\"bench\":\"churn\",\"mode\":\"tcp\",\"window\":%zu,\"cycles\":%d,"
+            "\"connections_per_sec\":%.0f,\"us_per_connection\":%.2f}\n",
+            window, cycles,
+            static_cast<double>(cycles) * 1e9 / elapsed,
+            static_cast<double>(elapsed) / 1e3 / cycles);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int cycles = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t window = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 1000;
+
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    // 客户端和服务器各占一个fd
+    if (window * 2 + 64 > rl.rlim_cur)
+    {
+        window = (rl.rlim_cur - 64) / 2;
+    }
+
+    Logger::setLogLevel(FATAL);   // RST关闭的连接每个都会打印handleError
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    runTable<MapTable>("table_unordered_map", 100000, 10 * cycles);
+    runTable<ChannelTable>("table_fd_indexed", 100000, 10 * cycles);
+    runTcp(cycles, window);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * 长度头分帧的解码开销，只测内存里的Buffer，不经过网络
+ *   retrieve_as_string : 常见写法，每帧readInt32 + retrieveAsString，每帧一次分配和拷贝
+ *   codec              : LengthHeaderCodec，帧是指向Buffer的StringPiece，最后一次retrieve
+ * 发送端：消息序列化成string再和长度头拼成新的string vs 直接序列化进Buffer、finishFrame把头写进预留空间
+ *
+ * ./codec_bench [frames]
+ */
+#include "LengthHeaderCodec.h"
+#include "Buffer.h"
+#include "Timestamp.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+
+static void fill(Buffer *buf, int frames, size_t size)
+{
+    std::string body(size, 'C');
+    for (int i = 0; i < frames; ++i)
+    {
+        buf->appendInt32(static_cast<int32_t>(size));
+        buf->append(body.data(), body.size());
+    }
+}
+
+static void report(const char *mode, size_t size, int frames, int64_t elapsed, uint64_t checksum)
+{
+    printf("{\"bench\":\"codec\",\"mode\":\"%s\",\"frame_size\":%zu,\"frames\":%d,\"ns_per_frame\":%.1f,\"checksum\":%lu}\n",
+            mode, size, frames, static_cast<double>(elapsed) / frames, static_cast<unsigned long>(checksum));
+    fflush(stdout);
+}
+
+static void runDecode(size_t size, int frames)
+{
+    Buffer buf;
+    fill(&buf, frames, size);
+    uint64_t checksum = 0;
+    int64_t start = nowNanos();
+    while (buf.readableBytes() >= LengthHeaderCodec::kHeaderLen)
+    {
+        size_t len = static_cast<size_t>(buf.readInt32());
+        std::string frame = buf.retrieveAsString(len);
+        checksum += frame.size() + static_cast<unsigned char>(frame[0]);
+    }
+    report("retrieve_as_string", size, frames, nowNanos() - start, checksum);
+
+    fill(&buf, frames, size);
+    checksum = 0;
+    LengthHeaderCodec codec([&checksum](const TcpConnectionPtr&, const StringPiece &frame, Timestamp) {
+        checksum += frame.size() + static_cast<unsigned char>(frame[0]);
+    });
+    start = nowNanos();
+    codec.onMessage(TcpConnectionPtr(), &buf, Timestamp());
+    report("codec", size, frames, nowNanos() - start, checksum);
+}
+
+static void runEncode(size_t size, int frames)
+{
+    std::string body(size, 'E');
+    uint64_t checksum = 0;
+    int64_t start = nowNanos();
+    for (int i = 0; i < frames; ++i)
+    {
+        std::string message(body); // 先把消息序列化成string
+        std::string frame;
+        uint32_t be = htobe32(static_cast<uint32_t>(message.size()));
+        frame.reserve(sizeof be + message.size());
+        frame.append(reinterpret_cast<const char*>(&be), sizeof be);
+        frame.append(message);
+        checksum += frame.size();
+    }
+    report("encode_string_concat", size, frames, nowNanos() - start, checksum);
+
+    checksum = 0;
+    start = nowNanos();
+    for (int i = 0; i < frames; ++i)
+    {
+        Buffer buf(size);
+        buf.append(body.data(), body.size());
+        LengthHeaderCodec::finishFrame(&buf);
+        checksum += buf.readableBytes();
+    }
+    report("encode_finish_frame", size, frames, nowNanos() - start, checksum);
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 200000;
+    const size_t sizes[] = { 16, 256, 4096 };
+    for (size_t size : sizes)
+    {
+        runDecode(size, frames);
+        runEncode(size, frames);
+    }
+    return 0;
+}
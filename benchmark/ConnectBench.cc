@@ -0,0 +1,136 @@
+/**
+ * 连接建立和销毁的速率：clients个线程不停地connect，服务器在connectionCallback里马上shutdown，
+ * 客户端读到EOF以后close，再发起下一个连接
+ * allocs_per_conn是这段时间进程里malloc的次数除以连接数，TcpConnection、控制块、Socket、Channel、
+ * 回调的std::function这些都算在里面  压测端只用裸socket，不分配内存
+ * 服务器先关闭，TIME_WAIT留在服务器这一端，客户端的端口可以马上复用
+ *
+ * ./connect_bench [seconds] [clients] [threads]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const uint16_t kPort = 18150;
+
+static std::atomic<uint64_t> gMallocs(0);
+
+// 替换glibc的malloc，只计数，实际分配交给__libc_malloc
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void *p, size_t size);
+
+void* malloc(size_t size)
+{
+    gMallocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    gMallocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void *p, size_t size)
+{
+    gMallocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+}
+
+static void runClient(int64_t deadline, uint64_t *connections)
+{
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char buf[16];
+    *connections = 0;
+    while (nowNanos() < deadline)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        while (::read(fd, buf, sizeof buf) > 0)
+        {
+        }
+        ::close(fd);
+        ++*connections;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int clients = argc > 2 ? atoi(argv[2]) : 2;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    loop->runInLoop([loop, threads]() {
+        // 不析构，进程结束时直接退出
+        TcpServer *server = new TcpServer(loop, InetAddress(kPort), "connect");
+        server->setThreadNum(threads);
+        server->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->shutdown();
+            }
+        });
+        server->start();
+    });
+    ::usleep(100 * 1000);
+
+    std::vector<uint64_t> counts(clients);
+    std::vector<std::thread> workers;
+    uint64_t mallocs = gMallocs.load();
+    int64_t start = nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    for (int i = 0; i < clients; ++i)
+    {
+        workers.emplace_back(runClient, deadline, &counts[i]);
+    }
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+    double elapsed = (nowNanos() - start) / 1e9;
+    mallocs = gMallocs.load() - mallocs;
+
+    uint64_t total = 0;
+    for (uint64_t n : counts)
+    {
+        total += n;
+    }
+    printf("{\"bench\":\"connect\",\"clients\":%d,\"threads\":%d,\"connections\":%lu,"
+            "\"conn_per_sec\":%.0f,\"allocs_per_conn\":%.2f}\n",
+            clients, threads, static_cast<unsigned long>(total), total / elapsed,
+            total ? static_cast<double>(mallocs) / total : 0);
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,214 @@
+/**
+ * 一次onMessage里多次send的开销：每个请求回复parts段16字节的数据，每段调用一次send
+ *   plain     : 每次send都是一次write，一个小包
+ *   auto_cork : TcpServer::setAutoCork，这一轮循环结束时一次writev
+ *   tcp_cork  : 回调开始setCork(true)，结束setCork(false)，系统调用次数不变，内核合并成整包
+ * writes_per_req是进程里write类系统调用的次数（减掉压测端每批一次的write），segs_per_req是压测端收到的TCP段数
+ *
+ * ./cork_bench [seconds] [connections] [pipeline] [parts]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t kMessageSize = 16;
+
+enum Mode
+{
+    kPlain,
+    kAutoCork,
+    kTcpCork,
+};
+
+static int gParts = 4;
+static Mode gMode = kPlain;
+
+// /proc/self/io里的syscw：write、writev、sendmsg等
+static long writeSyscalls()
+{
+    FILE *fp = ::fopen("/proc/self/io", "r");
+    if (fp == nullptr)
+    {
+        return 0;
+    }
+    char line[128];
+    long value = 0;
+    while (::fgets(line, sizeof line, fp))
+    {
+        if (::sscanf(line, "syscw: %ld", &value) == 1)
+        {
+            break;
+        }
+    }
+    ::fclose(fp);
+    return value;
+}
+
+static uint32_t segmentsIn(int fd)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof info;
+    ::memset(&info, 0, sizeof info);
+    ::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_segs_in;
+}
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    static const std::string part(kMessageSize, 'p');
+    if (gMode == kTcpCork)
+    {
+        conn->setCork(true);
+    }
+    while (buf->readableBytes() >= kMessageSize)
+    {
+        buf->retrieve(kMessageSize);
+        for (int i = 0; i < gParts; ++i)
+        {
+            conn->send(part);
+        }
+    }
+    if (gMode == kTcpCork)
+    {
+        conn->setCork(false);
+    }
+}
+
+static bool readFull(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = ::read(fd, buf + got, len - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+struct ClientResult
+{
+    uint64_t requests;
+    uint64_t batches;
+    uint32_t segments;
+};
+
+static void runClient(uint16_t port, int pipeline, int64_t deadline, ClientResult *result)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+    std::string batch(kMessageSize * pipeline, 'q');
+    std::vector<char> buf(kMessageSize * gParts * pipeline);
+    uint32_t segments = segmentsIn(fd);
+    result->requests = 0;
+    result->batches = 0;
+    while (nowNanos() < deadline)
+    {
+        if (::write(fd, batch.data(), batch.size()) != static_cast<ssize_t>(batch.size())
+            || !readFull(fd, buf.data(), buf.size()))
+        {
+            fprintf(stderr, "connection broken\n");
+            break;
+        }
+        result->requests += pipeline;
+        ++result->batches;
+    }
+    result->segments = segmentsIn(fd) - segments;
+    ::close(fd);
+}
+
+static void runMode(const char *name, uint16_t port, double seconds, int connections, int pipeline)
+{
+    std::vector<ClientResult> results(connections);
+    std::vector<std::thread> threads;
+    long writes = writeSyscalls();
+    int64_t start = nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    for (int i = 0; i < connections; ++i)
+    {
+        threads.emplace_back(runClient, port, pipeline, deadline, &results[i]);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = (nowNanos() - start) / 1e9;
+    writes = writeSyscalls() - writes;
+
+    uint64_t requests = 0, batches = 0, segments = 0;
+    for (const ClientResult &r : results)
+    {
+        requests += r.requests;
+        batches += r.batches;
+        segments += r.segments;
+    }
+    double perRequest = requests ? 1.0 / requests : 0;
+    printf("{\"bench\":\"cork\",\"mode\":\"%s\",\"connections\":%d,\"pipeline\":%d,\"parts\":%d,"
+            "\"req_per_sec\":%.0f,\"writes_per_req\":%.3f,\"segs_per_req\":%.3f}\n",
+            name, connections, pipeline, gParts, requests / elapsed,
+            (writes - static_cast<long>(batches)) * perRequest, segments * perRequest);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int pipeline = argc > 3 ? atoi(argv[3]) : 1;
+    gParts = argc > 4 ? atoi(argv[4]) : 4;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    const char *names[] = { "plain", "auto_cork", "tcp_cork" };
+    for (int mode = kPlain; mode <= kTcpCork; ++mode)
+    {
+        uint16_t port = static_cast<uint16_t>(18110 + mode);
+        loop->runInLoop([loop, port, mode]() {
+            // 不析构，进程结束时直接退出
+            TcpServer *server = new TcpServer(loop, InetAddress(port), "cork");
+            server->setConnectionCallback([](const TcpConnectionPtr&) {});
+            server->setMessageCallback(onMessage);
+            server->setAutoCork(mode == kAutoCork);
+            server->start();
+        });
+        ::usleep(100 * 1000);
+        gMode = static_cast<Mode>(mode);
+        runMode(names[mode], port, seconds, connections, pipeline);
+    }
+    _exit(0);
+}
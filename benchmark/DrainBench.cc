@@ -0,0 +1,154 @@
+/**
+ * 重启时丢多少数据：connections个客户端各发一个请求，服务器回一个responseKib的响应，
+ * 服务器收齐所有请求、响应还在发送队列里的时候关闭服务器
+ * destroy是直接析构TcpServer（原来的做法，连接马上关闭），stop是TcpServer::stop(timeout)
+ * complete是完整收到响应的连接数，truncated是只收到了一部分的；drain_ms是从开始关闭到关闭完成的时间
+ * stalled个客户端发完请求以后不再读，stop只能等到timeout强制关闭它们
+ *
+ * ./drain_bench [connections] [response_kib] [stalled] [timeout]
+ */
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 在loop线程里执行f，等它执行完
+static void runSync(EventLoop *loop, const std::function<void()> &f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+static void runOnce(const char *mode, uint16_t port, int connections, size_t responseSize, int stalled, double timeout)
+{
+    const bool useStop = mode[0] == 's';
+    const std::string response(responseSize, 'r');
+    std::atomic<int> requests(0);
+
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<TcpServer> server;
+    runSync(serverLoop, [&]() {
+        server.reset(new TcpServer(serverLoop, InetAddress(port, "127.0.0.1"), "DrainServer"));
+        server->setThreadNum(2);
+        server->setConnectionCallback([](const TcpConnectionPtr&) {});
+        server->setMessageCallback([&response, &requests](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            buf->retrieveAll();
+            conn->send(response);
+            requests.fetch_add(1);
+        });
+        server->start();
+    });
+
+    // received[i]是第i个客户端收到的字节数，只在客户端的loop里访问
+    std::vector<size_t> received(connections, 0);
+    std::atomic<int> closed(0);
+    EventLoopThread clientThread;
+    EventLoop *clientLoop = clientThread.startLoop();
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    runSync(clientLoop, [&]() {
+        for (int i = 0; i < connections; ++i)
+        {
+            TcpClient *client = new TcpClient(clientLoop, InetAddress(port, "127.0.0.1"), "DrainClient");
+            clients.emplace_back(client);
+            bool stall = i < stalled;
+            client->setConnectionCallback([&closed, stall](const TcpConnectionPtr &conn) {
+                if (conn->connected())
+                {
+                    conn->send(std::string("GET"));
+                    if (stall)
+                    {
+                        conn->stopRead();
+                    }
+                }
+                else
+                {
+                    closed.fetch_add(1);
+                }
+            });
+            client->setMessageCallback([&received, i](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+                received[i] += buf->readableBytes();
+                buf->retrieveAll();
+            });
+            client->connect();
+        }
+    });
+
+    while (requests.load() < connections)
+    {
+        ::usleep(1000);
+    }
+    int64_t start = nowNanos();
+    int64_t stopped = 0;
+    if (useStop)
+    {
+        std::promise<void> done;
+        server->stop(timeout, [&done]() { done.set_value(); });
+        done.get_future().wait();
+        stopped = nowNanos();
+        runSync(serverLoop, [&]() { server.reset(); });
+    }
+    else
+    {
+        runSync(serverLoop, [&]() { server.reset(); });
+        stopped = nowNanos();
+    }
+    // 客户端读到EOF或者RST以后关闭
+    for (int i = 0; i < 2000 && closed.load() < connections; ++i)
+    {
+        ::usleep(1000);
+    }
+
+    int complete = 0;
+    int truncated = 0;
+    runSync(clientLoop, [&]() {
+        for (size_t bytes : received)
+        {
+            if (bytes == responseSize)
+            {
+                ++complete;
+            }
+            else
+            {
+                ++truncated;
+            }
+        }
+        clients.clear();
+    });
+    printf("{\"bench\":\"drain\",\"mode\":\"%s\",\"connections\":%d,\"response_kib\":%zu,\"stalled\":%d,"
+            "\"complete\":%d,\"truncated\":%d,\"drain_ms\":%.1f}\n",
+            mode, connections, responseSize / 1024, stalled, complete, truncated, (stopped - start) / 1e6);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 4;
+    size_t responseKib = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 32768;
+    int stalled = argc > 3 ? atoi(argv[3]) : 1;
+    double timeout = argc > 4 ? atof(argv[4]) : 0.5;
+    Logger::setLogLevel(ERROR);
+
+    uint16_t port = 18250;
+    runOnce("destroy", port++, connections, responseKib * 1024, 0, timeout);
+    runOnce("stop", port++, connections, responseKib * 1024, 0, timeout);
+    runOnce("stop", port++, connections, responseKib * 1024, stalled, timeout);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * 水平触发和边沿触发（TcpServer::setEdgeTriggered）的对比
+ * 客户端在所有连接上各发一个小请求，服务器回复responseBytes字节，客户端读完以后开始下一轮
+ * 回复大于socket发送缓冲区时（loopback上自动调整以后大约4M），水平触发每个回复要enableWriting/disableWriting
+ * 两次epoll_ctl(MOD)，边沿触发一次也没有；小回复时边沿触发要多读一次EAGAIN
+ * 这里替换了epoll_ctl统计调用次数
+ *
+ * ./edgetrigger_bench [connections] [rounds]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Slice.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<int64_t> g_ctlCalls[4];  // 下标是EPOLL_CTL_ADD/DEL/MOD
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    if (op >= 0 && op < 4)
+    {
+        ++g_ctlCalls[op];
+    }
+    return static_cast<int>(::syscall(SYS_epoll_ctl, epfd, op, fd, event));
+}
+
+static const size_t kRequestBytes = 16;
+
+static void run(const char *mode, bool edgeTriggered, uint16_t port,
+                int numConns, int rounds, size_t responseBytes)
+{
+    SlicePtr response(new Slice(std::string(responseBytes, 'r')));
+
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&serverLoop, &response, port, edgeTriggered]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "EdgeTriggerBench");
+        server.setEdgeTriggered(edgeTriggered);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback([&response](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            while (buf->readableBytes() >= kRequestBytes)
+            {
+                buf->retrieve(kRequestBytes);
+                conn->send(response);
+            }
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    std::vector<int> fds;
+    for (int i = 0; i < numConns; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        fds.push_back(fd);
+    }
+    ::usleep(100 * 1000); // 等服务器把连接都建立好
+
+    std::string request(kRequestBytes, 'q');
+    std::vector<char> reply(64 * 1024);
+    int64_t ctlBefore[4];
+    for (int op = 0; op < 4; ++op)
+    {
+        ctlBefore[op] = g_ctlCalls[op];
+    }
+    int64_t start = nowNanos();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int fd : fds)
+        {
+            if (::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+            {
+                perror("write");
+                exit(1);
+            }
+        }
+        for (int fd : fds)
+        {
+            size_t got = 0;
+            while (got < responseBytes)
+            {
+                ssize_t n = ::read(fd, reply.data(), std::min(reply.size(), responseBytes - got));
+                if (n <= 0)
+                {
+                    perror("read");
+                    exit(1);
+                }
+                got += n;
+            }
+        }
+    }
+    int64_t elapsed = nowNanos() - start;
+    int64_t mods = g_ctlCalls[EPOLL_CTL_MOD] - ctlBefore[EPOLL_CTL_MOD];
+    int64_t total = 0;
+    for (int op = 0; op < 4; ++op)
+    {
+        total += g_ctlCalls[op] - ctlBefore[op];
+    }
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    serverLoop.load()->quit();
+    server.join();
+
+    const int64_t responses = static_cast<int64_t>(numConns) * rounds;
+    printf("{\"bench\":\"edgetrigger\",\"mode\":\"%s\",\"connections\":%d,\"response_bytes\":%zu,"
+            "\"responses\":%ld,\"responses_per_sec\":%.0f,\"mb_per_sec\":%.1f,"
+            "\"epoll_ctl\":%ld,\"epoll_ctl_mod_per_response\":%.2f}\n",
+            mode, numConns, responseBytes, responses,
+            static_cast<double>(responses) * 1e9 / elapsed,
+            static_cast<double>(responses) * responseBytes * 1e3 / elapsed,
+            total, static_cast<double>(mods) / responses);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numConns = argc > 1 ? atoi(argv[1]) : 50;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    uint16_t port = 19201;
+    run("lt", false, port++, numConns, rounds * 10, 64);
+    run("et", true, port++, numConns, rounds * 10, 64);
+
+    // 大回复每轮的数据量太大，减少连接数和轮数
+    int bulkConns = std::min(numConns, 8);
+    int bulkRounds = std::max(rounds / 20, 1);
+    run("lt", false, port++, bulkConns, bulkRounds, 16 * 1024 * 1024);
+    run("et", true, port++, bulkConns, bulkRounds, 16 * 1024 * 1024);
+    return 0;
+}
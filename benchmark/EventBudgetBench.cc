@@ -0,0 +1,133 @@
+/**
+ * 大量连接一直可读时，跨线程投递的回调要等多久才能执行
+ * numFds个eventfd写入以后不读，水平触发下每次poll都会返回它们，模拟被打满的loop
+ * 另一个线程每隔intervalUs投递一个回调，记录从投递到执行的延迟
+ *   budget=0 : 不限制，每一轮分发完所有就绪的事件才执行回调
+ *   budget=N : 每一轮最多分发N个事件
+ * 同时打印EventLoop::stats()
+ *
+ * ./eventbudget_bench [fds] [posts] [intervalUs]
+ */
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Channel.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+static void run(int budget, int numFds, int numPosts, int intervalUs)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+
+    std::vector<int> fds;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::atomic_int registered(0);
+    loop->runInLoop([&]() {
+        loop->setEventBudget(budget);
+        uint64_t one = 1;
+        for (int i = 0; i < numFds; ++i)
+        {
+            int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ssize_t n = ::write(fd, &one, sizeof one);
+            (void)n;
+            fds.push_back(fd);
+            channels.emplace_back(new Channel(loop, fd));
+            channels.back()->setReadCallback([](Timestamp) {}); // 不读，一直就绪
+            channels.back()->enableReading();
+        }
+        registered = 1;
+    });
+    while (registered == 0)
+    {
+        ::usleep(1000);
+    }
+
+    EventLoop::Stats before = loop->stats();
+    int64_t start = nowNanos();
+    std::vector<int64_t> latencies;
+    latencies.reserve(numPosts);
+    std::atomic_int executed(0);
+    for (int i = 0; i < numPosts; ++i)
+    {
+        int64_t posted = nowNanos();
+        loop->queueInLoop([&latencies, &executed, posted]() {
+            latencies.push_back(nowNanos() - posted);
+            ++executed;
+        });
+        ::usleep(intervalUs);
+    }
+    while (executed < numPosts)
+    {
+        ::usleep(1000);
+    }
+    EventLoop::Stats after = loop->stats();
+    int64_t elapsed = nowNanos() - start;
+
+    std::atomic_int removed(0);
+    loop->runInLoop([&]() {
+        for (size_t i = 0; i < channels.size(); ++i)
+        {
+            channels[i]->disableAll();
+            channels[i]->remove();
+            ::close(fds[i]);
+        }
+        channels.clear();
+        removed = 1;
+    });
+    while (removed == 0)
+    {
+        ::usleep(1000);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const uint64_t wakeups = after.wakeups - before.wakeups;
+    const uint64_t events = after.events - before.events;
+    printf("{\"bench\":\"eventbudget\",\"budget\":%d,\"fds\":%d,\"posts\":%d,"
+            "\"functor_latency_us_p50\":%.1f,\"functor_latency_us_p99\":%.1f,"
+            "\"events_per_sec\":%.0f,\"events_per_wakeup\":%.1f,\"budget_exhausted\":%lu,"
+            "\"dispatch_ns_per_event\":%.1f,\"functor_ns_per_wakeup\":%.1f}\n",
+            budget, numFds, numPosts,
+            latencies[latencies.size() / 2] / 1e3,
+            latencies[latencies.size() * 99 / 100] / 1e3,
+            static_cast<double>(events) * 1e9 / elapsed,
+            wakeups ? static_cast<double>(events) / wakeups : 0.0,
+            after.budgetExhausted - before.budgetExhausted,
+            events ? static_cast<double>(after.dispatchNanos - before.dispatchNanos) / events : 0.0,
+            wakeups ? static_cast<double>(after.functorNanos - before.functorNanos) / wakeups : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numFds = argc > 1 ? atoi(argv[1]) : 10000;
+    int numPosts = argc > 2 ? atoi(argv[2]) : 2000;
+    int intervalUs = argc > 3 ? atoi(argv[3]) : 200;
+
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    const int budgets[] = { 0, EventLoop::kDefaultEventBudget, 256, 64 };
+    for (int budget : budgets)
+    {
+        run(budget, numFds, numPosts, intervalUs);
+    }
+    return 0;
+}
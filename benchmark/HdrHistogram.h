@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * benchmark用的HdrHistogram  对数分段、段内线性，每个值的相对误差不超过1/1024（三位有效数字）
+ * 2048以下每个值一个桶，之后每翻一倍分1024个桶，最大记录2^41
+ * 只由一个线程写，多个线程各记一份再merge
+ */
+class HdrHistogram
+{
+public:
+    static const int kSubBucketBits = 10;
+    static const int kSubBuckets = 1 << kSubBucketBits;  // 每一段的桶数
+    static const int kMaxShift = 31;
+
+    HdrHistogram()
+        : counts_(2 * kSubBuckets + kMaxShift * kSubBuckets, 0)
+        , total_(0)
+        , sum_(0)
+        , min_(INT64_MAX)
+        , max_(0)
+    {}
+
+    void record(int64_t value)
+    {
+        if (value < 0)
+        {
+            value = 0;
+        }
+        ++counts_[indexOf(value)];
+        ++total_;
+        sum_ += value;
+        min_ = value < min_ ? value : min_;
+        max_ = value > max_ ? value : max_;
+    }
+
+    void merge(const HdrHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        min_ = other.min_ < min_ ? other.min_ : min_;
+        max_ = other.max_ > max_ ? other.max_ : max_;
+    }
+
+    // p在0到100之间  返回p百分位所在桶的上界，不超过max
+    int64_t percentile(double p) const
+    {
+        if (total_ == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100 * total_ + 0.5);
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+            {
+                int64_t value = upperBoundOf(static_cast<int>(i));
+                return value < max_ ? value : max_;
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return total_; }
+    int64_t min() const { return total_ ? min_ : 0; }
+    int64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0; }
+
+private:
+    static int indexOf(int64_t value)
+    {
+        if (value < 2 * kSubBuckets)
+        {
+            return static_cast<int>(value);
+        }
+        int magnitude = 63 - __builtin_clzll(static_cast<uint64_t>(value));    // >= kSubBucketBits + 1
+        int shift = magnitude - kSubBucketBits;
+        if (shift > kMaxShift)
+        {
+            shift = kMaxShift;
+            value = (static_cast<int64_t>(2 * kSubBuckets) << shift) - 1;
+        }
+        int top = static_cast<int>(value >> shift);     // [kSubBuckets, 2 * kSubBuckets)
+        return 2 * kSubBuckets + (shift - 1) * kSubBuckets + (top - kSubBuckets);
+    }
+
+    static int64_t upperBoundOf(int index)
+    {
+        if (index < 2 * kSubBuckets)
+        {
+            return index;
+        }
+        int k = index - 2 * kSubBuckets;
+        int shift = k / kSubBuckets + 1;
+        int64_t top = k % kSubBuckets + kSubBuckets;
+        return (top << shift) + (static_cast<int64_t>(1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    int64_t  sum_;
+    int64_t  min_;
+    int64_t  max_;
+};
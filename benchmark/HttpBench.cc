@@ -0,0 +1,211 @@
+/**
+ * wrk风格的HTTP压测：connections个长连接，每个连接一次发pipeline个GET，收齐所有响应再发下一批
+ *   echo : example/testserver.cc那样的回显TcpServer（不关闭连接），收到什么发回什么，是框架本身的上限
+ *   http : HttpServer，每个请求回复13字节的"Hello, World!"，多出来的是解析请求和生成响应的开销
+ * 延迟是一批请求从发出到收齐的时间，pipeline=1时就是单个请求的延迟
+ * 压测端和服务器在同一个进程里，各用自己的线程，机器核数少时压测端也会抢CPU，只适合比较两种模式
+ *
+ * ./http_bench [seconds] [connections] [pipeline]
+ */
+#include "HttpServer.h"
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char kRequest[] = "GET /plaintext HTTP/1.1\r\nHost: localhost\r\nUser-Agent: http_bench\r\nAccept: */*\r\n\r\n";
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+static bool readFull(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = ::read(fd, buf + got, len - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// 发一个请求，解析出一个响应的长度  后面每个响应都一样长
+static size_t probeResponseLength(uint16_t port)
+{
+    int fd = connectTo(port);
+    ::write(fd, kRequest, sizeof kRequest - 1);
+    std::string resp;
+    char buf[4096];
+    size_t headerEnd;
+    while ((headerEnd = resp.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0)
+        {
+            exit(1);
+        }
+        resp.append(buf, n);
+    }
+    size_t bodyLength = 0;
+    size_t pos = resp.find("Content-Length: ");
+    if (pos != std::string::npos && pos < headerEnd)
+    {
+        bodyLength = static_cast<size_t>(atoi(resp.c_str() + pos + 16));
+    }
+    ::close(fd);
+    return headerEnd + 4 + bodyLength;
+}
+
+struct ClientResult
+{
+    uint64_t requests;
+    std::vector<int64_t> latencies;
+};
+
+static void runClient(uint16_t port, int pipeline, size_t responseLength, int64_t deadline, ClientResult *result)
+{
+    int fd = connectTo(port);
+    std::string batch;
+    for (int i = 0; i < pipeline; ++i)
+    {
+        batch.append(kRequest, sizeof kRequest - 1);
+    }
+    std::vector<char> buf(responseLength * pipeline);
+    result->requests = 0;
+    while (nowNanos() < deadline)
+    {
+        int64_t start = nowNanos();
+        if (::write(fd, batch.data(), batch.size()) != static_cast<ssize_t>(batch.size())
+            || !readFull(fd, buf.data(), buf.size()))
+        {
+            fprintf(stderr, "connection broken\n");
+            break;
+        }
+        result->latencies.push_back(nowNanos() - start);
+        result->requests += pipeline;
+    }
+    ::close(fd);
+}
+
+static void report(const char *mode, double seconds, int connections, int pipeline, std::vector<ClientResult> &results)
+{
+    uint64_t requests = 0;
+    std::vector<int64_t> latencies;
+    for (ClientResult &r : results)
+    {
+        requests += r.requests;
+        latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2] / 1000.0;
+    double p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100] / 1000.0;
+    printf("{\"bench\":\"http\",\"mode\":\"%s\",\"connections\":%d,\"pipeline\":%d,\"requests\":%lu,"
+            "\"req_per_sec\":%.0f,\"p50_us\":%.1f,\"p99_us\":%.1f}\n",
+            mode, connections, pipeline, static_cast<unsigned long>(requests),
+            requests / seconds, p50, p99);
+    fflush(stdout);
+}
+
+static void runLoad(const char *mode, uint16_t port, double seconds, int connections, int pipeline)
+{
+    size_t responseLength = probeResponseLength(port);
+    std::vector<ClientResult> results(connections);
+    std::vector<std::thread> threads;
+    int64_t start = nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    for (int i = 0; i < connections; ++i)
+    {
+        threads.emplace_back(runClient, port, pipeline, responseLength, deadline, &results[i]);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    report(mode, (nowNanos() - start) / 1e9, connections, pipeline, results);
+}
+
+static void onEchoMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    conn->send(buf);
+}
+
+static void onPlaintext(const HttpRequest&, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setContentType("text/plain");
+    resp->setBody(StringPiece("Hello, World!"));
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int pipeline = argc > 3 ? atoi(argv[3]) : 16;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    TcpServer *echo = nullptr;
+    HttpServer *http = nullptr;
+    loop->runInLoop([&]() {
+        echo = new TcpServer(loop, InetAddress(18090), "echo");
+        echo->setConnectionCallback([](const TcpConnectionPtr&) {});
+        echo->setMessageCallback(onEchoMessage);
+        echo->start();
+        http = new HttpServer(loop, InetAddress(18091), "http");
+        http->setHttpCallback(onPlaintext);
+        http->start();
+    });
+    ::usleep(100 * 1000);
+
+    const int depths[] = { 1, pipeline };
+    for (int depth : depths)
+    {
+        runLoad("echo", 18090, seconds, connections, depth);
+        runLoad("http", 18091, seconds, connections, depth);
+        if (pipeline == 1)
+        {
+            break;
+        }
+    }
+    // 服务器对象不析构，loop线程退出时直接结束进程
+    _exit(0);
+}
@@ -0,0 +1,143 @@
+/**
+ * 闭环延迟：connections个客户端线程，每个线程一个连接，发一条size字节的消息，收到完整的回复以后
+ * 再发下一条  每次往返的时间记到HdrHistogram里，输出各个百分位，单位微秒
+ * 服务器是threads个subloop的echo TcpServer（threads为0表示只有mainLoop）
+ *
+ * ./latency_bench [seconds] [connections] [size] [threads]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "HdrHistogram.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const uint16_t kPort = 18170;
+
+static void runClient(size_t size, int64_t warmupEnd, int64_t deadline, HdrHistogram *histogram)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+    std::vector<char> buf(size, 'l');
+    while (true)
+    {
+        int64_t start = nowNanos();
+        if (start >= deadline)
+        {
+            break;
+        }
+        if (::write(fd, buf.data(), size) != static_cast<ssize_t>(size))
+        {
+            break;
+        }
+        size_t got = 0;
+        while (got < size)
+        {
+            ssize_t n = ::read(fd, buf.data() + got, size - got);
+            if (n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            got += static_cast<size_t>(n);
+        }
+        if (start >= warmupEnd)
+        {
+            histogram->record(nowNanos() - start);
+        }
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    int connections = argc > 2 ? atoi(argv[2]) : 1;
+    size_t size = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 64;
+    int threads = argc > 4 ? atoi(argv[4]) : 1;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(kPort), "LatencyServer");
+        server.setThreadNum(threads);
+        server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop.load() == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    // 前10%的时间用来预热，不计入结果
+    int64_t start = nowNanos();
+    int64_t warmupEnd = start + static_cast<int64_t>(seconds * 0.1e9);
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    std::vector<HdrHistogram> histograms(connections);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(runClient, size, warmupEnd, deadline, &histograms[i]);
+    }
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+
+    HdrHistogram total;
+    for (const HdrHistogram &h : histograms)
+    {
+        total.merge(h);
+    }
+    double measured = (deadline - warmupEnd) / 1e9;
+    printf("{\"bench\":\"latency\",\"size\":%zu,\"connections\":%d,\"threads\":%d,\"samples\":%llu,"
+            "\"rtt_per_sec\":%.0f,\"mean_us\":%.2f,\"min_us\":%.2f,\"p50_us\":%.2f,\"p90_us\":%.2f,"
+            "\"p99_us\":%.2f,\"p999_us\":%.2f,\"p9999_us\":%.2f,\"max_us\":%.2f}\n",
+            size, connections, threads, static_cast<unsigned long long>(total.count()),
+            total.count() / measured, total.mean() / 1e3, total.min() / 1e3,
+            total.percentile(50) / 1e3, total.percentile(90) / 1e3, total.percentile(99) / 1e3,
+            total.percentile(99.9) / 1e3, total.percentile(99.99) / 1e3, total.max() / 1e3);
+    fflush(stdout);
+
+    serverLoop.load()->quit();
+    server.join();
+    return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * 每个loop的计数器和直方图的开销
+ *   counter_add      : LoopMetrics::add
+ *   histogram_record : LatencyHistogram::record
+ *   sampled_timing   : runMessageCallback的做法，每kSampleEvery次取两次时间
+ * 然后起一个echo服务器（threads个subloop），connections个连接pingpong seconds秒，
+ * 输出吞吐和TcpServer::metricsText()
+ *
+ * ./metrics_bench [seconds] [connections] [threads]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "LoopMetrics.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kIterations = 50 * 1000 * 1000;
+static const size_t kMessageSize = 64;
+
+static void report(const char *op, int64_t nanos, int iterations)
+{
+    printf("{\"bench\":\"metrics\",\"op\":\"%s\",\"ns_per_op\":%.2f}\n", op, static_cast<double>(nanos) / iterations);
+    fflush(stdout);
+}
+
+static void microBench()
+{
+    LoopMetrics metrics;
+    int64_t start = LoopMetrics::nowNanos();
+    for (int i = 0; i < kIterations; ++i)
+    {
+        metrics.add(LoopMetrics::kBytesRead, static_cast<uint64_t>(i & 1023));
+    }
+    report("counter_add", LoopMetrics::nowNanos() - start, kIterations);
+
+    start = LoopMetrics::nowNanos();
+    for (int i = 0; i < kIterations; ++i)
+    {
+        metrics.record(LoopMetrics::kLoopIteration, i & 0xfffff);
+    }
+    report("histogram_record", LoopMetrics::nowNanos() - start, kIterations);
+
+    start = LoopMetrics::nowNanos();
+    for (int i = 0; i < kIterations; ++i)
+    {
+        if (metrics.sample())
+        {
+            int64_t begin = LoopMetrics::nowNanos();
+            metrics.record(LoopMetrics::kMessageCallback, LoopMetrics::nowNanos() - begin);
+        }
+    }
+    report("sampled_timing", LoopMetrics::nowNanos() - start, kIterations);
+
+    // 防止上面的循环被优化掉
+    if (metrics.snapshot().counters[LoopMetrics::kBytesRead] == 0)
+    {
+        printf("unexpected\n");
+    }
+}
+
+static void runClient(uint16_t port, int64_t deadline, std::atomic<uint64_t> *requests)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+    char buf[kMessageSize];
+    ::memset(buf, 'm', sizeof buf);
+    uint64_t count = 0;
+    while (LoopMetrics::nowNanos() < deadline)
+    {
+        if (::write(fd, buf, sizeof buf) != static_cast<ssize_t>(sizeof buf))
+        {
+            break;
+        }
+        size_t got = 0;
+        while (got < sizeof buf)
+        {
+            ssize_t n = ::read(fd, buf + got, sizeof buf - got);
+            if (n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            got += static_cast<size_t>(n);
+        }
+        ++count;
+    }
+    requests->fetch_add(count);
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int threads = argc > 3 ? atoi(argv[3]) : 2;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    microBench();
+
+    const uint16_t port = 18130;
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    TcpServer *server = nullptr;
+    loop->runInLoop([loop, port, threads, &server]() {
+        // 不析构，进程结束时直接退出
+        server = new TcpServer(loop, InetAddress(port), "metrics");
+        server->setThreadNum(threads);
+        server->setConnectionCallback([](const TcpConnectionPtr&) {});
+        server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+        server->start();
+    });
+    ::usleep(100 * 1000);
+
+    std::atomic<uint64_t> requests(0);
+    std::vector<std::thread> clients;
+    int64_t start = LoopMetrics::nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    for (int i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(runClient, port, deadline, &requests);
+    }
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    double elapsed = (LoopMetrics::nowNanos() - start) / 1e9;
+
+    LoopMetrics::Snapshot snap = server->metrics();
+    const LatencyHistogram::Snapshot &callback = snap.histograms[LoopMetrics::kMessageCallback];
+    printf("{\"bench\":\"metrics\",\"op\":\"echo\",\"connections\":%d,\"threads\":%d,\"req_per_sec\":%.0f,"
+            "\"bytes_read\":%llu,\"callback_p99_ns\":%lld}\n",
+            connections, threads, requests.load() / elapsed,
+            static_cast<unsigned long long>(snap.counters[LoopMetrics::kBytesRead]),
+            static_cast<long long>(callback.percentileNanos(99)));
+    printf("%s", server->metricsText().c_str());
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,210 @@
+/**
+ * muduo的pingpong吞吐测试：客户端每个连接建立以后发出一块size字节的数据，之后客户端和服务器
+ * 都把收到的数据原样发回去，统计客户端收到的字节数
+ * 服务器和客户端各用threads个loop线程，sessions个TcpClient轮流分配到客户端的loop上
+ * size为0时依次测16、256、4K、64K、1M；threads为0时依次测1、2、4...直到cpu个数
+ *
+ * ./pingpong_bench [seconds] [sessions] [size] [threads]
+ */
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 一个客户端loop线程  TcpClient都在这个线程里创建和销毁
+// 计数器只由这个loop线程写，主线程读，避免多个线程改同一个原子变量
+struct ClientThread
+{
+    std::thread                 thread;
+    std::atomic<EventLoop*>     loop;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::atomic<uint64_t>       bytesRead;
+    std::atomic<uint64_t>       messagesRead;
+    bool                        stopping;   // 只在loop线程访问
+
+    ClientThread() : loop(nullptr), bytesRead(0), messagesRead(0), stopping(false) {}
+
+    void onMessage(size_t bytes)
+    {
+        bytesRead.store(bytesRead.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+        messagesRead.store(messagesRead.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+static void sum(const std::vector<std::unique_ptr<ClientThread>> &threads, uint64_t *bytes, uint64_t *messages)
+{
+    *bytes = 0;
+    *messages = 0;
+    for (const std::unique_ptr<ClientThread> &ct : threads)
+    {
+        *bytes += ct->bytesRead.load(std::memory_order_relaxed);
+        *messages += ct->messagesRead.load(std::memory_order_relaxed);
+    }
+}
+
+static void runOnce(uint16_t port, double seconds, int sessions, size_t size, int threads)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "PingpongServer");
+        server.setThreadNum(threads);
+        server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop.load() == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    std::atomic<int> connected(0);
+    const std::string block(size, 'p');
+    std::vector<std::unique_ptr<ClientThread>> clientThreads;
+    for (int i = 0; i < threads; ++i)
+    {
+        clientThreads.emplace_back(new ClientThread);
+        ClientThread *ct = clientThreads.back().get();
+        ct->thread = std::thread([ct]() {
+            EventLoop loop;
+            ct->loop = &loop;
+            loop.loop();
+            ct->loop = nullptr;
+        });
+        while (ct->loop.load() == nullptr)
+        {
+            ::usleep(1000);
+        }
+    }
+    for (int i = 0; i < sessions; ++i)
+    {
+        ClientThread *ct = clientThreads[i % threads].get();
+        EventLoop *loop = ct->loop;
+        loop->runInLoop([ct, loop, port, &connected, &block]() {
+            TcpClient *client = new TcpClient(loop, InetAddress(port, "127.0.0.1"), "PingpongClient");
+            ct->clients.emplace_back(client);
+            client->setConnectionCallback([&connected, &block](const TcpConnectionPtr &conn) {
+                if (conn->connected())
+                {
+                    conn->setTcpNoDelay(true);
+                    ++connected;
+                    conn->send(block);
+                }
+            });
+            client->setMessageCallback([ct](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+                if (ct->stopping)
+                {
+                    // 不再回发，半关闭以后服务器读到EOF关闭连接，两边都没有丢数据的错误
+                    buf->retrieveAll();
+                    conn->shutdown();
+                    return;
+                }
+                ct->onMessage(buf->readableBytes());
+                conn->send(buf);
+            });
+            client->connect();
+        });
+    }
+    while (connected.load() < sessions)
+    {
+        ::usleep(1000);
+    }
+
+    uint64_t startBytes, startMessages, bytes, messages;
+    sum(clientThreads, &startBytes, &startMessages);
+    int64_t start = nowNanos();
+    ::usleep(static_cast<useconds_t>(seconds * 1e6));
+    sum(clientThreads, &bytes, &messages);
+    bytes -= startBytes;
+    messages -= startMessages;
+    double elapsed = (nowNanos() - start) / 1e9;
+
+    printf("{\"bench\":\"pingpong\",\"size\":%zu,\"sessions\":%d,\"threads\":%d,"
+            "\"mib_per_sec\":%.1f,\"msgs_per_sec\":%.0f,\"avg_msg_bytes\":%.0f}\n",
+            size, sessions, threads, bytes / elapsed / (1024 * 1024), messages / elapsed,
+            messages ? static_cast<double>(bytes) / messages : 0);
+    fflush(stdout);
+
+    // 先停止回发让连接正常关闭，再在各自的loop线程里销毁TcpClient，最后退出loop
+    for (std::unique_ptr<ClientThread> &ct : clientThreads)
+    {
+        ClientThread *raw = ct.get();
+        EventLoop *loop = raw->loop;
+        loop->runInLoop([raw]() { raw->stopping = true; });
+        loop->runAfter(0.2, [raw]() { raw->clients.clear(); });
+        loop->runAfter(0.3, [loop]() { loop->quit(); });
+    }
+    for (std::unique_ptr<ClientThread> &ct : clientThreads)
+    {
+        ct->thread.join();
+    }
+    serverLoop.load()->runAfter(0.1, [&serverLoop]() { serverLoop.load()->quit(); });
+    server.join();
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int sessions = argc > 2 ? atoi(argv[2]) : 16;
+    size_t size = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 0;
+    int threads = argc > 4 ? atoi(argv[4]) : 1;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    std::vector<size_t> sizes;
+    if (size > 0)
+    {
+        sizes.push_back(size);
+    }
+    else
+    {
+        sizes = { 16, 256, 4096, 64 * 1024, 1024 * 1024 };
+    }
+    std::vector<int> threadCounts;
+    if (threads > 0)
+    {
+        threadCounts.push_back(threads);
+    }
+    else
+    {
+        int cpus = static_cast<int>(::sysconf(_SC_NPROCESSORS_ONLN));
+        // 服务器和客户端都要用，各占一半的cpu
+        for (int n = 1; n <= std::max(1, cpus / 2); n *= 2)
+        {
+            threadCounts.push_back(n);
+        }
+    }
+
+    uint16_t port = 18150;
+    for (int n : threadCounts)
+    {
+        for (size_t s : sizes)
+        {
+            runOnce(port++, seconds, sessions, s, n);
+        }
+    }
+    return 0;
+}
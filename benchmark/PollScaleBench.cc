@@ -0,0 +1,180 @@
+/**
+ * 大量空闲fd下EPollPoller和PollPoller的对比
+ * 注册N个eventfd，每一轮让其中N*ratio个可读（均匀分布），loop处理完这一轮以后马上开始下一轮
+ *   events_per_sec : 每秒分发的事件数
+ *   round_ns       : 一轮的延迟（写完eventfd到最后一个回调执行完），平均值和p99
+ *
+ * ./pollscale_bench [secondsPerCase]
+ */
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class ScaleRun
+{
+public:
+    ScaleRun(EventLoop *loop, size_t numFds, size_t numActive, int64_t durationNs)
+        : loop_(loop)
+        , numActive_(numActive)
+        , stride_(numFds / numActive)
+        , offset_(0)
+        , pending_(0)
+        , roundStart_(0)
+        , deadline_(nowNanos() + durationNs)
+        , events_(0)
+    {
+        for (size_t i = 0; i < numFds; ++i)
+        {
+            int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0)
+            {
+                perror("eventfd");
+                exit(1);
+            }
+            fds_.push_back(fd);
+            channels_.emplace_back(new Channel(loop, fd));
+            channels_.back()->setReadCallback(std::bind(&ScaleRun::handleRead, this, fd));
+            channels_.back()->enableReading();
+        }
+        latencies_.reserve(1 << 16);
+    }
+
+    ~ScaleRun()
+    {
+        for (size_t i = 0; i < channels_.size(); ++i)
+        {
+            channels_[i]->disableAll();
+            channels_[i]->remove();
+            ::close(fds_[i]);
+        }
+    }
+
+    void startRound()
+    {
+        uint64_t one = 1;
+        for (size_t i = 0; i < numActive_; ++i)
+        {
+            ssize_t n = ::write(fds_[(offset_ + i * stride_) % fds_.size()], &one, sizeof one);
+            (void)n;
+        }
+        offset_ = (offset_ + 1) % stride_;  // 每一轮换一批fd
+        pending_ = numActive_;
+        roundStart_ = nowNanos();
+    }
+
+    int64_t events() const { return events_; }
+    std::vector<int64_t>& latencies() { return latencies_; }
+
+private:
+    void handleRead(int fd)
+    {
+        uint64_t value;
+        ssize_t n = ::read(fd, &value, sizeof value);
+        (void)n;
+        ++events_;
+        if (--pending_ == 0)
+        {
+            int64_t now = nowNanos();
+            latencies_.push_back(now - roundStart_);
+            if (now > deadline_)
+            {
+                loop_->quit();
+            }
+            else
+            {
+                startRound();
+            }
+        }
+    }
+
+    EventLoop                               *loop_;
+    std::vector<int>                        fds_;
+    std::vector<std::unique_ptr<Channel>>   channels_;
+    const size_t                            numActive_;
+    const size_t                            stride_;
+    size_t                                  offset_;
+    size_t                                  pending_;
+    int64_t                                 roundStart_;
+    const int64_t                           deadline_;
+    int64_t                                 events_;
+    std::vector<int64_t>                    latencies_;
+};
+
+static void run(const char *mode, size_t numFds, size_t numActive, int64_t durationNs)
+{
+    EventLoop loop;
+    ScaleRun bench(&loop, numFds, numActive, durationNs);
+    int64_t start = nowNanos();
+    bench.startRound();
+    loop.loop();
+    int64_t elapsed = nowNanos() - start;
+
+    std::vector<int64_t> &lat = bench.latencies();
+    std::sort(lat.begin(), lat.end());
+    int64_t sum = 0;
+    for (int64_t ns : lat)
+    {
+        sum += ns;
+    }
+
+    printf("{\"bench\":\"pollscale\",\"mode\":\"%s\",\"fds\":%zu,\"active\":%zu,\"rounds\":%zu,"
+            "\"events_per_sec\":%.0f,\"round_ns_avg\":%.0f,\"round_ns_p99\":%ld}\n",
+            mode, numFds, numActive, lat.size(),
+            static_cast<double>(bench.events()) * 1e9 / elapsed,
+            static_cast<double>(sum) / lat.size(),
+            lat[lat.size() * 99 / 100]);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 0.3;
+    int64_t durationNs = static_cast<int64_t>(seconds * 1e9);
+
+    // 尽量把fd上限提到hard limit，装不下的规模跳过
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+
+    const size_t sizes[] = { 10, 100, 1000, 10000, 100000 };
+    const double ratios[] = { 0.001, 0.01, 0.1, 1.0 };
+    for (size_t numFds : sizes)
+    {
+        if (numFds + 64 > rl.rlim_cur)
+        {
+            fprintf(stderr, "skip %zu fds: RLIMIT_NOFILE is %lu\n", numFds, static_cast<unsigned long>(rl.rlim_cur));
+            continue;
+        }
+        size_t lastActive = 0;
+        for (double ratio : ratios)
+        {
+            size_t numActive = std::max<size_t>(1, static_cast<size_t>(numFds * ratio));
+            if (numActive == lastActive)
+            {
+                continue;   // fd少的时候几个比例会退化成同一个
+            }
+            lastActive = numActive;
+            ::unsetenv("MUDUO_USE_POLL");
+            run("epoll", numFds, numActive, durationNs);
+            ::setenv("MUDUO_USE_POLL", "1", 1);
+            run("poll", numFds, numActive, durationNs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/**
+ * 同一个echo服务器在不同Poller上的对比
+ *   epoll      : EPollPoller
+ *   uring-poll : IoUringPoller，只用readiness（MUDUO_USE_URING=poll）
+ *   uring      : IoUringPoller，recv/send/accept走完成通知（MUDUO_USE_URING=1）
+ * 服务器只有一个loop线程；客户端在主线程，每一轮在所有连接上各发一条消息，再把回复全部读回来
+ * 除了吞吐量，还统计服务器线程消耗的CPU时间，这部分才是Poller的差别
+ *
+ * ./poller_bench [connections] [rounds] [messageBytes]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int64_t nowNanos(clockid_t clock)
+{
+    struct timespec ts;
+    ::clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    conn->send(buf->retrieveAllAsString());
+}
+
+static void run(const char *mode, const char *uringEnv, uint16_t port,
+                int numConns, int rounds, size_t messageBytes)
+{
+    if (uringEnv)
+    {
+        ::setenv("MUDUO_USE_URING", uringEnv, 1);
+    }
+    else
+    {
+        ::unsetenv("MUDUO_USE_URING");
+    }
+
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&serverLoop, port]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "PollerBench");
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback(onMessage);
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    InetAddress addr(port);
+    std::vector<int> fds;
+    for (int i = 0; i < numConns; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        fds.push_back(fd);
+    }
+    ::usleep(100 * 1000); // 等服务器把连接都建立好
+
+    clockid_t serverClock;
+    pthread_getcpuclockid(server.native_handle(), &serverClock);
+
+    std::string message(messageBytes, 'x');
+    std::vector<char> reply(messageBytes);
+    int64_t start = nowNanos(CLOCK_MONOTONIC);
+    int64_t serverCpuStart = nowNanos(serverClock);
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int fd : fds)
+        {
+            if (::write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+            {
+                perror("write");
+                exit(1);
+            }
+        }
+        for (int fd : fds)
+        {
+            size_t got = 0;
+            while (got < messageBytes)
+            {
+                ssize_t n = ::read(fd, reply.data() + got, messageBytes - got);
+                if (n <= 0)
+                {
+                    perror("read");
+                    exit(1);
+                }
+                got += n;
+            }
+        }
+    }
+    int64_t serverCpu = nowNanos(serverClock) - serverCpuStart;
+    int64_t elapsed = nowNanos(CLOCK_MONOTONIC) - start;
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    serverLoop.load()->quit();
+    server.join();
+
+    const int64_t messages = static_cast<int64_t>(numConns) * rounds;
+    printf("{\"bench\":\"poller\",\"mode\":\"%s\",\"connections\":%d,\"messages\":%ld,\"message_bytes\":%zu,"
+            "\"msgs_per_sec\":%.0f,\"server_cpu_ns_per_msg\":%.1f}\n",
+            mode, numConns, messages, messageBytes,
+            static_cast<double>(messages) * 1e9 / elapsed,
+            static_cast<double>(serverCpu) / messages);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numConns = argc > 1 ? atoi(argv[1]) : 100;
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+    size_t messageBytes = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 64;
+
+    Logger::setLogLevel(ERROR);
+    run("epoll", nullptr, 19101, numConns, rounds, messageBytes);
+    run("uring-poll", "poll", 19102, numConns, rounds, messageBytes);
+    run("uring", "1", 19103, numConns, rounds, messageBytes);
+    return 0;
+}
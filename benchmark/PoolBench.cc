@@ -0,0 +1,195 @@
+/**
+ * 上游连接池：代理每个请求都要访问一次上游，请求-响应式
+ *   connect_per_request : 每个请求新建一个TcpClient，收到响应以后关闭，每次都要三次握手
+ *   pooled              : ConnectionPool，用完release，下一个请求复用空闲连接
+ * 同时有concurrency个请求在进行，latency从发起请求（acquire/connect）开始算到收到响应
+ *
+ * ./pool_bench [requests] [concurrency]
+ */
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "ConnectionPool.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const uint16_t kPort = 19404;
+static const size_t kRequestSize = 64;
+
+// 请求方在同一个loop里跑，计数都不用加锁
+struct Driver
+{
+    EventLoop                   *loop;
+    InetAddress                 upstream;
+    int                         remaining;
+    int                         inflight;
+    std::string                 request;
+    std::vector<int64_t>        latencies;
+    std::unique_ptr<ConnectionPool> pool;
+    int                         nextClientId;
+    std::unordered_map<int, std::unique_ptr<TcpClient>> clients;
+
+    Driver(EventLoop *l, int requests)
+        : loop(l), upstream(kPort), remaining(requests), inflight(0), request(kRequestSize, 'R'), nextClientId(0)
+    {
+        latencies.reserve(requests);
+    }
+
+    void finish(int64_t start)
+    {
+        latencies.push_back(nowNanos() - start);
+        --inflight;
+        if (remaining == 0 && inflight == 0)
+        {
+            loop->quit();
+        }
+    }
+
+    void issuePooled()
+    {
+        if (remaining == 0)
+        {
+            return;
+        }
+        --remaining;
+        ++inflight;
+        int64_t start = nowNanos();
+        pool->acquire([this, start](const TcpConnectionPtr &conn) {
+            if (!conn)
+            {
+                fprintf(stderr, "acquire failed\n");
+                exit(1);
+            }
+            conn->setMessageCallback([this, start](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+                if (buf->readableBytes() < kRequestSize)
+                {
+                    return;
+                }
+                buf->retrieve(kRequestSize);
+                pool->release(conn);
+                finish(start);
+                issuePooled();
+            });
+            conn->send(request);
+        });
+    }
+
+    void issueConnect()
+    {
+        if (remaining == 0)
+        {
+            return;
+        }
+        --remaining;
+        ++inflight;
+        int64_t start = nowNanos();
+        int id = nextClientId++;
+        TcpClient *client = new TcpClient(loop, upstream, "PoolBench");
+        clients[id].reset(client);
+        client->setConnectionCallback([this](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->send(request);
+            }
+        });
+        client->setMessageCallback([this, id, start](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+            if (buf->readableBytes() < kRequestSize)
+            {
+                return;
+            }
+            buf->retrieve(kRequestSize);
+            // 在TcpClient自己的回调里不能析构它
+            loop->queueInLoop([this, id]() { clients.erase(id); });
+            finish(start);
+            issueConnect();
+        });
+        client->connect();
+    }
+};
+
+static void run(const char *mode, bool pooled, int requests, int concurrency)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(kPort), "PoolBenchUpstream", TcpServer::kReusePort);
+        server.setThreadNum(1);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    EventLoop loop;
+    Driver driver(&loop, requests);
+    if (pooled)
+    {
+        driver.pool.reset(new ConnectionPool(&loop, driver.upstream, "PoolBench"));
+        driver.pool->setMaxConnections(concurrency);
+    }
+    int64_t start = nowNanos();
+    loop.runInLoop([&]() {
+        for (int i = 0; i < concurrency; ++i)
+        {
+            pooled ? driver.issuePooled() : driver.issueConnect();
+        }
+    });
+    loop.loop();
+    int64_t elapsed = nowNanos() - start;
+    size_t connections = pooled ? driver.pool->totalConnections() : static_cast<size_t>(driver.nextClientId);
+    driver.pool.reset();
+    driver.clients.clear();
+    loop.runAfter(0.1, [&loop]() { loop.quit(); }); // 让关闭连接的回调执行完
+    loop.loop();
+
+    serverLoop.load()->quit();
+    server.join();
+
+    std::vector<int64_t> &lat = driver.latencies;
+    std::sort(lat.begin(), lat.end());
+    printf("{\"bench\":\"pool\",\"mode\":\"%s\",\"requests\":%d,\"concurrency\":%d,\"connections\":%zu,"
+            "\"requests_per_sec\":%.0f,\"p50_us\":%.1f,\"p99_us\":%.1f}\n",
+            mode, requests, concurrency, connections,
+            static_cast<double>(requests) * 1e9 / elapsed,
+            lat[lat.size() / 2] / 1e3,
+            lat[lat.size() * 99 / 100] / 1e3);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int requests = argc > 1 ? atoi(argv[1]) : 10000;
+    int concurrency = argc > 2 ? atoi(argv[2]) : 8;
+    if (concurrency < 1)
+    {
+        concurrency = 8;
+    }
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    run("connect_per_request", false, requests, concurrency);
+    run("pooled", true, requests, concurrency);
+    return 0;
+}
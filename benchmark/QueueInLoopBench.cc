@@ -0,0 +1,149 @@
+/**
+ * 多个生产者线程向同一个loop投递回调的吞吐量
+ *   mutex : 原来的实现，std::mutex + std::vector<Functor>，每次跨线程投递都写一次eventfd
+ *   mpsc  : 现在的EventLoop::queueInLoop，无锁MPSC队列 + 合并唤醒
+ *
+ * ./queueinloop_bench [producers] [postsPerProducer]
+ */
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 原来EventLoop中pendingFunctors_的实现，单独拿出来做对比
+class MutexLoop
+{
+public:
+    using Functor = std::function<void()>;
+
+    MutexLoop()
+        : wakeupFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        , quit_(false)
+        , thread_(&MutexLoop::loop, this)
+    {}
+
+    ~MutexLoop()
+    {
+        quit_ = true;
+        wakeup();
+        thread_.join();
+        ::close(wakeupFd_);
+    }
+
+    void queueInLoop(Functor cb)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pendingFunctors_.emplace_back(cb);
+        }
+        wakeup();
+    }
+
+private:
+    void wakeup()
+    {
+        uint64_t one = 1;
+        ssize_t n = ::write(wakeupFd_, &one, sizeof one);
+        (void)n;
+    }
+
+    void loop()
+    {
+        while (!quit_)
+        {
+            struct pollfd pfd = { wakeupFd_, POLLIN, 0 };
+            ::poll(&pfd, 1, 10000);
+            uint64_t one;
+            ssize_t n = ::read(wakeupFd_, &one, sizeof one);
+            (void)n;
+
+            std::vector<Functor> functors;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                functors.swap(pendingFunctors_);
+            }
+            for (const Functor &functor : functors)
+            {
+                functor();
+            }
+        }
+    }
+
+    int                         wakeupFd_;
+    std::atomic_bool            quit_;
+    std::mutex                  mutex_;
+    std::vector<Functor>        pendingFunctors_;
+    std::thread                 thread_;
+};
+
+template <typename Loop>
+static void run(const char *mode, Loop *loop, int numProducers, int numPosts)
+{
+    const int64_t total = static_cast<int64_t>(numProducers) * numPosts;
+    int64_t executed = 0; // 只在loop线程中访问
+    std::atomic_bool done(false);
+
+    int64_t start = nowNanos();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back([&]() {
+            for (int i = 0; i < numPosts; ++i)
+            {
+                loop->queueInLoop([&]() {
+                    if (++executed == total)
+                    {
+                        done = true;
+                    }
+                });
+            }
+        });
+    }
+    for (std::thread &thr : producers)
+    {
+        thr.join();
+    }
+    while (!done)
+    {
+        ::usleep(100);
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    printf("{\"bench\":\"queueinloop\",\"mode\":\"%s\",\"producers\":%d,\"posts\":%ld,"
+            "\"posts_per_sec\":%.0f,\"ns_per_post\":%.1f}\n",
+            mode, numProducers, total,
+            static_cast<double>(total) * 1e9 / elapsed,
+            static_cast<double>(elapsed) / total);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numProducers = argc > 1 ? atoi(argv[1]) : 4;
+    int numPosts = argc > 2 ? atoi(argv[2]) : 200000;
+
+    {
+        MutexLoop loop;
+        run("mutex", &loop, numProducers, numPosts);
+    }
+
+    {
+        EventLoopThread thread;
+        EventLoop *loop = thread.startLoop();
+        run("mpsc", loop, numProducers, numPosts);
+    }
+
+    return 0;
+}
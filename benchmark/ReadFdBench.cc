@@ -0,0 +1,75 @@
+/**
+ * 小消息的读路径开销
+ * socketpair一端每次写一条消息，另一端读到Buffer里再取走
+ *   zeroed : 原来的readFd，每次读都在栈上清零64K的extrabuf
+ *   buffer : 现在的Buffer::readFd，线程局部的extrabuf + 自适应的readHint
+ *
+ * ./readfd_bench [messages] [messageBytes]
+ */
+#include "Buffer.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+
+// 原来的readFd和现在相比多出来的部分就是每次清零64K的extrabuf
+static ssize_t zeroedReadFd(Buffer *buf, int fd)
+{
+    char extrabuf[65536] = {0};
+    __asm__ __volatile__("" : : "r"(extrabuf) : "memory"); // 不让编译器把清零优化掉
+    int savedErrno = 0;
+    return buf->readFd(fd, &savedErrno);
+}
+
+static ssize_t bufferReadFd(Buffer *buf, int fd)
+{
+    int savedErrno = 0;
+    return buf->readFd(fd, &savedErrno);
+}
+
+static void run(const char *mode, ssize_t (*readFd)(Buffer*, int), int numMessages, const std::string &message)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    Buffer buf;
+    size_t total = 0;
+    int64_t start = nowNanos();
+    for (int i = 0; i < numMessages; ++i)
+    {
+        ssize_t n = ::write(fds[0], message.data(), message.size());
+        (void)n;
+        readFd(&buf, fds[1]);
+        total += buf.readableBytes();
+        buf.retrieveAll();
+    }
+    int64_t elapsed = nowNanos() - start;
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    printf("{\"bench\":\"readfd\",\"mode\":\"%s\",\"messages\":%d,\"message_bytes\":%zu,"
+            "\"ns_per_message\":%.1f,\"bytes\":%zu}\n",
+            mode, numMessages, message.size(),
+            static_cast<double>(elapsed) / numMessages, total);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int numMessages = argc > 1 ? atoi(argv[1]) : 500000;
+    size_t messageBytes = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 20;
+    std::string message(messageBytes, 'x');
+
+    run("zeroed", zeroedReadFd, numMessages, message);
+    run("buffer", bufferReadFd, numMessages, message);
+    return 0;
+}
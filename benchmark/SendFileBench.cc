@@ -0,0 +1,256 @@
+/**
+ * 大文件发送和代理转发的吞吐量，以及整个进程（服务器+客户端）消耗的CPU时间
+ *   read_send   : 每次read 64K到string，再send，数据要拷贝进用户态再拷贝回内核
+ *   sendfile    : TcpConnection::sendFile，从page cache直接发送
+ *   proxy_copy  : 代理收到数据以后send给上游，经过inputBuffer_
+ *   proxy_splice: 代理两端startSplice，socket => pipe => socket
+ * 客户端用阻塞socket收完就关闭，文件第一遍读进page cache以后不再计入磁盘IO
+ *
+ * ./sendfile_bench [file_mb] [proxy_mb]
+ */
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+static int64_t cpuNanos()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static const uint16_t kFilePort = 19405;
+static const uint16_t kProxyPort = 19406;
+static const uint16_t kSinkPort = 19407;
+static const size_t kChunk = 64 * 1024;
+static const char *kPath = "/tmp/sendfile_bench.dat";
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    InetAddress addr(port);
+    if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+static void report(const char *mode, size_t bytes, int64_t elapsed, int64_t cpu)
+{
+    printf("{\"bench\":\"sendfile\",\"mode\":\"%s\",\"mb\":%zu,\"mb_per_sec\":%.0f,\"cpu_ms\":%.1f,\"cpu_ns_per_kb\":%.1f}\n",
+            mode, bytes >> 20, static_cast<double>(bytes) / (1 << 20) * 1e9 / elapsed,
+            cpu / 1e6, static_cast<double>(cpu) / (bytes >> 10));
+    fflush(stdout);
+}
+
+// read_send时每次输出缓冲区发完再读下一块，和sendfile一样只占用很少的内存
+struct FileReader
+{
+    int fd;
+    size_t remaining;
+};
+
+static void runFile(const char *mode, bool useSendfile, size_t bytes)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(kFilePort), "SendFileBench", TcpServer::kReusePort);
+        std::map<TcpConnection*, FileReader> readers; // 只在subloop中访问
+        server.setThreadNum(1);
+        server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (!conn->connected())
+            {
+                std::map<TcpConnection*, FileReader>::iterator it = readers.find(conn.get());
+                if (it != readers.end())
+                {
+                    ::close(it->second.fd);
+                    readers.erase(it);
+                }
+                return;
+            }
+            int fd = ::open(kPath, O_RDONLY);
+            if (useSendfile)
+            {
+                conn->sendFile(fd, 0, bytes);
+                ::close(fd);
+                conn->shutdown();
+            }
+            else
+            {
+                FileReader reader = { fd, bytes };
+                readers[conn.get()] = reader;
+                std::string chunk(kChunk, '\0');
+                ssize_t n = ::read(fd, &chunk[0], kChunk);
+                readers[conn.get()].remaining -= n;
+                conn->send(std::move(chunk));
+            }
+        });
+        server.setWriteCompleteCallback([&](const TcpConnectionPtr &conn) {
+            std::map<TcpConnection*, FileReader>::iterator it = readers.find(conn.get());
+            if (it == readers.end())
+            {
+                return;
+            }
+            if (it->second.remaining == 0)
+            {
+                conn->shutdown();
+                return;
+            }
+            std::string chunk(std::min(kChunk, it->second.remaining), '\0');
+            ssize_t n = ::read(it->second.fd, &chunk[0], chunk.size());
+            it->second.remaining -= n;
+            conn->send(std::move(chunk));
+        });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    int64_t start = nowNanos();
+    int64_t cpuStart = cpuNanos();
+    int fd = connectTo(kFilePort);
+    size_t got = 0;
+    char buf[kChunk];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0)
+    {
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    report(mode, got, nowNanos() - start, cpuNanos() - cpuStart);
+
+    serverLoop.load()->quit();
+    server.join();
+}
+
+static void runProxy(const char *mode, bool useSplice, size_t bytes)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::atomic<size_t> sunk(0);
+    std::thread server([&]() {
+        EventLoop loop;
+        // 上游只收数据，收够了关闭
+        TcpServer sink(&loop, InetAddress(kSinkPort), "Sink", TcpServer::kReusePort);
+        sink.setConnectionCallback([](const TcpConnectionPtr&) {});
+        sink.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            sunk += buf->readableBytes();
+            buf->retrieveAll();
+            if (sunk == bytes)
+            {
+                conn->shutdown();
+            }
+        });
+        sink.start();
+
+        // 代理和上游连接都在baseLoop里，startSplice要求两端在同一个loop
+        TcpServer proxy(&loop, InetAddress(kProxyPort), "Proxy", TcpServer::kReusePort);
+        std::map<std::string, std::shared_ptr<TcpClient>> upstreams;
+        proxy.setConnectionCallback([&](const TcpConnectionPtr &down) {
+            if (!down->connected())
+            {
+                return;
+            }
+            std::shared_ptr<TcpClient> client(new TcpClient(&loop, InetAddress(kSinkPort), "Upstream"));
+            upstreams[down->name()] = client;
+            std::weak_ptr<TcpConnection> weakDown(down);
+            client->setConnectionCallback([weakDown, useSplice](const TcpConnectionPtr &up) {
+                TcpConnectionPtr down(weakDown.lock());
+                if (!down)
+                {
+                    return;
+                }
+                if (!up->connected())
+                {
+                    down->shutdown();
+                    return;
+                }
+                if (!useSplice || !down->startSplice(up))
+                {
+                    down->setMessageCallback([up](const TcpConnectionPtr&, Buffer *buf, Timestamp) { up->send(buf); });
+                }
+            });
+            client->connect();
+        });
+        // 上游连上之前收到的数据留在inputBuffer_里，startSplice时先发出去
+        proxy.setMessageCallback([](const TcpConnectionPtr&, Buffer*, Timestamp) {});
+        proxy.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    int64_t start = nowNanos();
+    int64_t cpuStart = cpuNanos();
+    int fd = connectTo(kProxyPort);
+    std::string block(kChunk, 'P');
+    for (size_t sent = 0; sent < bytes; sent += block.size())
+    {
+        if (::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size()))
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    char buf[16];
+    ::read(fd, buf, sizeof buf); // 上游收完以后关闭，代理再关闭客户端
+    ::close(fd);
+    report(mode, bytes, nowNanos() - start, cpuNanos() - cpuStart);
+
+    serverLoop.load()->quit();
+    server.join();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t fileMb = argc > 1 ? atoi(argv[1]) : 256;
+    size_t proxyMb = argc > 2 ? atoi(argv[2]) : 256;
+    size_t fileBytes = fileMb << 20;
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    int fd = ::open(kPath, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    std::string block(1 << 20, 'F');
+    for (size_t i = 0; i < fileMb; ++i)
+    {
+        ::write(fd, block.data(), block.size());
+    }
+    ::close(fd);
+
+    runFile("read_send", false, fileBytes);
+    runFile("sendfile", true, fileBytes);
+    runProxy("proxy_copy", false, proxyMb << 20);
+    runProxy("proxy_splice", true, proxyMb << 20);
+    ::unlink(kPath);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * 跨线程queueInLoop每次投递的堆分配次数
+ * 投递的是和TcpConnection::send/connectEstablished一样的回调：std::bind一个成员函数 + shared_ptr + 参数
+ *
+ * ./taskalloc_bench [posts]
+ */
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+
+static std::atomic<int64_t> g_allocations(0);
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    void *p = ::malloc(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    ::free(p);
+}
+
+// 模拟TcpConnection
+class Connection : public std::enable_shared_from_this<Connection>
+{
+public:
+    Connection() : bytes_(0) {}
+    void sendInLoop(const void *data, size_t len) { (void)data; bytes_ += len; }
+    void connectEstablished() { ++bytes_; }
+    size_t bytes() const { return bytes_; }
+private:
+    size_t bytes_;
+};
+
+int main(int argc, char *argv[])
+{
+    int numPosts = argc > 1 ? atoi(argv[1]) : 100000;
+
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+
+    std::shared_ptr<Connection> conn(new Connection);
+    static const char kMessage[] = "hello";
+    std::atomic_int executed(0);
+
+    // sendInLoop样式：bind(成员函数, shared_ptr, 指针, 长度)
+    int64_t before = g_allocations.load();
+    for (int i = 0; i < numPosts; ++i)
+    {
+        loop->queueInLoop(std::bind(&Connection::sendInLoop, conn, kMessage, sizeof kMessage));
+    }
+    int64_t sendAllocs = g_allocations.load() - before;
+
+    // connectEstablished样式：bind(成员函数, shared_ptr)
+    before = g_allocations.load();
+    for (int i = 0; i < numPosts; ++i)
+    {
+        loop->queueInLoop(std::bind(&Connection::connectEstablished, conn));
+    }
+    int64_t establishAllocs = g_allocations.load() - before;
+
+    loop->queueInLoop([&executed]() { executed = 1; });
+    while (executed == 0)
+    {
+        ::usleep(1000);
+    }
+
+    printf("{\"bench\":\"taskalloc\",\"posts\":%d,\"send_allocs_per_post\":%.2f,"
+            "\"establish_allocs_per_post\":%.2f}\n",
+            numPosts,
+            static_cast<double>(sendAllocs) / numPosts,
+            static_cast<double>(establishAllocs) / numPosts);
+    return 0;
+}
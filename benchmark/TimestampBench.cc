@@ -0,0 +1,86 @@
+/**
+ * 取时间和格式化日志行的开销
+ *   clock     : Timestamp::now的四种时钟，以及原来用的gettimeofday
+ *   log_line  : Logger::log输出到空函数  legacy是原来的写法，每一行localtime_r加snprintf
+ *
+ * ./timestamp_bench [iterations]
+ */
+#include "Timestamp.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+static int64_t gSink = 0;
+
+static void report(const char *op, const char *mode, int64_t nanos, int iterations)
+{
+    printf("{\"bench\":\"timestamp\",\"op\":\"%s\",\"mode\":\"%s\",\"ns_per_op\":%.2f}\n",
+            op, mode, static_cast<double>(nanos) / iterations);
+    fflush(stdout);
+}
+
+static void benchClock(const char *mode, Timestamp::Clock clock, int iterations)
+{
+    int64_t start = nowNanos();
+    for (int i = 0; i < iterations; ++i)
+    {
+        gSink += Timestamp::now(clock).microSecondsSinceEpoch();
+    }
+    report("clock", mode, nowNanos() - start, iterations);
+}
+
+static void nullOutput(const char *msg, int len)
+{
+    gSink += len + msg[0];
+}
+
+// 原来Logger::log的格式化方式
+static void legacyLog(const char *msg)
+{
+    char line[1024 + 128];
+    int n = snprintf(line, sizeof line, "%s%s : %s\n", "[INFO]", Timestamp::now().toString().c_str(), msg);
+    nullOutput(line, n);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 5 * 1000 * 1000;
+
+    benchClock("realtime", Timestamp::kRealtime, iterations);
+    benchClock("realtime_coarse", Timestamp::kRealtimeCoarse, iterations);
+    benchClock("monotonic", Timestamp::kMonotonic, iterations);
+    benchClock("monotonic_coarse", Timestamp::kMonotonicCoarse, iterations);
+    int64_t start = nowNanos();
+    for (int i = 0; i < iterations; ++i)
+    {
+        struct timeval tv;
+        ::gettimeofday(&tv, NULL);
+        gSink += tv.tv_usec;
+    }
+    report("clock", "gettimeofday", nowNanos() - start, iterations);
+
+    const char *msg = "TcpServer::newConnection [EchoServer] - new connection [EchoServer-127.0.0.1:8000#1]";
+    int lines = iterations / 5;
+    start = nowNanos();
+    for (int i = 0; i < lines; ++i)
+    {
+        legacyLog(msg);
+    }
+    report("log_line", "legacy", nowNanos() - start, lines);
+
+    Logger::setOutput(nullOutput);
+    start = nowNanos();
+    for (int i = 0; i < lines; ++i)
+    {
+        Logger::instance().log(INFO, msg);
+    }
+    report("log_line", "cached_prefix", nowNanos() - start, lines);
+
+    return gSink == 42 ? 1 : 0;
+}
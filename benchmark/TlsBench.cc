@@ -0,0 +1,397 @@
+/**
+ * TLS的开销  证书是启动时生成的自签名P-256证书
+ * 握手：clients个TcpClient连上服务器，握手完成以后服务器马上shutdown，客户端读到close_notify以后自动重连，
+ * 对比打开和关闭session恢复时每秒的握手数和每次握手整个进程用的cpu时间
+ * echo：一个连接闭环发size字节的消息，对比明文和TLS的往返次数和cpu时间
+ * sendfile：服务器每个连接sendFile一个文件然后shutdown，客户端收完重连，对比明文和TLS的吞吐
+ * ktls_tx/ktls_rx是连接有没有交给内核TLS，内核没有tls模块时都是0，走的是用户态加密
+ * ktls为0时不尝试内核TLS，用来在支持的内核上对比
+ *
+ * ./tls_bench [seconds] [size] [ktls]
+ */
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "TlsContext.h"
+#include "TlsFilter.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 整个进程（服务器和客户端线程）的cpu时间，微秒
+static int64_t cpuMicros()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// 在loop线程里执行f，等它执行完
+static void runSync(EventLoop *loop, const std::function<void()> &f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+static bool writeSelfSigned(const std::string &certFile, const std::string &keyFile)
+{
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool ok = pctx != nullptr
+        && EVP_PKEY_keygen_init(pctx) > 0
+        && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) > 0
+        && EVP_PKEY_keygen(pctx, &pkey) > 0;
+    EVP_PKEY_CTX_free(pctx);
+    if (!ok)
+    {
+        return false;
+    }
+    X509 *x509 = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 86400);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    ok = X509_sign(x509, pkey, EVP_sha256()) > 0;
+
+    FILE *keyOut = ::fopen(keyFile.c_str(), "w");
+    FILE *certOut = ::fopen(certFile.c_str(), "w");
+    ok = ok && keyOut && certOut
+        && PEM_write_PrivateKey(keyOut, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1
+        && PEM_write_X509(certOut, x509) == 1;
+    if (keyOut)
+    {
+        ::fclose(keyOut);
+    }
+    if (certOut)
+    {
+        ::fclose(certOut);
+    }
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+struct Setup
+{
+    std::string certFile;
+    std::string keyFile;
+    bool        ktls;
+
+    TlsContextPtr server(bool resumption) const
+    {
+        TlsContextPtr context = TlsContext::newServer(certFile, keyFile);
+        context->setKtls(ktls);
+        context->setSessionResumption(resumption);
+        return context;
+    }
+
+    TlsContextPtr client(bool resumption) const
+    {
+        TlsContextPtr context = TlsContext::newClient();
+        context->setKtls(ktls);
+        context->setSessionResumption(resumption);
+        return context;
+    }
+};
+
+// 服务器和客户端各一个loop线程，TcpServer、TcpClient都在各自的loop里创建和销毁
+class Pair
+{
+public:
+    Pair()
+        : serverLoop_(serverThread_.startLoop())
+        , clientLoop_(clientThread_.startLoop())
+    {
+    }
+
+    ~Pair()
+    {
+        runSync(clientLoop_, [this]() { clients_.clear(); });
+        ::usleep(100 * 1000);
+        runSync(serverLoop_, [this]() { server_.reset(); });
+    }
+
+    void startServer(uint16_t port, const TlsContextPtr &tls, const std::function<void(TcpServer*)> &setup)
+    {
+        runSync(serverLoop_, [&]() {
+            server_.reset(new TcpServer(serverLoop_, InetAddress(port, "127.0.0.1"), "TlsBenchServer"));
+            if (tls)
+            {
+                server_->setTlsContext(tls);
+            }
+            server_->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+            setup(server_.get());
+            server_->start();
+        });
+    }
+
+    void startClients(uint16_t port, int n, const TlsContextPtr &tls, const std::function<void(TcpClient*)> &setup)
+    {
+        runSync(clientLoop_, [&]() {
+            for (int i = 0; i < n; ++i)
+            {
+                TcpClient *client = new TcpClient(clientLoop_, InetAddress(port, "127.0.0.1"), "TlsBenchClient");
+                clients_.emplace_back(client);
+                if (tls)
+                {
+                    client->setTlsContext(tls, "localhost");
+                }
+                client->setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+                setup(client);
+                client->connect();
+            }
+        });
+    }
+
+    TcpServer* server() const { return server_.get(); }
+    EventLoop* clientLoop() const { return clientLoop_; }
+    TcpClient* client(size_t i) const { return clients_[i].get(); }
+private:
+    EventLoopThread serverThread_;
+    EventLoopThread clientThread_;
+    EventLoop       *serverLoop_;
+    EventLoop       *clientLoop_;
+    std::unique_ptr<TcpServer> server_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+};
+
+// 前10%的时间用来预热，测中间的80%
+struct Window
+{
+    double  seconds;
+    int64_t start;
+    int64_t cpuStart;
+    double  elapsed;
+    int64_t cpu;
+
+    explicit Window(double s) : seconds(s), start(0), cpuStart(0), elapsed(0), cpu(0) {}
+
+    void begin()
+    {
+        ::usleep(static_cast<useconds_t>(seconds * 0.1e6));
+        start = nowNanos();
+        cpuStart = cpuMicros();
+    }
+
+    void end()
+    {
+        ::usleep(static_cast<useconds_t>(seconds * 0.8e6));
+        cpu = cpuMicros() - cpuStart;
+        elapsed = (nowNanos() - start) / 1e9;
+    }
+};
+
+static void runHandshakes(const Setup &setup, uint16_t port, bool resumption, int clients, double seconds)
+{
+    Pair pair;
+    pair.startServer(port, setup.server(resumption), [](TcpServer *server) {
+        server->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->shutdown(); // 服务器先关，TIME_WAIT留在服务器这一端
+            }
+        });
+    });
+    std::atomic<uint64_t> handshakes(0);
+    pair.startClients(port, clients, setup.client(resumption), [&handshakes](TcpClient *client) {
+        client->enableRetry(); // 读到close_notify关闭以后马上重连
+        client->setConnectionCallback([&handshakes](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                handshakes.store(handshakes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        });
+    });
+
+    Window window(seconds);
+    window.begin();
+    uint64_t startCount = handshakes.load();
+    LoopMetrics::Snapshot before = pair.server()->metrics();
+    window.end();
+    uint64_t count = handshakes.load() - startCount;
+    LoopMetrics::Snapshot after = pair.server()->metrics();
+    uint64_t serverHandshakes = after.counters[LoopMetrics::kTlsHandshakes] - before.counters[LoopMetrics::kTlsHandshakes];
+    uint64_t resumed = after.counters[LoopMetrics::kTlsResumed] - before.counters[LoopMetrics::kTlsResumed];
+
+    printf("{\"bench\":\"tls_handshake\",\"resumption\":%d,\"clients\":%d,\"handshakes\":%llu,"
+            "\"handshakes_per_sec\":%.0f,\"resumed_ratio\":%.3f,\"cpu_us_per_handshake\":%.1f}\n",
+            resumption ? 1 : 0, clients, static_cast<unsigned long long>(count), count / window.elapsed,
+            serverHandshakes ? static_cast<double>(resumed) / serverHandshakes : 0,
+            count ? static_cast<double>(window.cpu) / count : 0);
+    fflush(stdout);
+}
+
+// 连接的TLS有没有交给内核  在连接所属的loop里读
+static void ktlsState(const Pair &pair, int *tx, int *rx)
+{
+    *tx = 0;
+    *rx = 0;
+    runSync(pair.clientLoop(), [&]() {
+        TcpConnectionPtr conn = pair.client(0)->connection();
+        if (conn && conn->tls())
+        {
+            *tx = conn->tls()->txOffloaded() ? 1 : 0;
+            *rx = conn->tls()->rxOffloaded() ? 1 : 0;
+        }
+    });
+}
+
+static void runEcho(const Setup &setup, uint16_t port, bool tls, size_t size, double seconds)
+{
+    Pair pair;
+    pair.startServer(port, tls ? setup.server(true) : nullptr, [](TcpServer *server) {
+        server->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf);
+        });
+    });
+    std::atomic<uint64_t> rtts(0);
+    const std::string block(size, 't');
+    pair.startClients(port, 1, tls ? setup.client(true) : nullptr, [&rtts, &block, size](TcpClient *client) {
+        client->setConnectionCallback([&block](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->send(block);
+            }
+        });
+        client->setMessageCallback([&rtts, &block, size](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            while (buf->readableBytes() >= size)
+            {
+                buf->retrieve(size);
+                rtts.store(rtts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                conn->send(block);
+            }
+        });
+    });
+
+    Window window(seconds);
+    window.begin();
+    uint64_t startCount = rtts.load();
+    window.end();
+    uint64_t count = rtts.load() - startCount;
+    int tx, rx;
+    ktlsState(pair, &tx, &rx);
+
+    printf("{\"bench\":\"tls_echo\",\"tls\":%d,\"size\":%zu,\"rtt_per_sec\":%.0f,\"mib_per_sec\":%.1f,"
+            "\"cpu_us_per_rtt\":%.2f,\"ktls_tx\":%d,\"ktls_rx\":%d}\n",
+            tls ? 1 : 0, size, count / window.elapsed, count * size / window.elapsed / (1024 * 1024),
+            count ? static_cast<double>(window.cpu) / count : 0, tx, rx);
+    fflush(stdout);
+}
+
+static void runSendFile(const Setup &setup, uint16_t port, bool tls, int fd, size_t fileSize, double seconds)
+{
+    Pair pair;
+    pair.startServer(port, tls ? setup.server(true) : nullptr, [fd, fileSize](TcpServer *server) {
+        server->setConnectionCallback([fd, fileSize](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->sendFile(fd, 0, fileSize);
+                conn->shutdown(); // 文件发送完再关闭
+            }
+        });
+    });
+    std::atomic<uint64_t> received(0);
+    pair.startClients(port, 1, tls ? setup.client(true) : nullptr, [&received](TcpClient *client) {
+        client->enableRetry();
+        client->setMessageCallback([&received](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+            received.store(received.load(std::memory_order_relaxed) + buf->readableBytes(), std::memory_order_relaxed);
+            buf->retrieveAll();
+        });
+    });
+
+    Window window(seconds);
+    window.begin();
+    uint64_t startBytes = received.load();
+    window.end();
+    uint64_t bytes = received.load() - startBytes;
+    int tx, rx;
+    ktlsState(pair, &tx, &rx);
+    double mib = bytes / (1024.0 * 1024);
+
+    printf("{\"bench\":\"tls_sendfile\",\"tls\":%d,\"file_mib\":%zu,\"mib_per_sec\":%.1f,"
+            "\"cpu_us_per_mib\":%.1f,\"ktls_tx\":%d,\"ktls_rx\":%d}\n",
+            tls ? 1 : 0, fileSize >> 20, mib / window.elapsed, mib > 0 ? window.cpu / mib : 0, tx, rx);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    size_t size = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 16384;
+    bool ktls = argc > 3 ? atoi(argv[3]) != 0 : true;
+    ::unsetenv("MUDUO_USE_URING"); // 完成通知模式不支持TLS
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    std::string prefix = "/tmp/mymuduo_tls_bench." + std::to_string(::getpid());
+    Setup setup;
+    setup.certFile = prefix + ".crt";
+    setup.keyFile = prefix + ".key";
+    setup.ktls = ktls;
+    if (!writeSelfSigned(setup.certFile, setup.keyFile) || !setup.server(true))
+    {
+        fprintf(stderr, "tls_bench: cannot create certificate\n");
+        return 1;
+    }
+
+    // 文件内容在page cache里，测的是发送路径
+    const size_t fileSize = 16 * 1024 * 1024;
+    std::string fileName = prefix + ".dat";
+    int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    std::string chunk(1024 * 1024, 'f');
+    for (size_t written = 0; fd >= 0 && written < fileSize; written += chunk.size())
+    {
+        if (::write(fd, chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size()))
+        {
+            perror("tls_bench: write");
+            return 1;
+        }
+    }
+
+    uint16_t port = 18200;
+    runHandshakes(setup, port++, false, 4, seconds);
+    runHandshakes(setup, port++, true, 4, seconds);
+    runEcho(setup, port++, false, size, seconds);
+    runEcho(setup, port++, true, size, seconds);
+    runSendFile(setup, port++, false, fd, fileSize, seconds);
+    runSendFile(setup, port++, true, fd, fileSize, seconds);
+
+    ::close(fd);
+    ::unlink(fileName.c_str());
+    ::unlink(setup.certFile.c_str());
+    ::unlink(setup.keyFile.c_str());
+    return 0;
+}
@@ -0,0 +1,235 @@
+/**
+ * UdpServer的收包能力  clients个线程各用一个socket往服务器发size字节的数据报，服务器threads个loop
+ * sink模式只收不回，统计服务器每秒收到的数据报和每个数据报花的cpu时间（整个进程的，包括客户端）
+ * echo模式服务器在批回调里原样发回去，客户端每发一批等回复，统计往返的数据报数
+ * gro为1时服务器打开UDP_GRO，sink模式的客户端用UDP_SEGMENT一次发最多64个分段，loopback上内核才会合并
+ * gso为1时echo的回复打开UDP_SEGMENT
+ *
+ * ./udp_bench [seconds] [threads] [clients] [size] [sink|echo] [gro] [gso]
+ */
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+static const uint16_t kPort = 18190;
+static const int kClientBatch = 32;
+
+static int64_t cpuNanos()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return ((static_cast<int64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static int connectClient()
+{
+    InetAddress server(kPort, "127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || ::connect(fd, server.getSockAddr(), server.length()) < 0)
+    {
+        perror("udp client");
+        exit(1);
+    }
+    int bufSize = 4 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof bufSize);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof bufSize);
+    return fd;
+}
+
+// 一直发到deadline  segmented时每个消息带UDP_SEGMENT，由内核分成多个数据报，总共不超过一个IP包
+static void runSinkClient(size_t size, bool segmented, int64_t deadline)
+{
+    int fd = connectClient();
+    size_t segments = std::max<size_t>(1, std::min<size_t>(64, 65000 / size));
+    std::vector<char> data(size * segments, 's');
+    if (segmented)
+    {
+        int segmentSize = static_cast<int>(size);
+        if (::setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &segmentSize, sizeof segmentSize) < 0)
+        {
+            segmented = false;
+        }
+    }
+    std::vector<struct mmsghdr> msgs(kClientBatch);
+    std::vector<struct iovec> vecs(kClientBatch);
+    for (int i = 0; i < kClientBatch; ++i)
+    {
+        vecs[i].iov_base = data.data();
+        vecs[i].iov_len = segmented ? data.size() : size;
+        ::memset(&msgs[i], 0, sizeof msgs[i]);
+        msgs[i].msg_hdr.msg_iov = &vecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (nowNanos() < deadline)
+    {
+        if (::sendmmsg(fd, msgs.data(), kClientBatch, 0) < 0 && errno != ENOBUFS && errno != ECONNREFUSED)
+        {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+// 发一批，收回复直到收齐或者超时
+static void runEchoClient(size_t size, int64_t deadline, std::atomic<uint64_t> *echoed)
+{
+    int fd = connectClient();
+    struct timeval timeout = { 0, 10000 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    std::vector<char> data(size * kClientBatch, 'e');
+    std::vector<struct mmsghdr> msgs(kClientBatch);
+    std::vector<struct iovec> vecs(kClientBatch);
+    uint64_t count = 0;
+    while (nowNanos() < deadline)
+    {
+        for (int i = 0; i < kClientBatch; ++i)
+        {
+            vecs[i].iov_base = &data[size * i];
+            vecs[i].iov_len = size;
+            ::memset(&msgs[i], 0, sizeof msgs[i]);
+            msgs[i].msg_hdr.msg_iov = &vecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        if (::sendmmsg(fd, msgs.data(), kClientBatch, 0) < 0)
+        {
+            continue;
+        }
+        int got = 0;
+        while (got < kClientBatch)
+        {
+            int n = ::recvmmsg(fd, msgs.data(), kClientBatch - got, MSG_WAITFORONE, nullptr);
+            if (n <= 0)
+            {
+                break; // 超时，丢了的就不等了
+            }
+            got += n;
+        }
+        count += static_cast<uint64_t>(got);
+    }
+    echoed->fetch_add(count);
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int threads = argc > 2 ? atoi(argv[2]) : 2;
+    int clients = argc > 3 ? atoi(argv[3]) : 4;
+    size_t size = argc > 4 ? static_cast<size_t>(atol(argv[4])) : 64;
+    bool echo = argc > 5 && strcmp(argv[5], "echo") == 0;
+    bool gro = argc > 6 && atoi(argv[6]) != 0;
+    bool gso = argc > 7 && atoi(argv[7]) != 0;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::atomic<UdpServer*> udpServer(nullptr);
+    std::atomic<bool> groEnabled(false);
+    std::atomic<bool> gsoEnabled(false);
+    std::thread server([&]() {
+        EventLoop loop;
+        UdpServer server(&loop, InetAddress(kPort), "UdpBench");
+        server.setThreadNum(threads);
+        server.setGro(gro);
+        server.setGso(gso);
+        server.setBatchCallback([echo](UdpChannel *channel, const UdpBatch &batch, Timestamp) {
+            if (echo)
+            {
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    channel->send(batch[i].peer, batch[i].peerLen, batch[i].data, batch[i].len);
+                }
+            }
+        });
+        server.start();
+        int bufSize = 16 * 1024 * 1024;
+        for (UdpChannel *channel : server.channels())
+        {
+            ::setsockopt(channel->fd(), SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof bufSize);
+            groEnabled = channel->groEnabled();
+            gsoEnabled = channel->gsoEnabled();
+        }
+        udpServer = &server;
+        serverLoop = &loop;
+        loop.loop();
+        udpServer = nullptr;
+    });
+    while (serverLoop.load() == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    // 前10%的时间用来预热
+    int64_t start = nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    std::atomic<uint64_t> echoed(0);
+    std::vector<std::thread> clientThreads;
+    for (int i = 0; i < clients; ++i)
+    {
+        if (echo)
+        {
+            clientThreads.emplace_back(runEchoClient, size, deadline, &echoed);
+        }
+        else
+        {
+            clientThreads.emplace_back(runSinkClient, size, gro, deadline);
+        }
+    }
+    ::usleep(static_cast<useconds_t>(seconds * 0.1e6));
+    LoopMetrics::Snapshot before = udpServer.load()->metrics();
+    int64_t cpuBefore = cpuNanos();
+    int64_t measureStart = nowNanos();
+    ::usleep(static_cast<useconds_t>(seconds * 0.8e6));
+    LoopMetrics::Snapshot after = udpServer.load()->metrics();
+    int64_t cpu = cpuNanos() - cpuBefore;
+    double elapsed = (nowNanos() - measureStart) / 1e9;
+    for (std::thread &t : clientThreads)
+    {
+        t.join();
+    }
+
+    uint64_t received = after.counters[LoopMetrics::kDatagramsRead] - before.counters[LoopMetrics::kDatagramsRead];
+    uint64_t sent = after.counters[LoopMetrics::kDatagramsWritten] - before.counters[LoopMetrics::kDatagramsWritten];
+    uint64_t dropped = after.counters[LoopMetrics::kDatagramsDropped] - before.counters[LoopMetrics::kDatagramsDropped];
+    uint64_t wakeups = after.wakeups - before.wakeups;
+    printf("{\"bench\":\"udp\",\"mode\":\"%s\",\"size\":%zu,\"threads\":%d,\"clients\":%d,\"gro\":%d,\"gso\":%d,"
+            "\"rx_pps\":%.0f,\"tx_pps\":%.0f,\"dropped\":%llu,\"datagrams_per_wakeup\":%.1f,\"cpu_ns_per_datagram\":%.0f",
+            echo ? "echo" : "sink", size, threads, clients, groEnabled.load() ? 1 : 0, gsoEnabled.load() ? 1 : 0,
+            received / elapsed, sent / elapsed, static_cast<unsigned long long>(dropped),
+            wakeups ? static_cast<double>(received) / wakeups : 0, received ? static_cast<double>(cpu) / received : 0);
+    if (echo)
+    {
+        printf(",\"client_echoed\":%llu", static_cast<unsigned long long>(echoed.load()));
+    }
+    printf("}\n");
+    fflush(stdout);
+
+    serverLoop.load()->quit();
+    server.join();
+    return 0;
+}
@@ -0,0 +1,316 @@
+/**
+ * 本机通信用loopback TCP、IPv6 loopback、AF_UNIX文件路径、AF_UNIX抽象地址的对比
+ * 一个客户端线程闭环发size字节的消息，服务器是一个loop的echo TcpServer  输出往返延迟和每次往返两个进程一共用的cpu时间
+ * 最后测SCM_RIGHTS：客户端每次带一个fd，服务器sendWithFds原样传回来，检查收到的是同一个文件
+ *
+ * ./unix_socket_bench [seconds] [size]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "HdrHistogram.h"
+#include "BenchClock.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 整个进程（服务器和客户端线程）的cpu时间，微秒
+static int64_t cpuMicros()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int connectTo(const InetAddress &addr)
+{
+    int fd = ::socket(addr.family(), SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, addr.getSockAddr(), addr.length()) < 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    if (!addr.isUnix())
+    {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    }
+    return fd;
+}
+
+static bool readFully(int fd, char *buf, size_t size)
+{
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = ::read(fd, buf + got, size - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// 一个loop的echo服务器跑在自己的线程里  fdPassing时把收到的fd跟着数据传回去
+class EchoServer
+{
+public:
+    EchoServer(const InetAddress &addr, bool fdPassing)
+        : loop_(nullptr)
+    {
+        thread_ = std::thread([this, addr, fdPassing]() {
+            EventLoop loop;
+            TcpServer server(&loop, addr, "UnixSocketBench");
+            server.setConnectionCallback([fdPassing](const TcpConnectionPtr &conn) {
+                if (conn->connected())
+                {
+                    if (conn->localAddress().isUnix())
+                    {
+                        conn->setFdPassing(fdPassing);
+                    }
+                    else
+                    {
+                        conn->setTcpNoDelay(true);
+                    }
+                }
+            });
+            server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+                std::vector<int> fds = conn->takeReceivedFds();
+                if (fds.empty())
+                {
+                    conn->send(buf);
+                    return;
+                }
+                conn->sendWithFds(buf->retrieveAllAsString(), fds);
+                for (int fd : fds)
+                {
+                    ::close(fd);
+                }
+            });
+            server.start();
+            loop_ = &loop;
+            loop.loop();
+        });
+        while (loop_.load() == nullptr)
+        {
+            ::usleep(1000);
+        }
+    }
+
+    ~EchoServer()
+    {
+        loop_.load()->quit();
+        thread_.join();
+    }
+private:
+    std::atomic<EventLoop*> loop_;
+    std::thread thread_;
+};
+
+static void runEcho(const char *transport, const InetAddress &addr, double seconds, size_t size)
+{
+    EchoServer server(addr, false);
+    int fd = connectTo(addr);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: connect %s failed: %s\n", transport, addr.toIpPort().c_str(), strerror(errno));
+        return;
+    }
+
+    std::vector<char> buf(size, 'u');
+    HdrHistogram histogram;
+    int64_t warmupEnd = nowNanos() + static_cast<int64_t>(seconds * 0.1e9);
+    int64_t deadline = nowNanos() + static_cast<int64_t>(seconds * 1e9);
+    int64_t cpuStart = 0;
+    bool measuring = false;
+    while (true)
+    {
+        int64_t start = nowNanos();
+        if (start >= deadline)
+        {
+            break;
+        }
+        if (!measuring && start >= warmupEnd)
+        {
+            measuring = true;
+            cpuStart = cpuMicros();
+        }
+        if (::write(fd, buf.data(), size) != static_cast<ssize_t>(size) || !readFully(fd, buf.data(), size))
+        {
+            break;
+        }
+        if (measuring)
+        {
+            histogram.record(nowNanos() - start);
+        }
+    }
+    int64_t cpu = cpuMicros() - cpuStart;
+    ::close(fd);
+
+    uint64_t samples = histogram.count();
+    printf("{\"bench\":\"unix_socket\",\"transport\":\"%s\",\"size\":%zu,\"samples\":%llu,"
+            "\"rtt_per_sec\":%.0f,\"cpu_us_per_rtt\":%.2f,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f}\n",
+            transport, size, static_cast<unsigned long long>(samples), samples / (seconds * 0.9),
+            samples ? static_cast<double>(cpu) / samples : 0, histogram.mean() / 1e3,
+            histogram.percentile(50) / 1e3, histogram.percentile(99) / 1e3, histogram.percentile(99.9) / 1e3);
+    fflush(stdout);
+}
+
+static bool sendWithFd(int sock, const char *data, size_t len, int fd)
+{
+    union
+    {
+        struct cmsghdr  align;
+        char            buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec vec = { const_cast<char*>(data), len };
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    ::memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+    return ::sendmsg(sock, &msg, 0) == static_cast<ssize_t>(len);
+}
+
+// 读满len字节，返回其中带过来的fd，没有时返回-1
+static int recvWithFd(int sock, char *data, size_t len)
+{
+    int received = -1;
+    size_t got = 0;
+    while (got < len)
+    {
+        union
+        {
+            struct cmsghdr  align;
+            char            buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec vec = { data + got, len - got };
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &vec;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof control.buf;
+        ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n <= 0)
+        {
+            break;
+        }
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            ::memcpy(&received, CMSG_DATA(cmsg), sizeof received);
+        }
+        got += static_cast<size_t>(n);
+    }
+    return received;
+}
+
+static void runFdPassing(const InetAddress &addr, double seconds)
+{
+    EchoServer server(addr, true);
+    int sock = connectTo(addr);
+    int pipeFds[2];
+    if (sock < 0 || ::pipe(pipeFds) < 0)
+    {
+        fprintf(stderr, "fd passing: setup failed: %s\n", strerror(errno));
+        return;
+    }
+    struct stat expected;
+    ::fstat(pipeFds[0], &expected);
+
+    char buf[16] = "fd";
+    HdrHistogram histogram;
+    uint64_t mismatches = 0;
+    int64_t deadline = nowNanos() + static_cast<int64_t>(seconds * 1e9);
+    while (nowNanos() < deadline)
+    {
+        int64_t start = nowNanos();
+        if (!sendWithFd(sock, buf, sizeof buf, pipeFds[0]))
+        {
+            break;
+        }
+        int fd = recvWithFd(sock, buf, sizeof buf);
+        histogram.record(nowNanos() - start);
+        struct stat got;
+        if (fd < 0 || ::fstat(fd, &got) < 0 || got.st_ino != expected.st_ino || got.st_dev != expected.st_dev)
+        {
+            ++mismatches;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    ::close(sock);
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+
+    printf("{\"bench\":\"unix_fd_passing\",\"transport\":\"unix_abstract\",\"samples\":%llu,\"mismatches\":%llu,"
+            "\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f}\n",
+            static_cast<unsigned long long>(histogram.count()), static_cast<unsigned long long>(mismatches),
+            histogram.mean() / 1e3, histogram.percentile(50) / 1e3, histogram.percentile(99) / 1e3);
+    fflush(stdout);
+}
+
+// 没有IPv6的环境里bind ::1会失败，Socket::bindAddress是LOG_FATAL，先试一下
+static bool ipv6Available()
+{
+    InetAddress addr(0, "::1");
+    int fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+    bool ok = fd >= 0 && ::bind(fd, addr.getSockAddr(), addr.length()) == 0;
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    size_t size = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 64;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    std::string path = "/tmp/mymuduo_unix_bench." + std::to_string(::getpid());
+    std::string abstractName = "mymuduo_unix_bench." + std::to_string(::getpid());
+
+    runEcho("tcp_loopback", InetAddress(18180, "127.0.0.1"), seconds, size);
+    if (ipv6Available())
+    {
+        runEcho("tcp6_loopback", InetAddress(18181, "::1"), seconds, size);
+    }
+    runEcho("unix_path", InetAddress::unixPath(path), seconds, size);
+    runEcho("unix_abstract", InetAddress::unixAbstract(abstractName), seconds, size);
+    ::unlink(path.c_str());
+    runFdPassing(InetAddress::unixAbstract(abstractName + ".fd"), seconds);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * LoopWatchdog
+ *   overhead : 一个loop线程上echo pingpong，开和不开watchdog的吞吐
+ *   stall    : 在loop里投递一个sleep的回调、在一个连接的onMessage里sleep，检查两次都报告出来，
+ *              带上正在执行的回调类型或者fd，以及抓到的调用栈的深度
+ *
+ * ./watchdog_bench [seconds] [stall_ms]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "LoopWatchdog.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const size_t kMessageSize = 64;
+static std::atomic_int gStallMs(0);
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    int stallMs = gStallMs.exchange(0);
+    if (stallMs > 0)
+    {
+        ::usleep(stallMs * 1000);
+    }
+    conn->send(buf);
+}
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+static bool roundTrip(int fd)
+{
+    char buf[kMessageSize];
+    ::memset(buf, 'w', sizeof buf);
+    if (::write(fd, buf, sizeof buf) != static_cast<ssize_t>(sizeof buf))
+    {
+        return false;
+    }
+    size_t got = 0;
+    while (got < sizeof buf)
+    {
+        ssize_t n = ::read(fd, buf + got, sizeof buf - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void runPingpong(const char *mode, int fd, double seconds)
+{
+    uint64_t count = 0;
+    int64_t start = nowNanos();
+    int64_t deadline = start + static_cast<int64_t>(seconds * 1e9);
+    while (nowNanos() < deadline && roundTrip(fd))
+    {
+        ++count;
+    }
+    double elapsed = (nowNanos() - start) / 1e9;
+    printf("{\"bench\":\"watchdog\",\"op\":\"overhead\",\"mode\":\"%s\",\"req_per_sec\":%.0f}\n", mode, count / elapsed);
+    fflush(stdout);
+}
+
+static void sleepInLoop(int ms)
+{
+    ::usleep(ms * 1000);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int stallMs = argc > 2 ? atoi(argv[2]) : 100;
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+    Logger::setLogLevel(ERROR);
+
+    const uint16_t port = 18140;
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    loop->runInLoop([loop, port]() {
+        // 不析构，进程结束时直接退出
+        TcpServer *server = new TcpServer(loop, InetAddress(port), "watchdog");
+        server->setConnectionCallback([](const TcpConnectionPtr&) {});
+        server->setMessageCallback(onMessage);
+        server->start();
+    });
+    ::usleep(100 * 1000);
+    int fd = connectTo(port);
+
+    runPingpong("off", fd, seconds);
+
+    std::mutex mutex;
+    std::vector<LoopWatchdog::Stall> stalls;
+    LoopWatchdog watchdog(stallMs / 2000.0, 0.005);
+    watchdog.setCaptureBacktrace(true);
+    watchdog.setStallCallback([&mutex, &stalls](const LoopWatchdog::Stall &stall) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stalls.push_back(stall);
+    });
+    watchdog.watch(loop);
+    watchdog.start();
+
+    runPingpong("on", fd, seconds);
+
+    loop->queueInLoop(std::bind(sleepInLoop, stallMs));
+    ::usleep(stallMs * 2000);
+    gStallMs = stallMs;
+    roundTrip(fd);
+    ::usleep(10 * 1000);
+    watchdog.stop();
+
+    for (const LoopWatchdog::Stall &stall : stalls)
+    {
+        std::string task = stall.task.substr(0, 80);
+        for (char &c : task)
+        {
+            if (c == '"')
+            {
+                c = '\'';
+            }
+        }
+        int frames = 0;
+        for (char c : stall.backtrace)
+        {
+            frames += c == '\n';
+        }
+        printf("{\"bench\":\"watchdog\",\"op\":\"stall\",\"seconds\":%.3f,\"fd\":%d,\"task\":\"%s\",\"frames\":%d}\n",
+                stall.seconds, stall.fd, task.c_str(), frames);
+    }
+    if (!stalls.empty())
+    {
+        printf("%s", stalls.back().backtrace.c_str());
+    }
+    fflush(stdout);
+    ::close(fd);
+    _exit(stalls.size() == 2 ? 0 : 1);
+}
@@ -0,0 +1,126 @@
+/**
+ * 大块数据发送：send(std::string&&)每块256K，一共total_mb
+ *   copy     : 普通write，数据拷贝进socket缓冲区
+ *   zerocopy : setZeroCopyThreshold(32K)，send(MSG_ZEROCOPY)，数据持有到错误队列里的完成通知
+ * loopback上内核在接收端还是会拷贝一次，第一个完成通知报告COPIED以后连接自动改回普通发送，
+ * 这里测到的只是打开MSG_ZEROCOPY的额外开销；要看到收益需要真实网卡，客户端放在另一台机器上
+ *
+ * ./zerocopy_bench [total_mb]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "BenchClock.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+static int64_t cpuNanos()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (static_cast<int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static const uint16_t kPort = 19408;
+static const size_t kBlock = 256 * 1024;
+static const size_t kThreshold = 32 * 1024;
+static const size_t kBlocksPerRound = 16;   // 每轮发这么多块，等writeComplete再发下一轮
+
+static void run(const char *mode, bool zeroCopy, size_t total)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    size_t maxPending = 0; // 只在subloop中修改，join以后读
+    std::thread server([&]() {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(kPort), "ZeroCopyBench", TcpServer::kReusePort);
+        server.setThreadNum(1);
+        if (zeroCopy)
+        {
+            server.setZeroCopyThreshold(kThreshold);
+        }
+        size_t sent = 0;
+        std::function<void(const TcpConnectionPtr&)> pump = [&](const TcpConnectionPtr &conn) {
+            for (size_t i = 0; i < kBlocksPerRound && sent < total; ++i)
+            {
+                conn->send(std::string(kBlock, 'Z'));
+                sent += kBlock;
+            }
+            maxPending = std::max(maxPending, conn->zeroCopyPendingBytes());
+            if (sent >= total)
+            {
+                conn->shutdown();
+            }
+        };
+        server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                pump(conn);
+            }
+        });
+        server.setWriteCompleteCallback([&](const TcpConnectionPtr &conn) {
+            if (sent < total)
+            {
+                pump(conn);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while (serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    int64_t start = nowNanos();
+    int64_t cpuStart = cpuNanos();
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    InetAddress addr(kPort);
+    if (::connect(fd, (const sockaddr*)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    size_t got = 0;
+    char buf[kBlock];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0)
+    {
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    int64_t elapsed = nowNanos() - start;
+    int64_t cpu = cpuNanos() - cpuStart;
+
+    serverLoop.load()->quit();
+    server.join();
+
+    printf("{\"bench\":\"zerocopy\",\"mode\":\"%s\",\"mb\":%zu,\"mb_per_sec\":%.0f,\"cpu_ns_per_kb\":%.1f,\"max_pending_kb\":%zu}\n",
+            mode, got >> 20, static_cast<double>(got) / (1 << 20) * 1e9 / elapsed,
+            static_cast<double>(cpu) / (got >> 10), maxPending >> 10);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalMb = argc > 1 ? atoi(argv[1]) : 512;
+
+    Logger::setLogLevel(ERROR);
+    ::unsetenv("MUDUO_USE_URING");
+    ::unsetenv("MUDUO_USE_POLL");
+
+    run("copy", false, totalMb << 20);
+    run("zerocopy", true, totalMb << 20);
+    return 0;
+}
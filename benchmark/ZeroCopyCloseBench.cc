@@ -0,0 +1,148 @@
+/**
+ * 带着还没确认的MSG_ZEROCOPY数据关闭连接：客户端连上以后先不读，服务器send几块'A'以后forceClose
+ * 连接销毁以后服务器在同一个loop线程里分配同样大小的内存写满'B'，复用刚释放的数据块，然后客户端才开始读
+ * 内核还在用这些内存里的数据的话，客户端会在'A'后面读到'B'
+ *   zerocopy : setZeroCopyThreshold(32K)
+ *   copy     : 普通write，作为对照
+ * pending_kb是关闭时还在等完成通知的数据，corrupted_kb是客户端读到的不是'A'的数据，必须是0
+ * reset表示客户端读到的是RST而不是FIN
+ *
+ * ./zerocopy_close_bench [blocks]
+ */
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const size_t kBlock = 64 * 1024;       // 小于glibc的mmap阈值，释放以后同一个线程再分配会复用
+static const size_t kThreshold = 32 * 1024;
+
+// 在loop线程里执行f，等它执行完
+static void runSync(EventLoop *loop, const std::function<void()> &f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+static void runOnce(const char *mode, bool zeroCopy, uint16_t port, int blocks)
+{
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<TcpServer> server;
+    std::atomic<EventLoop*> ioLoop(nullptr);
+    std::atomic<bool> closed(false);
+    size_t pendingAtClose = 0; // 只在ioLoop中修改，closed以后读
+    runSync(serverLoop, [&]() {
+        server.reset(new TcpServer(serverLoop, InetAddress(port, "127.0.0.1"), "ZeroCopyCloseServer"));
+        server->setThreadNum(1);
+        if (zeroCopy)
+        {
+            server->setZeroCopyThreshold(kThreshold);
+        }
+        server->setConnectionCallback([&, blocks](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                for (int i = 0; i < blocks; ++i)
+                {
+                    conn->send(std::string(kBlock, 'A'));
+                }
+                pendingAtClose = conn->zeroCopyPendingBytes();
+                ioLoop = conn->getLoop();
+                conn->forceClose();
+            }
+            else
+            {
+                closed = true;
+            }
+        });
+        server->start();
+    });
+
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(sockfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    while (!closed.load())
+    {
+        ::usleep(1000);
+    }
+    ::usleep(100 * 1000); // 等connectDestroyed执行完，连接对象和发送队列都释放掉
+
+    // 释放的数据块交给新的数据，一直持有到客户端读完
+    std::vector<std::string> reused;
+    runSync(ioLoop.load(), [&]() {
+        for (int i = 0; i < blocks * 4; ++i)
+        {
+            reused.emplace_back(kBlock, 'B');
+        }
+    });
+
+    size_t received = 0;
+    size_t corrupted = 0;
+    bool reset = false;
+    char buf[65536];
+    for (;;)
+    {
+        ssize_t n = ::read(sockfd, buf, sizeof buf);
+        if (n < 0)
+        {
+            reset = errno == ECONNRESET;
+            break;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            corrupted += buf[i] != 'A';
+        }
+        received += static_cast<size_t>(n);
+    }
+    ::close(sockfd);
+
+    runSync(ioLoop.load(), [&]() { reused.clear(); });
+    runSync(serverLoop, [&]() { server.reset(); });
+    printf("{\"bench\":\"zerocopy_close\",\"mode\":\"%s\",\"blocks\":%d,\"pending_kb\":%zu,"
+            "\"received_kb\":%zu,\"corrupted_kb\":%zu,\"reset\":%s}\n",
+            mode, blocks, pendingAtClose / 1024, received / 1024, corrupted / 1024, reset ? "true" : "false");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int blocks = argc > 1 ? atoi(argv[1]) : 16;
+    Logger::setLogLevel(ERROR);
+
+    uint16_t port = 19418;
+    runOnce("copy", false, port++, blocks);
+    runOnce("zerocopy", true, port++, blocks);
+    return 0;
+}
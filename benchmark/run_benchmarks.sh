@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# 跑一遍回归用的benchmark，每个结果一行JSON，加上版本和时间追加到结果文件里
+# 不同版本的结果放在同一个文件里，按bench和参数分组比较
+#
+# ./benchmark/run_benchmarks.sh [build目录] [结果文件]
+
+set -e
+
+BUILD_DIR=${1:-`pwd`/build}
+OUTPUT=${2:-$BUILD_DIR/bench_results.jsonl}
+BENCH_DIR=$BUILD_DIR/benchmark
+SECONDS_PER_RUN=${BENCH_SECONDS:-2}
+
+if [ ! -x $BENCH_DIR/pingpong_bench ]; then
+    echo "benchmark binaries not found in $BENCH_DIR, build first" >&2
+    exit 1
+fi
+
+REV=`git rev-parse --short HEAD 2>/dev/null || echo unknown`
+DATE=`date -u +%Y-%m-%dT%H:%M:%SZ`
+
+run()
+{
+    echo "+ $*" >&2
+    "$@" | grep '^{' | sed "s/^{/{\"rev\":\"$REV\",\"date\":\"$DATE\",/" | tee -a $OUTPUT
+}
+
+# 吞吐：消息大小16B到1MB，loop线程数从1到cpu个数的一半
+run $BENCH_DIR/pingpong_bench $SECONDS_PER_RUN 16 0 0
+# 延迟：单连接和16个连接
+run $BENCH_DIR/latency_bench $SECONDS_PER_RUN 1 64 1
+run $BENCH_DIR/latency_bench $SECONDS_PER_RUN 16 64 2
+run $BENCH_DIR/latency_bench $SECONDS_PER_RUN 1 16384 1
+# 连接建立和销毁
+run $BENCH_DIR/connect_bench $SECONDS_PER_RUN 4 2
+# 跨线程queueInLoop
+run $BENCH_DIR/queueinloop_bench 4 1000000
+# 本机通信：loopback TCP和AF_UNIX
+run $BENCH_DIR/unix_socket_bench $SECONDS_PER_RUN 64
+# UDP：recvmmsg收包、GRO收包、sendmmsg回复、GSO回复
+run $BENCH_DIR/udp_bench $SECONDS_PER_RUN 2 4 64 sink
+run $BENCH_DIR/udp_bench $SECONDS_PER_RUN 2 4 1200 sink 1
+run $BENCH_DIR/udp_bench $SECONDS_PER_RUN 2 4 1200 echo 0 0
+run $BENCH_DIR/udp_bench $SECONDS_PER_RUN 2 4 1200 echo 0 1
+# 关闭服务器：直接析构和stop平滑关闭丢掉的响应
+run $BENCH_DIR/drain_bench 4 32768 1 0.5
+# 带着没确认的MSG_ZEROCOPY数据关闭连接，corrupted_kb必须是0
+run $BENCH_DIR/zerocopy_close_bench 16
+# TLS：握手（有无session恢复）、echo和sendfile对比明文  没有OpenSSL时不编译
+if [ -x $BENCH_DIR/tls_bench ]; then
+    run $BENCH_DIR/tls_bench $SECONDS_PER_RUN 16384
+fi